@@ -5,10 +5,23 @@
 #include <cublas_v2.h>
 #include <device_launch_parameters.h>
 #include <math_functions.h>
+#include <cuda_fp16.h>
+#include <cuda_bf16.h>
+#include <mma.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 
 extern "C" {
 
-// CUDA kernel for computing cosine similarity between vectors
+// CUDA kernel for computing cosine similarity between vectors: one thread per
+// document, reading the query from global memory. Kept as the baseline the
+// tiled and tensor-core kernels are benchmarked against.
 __global__ void cosine_similarity_kernel(
     const float* __restrict__ query_vector,
     const float* __restrict__ doc_vectors,
@@ -20,42 +33,19 @@ __global__ void cosine_similarity_kernel(
     
     if (doc_idx >= num_docs) return;
     
-    const float* doc_vec = doc_vectors + doc_idx * vector_dim;
-    
-    // Compute dot product and norms using shared memory
-    __shared__ float shared_query[1024];  // Assuming max 1024 dims per block
-    __shared__ float shared_doc[1024];
+    const float* doc_vec = doc_vectors + (size_t)doc_idx * vector_dim;
     
     float dot_product = 0.0f;
     float query_norm = 0.0f;
     float doc_norm = 0.0f;
     
-    // Process vector in chunks
-    for (int i = 0; i < vector_dim; i += blockDim.x) {
-        int idx = i + threadIdx.x;
-        
-        // Load data into shared memory
-        if (idx < vector_dim) {
-            shared_query[threadIdx.x] = query_vector[idx];
-            shared_doc[threadIdx.x] = doc_vec[idx];
-        } else {
-            shared_query[threadIdx.x] = 0.0f;
-            shared_doc[threadIdx.x] = 0.0f;
-        }
-        
-        __syncthreads();
-        
-        // Compute partial dot product and norms
-        if (idx < vector_dim) {
-            float q_val = shared_query[threadIdx.x];
-            float d_val = shared_doc[threadIdx.x];
-            
-            dot_product += q_val * d_val;
-            query_norm += q_val * q_val;
-            doc_norm += d_val * d_val;
-        }
+    for (int i = 0; i < vector_dim; i++) {
+        float q_val = query_vector[i];
+        float d_val = doc_vec[i];
         
-        __syncthreads();
+        dot_product += q_val * d_val;
+        query_norm += q_val * q_val;
+        doc_norm += d_val * d_val;
     }
     
     // Compute cosine similarity
@@ -271,20 +261,852 @@ __global__ void kmeans_update_kernel(
     distances[point_idx] = min_distance;
 }
 
+// Lloyd and mini-batch k-means state, kept on the device so the iteration
+// loop never waits on the host. Once converged is set every k-means kernel
+// below returns immediately.
+struct kmeans_status {
+    int converged;
+    int iterations;
+    int changed;      // points whose cluster changed this iteration
+    int max_shift;    // bits of the largest squared centroid move (non-negative floats order as ints)
+    float inertia;    // sum of squared distances to the assigned centroids
+};
+
+__global__ void kmeans_begin_kernel(kmeans_status* status) {
+    if (status->converged) return;
+    status->changed = 0;
+    status->max_shift = 0;
+    status->inertia = 0.0f;
+}
+
+// Nearest centroid of each point from its dot products with the centroids
+// (scores, num_points x num_clusters), a warp per point: |c|^2 - 2 p.c is
+// minimized across the lanes, |p|^2 only being needed for the inertia.
+// Counts the points of each cluster and the changed assignments; inertia is
+// summed per block before its one atomic.
+__global__ void kmeans_assign_kernel(
+    const float* __restrict__ scores,
+    const float* __restrict__ point_norms,
+    const float* __restrict__ centroid_norms,
+    int* __restrict__ assignments,
+    int* __restrict__ counts,
+    kmeans_status* __restrict__ status,
+    int num_points,
+    int num_clusters
+) {
+    __shared__ float block_inertia[32];
+    
+    if (status->converged) return;
+    
+    int warp = threadIdx.x / 32;
+    int lane = threadIdx.x % 32;
+    int point = blockIdx.x * (blockDim.x / 32) + warp;
+    
+    float inertia = 0.0f;
+    if (point < num_points) {
+        const float* row = scores + (size_t)point * num_clusters;
+        float best = INFINITY;
+        int best_cluster = 0;
+        for (int c = lane; c < num_clusters; c += 32) {
+            float distance = centroid_norms[c] * centroid_norms[c] - 2.0f * row[c];
+            if (distance < best) {
+                best = distance;
+                best_cluster = c;
+            }
+        }
+        for (int offset = 16; offset > 0; offset >>= 1) {
+            float other = __shfl_down_sync(0xffffffff, best, offset);
+            int other_cluster = __shfl_down_sync(0xffffffff, best_cluster, offset);
+            if (other < best || (other == best && other_cluster < best_cluster)) {
+                best = other;
+                best_cluster = other_cluster;
+            }
+        }
+        if (lane == 0) {
+            inertia = fmaxf(point_norms[point] * point_norms[point] + best, 0.0f);
+            if (assignments[point] != best_cluster) atomicAdd(&status->changed, 1);
+            assignments[point] = best_cluster;
+            atomicAdd(&counts[best_cluster], 1);
+        }
+    }
+    
+    if (lane == 0) block_inertia[warp] = inertia;
+    __syncthreads();
+    if (threadIdx.x == 0) {
+        float sum = 0.0f;
+        for (int w = 0; w < (int)(blockDim.x / 32); w++) sum += block_inertia[w];
+        atomicAdd(&status->inertia, sum);
+    }
+}
+
+// Exclusive prefix sum of the cluster counts into offsets, in one block of
+// up to 1024 threads each scanning a contiguous range; also zeroes the
+// scatter cursors
+__global__ void kmeans_offsets_kernel(
+    const int* __restrict__ counts,
+    int* __restrict__ offsets,
+    int* __restrict__ cursors,
+    const kmeans_status* __restrict__ status,
+    int num_clusters
+) {
+    __shared__ int partial[1024];
+    
+    if (status->converged) return;
+    
+    int per_thread = (num_clusters + blockDim.x - 1) / blockDim.x;
+    int begin = min((int)threadIdx.x * per_thread, num_clusters);
+    int end = min(begin + per_thread, num_clusters);
+    
+    int sum = 0;
+    for (int c = begin; c < end; c++) sum += counts[c];
+    partial[threadIdx.x] = sum;
+    __syncthreads();
+    
+    for (unsigned int stride = 1; stride < blockDim.x; stride <<= 1) {
+        int value = (threadIdx.x >= stride) ? partial[threadIdx.x - stride] : 0;
+        __syncthreads();
+        partial[threadIdx.x] += value;
+        __syncthreads();
+    }
+    
+    int running = partial[threadIdx.x] - sum;
+    for (int c = begin; c < end; c++) {
+        offsets[c] = running;
+        cursors[c] = 0;
+        running += counts[c];
+    }
+}
+
+// Groups point indices by cluster: order[offsets[c] ...] lists cluster c
+__global__ void kmeans_scatter_kernel(
+    const int* __restrict__ assignments,
+    const int* __restrict__ offsets,
+    int* __restrict__ cursors,
+    int* __restrict__ order,
+    const kmeans_status* __restrict__ status,
+    int num_points
+) {
+    if (status->converged) return;
+    
+    int point = blockIdx.x * blockDim.x + threadIdx.x;
+    if (point >= num_points) return;
+    
+    int cluster = assignments[point];
+    order[offsets[cluster] + atomicAdd(&cursors[cluster], 1)] = point;
+}
+
+// Segmented centroid update, a block per cluster summing its members with
+// reads coalesced across the dimensions, so no float atomics are needed.
+// Lloyd (totals null) moves each centroid to the mean of its points; in
+// mini-batch mode totals holds the points each cluster has seen, and the
+// centroid moves toward the batch mean by count / (totals + count), the
+// per-centre learning rate of mini-batch k-means applied once per batch.
+// Empty clusters keep their centroid. Records the largest squared move.
+__global__ void kmeans_centroid_kernel(
+    const float* __restrict__ points,
+    const int* __restrict__ order,
+    const int* __restrict__ offsets,
+    const int* __restrict__ counts,
+    float* __restrict__ centroids,
+    float* __restrict__ totals,
+    kmeans_status* __restrict__ status,
+    int dimensions
+) {
+    __shared__ float block_shift[256];
+    
+    if (status->converged) return;
+    
+    int cluster = blockIdx.x;
+    int count = counts[cluster];
+    
+    float shift = 0.0f;
+    if (count > 0) {
+        const int* members = order + offsets[cluster];
+        float* centroid = centroids + (size_t)cluster * dimensions;
+        float rate = totals ? count / (totals[cluster] + count) : 1.0f;
+        for (int d = threadIdx.x; d < dimensions; d += blockDim.x) {
+            float sum = 0.0f;
+            for (int j = 0; j < count; j++) {
+                sum += points[(size_t)members[j] * dimensions + d];
+            }
+            float previous = centroid[d];
+            float updated = previous + rate * (sum / count - previous);
+            centroid[d] = updated;
+            shift += (updated - previous) * (updated - previous);
+        }
+    }
+    
+    block_shift[threadIdx.x] = shift;
+    __syncthreads();
+    for (unsigned int stride = blockDim.x / 2; stride > 0; stride >>= 1) {
+        if (threadIdx.x < stride) block_shift[threadIdx.x] += block_shift[threadIdx.x + stride];
+        __syncthreads();
+    }
+    if (threadIdx.x == 0) {
+        if (totals) totals[cluster] += count;
+        atomicMax(&status->max_shift, __float_as_int(block_shift[0]));
+    }
+}
+
+// Ends an iteration: converged once no centroid moved more than the
+// tolerance (tolerance_sq < 0 disables this) or, when check_changed is set,
+// no point changed cluster
+__global__ void kmeans_check_kernel(kmeans_status* status, float tolerance_sq, int check_changed) {
+    if (status->converged) return;
+    
+    status->iterations++;
+    if ((check_changed && status->changed == 0) || __int_as_float(status->max_shift) <= tolerance_sq) {
+        status->converged = 1;
+    }
+}
+
+// Turns a chunk's dot products (num_queries x num_docs, row-major) into
+// cosine similarities with precomputed norms, 0 where either norm is zero
+// as in cosine_similarity_kernel. blockIdx.y selects the query, so
+// consecutive threads touch consecutive scores.
+__global__ void cosine_from_dots_kernel(
+    float* __restrict__ scores,
+    const float* __restrict__ query_norms,
+    const float* __restrict__ doc_norms,
+    int num_docs
+) {
+    const int query_idx = blockIdx.y;
+    const int doc_idx = blockIdx.x * blockDim.x + threadIdx.x;
+    if (doc_idx >= num_docs) return;
+    
+    const size_t at = (size_t)query_idx * num_docs + doc_idx;
+    float norm_product = query_norms[query_idx] * doc_norms[doc_idx];
+    scores[at] = (norm_product > 0.0f) ? (scores[at] / norm_product) : 0.0f;
+}
+
+// CUDA kernel for moving whole rows of a vector matrix: row src_rows[i] of
+// src goes to row dst_rows[i] of dst (i itself when either is null). Rows
+// with a negative destination are skipped. Destinations must be distinct.
+__global__ void copy_rows_kernel(
+    float* __restrict__ dst,
+    const float* __restrict__ src,
+    const int* __restrict__ dst_rows,
+    const int* __restrict__ src_rows,
+    int num_rows,
+    int vector_dim
+) {
+    int row = blockIdx.y;
+    int d = blockIdx.x * blockDim.x + threadIdx.x;
+    
+    if (row >= num_rows || d >= vector_dim) return;
+    
+    int dst_row = dst_rows ? dst_rows[row] : row;
+    int src_row = src_rows ? src_rows[row] : row;
+    if (dst_row < 0) return;
+    
+    dst[(size_t)dst_row * vector_dim + d] = src[(size_t)src_row * vector_dim + d];
+}
+
+// CUDA kernel for top-k selection: each block sorts one segment of
+// TOPK_SEGMENT scores of one query (blockIdx.y) in shared memory with a
+// bitonic sort, and writes its best k. Running it again over the
+// per-segment results shrinks the candidates by TOPK_SEGMENT / k per pass
+// until a single segment is left. indices carries the original positions
+// from earlier passes (null on the first). Requires k <= TOPK_SEGMENT / 2.
+#define TOPK_SEGMENT 2048
+#define TOPK_THREADS 512
+
+__global__ void topk_segments_kernel(
+    const float* __restrict__ scores,
+    const int* __restrict__ indices,
+    int count,
+    int in_stride,
+    int k,
+    float* __restrict__ out_scores,
+    int* __restrict__ out_indices,
+    int out_stride
+) {
+    __shared__ float shared_scores[TOPK_SEGMENT];
+    __shared__ int shared_indices[TOPK_SEGMENT];
+    
+    const int query_idx = blockIdx.y;
+    const int base = blockIdx.x * TOPK_SEGMENT;
+    const float* row_scores = scores + (size_t)query_idx * in_stride;
+    const int* row_indices = indices ? indices + (size_t)query_idx * in_stride : nullptr;
+    
+    for (int i = threadIdx.x; i < TOPK_SEGMENT; i += blockDim.x) {
+        int src = base + i;
+        if (src < count) {
+            shared_scores[i] = row_scores[src];
+            shared_indices[i] = row_indices ? row_indices[src] : src;
+        } else {
+            shared_scores[i] = -INFINITY;
+            shared_indices[i] = -1;
+        }
+    }
+    __syncthreads();
+    
+    // Bitonic sort, descending
+    for (int size = 2; size <= TOPK_SEGMENT; size <<= 1) {
+        for (int stride = size >> 1; stride > 0; stride >>= 1) {
+            for (int i = threadIdx.x; i < TOPK_SEGMENT; i += blockDim.x) {
+                int partner = i ^ stride;
+                if (partner > i) {
+                    bool descending = (i & size) == 0;
+                    float a = shared_scores[i];
+                    float b = shared_scores[partner];
+                    if ((a < b) == descending) {
+                        shared_scores[i] = b;
+                        shared_scores[partner] = a;
+                        int index = shared_indices[i];
+                        shared_indices[i] = shared_indices[partner];
+                        shared_indices[partner] = index;
+                    }
+                }
+            }
+            __syncthreads();
+        }
+    }
+    
+    float* best_scores = out_scores + (size_t)query_idx * out_stride + (size_t)blockIdx.x * k;
+    int* best_indices = out_indices + (size_t)query_idx * out_stride + (size_t)blockIdx.x * k;
+    for (int i = threadIdx.x; i < k; i += blockDim.x) {
+        best_scores[i] = shared_scores[i];
+        best_indices[i] = shared_indices[i];
+    }
+}
+
+} // extern "C"
+
+// Tiled and tensor-core kernels
+//
+// Similarity and attention both reduce to C = alpha * A * B^T-style
+// products, so one tiled GEMM serves both, in an FP32 shared-memory version
+// and in FP16/BF16 WMMA versions that run on tensor cores. Inputs stay FP32
+// in global memory. The WMMA kernels round each tile to 16 bits as they
+// stage it into shared memory and accumulate in FP32. These are templates,
+// which cannot have C linkage, so they sit outside the extern "C" block.
+
+#define GEMM_TILE_M 32
+#define GEMM_TILE_N 64
+#define GEMM_TILE_K 16
+#define WMMA_TILE_K 32
+#define WMMA_PAD 8
+#define GEMM_THREADS 256
+
+// Kernel variants, as taken by the *_variant entry points and reported by
+// cuda_benchmark_similarity_kernels
+#define CUDA_KERNEL_AUTO 0
+#define CUDA_KERNEL_NAIVE 1
+#define CUDA_KERNEL_TILED 2
+#define CUDA_KERNEL_WMMA_FP16 3
+#define CUDA_KERNEL_WMMA_BF16 4
+#define CUDA_KERNEL_WARP 5  // one warp per document; similarity of a single query only
+#define CUDA_KERNEL_VARIANTS 6
+
+// Alpha scaling plus, when norms are given, division by both norms (0 when
+// either is 0), which turns dot products into cosines
+__device__ __forceinline__ float gemm_epilogue(float acc, float alpha,
+                                               const float* __restrict__ row_norms,
+                                               const float* __restrict__ col_norms,
+                                               int row, int col) {
+    float value = alpha * acc;
+    if (row_norms) {
+        float norm_product = row_norms[row] * col_norms[col];
+        value = (norm_product > 0.0f) ? (value / norm_product) : 0.0f;
+    }
+    return value;
+}
+
+// C (M x N) = alpha * A (M x K) * B over row-major matrices. With B_ROWS,
+// B holds one row of K per output column (documents, keys); otherwise it is
+// K x N (attention values). 256 threads as 16 x 16, each accumulating 2 x 4
+// outputs from shared-memory tiles, so every A and B element is read from
+// global memory once per tile instead of once per output.
+template <bool B_ROWS>
+__global__ void tiled_gemm_kernel(
+    const float* __restrict__ A,
+    const float* __restrict__ B,
+    float* __restrict__ C,
+    int M,
+    int N,
+    int K,
+    float alpha,
+    const float* __restrict__ row_norms,
+    const float* __restrict__ col_norms
+) {
+    __shared__ float shared_a[GEMM_TILE_M][GEMM_TILE_K + 1];
+    __shared__ float shared_b[GEMM_TILE_N][GEMM_TILE_K + 1];
+    
+    const int tid = threadIdx.x;
+    const int tx = tid % 16;
+    const int ty = tid / 16;
+    const int m0 = blockIdx.y * GEMM_TILE_M;
+    const int n0 = blockIdx.x * GEMM_TILE_N;
+    
+    float acc[2][4] = {};
+    
+    for (int k0 = 0; k0 < K; k0 += GEMM_TILE_K) {
+        for (int idx = tid; idx < GEMM_TILE_M * GEMM_TILE_K; idx += GEMM_THREADS) {
+            int row = idx / GEMM_TILE_K, k = idx % GEMM_TILE_K;
+            int gm = m0 + row, gk = k0 + k;
+            shared_a[row][k] = (gm < M && gk < K) ? A[(size_t)gm * K + gk] : 0.0f;
+        }
+        for (int idx = tid; idx < GEMM_TILE_N * GEMM_TILE_K; idx += GEMM_THREADS) {
+            int n, k;
+            if (B_ROWS) {
+                n = idx / GEMM_TILE_K;
+                k = idx % GEMM_TILE_K;
+            } else {
+                k = idx / GEMM_TILE_N;
+                n = idx % GEMM_TILE_N;
+            }
+            int gn = n0 + n, gk = k0 + k;
+            float value = 0.0f;
+            if (gn < N && gk < K) {
+                value = B_ROWS ? B[(size_t)gn * K + gk] : B[(size_t)gk * N + gn];
+            }
+            shared_b[n][k] = value;
+        }
+        __syncthreads();
+        
+        for (int kk = 0; kk < GEMM_TILE_K; kk++) {
+            float a[2], b[4];
+            for (int i = 0; i < 2; i++) a[i] = shared_a[ty + 16 * i][kk];
+            for (int j = 0; j < 4; j++) b[j] = shared_b[tx + 16 * j][kk];
+            for (int i = 0; i < 2; i++) {
+                for (int j = 0; j < 4; j++) {
+                    acc[i][j] += a[i] * b[j];
+                }
+            }
+        }
+        __syncthreads();
+    }
+    
+    for (int i = 0; i < 2; i++) {
+        for (int j = 0; j < 4; j++) {
+            int row = m0 + ty + 16 * i, col = n0 + tx + 16 * j;
+            if (row < M && col < N) {
+                C[(size_t)row * N + col] = gemm_epilogue(acc[i][j], alpha, row_norms, col_norms, row, col);
+            }
+        }
+    }
+}
+
+template <typename T> __device__ __forceinline__ T wmma_from_float(float value);
+template <> __device__ __forceinline__ __half wmma_from_float<__half>(float value) {
+    return __float2half(value);
+}
+template <> __device__ __forceinline__ __nv_bfloat16 wmma_from_float<__nv_bfloat16>(float value) {
+    return __float2bfloat16(value);
+}
+
+// The tiled GEMM on tensor cores: 8 warps, each computing one 16 x 16 WMMA
+// tile of the block's 32 x 64 output. The accumulators pass through shared
+// memory for the epilogue and the bounds checks.
+template <typename T, bool B_ROWS>
+__device__ void wmma_gemm_tile(
+    const float* __restrict__ A,
+    const float* __restrict__ B,
+    float* __restrict__ C,
+    int M,
+    int N,
+    int K,
+    float alpha,
+    const float* __restrict__ row_norms,
+    const float* __restrict__ col_norms
+) {
+    using namespace nvcuda;
+    
+    __shared__ __align__(32) T shared_a[GEMM_TILE_M][WMMA_TILE_K + WMMA_PAD];
+    __shared__ __align__(32) T shared_b[GEMM_TILE_N][WMMA_TILE_K + WMMA_PAD];
+    __shared__ __align__(32) float shared_c[GEMM_TILE_M][GEMM_TILE_N + 4];
+    
+    const int tid = threadIdx.x;
+    const int warp = tid / 32;
+    const int warp_m = warp / 4;
+    const int warp_n = warp % 4;
+    const int m0 = blockIdx.y * GEMM_TILE_M;
+    const int n0 = blockIdx.x * GEMM_TILE_N;
+    
+    wmma::fragment<wmma::matrix_a, 16, 16, 16, T, wmma::row_major> a_frag;
+    wmma::fragment<wmma::matrix_b, 16, 16, 16, T, wmma::col_major> b_frag;
+    wmma::fragment<wmma::accumulator, 16, 16, 16, float> acc_frag;
+    wmma::fill_fragment(acc_frag, 0.0f);
+    
+    for (int k0 = 0; k0 < K; k0 += WMMA_TILE_K) {
+        for (int idx = tid; idx < GEMM_TILE_M * WMMA_TILE_K; idx += GEMM_THREADS) {
+            int row = idx / WMMA_TILE_K, k = idx % WMMA_TILE_K;
+            int gm = m0 + row, gk = k0 + k;
+            shared_a[row][k] = wmma_from_float<T>((gm < M && gk < K) ? A[(size_t)gm * K + gk] : 0.0f);
+        }
+        for (int idx = tid; idx < GEMM_TILE_N * WMMA_TILE_K; idx += GEMM_THREADS) {
+            int n, k;
+            if (B_ROWS) {
+                n = idx / WMMA_TILE_K;
+                k = idx % WMMA_TILE_K;
+            } else {
+                k = idx / GEMM_TILE_N;
+                n = idx % GEMM_TILE_N;
+            }
+            int gn = n0 + n, gk = k0 + k;
+            float value = 0.0f;
+            if (gn < N && gk < K) {
+                value = B_ROWS ? B[(size_t)gn * K + gk] : B[(size_t)gk * N + gn];
+            }
+            shared_b[n][k] = wmma_from_float<T>(value);
+        }
+        __syncthreads();
+        
+        for (int kk = 0; kk < WMMA_TILE_K; kk += 16) {
+            wmma::load_matrix_sync(a_frag, &shared_a[warp_m * 16][kk], WMMA_TILE_K + WMMA_PAD);
+            wmma::load_matrix_sync(b_frag, &shared_b[warp_n * 16][kk], WMMA_TILE_K + WMMA_PAD);
+            wmma::mma_sync(acc_frag, a_frag, b_frag, acc_frag);
+        }
+        __syncthreads();
+    }
+    
+    wmma::store_matrix_sync(&shared_c[warp_m * 16][warp_n * 16], acc_frag, GEMM_TILE_N + 4,
+                            wmma::mem_row_major);
+    __syncthreads();
+    
+    for (int idx = tid; idx < GEMM_TILE_M * GEMM_TILE_N; idx += GEMM_THREADS) {
+        int r = idx / GEMM_TILE_N, c = idx % GEMM_TILE_N;
+        int row = m0 + r, col = n0 + c;
+        if (row < M && col < N) {
+            C[(size_t)row * N + col] = gemm_epilogue(shared_c[r][c], alpha, row_norms, col_norms, row, col);
+        }
+    }
+}
+
+// WMMA needs compute capability 7.0, BF16 fragments 8.0; the bodies are
+// compiled only for architectures that have them and the host never
+// launches them elsewhere
+template <bool B_ROWS>
+__global__ void wmma_fp16_gemm_kernel(const float* __restrict__ A, const float* __restrict__ B,
+                                      float* __restrict__ C, int M, int N, int K, float alpha,
+                                      const float* __restrict__ row_norms,
+                                      const float* __restrict__ col_norms) {
+#if defined(__CUDA_ARCH__) && __CUDA_ARCH__ >= 700
+    wmma_gemm_tile<__half, B_ROWS>(A, B, C, M, N, K, alpha, row_norms, col_norms);
+#endif
+}
+
+template <bool B_ROWS>
+__global__ void wmma_bf16_gemm_kernel(const float* __restrict__ A, const float* __restrict__ B,
+                                      float* __restrict__ C, int M, int N, int K, float alpha,
+                                      const float* __restrict__ row_norms,
+                                      const float* __restrict__ col_norms) {
+#if defined(__CUDA_ARCH__) && __CUDA_ARCH__ >= 800
+    wmma_gemm_tile<__nv_bfloat16, B_ROWS>(A, B, C, M, N, K, alpha, row_norms, col_norms);
+#endif
+}
+
+// L2 norm of each row, a warp per row
+__global__ void row_norms_kernel(
+    const float* __restrict__ vectors,
+    float* __restrict__ norms,
+    int num_vectors,
+    int vector_dim
+) {
+    int row = blockIdx.x * (blockDim.x / 32) + threadIdx.x / 32;
+    int lane = threadIdx.x % 32;
+    
+    if (row >= num_vectors) return;
+    
+    const float* vec = vectors + (size_t)row * vector_dim;
+    float sum = 0.0f;
+    for (int i = lane; i < vector_dim; i += 32) {
+        sum += vec[i] * vec[i];
+    }
+    for (int offset = 16; offset > 0; offset >>= 1) {
+        sum += __shfl_down_sync(0xffffffff, sum, offset);
+    }
+    if (lane == 0) norms[row] = sqrtf(sum);
+}
+
+// Single-query similarity, where there is nothing to tile: the query
+// (blockIdx.y) sits in dynamic shared memory and a warp reads each
+// document row with coalesced loads
+__global__ void warp_cosine_similarity_kernel(
+    const float* __restrict__ queries,
+    const float* __restrict__ doc_vectors,
+    float* __restrict__ similarities,  // num_queries x num_docs
+    int num_docs,
+    int vector_dim
+) {
+    extern __shared__ float shared_vector[];
+    
+    const int query_idx = blockIdx.y;
+    const float* query = queries + (size_t)query_idx * vector_dim;
+    for (int i = threadIdx.x; i < vector_dim; i += blockDim.x) {
+        shared_vector[i] = query[i];
+    }
+    __syncthreads();
+    
+    int doc_idx = blockIdx.x * (blockDim.x / 32) + threadIdx.x / 32;
+    int lane = threadIdx.x % 32;
+    
+    if (doc_idx >= num_docs) return;
+    
+    const float* doc_vec = doc_vectors + (size_t)doc_idx * vector_dim;
+    float dot_product = 0.0f;
+    float query_norm = 0.0f;
+    float doc_norm = 0.0f;
+    for (int i = lane; i < vector_dim; i += 32) {
+        float q_val = shared_vector[i];
+        float d_val = doc_vec[i];
+        dot_product += q_val * d_val;
+        query_norm += q_val * q_val;
+        doc_norm += d_val * d_val;
+    }
+    for (int offset = 16; offset > 0; offset >>= 1) {
+        dot_product += __shfl_down_sync(0xffffffff, dot_product, offset);
+        query_norm += __shfl_down_sync(0xffffffff, query_norm, offset);
+        doc_norm += __shfl_down_sync(0xffffffff, doc_norm, offset);
+    }
+    
+    if (lane == 0) {
+        float norm_product = sqrtf(query_norm) * sqrtf(doc_norm);
+        similarities[(size_t)query_idx * num_docs + doc_idx] =
+            (norm_product > 0.0f) ? (dot_product / norm_product) : 0.0f;
+    }
+}
+
+// In-place softmax of each row of scores, a block per row
+__global__ void softmax_rows_kernel(
+    float* __restrict__ scores,
+    int row_length
+) {
+    __shared__ float shared_reduce[256];
+    
+    float* row = scores + (size_t)blockIdx.x * row_length;
+    
+    float max_score = -INFINITY;
+    for (int i = threadIdx.x; i < row_length; i += blockDim.x) {
+        max_score = fmaxf(max_score, row[i]);
+    }
+    shared_reduce[threadIdx.x] = max_score;
+    __syncthreads();
+    for (unsigned int stride = blockDim.x / 2; stride > 0; stride >>= 1) {
+        if (threadIdx.x < stride) {
+            shared_reduce[threadIdx.x] = fmaxf(shared_reduce[threadIdx.x], shared_reduce[threadIdx.x + stride]);
+        }
+        __syncthreads();
+    }
+    max_score = shared_reduce[0];
+    __syncthreads();
+    
+    float sum_exp = 0.0f;
+    for (int i = threadIdx.x; i < row_length; i += blockDim.x) {
+        float exp_score = expf(row[i] - max_score);
+        row[i] = exp_score;
+        sum_exp += exp_score;
+    }
+    shared_reduce[threadIdx.x] = sum_exp;
+    __syncthreads();
+    for (unsigned int stride = blockDim.x / 2; stride > 0; stride >>= 1) {
+        if (threadIdx.x < stride) {
+            shared_reduce[threadIdx.x] += shared_reduce[threadIdx.x + stride];
+        }
+        __syncthreads();
+    }
+    float inverse = 1.0f / shared_reduce[0];
+    
+    for (int i = threadIdx.x; i < row_length; i += blockDim.x) {
+        row[i] *= inverse;
+    }
+}
+
+static int device_compute_capability() {
+    int device = 0, major = 0, minor = 0;
+    if (cudaGetDevice(&device) != cudaSuccess ||
+        cudaDeviceGetAttribute(&major, cudaDevAttrComputeCapabilityMajor, device) != cudaSuccess ||
+        cudaDeviceGetAttribute(&minor, cudaDevAttrComputeCapabilityMinor, device) != cudaSuccess) {
+        return 0;
+    }
+    return major * 10 + minor;
+}
+
+template <bool B_ROWS>
+static void launch_gemm(int variant, const float* A, const float* B, float* C, int M, int N, int K,
+                        float alpha, const float* row_norms, const float* col_norms) {
+    dim3 blockSize(GEMM_THREADS);
+    dim3 gridSize((N + GEMM_TILE_N - 1) / GEMM_TILE_N, (M + GEMM_TILE_M - 1) / GEMM_TILE_M);
+    
+    if (variant == CUDA_KERNEL_WMMA_BF16) {
+        wmma_bf16_gemm_kernel<B_ROWS><<<gridSize, blockSize>>>(A, B, C, M, N, K, alpha, row_norms, col_norms);
+    } else if (variant == CUDA_KERNEL_WMMA_FP16) {
+        wmma_fp16_gemm_kernel<B_ROWS><<<gridSize, blockSize>>>(A, B, C, M, N, K, alpha, row_norms, col_norms);
+    } else {
+        tiled_gemm_kernel<B_ROWS><<<gridSize, blockSize>>>(A, B, C, M, N, K, alpha, row_norms, col_norms);
+    }
+}
+
+extern "C" {
+
+// The variant the *_ex entry points use on the current device: with
+// use_tensor_cores, BF16 WMMA from compute capability 8.0 (BF16 keeps the
+// FP32 exponent range) and FP16 WMMA on 7.x; the tiled FP32 kernels
+// otherwise
+int cuda_select_kernel(int use_tensor_cores) {
+    const int capability = device_compute_capability();
+    if (use_tensor_cores && capability >= 80) return CUDA_KERNEL_WMMA_BF16;
+    if (use_tensor_cores && capability >= 70) return CUDA_KERNEL_WMMA_FP16;
+    return CUDA_KERNEL_TILED;
+}
+
+int cuda_kernel_supported(int variant) {
+    switch (variant) {
+    case CUDA_KERNEL_AUTO:
+    case CUDA_KERNEL_NAIVE:
+    case CUDA_KERNEL_TILED:
+    case CUDA_KERNEL_WARP:
+        return 1;
+    case CUDA_KERNEL_WMMA_FP16:
+        return device_compute_capability() >= 70;
+    case CUDA_KERNEL_WMMA_BF16:
+        return device_compute_capability() >= 80;
+    default:
+        return 0;
+    }
+}
+
+// The similarity kernel cuda_select_kernel(use_tensor_cores) amounts to for
+// this shape: a single query is a matrix-vector product, bound by reading the
+// documents, so there the FP32 path takes the warp kernel instead of tiling
+int cuda_select_similarity_kernel(int use_tensor_cores, int num_queries, int vector_dim) {
+    const int variant = cuda_select_kernel(use_tensor_cores);
+    if (variant == CUDA_KERNEL_TILED && num_queries == 1 &&
+        (size_t)vector_dim * sizeof(float) <= 48 * 1024) {
+        return CUDA_KERNEL_WARP;
+    }
+    return variant;
+}
+
+} // extern "C"
+
+// Launches for a resolved, supported variant, without allocating: norms is
+// scratch for num_queries + num_docs floats, used by the GEMM variants
+static cudaError_t launch_vector_similarity(int variant, const float* queries, const float* doc_vectors,
+                                            float* similarities, int num_queries, int num_docs,
+                                            int vector_dim, float* norms) {
+    if (variant == CUDA_KERNEL_NAIVE) {
+        dim3 blockSize(256);
+        dim3 gridSize((num_docs + blockSize.x - 1) / blockSize.x);
+        for (int q = 0; q < num_queries; q++) {
+            cosine_similarity_kernel<<<gridSize, blockSize>>>(
+                queries + (size_t)q * vector_dim, doc_vectors, similarities + (size_t)q * num_docs,
+                num_docs, vector_dim
+            );
+        }
+        return cudaGetLastError();
+    }
+    
+    if (variant == CUDA_KERNEL_WARP) {
+        const size_t query_bytes = (size_t)vector_dim * sizeof(float);
+        dim3 blockSize(256);
+        dim3 gridSize((num_docs + 7) / 8, num_queries);
+        warp_cosine_similarity_kernel<<<gridSize, blockSize, query_bytes>>>(
+            queries, doc_vectors, similarities, num_docs, vector_dim
+        );
+        return cudaGetLastError();
+    }
+    
+    row_norms_kernel<<<(num_queries + 7) / 8, 256>>>(queries, norms, num_queries, vector_dim);
+    row_norms_kernel<<<(num_docs + 7) / 8, 256>>>(doc_vectors, norms + num_queries, num_docs, vector_dim);
+    launch_gemm<true>(variant, queries, doc_vectors, similarities, num_queries, num_docs, vector_dim,
+                      1.0f, norms, norms + num_queries);
+    return cudaGetLastError();
+}
+
+// Checks a variant against the device and the shape, resolving AUTO as
+// cuda_select_similarity_kernel(1, ...) does. The warp kernel only takes a
+// single query that fits in shared memory.
+static cudaError_t resolve_similarity_variant(int& variant, int num_queries, int num_docs, int vector_dim) {
+    if (variant == CUDA_KERNEL_AUTO) variant = cuda_select_similarity_kernel(1, num_queries, vector_dim);
+    if (!cuda_kernel_supported(variant)) return cudaErrorNotSupported;
+    if (num_queries <= 0 || num_docs <= 0 || vector_dim <= 0) return cudaErrorInvalidValue;
+    if (variant == CUDA_KERNEL_WARP &&
+        (num_queries != 1 || (size_t)vector_dim * sizeof(float) > 48 * 1024)) {
+        return cudaErrorInvalidValue;
+    }
+    return cudaSuccess;
+}
+
+extern "C" {
+
+// Cosine similarity of num_queries queries against num_docs documents, all
+// device pointers, with the given variant (CUDA_KERNEL_AUTO picks as
+// cuda_select_similarity_kernel(1, ...) does). similarities receives
+// num_queries x num_docs scores, row-major. Asynchronous on the default
+// stream; returns cudaErrorNotSupported for a variant the device cannot run
+// and cudaErrorInvalidValue for one that cannot take this shape.
+int cuda_vector_similarity_variant(int variant, const float* queries, const float* doc_vectors,
+                                   float* similarities, int num_queries, int num_docs, int vector_dim) {
+    cudaError_t err = resolve_similarity_variant(variant, num_queries, num_docs, vector_dim);
+    if (err != cudaSuccess) return err;
+    
+    float* norms = nullptr;
+    const bool gemm = variant != CUDA_KERNEL_NAIVE && variant != CUDA_KERNEL_WARP;
+    if (gemm) {
+        err = cudaMallocAsync(&norms, (size_t)(num_queries + num_docs) * sizeof(float), 0);
+        if (err != cudaSuccess) return err;
+    }
+    
+    err = launch_vector_similarity(variant, queries, doc_vectors, similarities,
+                                   num_queries, num_docs, vector_dim, norms);
+    if (norms) cudaFreeAsync(norms, 0);
+    return err;
+}
+
+// Self-attention over seq_len rows of head_dim (device pointers) with the
+// given variant: scores = Q K^T / sqrt(head_dim) into attention_weights,
+// softmaxed per row, then output = weights V. Asynchronous on the default
+// stream.
+int cuda_attention_variant(int variant, const float* queries, const float* keys, const float* values,
+                           float* output, float* attention_weights, int seq_len, int head_dim) {
+    if (variant == CUDA_KERNEL_AUTO) variant = cuda_select_kernel(1);
+    if (!cuda_kernel_supported(variant)) return cudaErrorNotSupported;
+    if (seq_len <= 0 || head_dim <= 0) return cudaErrorInvalidValue;
+    
+    float scale = 1.0f / sqrtf((float)head_dim);
+    
+    if (variant == CUDA_KERNEL_NAIVE) {
+        dim3 blockSize(16, 16);
+        dim3 gridSize((seq_len + blockSize.x - 1) / blockSize.x,
+                      (head_dim + blockSize.y - 1) / blockSize.y);
+        attention_kernel<<<gridSize, blockSize>>>(
+            queries, keys, values, output, attention_weights, seq_len, head_dim, scale
+        );
+        return cudaGetLastError();
+    }
+    
+    launch_gemm<true>(variant, queries, keys, attention_weights, seq_len, seq_len, head_dim,
+                      scale, nullptr, nullptr);
+    softmax_rows_kernel<<<seq_len, 256>>>(attention_weights, seq_len);
+    launch_gemm<false>(variant, attention_weights, values, output, seq_len, head_dim, seq_len,
+                       1.0f, nullptr, nullptr);
+    return cudaGetLastError();
+}
+
 // Wrapper functions for Go integration
 
+// similarities receives num_queries x num_docs scores, row-major
 void cuda_vector_similarity(float* query_vector, float* doc_vectors, float* similarities, 
                            int num_queries, int num_docs, int vector_dim) {
-    dim3 blockSize(256);
-    dim3 gridSize((num_docs + blockSize.x - 1) / blockSize.x);
-    
-    cosine_similarity_kernel<<<gridSize, blockSize>>>(
-        query_vector, doc_vectors, similarities, num_docs, vector_dim
-    );
+    cuda_vector_similarity_variant(cuda_select_similarity_kernel(0, num_queries, vector_dim), query_vector,
+                                   doc_vectors, similarities, num_queries, num_docs, vector_dim);
     
     cudaDeviceSynchronize();
 }
 
+// cuda_vector_similarity on tensor cores when use_tensor_cores is set
+// (CudaOptions.use_tensor_cores) and the device has them
+int cuda_vector_similarity_ex(float* query_vector, float* doc_vectors, float* similarities,
+                              int num_queries, int num_docs, int vector_dim, int use_tensor_cores) {
+    int err = cuda_vector_similarity_variant(
+        cuda_select_similarity_kernel(use_tensor_cores, num_queries, vector_dim), query_vector,
+        doc_vectors, similarities, num_queries, num_docs, vector_dim);
+    cudaDeviceSynchronize();
+    return err;
+}
+
 void cuda_batch_embeddings(float* input, float* output, int batch_size, 
                           int input_dims, int output_dims) {
     // Placeholder for actual neural network inference
@@ -331,20 +1153,21 @@ void cuda_pairwise_distances(float* vectors1, float* vectors2, float* distances,
 void cuda_attention_computation(float* queries, float* keys, float* values,
                               float* output, float* attention_weights,
                               int seq_len, int head_dim) {
-    float scale = 1.0f / sqrtf((float)head_dim);
-    
-    dim3 blockSize(16, 16);
-    dim3 gridSize((seq_len + blockSize.x - 1) / blockSize.x,
-                  (head_dim + blockSize.y - 1) / blockSize.y);
-    
-    attention_kernel<<<gridSize, blockSize>>>(
-        queries, keys, values, output, attention_weights,
-        seq_len, head_dim, scale
-    );
+    cuda_attention_variant(CUDA_KERNEL_TILED, queries, keys, values, output, attention_weights,
+                           seq_len, head_dim);
     
     cudaDeviceSynchronize();
 }
 
+int cuda_attention_computation_ex(float* queries, float* keys, float* values,
+                                  float* output, float* attention_weights,
+                                  int seq_len, int head_dim, int use_tensor_cores) {
+    int err = cuda_attention_variant(cuda_select_kernel(use_tensor_cores), queries, keys, values,
+                                     output, attention_weights, seq_len, head_dim);
+    cudaDeviceSynchronize();
+    return err;
+}
+
 void cuda_memory_consolidation(float* memory_weights, float* timestamps,
                              float current_time, float decay_rate, int num_memories) {
     dim3 blockSize(256);
@@ -372,8 +1195,10 @@ void cuda_kmeans_clustering(float* points, float* centroids, int* assignments,
 
 // Device information functions
 int cuda_device_count() {
-    int count;
-    cudaGetDeviceCount(&count);
+    int count = 0;
+    if (cudaGetDeviceCount(&count) != cudaSuccess) {
+        return 0;
+    }
     return count;
 }
 
@@ -412,6 +1237,1030 @@ void cuda_memcpy_d2h(void* dst, const void* src, size_t size) {
     cudaMemcpy(dst, src, size, cudaMemcpyDeviceToHost);
 }
 
+// Batching engine for host-resident data
+//
+// The wrappers above take device pointers and run synchronously on the
+// default stream of the current device. The batching engine takes host
+// arrays instead: the document matrix is sharded by rows across every
+// device, and each device streams its shard through pinned buffers in
+// chunks. Each chunk is staged, copied in, scored and copied out on one of
+// the device's streams; scoring is one cuBLAS GEMM against all the queries,
+// then a pass dividing by the query norms (computed once per call on the
+// host) and the chunk's document norms. With two or more streams, a chunk's
+// copy in overlaps the previous chunk's kernels and copy out. Each device is driven
+// from its own host thread, so staging into pinned memory also runs in
+// parallel. An engine handles one call at a time.
+
+#define BATCH_DEFAULT_CHUNK_DOCS 8192
+#define BATCH_MIN_SHARD_DOCS 1024
+
+struct cuda_batch_slot {
+    cudaStream_t stream;
+    cudaEvent_t done;
+    cublasHandle_t blas;  // bound to stream, so slots share no workspace
+    float* h_docs;      // pinned, chunk_docs x vector_dim
+    float* h_scores;    // pinned, max_queries x chunk_docs
+    float* d_docs;
+    float* d_doc_norms; // chunk_docs
+    float* d_scores;
+    int pending_begin;  // first document of the chunk in flight
+    int pending_rows;   // 0 when the slot is idle
+};
+
+struct cuda_batch_device {
+    int device;
+    float* d_queries;   // max_queries x vector_dim
+    float* d_query_norms;
+    cudaEvent_t queries_ready;  // recorded on slots[0] after the query upload
+    std::vector<cuda_batch_slot> slots;
+};
+
+struct cuda_batch_engine {
+    int vector_dim;
+    int max_queries;
+    int chunk_docs;
+    std::vector<cuda_batch_device> devices;
+};
+
+static cudaError_t batch_device_init(cuda_batch_engine* engine, cuda_batch_device& dev,
+                                     int device, int streams) {
+    const size_t doc_bytes = (size_t)engine->chunk_docs * engine->vector_dim * sizeof(float);
+    const size_t score_bytes = (size_t)engine->max_queries * engine->chunk_docs * sizeof(float);
+    
+    dev.device = device;
+    dev.slots.resize(streams);
+    cudaError_t err = cudaSetDevice(device);
+    if (err == cudaSuccess) {
+        err = cudaMalloc(&dev.d_queries, (size_t)engine->max_queries * engine->vector_dim * sizeof(float));
+    }
+    if (err == cudaSuccess) err = cudaMalloc(&dev.d_query_norms, engine->max_queries * sizeof(float));
+    if (err == cudaSuccess) err = cudaEventCreateWithFlags(&dev.queries_ready, cudaEventDisableTiming);
+    for (auto& slot : dev.slots) {
+        if (err == cudaSuccess) err = cudaStreamCreateWithFlags(&slot.stream, cudaStreamNonBlocking);
+        if (err == cudaSuccess) err = cudaEventCreateWithFlags(&slot.done, cudaEventDisableTiming);
+        if (err == cudaSuccess && cublasCreate(&slot.blas) != CUBLAS_STATUS_SUCCESS) err = cudaErrorUnknown;
+        if (err == cudaSuccess && cublasSetStream(slot.blas, slot.stream) != CUBLAS_STATUS_SUCCESS) {
+            err = cudaErrorUnknown;
+        }
+        if (err == cudaSuccess) err = cudaMallocHost(&slot.h_docs, doc_bytes);
+        if (err == cudaSuccess) err = cudaMallocHost(&slot.h_scores, score_bytes);
+        if (err == cudaSuccess) err = cudaMalloc(&slot.d_docs, doc_bytes);
+        if (err == cudaSuccess) err = cudaMalloc(&slot.d_doc_norms, engine->chunk_docs * sizeof(float));
+        if (err == cudaSuccess) err = cudaMalloc(&slot.d_scores, score_bytes);
+    }
+    return err;
+}
+
+void cuda_batch_engine_destroy(cuda_batch_engine* engine) {
+    if (!engine) return;
+    
+    for (auto& dev : engine->devices) {
+        cudaSetDevice(dev.device);
+        for (auto& slot : dev.slots) {
+            if (slot.stream) {
+                cudaStreamSynchronize(slot.stream);
+                cudaStreamDestroy(slot.stream);
+            }
+            if (slot.done) cudaEventDestroy(slot.done);
+            if (slot.blas) cublasDestroy(slot.blas);
+            if (slot.h_docs) cudaFreeHost(slot.h_docs);
+            if (slot.h_scores) cudaFreeHost(slot.h_scores);
+            cuda_free(slot.d_docs);
+            cuda_free(slot.d_doc_norms);
+            cuda_free(slot.d_scores);
+        }
+        if (dev.queries_ready) cudaEventDestroy(dev.queries_ready);
+        cuda_free(dev.d_queries);
+        cuda_free(dev.d_query_norms);
+    }
+    delete engine;
+}
+
+// Scores up to max_queries queries of vector_dim floats per call.
+// chunk_docs is the number of documents per pipeline stage (0 for 8192).
+// streams_per_device is raised to at least 2, the double-buffered minimum.
+// max_devices limits the shards (0 uses every device). Returns nullptr if no
+// device is available or an allocation fails.
+cuda_batch_engine* cuda_batch_engine_create(int vector_dim, int max_queries, int chunk_docs,
+                                            int streams_per_device, int max_devices) {
+    if (vector_dim <= 0 || max_queries <= 0) return nullptr;
+    
+    int device_count = cuda_device_count();
+    if (max_devices > 0) device_count = std::min(device_count, max_devices);
+    if (device_count <= 0) return nullptr;
+    
+    auto* engine = new cuda_batch_engine();
+    engine->vector_dim = vector_dim;
+    engine->max_queries = max_queries;
+    engine->chunk_docs = (chunk_docs > 0) ? chunk_docs : BATCH_DEFAULT_CHUNK_DOCS;
+    engine->devices.resize(device_count);
+    
+    for (int d = 0; d < device_count; d++) {
+        if (batch_device_init(engine, engine->devices[d], d, std::max(streams_per_device, 2)) != cudaSuccess) {
+            cuda_batch_engine_destroy(engine);
+            return nullptr;
+        }
+    }
+    return engine;
+}
+
+int cuda_batch_engine_device_count(const cuda_batch_engine* engine) {
+    return engine ? (int)engine->devices.size() : 0;
+}
+
+// Wait for the slot's chunk and scatter its scores into the caller's
+// num_queries x num_docs output (dropped when output is null)
+static cudaError_t batch_collect(cuda_batch_slot& slot, int num_queries, int num_docs, float* output) {
+    if (slot.pending_rows == 0) return cudaSuccess;
+    
+    cudaError_t err = cudaEventSynchronize(slot.done);
+    if (err == cudaSuccess && output) {
+        for (int q = 0; q < num_queries; q++) {
+            memcpy(output + (size_t)q * num_docs + slot.pending_begin,
+                   slot.h_scores + (size_t)q * slot.pending_rows,
+                   slot.pending_rows * sizeof(float));
+        }
+    }
+    slot.pending_rows = 0;
+    return err;
+}
+
+static cudaError_t batch_similarity_shard(cuda_batch_engine* engine, cuda_batch_device& dev,
+                                          const float* queries, const float* query_norms,
+                                          int num_queries, const float* doc_vectors, int num_docs,
+                                          int begin, int end, float* similarities) {
+    const size_t dim = engine->vector_dim;
+    
+    // The slot streams are non-blocking, so a copy on the legacy stream would
+    // not order them. The queries go up on the first slot's stream and the
+    // other slots wait for its event before their first GEMM.
+    cudaError_t err = cudaSetDevice(dev.device);
+    cudaStream_t upload = dev.slots[0].stream;
+    if (err == cudaSuccess) {
+        err = cudaMemcpyAsync(dev.d_queries, queries, num_queries * dim * sizeof(float),
+                              cudaMemcpyHostToDevice, upload);
+    }
+    if (err == cudaSuccess) {
+        err = cudaMemcpyAsync(dev.d_query_norms, query_norms, num_queries * sizeof(float),
+                              cudaMemcpyHostToDevice, upload);
+    }
+    if (err == cudaSuccess) err = cudaEventRecord(dev.queries_ready, upload);
+    for (size_t s = 1; s < dev.slots.size() && err == cudaSuccess; s++) {
+        err = cudaStreamWaitEvent(dev.slots[s].stream, dev.queries_ready, 0);
+    }
+    
+    size_t chunk = 0;
+    for (int chunk_begin = begin; chunk_begin < end && err == cudaSuccess;
+         chunk_begin += engine->chunk_docs, chunk++) {
+        cuda_batch_slot& slot = dev.slots[chunk % dev.slots.size()];
+        err = batch_collect(slot, num_queries, num_docs, similarities);
+        if (err != cudaSuccess) break;
+        
+        const int rows = std::min(engine->chunk_docs, end - chunk_begin);
+        memcpy(slot.h_docs, doc_vectors + (size_t)chunk_begin * dim, rows * dim * sizeof(float));
+        cudaMemcpyAsync(slot.d_docs, slot.h_docs, rows * dim * sizeof(float),
+                        cudaMemcpyHostToDevice, slot.stream);
+        
+        row_norms_kernel<<<(rows + 7) / 8, 256, 0, slot.stream>>>(
+            slot.d_docs, slot.d_doc_norms, rows, (int)dim
+        );
+        
+        // Column-major view: scores (rows x num_queries) = docs^T * queries,
+        // which is num_queries x rows row-major
+        const float alpha = 1.0f;
+        const float beta = 0.0f;
+        if (cublasSgemm(slot.blas, CUBLAS_OP_T, CUBLAS_OP_N, rows, num_queries, (int)dim,
+                        &alpha, slot.d_docs, (int)dim, dev.d_queries, (int)dim,
+                        &beta, slot.d_scores, rows) != CUBLAS_STATUS_SUCCESS) {
+            err = cudaErrorUnknown;
+            break;
+        }
+        
+        dim3 blockSize(256);
+        dim3 gridSize((rows + blockSize.x - 1) / blockSize.x, num_queries);
+        cosine_from_dots_kernel<<<gridSize, blockSize, 0, slot.stream>>>(
+            slot.d_scores, dev.d_query_norms, slot.d_doc_norms, rows
+        );
+        
+        cudaMemcpyAsync(slot.h_scores, slot.d_scores, (size_t)num_queries * rows * sizeof(float),
+                        cudaMemcpyDeviceToHost, slot.stream);
+        cudaEventRecord(slot.done, slot.stream);
+        err = cudaGetLastError();
+        
+        slot.pending_begin = chunk_begin;
+        slot.pending_rows = rows;
+    }
+    
+    // Drain every slot, even after an error, so nothing is left in flight
+    for (auto& slot : dev.slots) {
+        cudaError_t drained = batch_collect(slot, num_queries, num_docs,
+                                            (err == cudaSuccess) ? similarities : nullptr);
+        if (err == cudaSuccess) err = drained;
+    }
+    return err;
+}
+
+// Cosine similarity of num_queries host-memory queries against num_docs
+// host-memory documents. similarities receives num_queries x num_docs
+// scores, row-major. Returns cudaSuccess (0) or the first CUDA error a
+// device reported.
+int cuda_batch_vector_similarity(cuda_batch_engine* engine, const float* queries, int num_queries,
+                                 const float* doc_vectors, int num_docs, float* similarities) {
+    if (!engine || num_queries <= 0 || num_queries > engine->max_queries || num_docs < 0) {
+        return cudaErrorInvalidValue;
+    }
+    if (num_docs == 0) return cudaSuccess;
+    
+    // Small inputs stay on fewer devices rather than paying a launch per device
+    const int devices = (int)engine->devices.size();
+    const int shard = std::max((num_docs + devices - 1) / devices,
+                               std::min(num_docs, BATCH_MIN_SHARD_DOCS));
+    const int shards = (num_docs + shard - 1) / shard;
+    
+    // Shared by every shard
+    const size_t dim = engine->vector_dim;
+    std::vector<float> query_norms(num_queries);
+    for (int q = 0; q < num_queries; q++) {
+        double sum = 0.0;
+        for (size_t i = 0; i < dim; i++) {
+            const float value = queries[q * dim + i];
+            sum += (double)value * value;
+        }
+        query_norms[q] = (float)std::sqrt(sum);
+    }
+    
+    std::vector<cudaError_t> errors(shards, cudaSuccess);
+    auto run_shard = [&](int d) {
+        const int begin = d * shard;
+        const int end = std::min(num_docs, begin + shard);
+        errors[d] = batch_similarity_shard(engine, engine->devices[d], queries, query_norms.data(),
+                                           num_queries, doc_vectors, num_docs, begin, end,
+                                           similarities);
+    };
+    
+    if (shards == 1) {
+        run_shard(0);
+    } else {
+        std::vector<std::thread> workers;
+        for (int d = 0; d < shards; d++) {
+            workers.emplace_back(run_shard, d);
+        }
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+    
+    for (cudaError_t err : errors) {
+        if (err != cudaSuccess) return err;
+    }
+    return cudaSuccess;
+}
+
+// Device-resident collections
+//
+// A collection keeps a document matrix on one device between calls, so a
+// search uploads only its queries. Vectors are normalized as they are
+// appended, which makes every score a plain dot product. A search is then
+// one cuBLAS GEMM per group of queries, followed by on-device top-k passes,
+// and only k ids and scores per query come back. Appending an existing id
+// replaces its vector in place. Removing moves the last rows into the gaps,
+// so no call ever re-uploads the matrix. Ids are the caller's (e.g. a
+// database row id). A collection handles one call at a time.
+
+#define COLLECTION_DEFAULT_CAPACITY 65536
+#define COLLECTION_DEFAULT_QUERY_BATCH 16
+#define COLLECTION_MAX_K (TOPK_SEGMENT / 2)
+
+struct cuda_collection {
+    int device;
+    int vector_dim;
+    int capacity;
+    int size;
+    int query_batch;
+    cudaStream_t stream;
+    cublasHandle_t blas;
+    float* d_vectors;                 // capacity x vector_dim, unit length
+    std::vector<long long> ids;       // id of each row
+    std::unordered_map<long long, int> rows;
+    
+    // Scratch, grown on demand
+    float* d_staging;  size_t staging_bytes;
+    int* d_rows;       size_t rows_bytes;
+    float* d_scores;   size_t scores_bytes;
+    float* d_candidate_scores[2];  size_t candidate_score_bytes[2];
+    int* d_candidate_indices[2];   size_t candidate_index_bytes[2];
+};
+
+static cudaError_t ensure_device_buffer(void** buffer, size_t* capacity, size_t bytes) {
+    if (bytes <= *capacity) return cudaSuccess;
+    
+    cuda_free(*buffer);
+    *buffer = nullptr;
+    *capacity = 0;
+    cudaError_t err = cudaMalloc(buffer, bytes);
+    if (err == cudaSuccess) *capacity = bytes;
+    return err;
+}
+
+void cuda_collection_destroy(cuda_collection* collection) {
+    if (!collection) return;
+    
+    cudaSetDevice(collection->device);
+    if (collection->stream) cudaStreamSynchronize(collection->stream);
+    if (collection->blas) cublasDestroy(collection->blas);
+    if (collection->stream) cudaStreamDestroy(collection->stream);
+    cuda_free(collection->d_vectors);
+    cuda_free(collection->d_staging);
+    cuda_free(collection->d_rows);
+    cuda_free(collection->d_scores);
+    for (int i = 0; i < 2; i++) {
+        cuda_free(collection->d_candidate_scores[i]);
+        cuda_free(collection->d_candidate_indices[i]);
+    }
+    delete collection;
+}
+
+// initial_capacity is in vectors (0 for 65536); the matrix doubles as it
+// fills. query_batch is the number of queries scored per GEMM (0 for 16),
+// which sets the score buffer to query_batch x size floats.
+cuda_collection* cuda_collection_create(int device, int vector_dim, int initial_capacity, int query_batch) {
+    if (vector_dim <= 0 || device < 0 || device >= cuda_device_count()) return nullptr;
+    
+    auto* collection = new cuda_collection();
+    collection->device = device;
+    collection->vector_dim = vector_dim;
+    collection->capacity = (initial_capacity > 0) ? initial_capacity : COLLECTION_DEFAULT_CAPACITY;
+    collection->query_batch = (query_batch > 0) ? query_batch : COLLECTION_DEFAULT_QUERY_BATCH;
+    
+    cudaError_t err = cudaSetDevice(device);
+    if (err == cudaSuccess) err = cudaStreamCreateWithFlags(&collection->stream, cudaStreamNonBlocking);
+    if (err == cudaSuccess) {
+        err = cudaMalloc(&collection->d_vectors,
+                         (size_t)collection->capacity * vector_dim * sizeof(float));
+    }
+    if (err == cudaSuccess && cublasCreate(&collection->blas) != CUBLAS_STATUS_SUCCESS) {
+        collection->blas = nullptr;
+        err = cudaErrorUnknown;
+    }
+    if (err == cudaSuccess) cublasSetStream(collection->blas, collection->stream);
+    
+    if (err != cudaSuccess) {
+        cuda_collection_destroy(collection);
+        return nullptr;
+    }
+    return collection;
+}
+
+int cuda_collection_size(const cuda_collection* collection) {
+    return collection ? collection->size : 0;
+}
+
+static cudaError_t collection_reserve(cuda_collection* collection, int needed) {
+    if (needed <= collection->capacity) return cudaSuccess;
+    
+    int capacity = collection->capacity;
+    while (capacity < needed) capacity *= 2;
+    
+    float* vectors = nullptr;
+    cudaError_t err = cudaMalloc(&vectors, (size_t)capacity * collection->vector_dim * sizeof(float));
+    if (err != cudaSuccess) return err;
+    
+    err = cudaMemcpyAsync(vectors, collection->d_vectors,
+                          (size_t)collection->size * collection->vector_dim * sizeof(float),
+                          cudaMemcpyDeviceToDevice, collection->stream);
+    if (err == cudaSuccess) err = cudaStreamSynchronize(collection->stream);
+    if (err != cudaSuccess) {
+        cudaFree(vectors);
+        return err;
+    }
+    cudaFree(collection->d_vectors);
+    collection->d_vectors = vectors;
+    collection->capacity = capacity;
+    return cudaSuccess;
+}
+
+// Add count vectors (count x vector_dim floats, host memory) under ids.
+// An id already in the collection has its vector replaced; when an id
+// repeats within the call, its last vector wins.
+int cuda_collection_append(cuda_collection* collection, const long long* ids,
+                           const float* vectors, int count) {
+    if (!collection || count < 0 || (count > 0 && (!ids || !vectors))) return cudaErrorInvalidValue;
+    if (count == 0) return cudaSuccess;
+    
+    cudaError_t err = cudaSetDevice(collection->device);
+    if (err != cudaSuccess) return err;
+    
+    // Destination rows; earlier duplicates within the call are skipped
+    std::vector<int> dst_rows(count);
+    std::unordered_map<long long, int> position;
+    int new_rows = 0;
+    for (int i = 0; i < count; i++) {
+        auto seen = position.find(ids[i]);
+        if (seen != position.end()) {
+            dst_rows[i] = dst_rows[seen->second];
+            dst_rows[seen->second] = -1;
+            seen->second = i;
+            continue;
+        }
+        position.emplace(ids[i], i);
+        auto existing = collection->rows.find(ids[i]);
+        dst_rows[i] = (existing != collection->rows.end()) ? existing->second
+                                                             : collection->size + new_rows++;
+    }
+    
+    err = collection_reserve(collection, collection->size + new_rows);
+    
+    const size_t dim = collection->vector_dim;
+    if (err == cudaSuccess) {
+        err = ensure_device_buffer((void**)&collection->d_staging, &collection->staging_bytes,
+                                   count * dim * sizeof(float));
+    }
+    if (err == cudaSuccess) {
+        err = ensure_device_buffer((void**)&collection->d_rows, &collection->rows_bytes, count * sizeof(int));
+    }
+    if (err != cudaSuccess) return err;
+    
+    cudaMemcpyAsync(collection->d_staging, vectors, count * dim * sizeof(float),
+                    cudaMemcpyHostToDevice, collection->stream);
+    cudaMemcpyAsync(collection->d_rows, dst_rows.data(), count * sizeof(int),
+                    cudaMemcpyHostToDevice, collection->stream);
+    
+    normalize_vectors_kernel<<<(count + 255) / 256, 256, 0, collection->stream>>>(
+        collection->d_staging, count, (int)dim
+    );
+    
+    dim3 blockSize(256);
+    dim3 gridSize((dim + blockSize.x - 1) / blockSize.x, count);
+    copy_rows_kernel<<<gridSize, blockSize, 0, collection->stream>>>(
+        collection->d_vectors, collection->d_staging, collection->d_rows, nullptr, count, (int)dim
+    );
+    
+    err = cudaStreamSynchronize(collection->stream);
+    if (err == cudaSuccess) err = cudaGetLastError();
+    if (err != cudaSuccess) return err;
+    
+    collection->ids.resize(collection->size + new_rows);
+    for (int i = 0; i < count; i++) {
+        if (dst_rows[i] < 0) continue;
+        collection->ids[dst_rows[i]] = ids[i];
+        collection->rows[ids[i]] = dst_rows[i];
+    }
+    collection->size += new_rows;
+    return cudaSuccess;
+}
+
+// Remove the vectors of ids (unknown ids are ignored); removed, if not
+// null, receives how many were. The last rows move into the gaps in one
+// kernel launch.
+int cuda_collection_remove(cuda_collection* collection, const long long* ids, int count, int* removed) {
+    if (removed) *removed = 0;
+    if (!collection || count < 0 || (count > 0 && !ids)) return cudaErrorInvalidValue;
+    
+    // Swap-with-last on the host first. Every source row ends up beyond the
+    // new size and every destination inside it, so the moves cannot overlap.
+    std::unordered_map<int, int> origin;  // row -> row its contents come from
+    int size = collection->size;
+    int count_removed = 0;
+    for (int i = 0; i < count; i++) {
+        auto it = collection->rows.find(ids[i]);
+        if (it == collection->rows.end()) continue;
+        
+        const int row = it->second;
+        const int last = --size;
+        collection->rows.erase(it);
+        if (row != last) {
+            const long long moved_id = collection->ids[last];
+            collection->ids[row] = moved_id;
+            collection->rows[moved_id] = row;
+            auto from = origin.find(last);
+            origin[row] = (from != origin.end()) ? from->second : last;
+        }
+        origin.erase(last);
+        count_removed++;
+    }
+    if (count_removed == 0) return cudaSuccess;
+    
+    std::vector<int> moves;  // dst rows then src rows
+    for (const auto& move : origin) moves.push_back(move.first);
+    for (const auto& move : origin) moves.push_back(move.second);
+    const int num_moves = (int)origin.size();
+    
+    cudaError_t err = cudaSuccess;
+    if (num_moves > 0) {
+        err = cudaSetDevice(collection->device);
+        if (err == cudaSuccess) {
+            err = ensure_device_buffer((void**)&collection->d_rows, &collection->rows_bytes,
+                                       moves.size() * sizeof(int));
+        }
+        if (err == cudaSuccess) {
+            cudaMemcpyAsync(collection->d_rows, moves.data(), moves.size() * sizeof(int),
+                            cudaMemcpyHostToDevice, collection->stream);
+            dim3 blockSize(256);
+            dim3 gridSize((collection->vector_dim + blockSize.x - 1) / blockSize.x, num_moves);
+            copy_rows_kernel<<<gridSize, blockSize, 0, collection->stream>>>(
+                collection->d_vectors, collection->d_vectors, collection->d_rows,
+                collection->d_rows + num_moves, num_moves, collection->vector_dim
+            );
+            err = cudaStreamSynchronize(collection->stream);
+            if (err == cudaSuccess) err = cudaGetLastError();
+        }
+    }
+    
+    // The host bookkeeping already reflects the removal; on a device error
+    // the affected rows hold stale vectors until they are appended again
+    collection->size = size;
+    collection->ids.resize(size);
+    if (removed) *removed = count_removed;
+    return err;
+}
+
+// Top-k over the query_count x size scores already in d_scores. Leaves the
+// winners in d_candidate_*[*result], query_count x k.
+static cudaError_t collection_topk(cuda_collection* collection, int query_count, int k, int* result) {
+    const float* in_scores = collection->d_scores;
+    const int* in_indices = nullptr;
+    int count = collection->size;
+    int buffer = 0;
+    
+    for (;;) {
+        const int segments = (count + TOPK_SEGMENT - 1) / TOPK_SEGMENT;
+        const size_t out_stride = (size_t)segments * k;
+        cudaError_t err = ensure_device_buffer((void**)&collection->d_candidate_scores[buffer],
+                                               &collection->candidate_score_bytes[buffer],
+                                               query_count * out_stride * sizeof(float));
+        if (err == cudaSuccess) {
+            err = ensure_device_buffer((void**)&collection->d_candidate_indices[buffer],
+                                       &collection->candidate_index_bytes[buffer],
+                                       query_count * out_stride * sizeof(int));
+        }
+        if (err != cudaSuccess) return err;
+        
+        dim3 gridSize(segments, query_count);
+        topk_segments_kernel<<<gridSize, TOPK_THREADS, 0, collection->stream>>>(
+            in_scores, in_indices, count, count, k,
+            collection->d_candidate_scores[buffer], collection->d_candidate_indices[buffer],
+            (int)out_stride
+        );
+        if (segments == 1) break;
+        
+        in_scores = collection->d_candidate_scores[buffer];
+        in_indices = collection->d_candidate_indices[buffer];
+        count = (int)out_stride;
+        buffer ^= 1;
+    }
+    *result = buffer;
+    return cudaGetLastError();
+}
+
+// Cosine similarity of num_queries host-memory queries against the
+// collection, keeping the best k (up to 1024) per query. out_ids and
+// out_scores receive num_queries x k entries, best first; when the
+// collection holds fewer than k vectors the rest have id -1 and score
+// -INFINITY.
+int cuda_collection_search(cuda_collection* collection, const float* queries, int num_queries, int k,
+                           long long* out_ids, float* out_scores) {
+    if (!collection || num_queries < 0 || k <= 0 || k > COLLECTION_MAX_K) return cudaErrorInvalidValue;
+    if (num_queries == 0) return cudaSuccess;
+    if (!queries || !out_ids || !out_scores) return cudaErrorInvalidValue;
+    
+    const size_t total = (size_t)num_queries * k;
+    if (collection->size == 0) {
+        std::fill(out_ids, out_ids + total, -1LL);
+        std::fill(out_scores, out_scores + total, -INFINITY);
+        return cudaSuccess;
+    }
+    
+    cudaError_t err = cudaSetDevice(collection->device);
+    const size_t dim = collection->vector_dim;
+    const int batch = std::min(num_queries, collection->query_batch);
+    if (err == cudaSuccess) {
+        err = ensure_device_buffer((void**)&collection->d_staging, &collection->staging_bytes,
+                                   batch * dim * sizeof(float));
+    }
+    if (err == cudaSuccess) {
+        err = ensure_device_buffer((void**)&collection->d_scores, &collection->scores_bytes,
+                                   (size_t)batch * collection->size * sizeof(float));
+    }
+    if (err != cudaSuccess) return err;
+    
+    std::vector<float> best_scores((size_t)batch * k);
+    std::vector<int> best_rows((size_t)batch * k);
+    
+    for (int first = 0; first < num_queries; first += batch) {
+        const int query_count = std::min(batch, num_queries - first);
+        
+        cudaMemcpyAsync(collection->d_staging, queries + first * dim, query_count * dim * sizeof(float),
+                        cudaMemcpyHostToDevice, collection->stream);
+        normalize_vectors_kernel<<<(query_count + 255) / 256, 256, 0, collection->stream>>>(
+            collection->d_staging, query_count, (int)dim
+        );
+        
+        // Column-major view: scores (size x query_count) = vectors^T * queries,
+        // which is query_count x size row-major
+        const float alpha = 1.0f;
+        const float beta = 0.0f;
+        if (cublasSgemm(collection->blas, CUBLAS_OP_T, CUBLAS_OP_N,
+                        collection->size, query_count, (int)dim,
+                        &alpha, collection->d_vectors, (int)dim,
+                        collection->d_staging, (int)dim,
+                        &beta, collection->d_scores, collection->size) != CUBLAS_STATUS_SUCCESS) {
+            return cudaErrorUnknown;
+        }
+        
+        int buffer = 0;
+        err = collection_topk(collection, query_count, k, &buffer);
+        if (err != cudaSuccess) return err;
+        
+        cudaMemcpyAsync(best_scores.data(), collection->d_candidate_scores[buffer],
+                        query_count * k * sizeof(float), cudaMemcpyDeviceToHost, collection->stream);
+        cudaMemcpyAsync(best_rows.data(), collection->d_candidate_indices[buffer],
+                        query_count * k * sizeof(int), cudaMemcpyDeviceToHost, collection->stream);
+        err = cudaStreamSynchronize(collection->stream);
+        if (err != cudaSuccess) return err;
+        
+        for (size_t i = 0; i < (size_t)query_count * k; i++) {
+            const int row = best_rows[i];
+            out_ids[first * k + i] = (row >= 0) ? collection->ids[row] : -1LL;
+            out_scores[first * k + i] = best_scores[i];
+        }
+    }
+    return cudaSuccess;
+}
+
+// K-means
+//
+// cuda_kmeans_fit runs whole Lloyd iterations on the device. Per iteration,
+// point-centroid dot products come from cuBLAS in chunks of points. A warp
+// per point picks the nearest centroid and counts cluster sizes. A prefix sum
+// and a scatter then group the point indices by cluster. Finally a block per
+// cluster averages its members into the new centroid. The convergence test
+// also runs on the device, and only the small status record is copied back.
+// The host reads that status one iteration late, so the device always has
+// the next iteration queued; an iteration queued after convergence does
+// nothing but its GEMMs.
+//
+// cuda_kmeans_minibatch_fit is for corpora that do not fit on the device,
+// such as the full clause-embedding set. Points stay in host memory. Random
+// batches are gathered into two pinned buffers, and the next batch is copied
+// in while the current one updates the centroids on the device.
+
+#define KMEANS_THREADS 256
+#define KMEANS_SCORE_BUDGET (32 << 20)  // floats of point-centroid scores per GEMM chunk
+#define KMEANS_DEFAULT_BATCH 65536
+
+struct kmeans_workspace {
+    cudaStream_t stream;
+    cublasHandle_t blas;
+    int dimensions;
+    int num_clusters;
+    int chunk;               // points per GEMM
+    float* d_scores;         // chunk x num_clusters
+    float* d_centroid_norms;
+    int* d_counts;
+    int* d_offsets;
+    int* d_cursors;
+    kmeans_status* d_status;
+};
+
+static void kmeans_workspace_free(kmeans_workspace& ws) {
+    if (ws.stream) cudaStreamSynchronize(ws.stream);
+    if (ws.blas) cublasDestroy(ws.blas);
+    if (ws.stream) cudaStreamDestroy(ws.stream);
+    cuda_free(ws.d_scores);
+    cuda_free(ws.d_centroid_norms);
+    cuda_free(ws.d_counts);
+    cuda_free(ws.d_offsets);
+    cuda_free(ws.d_cursors);
+    cuda_free(ws.d_status);
+}
+
+static cudaError_t kmeans_workspace_init(kmeans_workspace& ws, int dimensions, int num_clusters,
+                                         long long max_points) {
+    memset(&ws, 0, sizeof(ws));
+    ws.dimensions = dimensions;
+    ws.num_clusters = num_clusters;
+    ws.chunk = (int)std::max(1LL, std::min(max_points, (long long)(KMEANS_SCORE_BUDGET / num_clusters)));
+    
+    cudaError_t err = cudaStreamCreateWithFlags(&ws.stream, cudaStreamNonBlocking);
+    if (err == cudaSuccess && cublasCreate(&ws.blas) != CUBLAS_STATUS_SUCCESS) err = cudaErrorUnknown;
+    if (err == cudaSuccess && cublasSetStream(ws.blas, ws.stream) != CUBLAS_STATUS_SUCCESS) err = cudaErrorUnknown;
+    if (err == cudaSuccess) err = cudaMalloc(&ws.d_scores, (size_t)ws.chunk * num_clusters * sizeof(float));
+    if (err == cudaSuccess) err = cudaMalloc(&ws.d_centroid_norms, num_clusters * sizeof(float));
+    if (err == cudaSuccess) err = cudaMalloc(&ws.d_counts, num_clusters * sizeof(int));
+    if (err == cudaSuccess) err = cudaMalloc(&ws.d_offsets, num_clusters * sizeof(int));
+    if (err == cudaSuccess) err = cudaMalloc(&ws.d_cursors, num_clusters * sizeof(int));
+    if (err == cudaSuccess) err = cudaMalloc(&ws.d_status, sizeof(kmeans_status));
+    if (err == cudaSuccess) err = cudaMemsetAsync(ws.d_status, 0, sizeof(kmeans_status), ws.stream);
+    if (err != cudaSuccess) kmeans_workspace_free(ws);
+    return err;
+}
+
+// Assigns num_points device points (with their norms) to the nearest of the
+// centroids, adding to the cluster counts and the status
+static cudaError_t kmeans_assign(kmeans_workspace& ws, const float* points, const float* point_norms,
+                                 int num_points, const float* centroids, int* assignments) {
+    const int k = ws.num_clusters;
+    const int warps = KMEANS_THREADS / 32;
+    row_norms_kernel<<<(k + warps - 1) / warps, KMEANS_THREADS, 0, ws.stream>>>(
+        centroids, ws.d_centroid_norms, k, ws.dimensions
+    );
+    
+    const float alpha = 1.0f;
+    const float beta = 0.0f;
+    for (int first = 0; first < num_points; first += ws.chunk) {
+        const int count = std::min(ws.chunk, num_points - first);
+        
+        // Column-major view: scores (k x count) = centroids^T * points,
+        // which is count x k row-major
+        if (cublasSgemm(ws.blas, CUBLAS_OP_T, CUBLAS_OP_N, k, count, ws.dimensions,
+                        &alpha, centroids, ws.dimensions,
+                        points + (size_t)first * ws.dimensions, ws.dimensions,
+                        &beta, ws.d_scores, k) != CUBLAS_STATUS_SUCCESS) {
+            return cudaErrorUnknown;
+        }
+        kmeans_assign_kernel<<<(count + warps - 1) / warps, KMEANS_THREADS, 0, ws.stream>>>(
+            ws.d_scores, point_norms + first, ws.d_centroid_norms, assignments + first,
+            ws.d_counts, ws.d_status, count, k
+        );
+    }
+    return cudaGetLastError();
+}
+
+// One Lloyd iteration, or one mini-batch step when totals is set, over
+// num_points device points. order needs room for num_points indices.
+static cudaError_t kmeans_iteration(kmeans_workspace& ws, const float* points, const float* point_norms,
+                                    int num_points, float* centroids, int* assignments, int* order,
+                                    float* totals, float tolerance_sq) {
+    kmeans_begin_kernel<<<1, 1, 0, ws.stream>>>(ws.d_status);
+    cudaMemsetAsync(ws.d_counts, 0, ws.num_clusters * sizeof(int), ws.stream);
+    
+    cudaError_t err = kmeans_assign(ws, points, point_norms, num_points, centroids, assignments);
+    if (err != cudaSuccess) return err;
+    
+    kmeans_offsets_kernel<<<1, 1024, 0, ws.stream>>>(
+        ws.d_counts, ws.d_offsets, ws.d_cursors, ws.d_status, ws.num_clusters
+    );
+    kmeans_scatter_kernel<<<(num_points + KMEANS_THREADS - 1) / KMEANS_THREADS, KMEANS_THREADS, 0, ws.stream>>>(
+        assignments, ws.d_offsets, ws.d_cursors, order, ws.d_status, num_points
+    );
+    kmeans_centroid_kernel<<<ws.num_clusters, KMEANS_THREADS, 0, ws.stream>>>(
+        points, order, ws.d_offsets, ws.d_counts, centroids, totals, ws.d_status, ws.dimensions
+    );
+    kmeans_check_kernel<<<1, 1, 0, ws.stream>>>(ws.d_status, tolerance_sq, totals ? 0 : 1);
+    return cudaGetLastError();
+}
+
+static float kmeans_tolerance_sq(float tolerance) {
+    return tolerance > 0.0f ? tolerance * tolerance : -1.0f;
+}
+
+// Lloyd's k-means over num_points device points. centroids (num_clusters x
+// dimensions, device) holds the initial centroids, such as a random sample
+// of the points, and receives the result; assignments (num_points, device)
+// receives each point's cluster. Stops after max_iterations, once no point
+// changes cluster, or once no centroid moves further than tolerance (L2;
+// 0 disables the test). iterations_run and inertia (the sum of squared
+// distances under the final assignments) may be null.
+int cuda_kmeans_fit(const float* points, int num_points, int dimensions, int num_clusters,
+                    float* centroids, int* assignments, int max_iterations, float tolerance,
+                    int* iterations_run, float* inertia) {
+    if (!points || !centroids || !assignments || num_points <= 0 || dimensions <= 0 ||
+        num_clusters <= 0 || num_clusters > num_points || max_iterations <= 0) {
+        return cudaErrorInvalidValue;
+    }
+    
+    kmeans_workspace ws;
+    cudaError_t err = kmeans_workspace_init(ws, dimensions, num_clusters, num_points);
+    if (err != cudaSuccess) return err;
+    
+    float* d_point_norms = nullptr;
+    int* d_order = nullptr;
+    kmeans_status* h_status = nullptr;
+    cudaEvent_t status_ready[2] = {nullptr, nullptr};
+    err = cudaMalloc(&d_point_norms, (size_t)num_points * sizeof(float));
+    if (err == cudaSuccess) err = cudaMalloc(&d_order, (size_t)num_points * sizeof(int));
+    if (err == cudaSuccess) err = cudaMallocHost(&h_status, 2 * sizeof(kmeans_status));
+    for (int i = 0; i < 2 && err == cudaSuccess; i++) {
+        err = cudaEventCreateWithFlags(&status_ready[i], cudaEventDisableTiming);
+    }
+    
+    if (err == cudaSuccess) {
+        const int warps = KMEANS_THREADS / 32;
+        row_norms_kernel<<<(num_points + warps - 1) / warps, KMEANS_THREADS, 0, ws.stream>>>(
+            points, d_point_norms, num_points, dimensions
+        );
+        // No valid cluster, so every point counts as changed the first time
+        cudaMemsetAsync(assignments, 0xff, (size_t)num_points * sizeof(int), ws.stream);
+        
+        const float tolerance_sq = kmeans_tolerance_sq(tolerance);
+        for (int it = 0; it < max_iterations && err == cudaSuccess; it++) {
+            err = kmeans_iteration(ws, points, d_point_norms, num_points, centroids, assignments,
+                                   d_order, nullptr, tolerance_sq);
+            if (err != cudaSuccess) break;
+            cudaMemcpyAsync(&h_status[it % 2], ws.d_status, sizeof(kmeans_status),
+                            cudaMemcpyDeviceToHost, ws.stream);
+            cudaEventRecord(status_ready[it % 2], ws.stream);
+            
+            if (it > 0) {
+                err = cudaEventSynchronize(status_ready[(it - 1) % 2]);
+                if (err == cudaSuccess && h_status[(it - 1) % 2].converged) break;
+            }
+        }
+    }
+    
+    kmeans_status final_status = {};
+    if (err == cudaSuccess) {
+        err = cudaMemcpyAsync(&final_status, ws.d_status, sizeof(kmeans_status),
+                              cudaMemcpyDeviceToHost, ws.stream);
+    }
+    if (err == cudaSuccess) err = cudaStreamSynchronize(ws.stream);
+    if (err == cudaSuccess) {
+        if (iterations_run) *iterations_run = final_status.iterations;
+        if (inertia) *inertia = final_status.inertia;
+    }
+    
+    for (int i = 0; i < 2; i++) {
+        if (status_ready[i]) cudaEventDestroy(status_ready[i]);
+    }
+    if (h_status) cudaFreeHost(h_status);
+    cuda_free(d_point_norms);
+    cuda_free(d_order);
+    kmeans_workspace_free(ws);
+    return err;
+}
+
+// Mini-batch k-means over num_points host points. centroids (num_clusters x
+// dimensions, host) holds the initial centroids and receives the result.
+// Each step samples batch_size points (0 for the default) with seed, for up
+// to max_batches steps or until a step moves no centroid further than
+// tolerance (L2, 0 disables the test). When assignments (num_points, host) is
+// given, a final pass streams every point through to assign it, and inertia
+// receives the sum of squared distances. batches_run and inertia may be null.
+int cuda_kmeans_minibatch_fit(const float* points, long long num_points, int dimensions, int num_clusters,
+                              float* centroids, int batch_size, int max_batches, float tolerance,
+                              unsigned int seed, int* assignments, int* batches_run, float* inertia) {
+    if (!points || !centroids || num_points <= 0 || dimensions <= 0 || num_clusters <= 0 ||
+        num_clusters > num_points || batch_size < 0 || max_batches <= 0) {
+        return cudaErrorInvalidValue;
+    }
+    const int batch = (int)std::min(num_points, (long long)(batch_size > 0 ? batch_size : KMEANS_DEFAULT_BATCH));
+    const size_t batch_floats = (size_t)batch * dimensions;
+    const size_t centroid_bytes = (size_t)num_clusters * dimensions * sizeof(float);
+    
+    kmeans_workspace ws;
+    cudaError_t err = kmeans_workspace_init(ws, dimensions, num_clusters, batch);
+    if (err != cudaSuccess) return err;
+    
+    cudaStream_t copy_stream = nullptr;
+    float* d_centroids = nullptr;
+    float* d_totals = nullptr;
+    float* d_point_norms = nullptr;
+    int* d_assignments = nullptr;
+    int* d_order = nullptr;
+    float* d_batch[2] = {nullptr, nullptr};
+    float* h_batch[2] = {nullptr, nullptr};
+    cudaEvent_t copied[2] = {nullptr, nullptr};    // batch slot copied in
+    cudaEvent_t consumed[2] = {nullptr, nullptr};  // batch slot no longer read by the device
+    cudaEvent_t status_ready[2] = {nullptr, nullptr};
+    kmeans_status* h_status = nullptr;
+    
+    err = cudaStreamCreateWithFlags(&copy_stream, cudaStreamNonBlocking);
+    if (err == cudaSuccess) err = cudaMalloc(&d_centroids, centroid_bytes);
+    if (err == cudaSuccess) err = cudaMalloc(&d_totals, num_clusters * sizeof(float));
+    if (err == cudaSuccess) err = cudaMalloc(&d_point_norms, batch * sizeof(float));
+    if (err == cudaSuccess) err = cudaMalloc(&d_assignments, batch * sizeof(int));
+    if (err == cudaSuccess) err = cudaMalloc(&d_order, batch * sizeof(int));
+    if (err == cudaSuccess) err = cudaMallocHost(&h_status, 2 * sizeof(kmeans_status));
+    for (int i = 0; i < 2 && err == cudaSuccess; i++) {
+        err = cudaMalloc(&d_batch[i], batch_floats * sizeof(float));
+        if (err == cudaSuccess) err = cudaMallocHost(&h_batch[i], batch_floats * sizeof(float));
+        if (err == cudaSuccess) err = cudaEventCreateWithFlags(&copied[i], cudaEventDisableTiming);
+        if (err == cudaSuccess) err = cudaEventCreateWithFlags(&consumed[i], cudaEventDisableTiming);
+        if (err == cudaSuccess) err = cudaEventCreateWithFlags(&status_ready[i], cudaEventDisableTiming);
+    }
+    
+    // Fills pinned slot with rows (first_row onward, or random ones when
+    // first_row < 0) and copies it in once the device is done with the slot
+    std::mt19937_64 rng(seed);
+    std::uniform_int_distribution<long long> pick(0, num_points - 1);
+    auto stage = [&](int slot, long long first_row, int rows) -> cudaError_t {
+        cudaError_t status = cudaEventSynchronize(copied[slot]);
+        if (status != cudaSuccess) return status;
+        float* out = h_batch[slot];
+        if (first_row >= 0) {
+            memcpy(out, points + first_row * dimensions, (size_t)rows * dimensions * sizeof(float));
+        } else {
+            for (int r = 0; r < rows; r++) {
+                memcpy(out + (size_t)r * dimensions, points + pick(rng) * dimensions, dimensions * sizeof(float));
+            }
+        }
+        cudaStreamWaitEvent(copy_stream, consumed[slot], 0);
+        cudaMemcpyAsync(d_batch[slot], out, (size_t)rows * dimensions * sizeof(float),
+                        cudaMemcpyHostToDevice, copy_stream);
+        return cudaEventRecord(copied[slot], copy_stream);
+    };
+    
+    const int warps = KMEANS_THREADS / 32;
+    if (err == cudaSuccess) {
+        cudaMemcpyAsync(d_centroids, centroids, centroid_bytes, cudaMemcpyHostToDevice, ws.stream);
+        cudaMemsetAsync(d_totals, 0, num_clusters * sizeof(float), ws.stream);
+        err = stage(0, -1, batch);
+    }
+    
+    const float tolerance_sq = kmeans_tolerance_sq(tolerance);
+    for (int b = 0; b < max_batches && err == cudaSuccess; b++) {
+        const int slot = b % 2;
+        cudaStreamWaitEvent(ws.stream, copied[slot], 0);
+        row_norms_kernel<<<(batch + warps - 1) / warps, KMEANS_THREADS, 0, ws.stream>>>(
+            d_batch[slot], d_point_norms, batch, dimensions
+        );
+        err = kmeans_iteration(ws, d_batch[slot], d_point_norms, batch, d_centroids, d_assignments,
+                               d_order, d_totals, tolerance_sq);
+        if (err != cudaSuccess) break;
+        cudaEventRecord(consumed[slot], ws.stream);
+        cudaMemcpyAsync(&h_status[slot], ws.d_status, sizeof(kmeans_status),
+                        cudaMemcpyDeviceToHost, ws.stream);
+        cudaEventRecord(status_ready[slot], ws.stream);
+        
+        // Gather the next batch while this one runs
+        if (b + 1 < max_batches) err = stage(slot ^ 1, -1, batch);
+        if (err == cudaSuccess && b > 0) {
+            err = cudaEventSynchronize(status_ready[slot ^ 1]);
+            if (err == cudaSuccess && h_status[slot ^ 1].converged) break;
+        }
+    }
+    
+    kmeans_status final_status = {};
+    if (err == cudaSuccess) {
+        cudaMemcpyAsync(&final_status, ws.d_status, sizeof(kmeans_status), cudaMemcpyDeviceToHost, ws.stream);
+        err = cudaStreamSynchronize(ws.stream);
+    }
+    if (err == cudaSuccess && batches_run) *batches_run = final_status.iterations;
+    
+    // Final pass in order: clear the status so the kernels run again, then
+    // assign every point, batch by batch, with the same double buffering
+    if (err == cudaSuccess && assignments) {
+        cudaMemsetAsync(ws.d_status, 0, sizeof(kmeans_status), ws.stream);
+        kmeans_begin_kernel<<<1, 1, 0, ws.stream>>>(ws.d_status);
+        const long long num_batches = (num_points + batch - 1) / batch;
+        err = cudaStreamSynchronize(ws.stream);
+        if (err == cudaSuccess) err = stage(0, 0, (int)std::min((long long)batch, num_points));
+        for (long long b = 0; b < num_batches && err == cudaSuccess; b++) {
+            const int slot = b % 2;
+            const long long first = b * batch;
+            const int rows = (int)std::min((long long)batch, num_points - first);
+            
+            cudaStreamWaitEvent(ws.stream, copied[slot], 0);
+            row_norms_kernel<<<(rows + warps - 1) / warps, KMEANS_THREADS, 0, ws.stream>>>(
+                d_batch[slot], d_point_norms, rows, dimensions
+            );
+            err = kmeans_assign(ws, d_batch[slot], d_point_norms, rows, d_centroids, d_assignments);
+            if (err != cudaSuccess) break;
+            cudaEventRecord(consumed[slot], ws.stream);
+            
+            if (b + 1 < num_batches) {
+                const long long next = first + batch;
+                err = stage(slot ^ 1, next, (int)std::min((long long)batch, num_points - next));
+            }
+            if (err == cudaSuccess) {
+                cudaMemcpyAsync(assignments + first, d_assignments, rows * sizeof(int),
+                                cudaMemcpyDeviceToHost, ws.stream);
+                err = cudaStreamSynchronize(ws.stream);
+            }
+        }
+        if (err == cudaSuccess) {
+            cudaMemcpyAsync(&final_status, ws.d_status, sizeof(kmeans_status), cudaMemcpyDeviceToHost, ws.stream);
+            err = cudaStreamSynchronize(ws.stream);
+        }
+        if (err == cudaSuccess && inertia) *inertia = final_status.inertia;
+    }
+    
+    if (err == cudaSuccess) {
+        cudaMemcpyAsync(centroids, d_centroids, centroid_bytes, cudaMemcpyDeviceToHost, ws.stream);
+        err = cudaStreamSynchronize(ws.stream);
+    }
+    
+    if (copy_stream) {
+        cudaStreamSynchronize(copy_stream);
+        cudaStreamDestroy(copy_stream);
+    }
+    for (int i = 0; i < 2; i++) {
+        if (copied[i]) cudaEventDestroy(copied[i]);
+        if (consumed[i]) cudaEventDestroy(consumed[i]);
+        if (status_ready[i]) cudaEventDestroy(status_ready[i]);
+        if (h_batch[i]) cudaFreeHost(h_batch[i]);
+        cuda_free(d_batch[i]);
+    }
+    if (h_status) cudaFreeHost(h_status);
+    cuda_free(d_centroids);
+    cuda_free(d_totals);
+    cuda_free(d_point_norms);
+    cuda_free(d_assignments);
+    cuda_free(d_order);
+    kmeans_workspace_free(ws);
+    return err;
+}
+
 // Performance profiling
 float cuda_benchmark_vector_similarity(int num_docs, int vector_dim, int iterations) {
     // Allocate test data
@@ -467,4 +2316,96 @@ float cuda_benchmark_vector_similarity(int num_docs, int vector_dim, int iterati
     return milliseconds / iterations;  // Average time per iteration
 }
 
+// Compare the similarity kernel variants on random data: ms receives the
+// average milliseconds per call and max_error the largest difference from
+// the tiled FP32 scores, both indexed by variant (CUDA_KERNEL_VARIANTS
+// entries; AUTO times the kernel cuda_select_similarity_kernel(1, ...) picks
+// for this shape). Variants the device or the shape cannot run (the warp
+// kernel takes a single query) get -1 in both. Returns cudaSuccess or the
+// first error.
+int cuda_benchmark_similarity_kernels(int num_docs, int vector_dim, int num_queries, int iterations,
+                                      float* ms, float* max_error) {
+    if (num_docs <= 0 || vector_dim <= 0 || num_queries <= 0 || iterations <= 0 || !ms || !max_error) {
+        return cudaErrorInvalidValue;
+    }
+    
+    const size_t query_count = (size_t)num_queries * vector_dim;
+    const size_t doc_count = (size_t)num_docs * vector_dim;
+    const size_t score_count = (size_t)num_queries * num_docs;
+    
+    std::vector<float> h_queries(query_count), h_docs(doc_count);
+    for (auto& value : h_queries) value = (float)rand() / RAND_MAX - 0.5f;
+    for (auto& value : h_docs) value = (float)rand() / RAND_MAX - 0.5f;
+    
+    float *d_queries = nullptr, *d_docs = nullptr, *d_similarities = nullptr;
+    cudaError_t err = cudaMalloc(&d_queries, query_count * sizeof(float));
+    if (err == cudaSuccess) err = cudaMalloc(&d_docs, doc_count * sizeof(float));
+    if (err == cudaSuccess) err = cudaMalloc(&d_similarities, score_count * sizeof(float));
+    if (err == cudaSuccess) {
+        cudaMemcpy(d_queries, h_queries.data(), query_count * sizeof(float), cudaMemcpyHostToDevice);
+        err = cudaMemcpy(d_docs, h_docs.data(), doc_count * sizeof(float), cudaMemcpyHostToDevice);
+    }
+    
+    cudaEvent_t start = nullptr, stop = nullptr;
+    if (err == cudaSuccess) err = cudaEventCreate(&start);
+    if (err == cudaSuccess) err = cudaEventCreate(&stop);
+    
+    // Norm scratch for the GEMM variants, allocated once so the timed loop
+    // only launches kernels
+    float* d_norms = nullptr;
+    if (err == cudaSuccess) err = cudaMalloc(&d_norms, (size_t)(num_queries + num_docs) * sizeof(float));
+    
+    // Tiled first, as the reference the others are checked against
+    const int order[CUDA_KERNEL_VARIANTS] = {
+        CUDA_KERNEL_TILED, CUDA_KERNEL_NAIVE, CUDA_KERNEL_WARP,
+        CUDA_KERNEL_WMMA_FP16, CUDA_KERNEL_WMMA_BF16, CUDA_KERNEL_AUTO
+    };
+    std::vector<float> reference(score_count), scores(score_count);
+    
+    for (int i = 0; i < CUDA_KERNEL_VARIANTS && err == cudaSuccess; i++) {
+        const int variant = order[i];
+        ms[variant] = -1.0f;
+        max_error[variant] = -1.0f;
+        
+        // Resolved and checked against the device once, outside the timing
+        int kernel = variant;
+        if (resolve_similarity_variant(kernel, num_queries, num_docs, vector_dim) != cudaSuccess) continue;
+        
+        // Warm up, which also produces the scores that are checked
+        err = launch_vector_similarity(kernel, d_queries, d_docs, d_similarities,
+                                       num_queries, num_docs, vector_dim, d_norms);
+        if (err == cudaSuccess) err = cudaDeviceSynchronize();
+        if (err != cudaSuccess) break;
+        
+        cudaEventRecord(start);
+        for (int iter = 0; iter < iterations; iter++) {
+            launch_vector_similarity(kernel, d_queries, d_docs, d_similarities,
+                                     num_queries, num_docs, vector_dim, d_norms);
+        }
+        cudaEventRecord(stop);
+        err = cudaEventSynchronize(stop);
+        if (err != cudaSuccess) break;
+        
+        float milliseconds = 0.0f;
+        cudaEventElapsedTime(&milliseconds, start, stop);
+        ms[variant] = milliseconds / iterations;
+        
+        std::vector<float>& target = (variant == CUDA_KERNEL_TILED) ? reference : scores;
+        err = cudaMemcpy(target.data(), d_similarities, score_count * sizeof(float), cudaMemcpyDeviceToHost);
+        float worst = 0.0f;
+        for (size_t j = 0; j < score_count; j++) {
+            worst = std::max(worst, fabsf(target[j] - reference[j]));
+        }
+        max_error[variant] = worst;
+    }
+    
+    if (start) cudaEventDestroy(start);
+    if (stop) cudaEventDestroy(stop);
+    cuda_free(d_norms);
+    cuda_free(d_queries);
+    cuda_free(d_docs);
+    cuda_free(d_similarities);
+    return err;
+}
+
 } // extern "C"
\ No newline at end of file
@@ -0,0 +1,83 @@
+/**
+ * Test-side mirror of FlatMessageWriter (legal_flat_message.h): little-endian
+ * fields, each padded to 4 bytes, strings and float arrays prefixed by their
+ * u32 length
+ */
+
+import { FlatMessageKind } from '../legal-grpc-decoder';
+
+export class FlatMessageWriter {
+  private bytes = new Uint8Array(256);
+  private view = new DataView(this.bytes.buffer);
+  private length = 0;
+
+  constructor(kind: FlatMessageKind) {
+    this.u32(kind);
+  }
+
+  u32(value: number): this {
+    const at = this.reserve(4);
+    this.view.setUint32(at, value, true);
+    return this;
+  }
+
+  i32(value: number): this {
+    const at = this.reserve(4);
+    this.view.setInt32(at, value, true);
+    return this;
+  }
+
+  f32(value: number): this {
+    const at = this.reserve(4);
+    this.view.setFloat32(at, value, true);
+    return this;
+  }
+
+  f64(value: number): this {
+    const at = this.reserve(8);
+    this.view.setFloat64(at, value, true);
+    return this;
+  }
+
+  string(value: string): this {
+    const encoded = new TextEncoder().encode(value);
+    this.u32(encoded.length);
+    const at = this.reserve(encoded.length);
+    this.bytes.set(encoded, at);
+    return this;
+  }
+
+  floats(values: ArrayLike<number>): this {
+    this.u32(values.length);
+    for (let i = 0; i < values.length; i++) {
+      const at = this.reserve(4);
+      this.view.setFloat32(at, values[i], true);
+    }
+    return this;
+  }
+
+  finish(): Uint8Array {
+    return this.bytes.slice(0, this.length);
+  }
+
+  private reserve(size: number): number {
+    const start = this.length;
+    const padded = (size + 3) & ~3;
+    if (start + padded > this.bytes.length) {
+      const grown = new Uint8Array(Math.max(this.bytes.length * 2, start + padded));
+      grown.set(this.bytes);
+      this.bytes = grown;
+      this.view = new DataView(grown.buffer);
+    }
+    this.length = start + padded;
+    return start;
+  }
+}
+
+export function documentProgress(documentId: string, stage: number, progress: number): Uint8Array {
+  return new FlatMessageWriter(FlatMessageKind.DocumentResponse)
+    .string(documentId)
+    .i32(stage)
+    .f32(progress)
+    .finish();
+}
@@ -0,0 +1,247 @@
+import { readFileSync } from 'node:fs';
+import { describe, it, expect } from 'vitest';
+import { decodeFlatMessage, FlatMessageKind } from '../legal-grpc-decoder';
+import { FlatMessageWriter, documentProgress } from './flat-message-writer';
+
+describe('decodeFlatMessage', () => {
+  it('decodes a CudaResponse with embeddings and metrics', () => {
+    const embedding = [0.5, -1.25, 3, 0];
+    const bytes = new FlatMessageWriter(FlatMessageKind.CudaResponse)
+      .string('session-1')
+      .string('embed')
+      .i32(0)
+      .floats(embedding)
+      .u32(1)
+      .f64(1234.5)
+      .f32(0.75)
+      .string('RTX 3060 Ti')
+      .finish();
+
+    const message = decodeFlatMessage(bytes);
+    expect(message).toEqual({
+      kind: FlatMessageKind.CudaResponse,
+      session_id: 'session-1',
+      operation_type: 'embed',
+      status: 0,
+      embeddings: new Float32Array(embedding),
+      performance: { processing_time_us: 1234.5, gpu_utilization: 0.75, gpu_model: 'RTX 3060 Ti' }
+    });
+  });
+
+  it('decodes a CudaResponse without metrics or embeddings', () => {
+    const bytes = new FlatMessageWriter(FlatMessageKind.CudaResponse)
+      .string('s')
+      .string('search')
+      .i32(-2)
+      .floats([])
+      .u32(0)
+      .finish();
+
+    const message = decodeFlatMessage(bytes);
+    expect(message.kind).toBe(FlatMessageKind.CudaResponse);
+    if (message.kind !== FlatMessageKind.CudaResponse) return;
+    expect(message.status).toBe(-2);
+    expect(message.embeddings.length).toBe(0);
+    expect(message.performance).toBeUndefined();
+  });
+
+  it('decodes a DocumentResponse', () => {
+    expect(decodeFlatMessage(documentProgress('doc-7', 3, 0.5))).toEqual({
+      kind: FlatMessageKind.DocumentResponse,
+      document_id: 'doc-7',
+      stage: 3,
+      progress: 0.5
+    });
+  });
+
+  it('decodes a SearchResponse with scores ahead of the per-match fields', () => {
+    const bytes = new FlatMessageWriter(FlatMessageKind.SearchResponse)
+      .string('query-9')
+      .i32(42)
+      .u32(1)
+      .u32(2)
+      .f32(0.875)
+      .f32(0.5)
+      .string('doc-a').string('Title A').string('Snippet with ü and 中文')
+      .u32(2).string('court').string('9th Cir.').string('year').string('2019')
+      .string('doc-b').string('').string('')
+      .u32(0)
+      .finish();
+
+    expect(decodeFlatMessage(bytes)).toEqual({
+      kind: FlatMessageKind.SearchResponse,
+      query_id: 'query-9',
+      total_matches: 42,
+      is_complete: true,
+      scores: new Float32Array([0.875, 0.5]),
+      matches: [
+        {
+          document_id: 'doc-a',
+          similarity_score: 0.875,
+          title: 'Title A',
+          snippet: 'Snippet with ü and 中文',
+          metadata: { court: '9th Cir.', year: '2019' }
+        },
+        { document_id: 'doc-b', similarity_score: 0.5, title: '', snippet: '', metadata: {} }
+      ]
+    });
+  });
+
+  it('decodes a SimilarityResponse with per-case metrics', () => {
+    const bytes = new FlatMessageWriter(FlatMessageKind.SimilarityResponse)
+      .string('case-base')
+      .u32(2)
+      .f32(0.25)
+      .f32(0.75)
+      .string('case-1')
+      .u32(1).string('factual').f32(0.5)
+      .string('case-2')
+      .u32(2).string('outcome').f32(1).string('procedural').f32(0.125)
+      .finish();
+
+    expect(decodeFlatMessage(bytes)).toEqual({
+      kind: FlatMessageKind.SimilarityResponse,
+      base_case_id: 'case-base',
+      scores: new Float32Array([0.25, 0.75]),
+      similarities: [
+        { case_id: 'case-1', similarity: 0.25, metrics: { factual: 0.5 } },
+        { case_id: 'case-2', similarity: 0.75, metrics: { outcome: 1, procedural: 0.125 } }
+      ]
+    });
+  });
+
+  it('decodes CallComplete', () => {
+    const ok = new FlatMessageWriter(FlatMessageKind.CallComplete).u32(1).finish();
+    const failed = new FlatMessageWriter(FlatMessageKind.CallComplete).u32(0).finish();
+    expect(decodeFlatMessage(ok)).toEqual({ kind: FlatMessageKind.CallComplete, ok: true });
+    expect(decodeFlatMessage(failed)).toEqual({ kind: FlatMessageKind.CallComplete, ok: false });
+  });
+
+  it('decodes from a view at an offset and copies out of it', () => {
+    const message = documentProgress('doc-offset', 1, 0.25);
+    const memory = new Uint8Array(message.length + 36);
+    memory.set(message, 36);
+    const view = memory.subarray(36, 36 + message.length);
+
+    const decoded = decodeFlatMessage(view);
+    memory.fill(0);
+    expect(decoded).toEqual({
+      kind: FlatMessageKind.DocumentResponse,
+      document_id: 'doc-offset',
+      stage: 1,
+      progress: 0.25
+    });
+  });
+
+  it('keeps embeddings valid after the source memory is reused', () => {
+    const bytes = new FlatMessageWriter(FlatMessageKind.CudaResponse)
+      .string('s').string('embed').i32(0).floats([1, 2, 3]).u32(0)
+      .finish();
+    const message = decodeFlatMessage(bytes);
+    bytes.fill(0xff);
+    if (message.kind !== FlatMessageKind.CudaResponse) throw new Error('wrong kind');
+    expect(Array.from(message.embeddings)).toEqual([1, 2, 3]);
+  });
+
+  it('rejects unknown kinds', () => {
+    const bytes = new FlatMessageWriter(99 as FlatMessageKind).finish();
+    expect(() => decodeFlatMessage(bytes)).toThrow('Unknown flat message kind: 99');
+  });
+});
+
+/** Written by native/legal_flat_fixtures.cpp with the client's *ToFlat helpers */
+function fixture(name: string): Uint8Array {
+  return new Uint8Array(readFileSync(new URL(`./fixtures/${name}.bin`, import.meta.url)));
+}
+
+describe('decodeFlatMessage on bytes from the C++ writer', () => {
+  it('decodes a CudaResponse', () => {
+    expect(decodeFlatMessage(fixture('cuda-response'))).toEqual({
+      kind: FlatMessageKind.CudaResponse,
+      session_id: 'session-1',
+      operation_type: 'embed',
+      status: 0,
+      embeddings: new Float32Array([0.5, -1.25, 3, 0]),
+      performance: { processing_time_us: 1234, gpu_utilization: 0.75, gpu_model: 'RTX 3060 Ti' }
+    });
+  });
+
+  it('decodes a CudaResponse written without its embedding', () => {
+    const message = decodeFlatMessage(fixture('cuda-response-without-embeddings'));
+    expect(message).toEqual({
+      kind: FlatMessageKind.CudaResponse,
+      session_id: 'session-1',
+      operation_type: 'embed',
+      status: -2,
+      embeddings: new Float32Array(0)
+    });
+  });
+
+  it('decodes a DocumentResponse', () => {
+    expect(decodeFlatMessage(fixture('document-response'))).toEqual({
+      kind: FlatMessageKind.DocumentResponse,
+      document_id: 'doc-7',
+      stage: 3,
+      progress: 0.5
+    });
+  });
+
+  it('decodes a SearchResponse', () => {
+    expect(decodeFlatMessage(fixture('search-response'))).toEqual({
+      kind: FlatMessageKind.SearchResponse,
+      query_id: 'query-9',
+      total_matches: 42,
+      is_complete: true,
+      scores: new Float32Array([0.875, 0.5]),
+      matches: [
+        {
+          document_id: 'doc-a',
+          similarity_score: 0.875,
+          title: 'Title A',
+          snippet: 'Snippet with ü and 中文',
+          metadata: { court: '9th Cir.' }
+        },
+        { document_id: 'doc-b', similarity_score: 0.5, title: '', snippet: '', metadata: {} }
+      ]
+    });
+  });
+
+  it('decodes a SimilarityResponse', () => {
+    expect(decodeFlatMessage(fixture('similarity-response'))).toEqual({
+      kind: FlatMessageKind.SimilarityResponse,
+      base_case_id: 'case-base',
+      scores: new Float32Array([0.25, 0.75]),
+      similarities: [
+        { case_id: 'case-1', similarity: 0.25, metrics: { factual: 0.5 } },
+        { case_id: 'case-2', similarity: 0.75, metrics: {} }
+      ]
+    });
+  });
+
+  it('decodes CallComplete', () => {
+    expect(decodeFlatMessage(fixture('call-complete'))).toEqual({
+      kind: FlatMessageKind.CallComplete,
+      ok: true
+    });
+  });
+
+  it('matches the test-side writer byte for byte', () => {
+    expect(documentProgress('doc-7', 3, 0.5)).toEqual(fixture('document-response'));
+    expect(new FlatMessageWriter(FlatMessageKind.CallComplete).u32(1).finish()).toEqual(
+      fixture('call-complete')
+    );
+    const search = new FlatMessageWriter(FlatMessageKind.SearchResponse)
+      .string('query-9')
+      .i32(42)
+      .u32(1)
+      .u32(2)
+      .f32(0.875)
+      .f32(0.5)
+      .string('doc-a').string('Title A').string('Snippet with ü and 中文')
+      .u32(1).string('court').string('9th Cir.')
+      .string('doc-b').string('').string('')
+      .u32(0)
+      .finish();
+    expect(search).toEqual(fixture('search-response'));
+  });
+});
@@ -0,0 +1,180 @@
+import { describe, it, expect, vi, afterEach } from 'vitest';
+import { ResultRingReader } from '../legal-grpc-result-ring';
+import { FlatMessageKind, type FlatMessage } from '../legal-grpc-decoder';
+import { documentProgress } from './flat-message-writer';
+
+const HEADER_SIZE = 192;
+const WRAP_MARKER = 0xffffffff;
+const RING_OFFSET = 1024;
+
+/** Producer side of legal_result_ring.h, writing into WASM-style shared memory */
+class TestRingProducer {
+  private header: Int32Array;
+  private view: DataView;
+
+  constructor(private memory: WebAssembly.Memory, private capacity: number, start = 0) {
+    this.header = new Int32Array(memory.buffer, RING_OFFSET, HEADER_SIZE / 4);
+    this.view = new DataView(memory.buffer);
+    this.header[32] = capacity;
+    Atomics.store(this.header, 0, start | 0);
+    Atomics.store(this.header, 16, start | 0);
+  }
+
+  get writeCounter(): number {
+    return Atomics.load(this.header, 0) >>> 0;
+  }
+
+  get readCounter(): number {
+    return Atomics.load(this.header, 16) >>> 0;
+  }
+
+  /** false when the record does not fit yet; notify wakes a waiting reader */
+  publish(tag: number, payload: Uint8Array, notify = true): boolean {
+    this.refresh();
+    const record = 8 + ((payload.length + 3) & ~3);
+    const write = this.writeCounter;
+    const used = (write - this.readCounter) >>> 0;
+    const position = write & (this.capacity - 1);
+    const untilEnd = this.capacity - position;
+    const padding = record > untilEnd ? untilEnd : 0;
+    if (used + padding + record > this.capacity) return false;
+
+    const data = RING_OFFSET + HEADER_SIZE;
+    let at = position;
+    if (padding > 0) {
+      this.view.setUint32(data + at, WRAP_MARKER, true);
+      at = 0;
+    }
+    this.view.setUint32(data + at, payload.length, true);
+    this.view.setUint32(data + at + 4, tag, true);
+    new Uint8Array(this.memory.buffer).set(payload, data + at + 8);
+
+    Atomics.store(this.header, 0, (write + padding + record) | 0);
+    if (notify) Atomics.notify(this.header, 0);
+    return true;
+  }
+
+  private refresh(): void {
+    if (this.view.buffer === this.memory.buffer) return;
+    this.header = new Int32Array(this.memory.buffer, RING_OFFSET, HEADER_SIZE / 4);
+    this.view = new DataView(this.memory.buffer);
+  }
+}
+
+function sharedMemory(): WebAssembly.Memory {
+  return new WebAssembly.Memory({ initial: 1, maximum: 4, shared: true });
+}
+
+function progressOf(message: FlatMessage): number {
+  if (message.kind !== FlatMessageKind.DocumentResponse) throw new Error('unexpected kind');
+  return message.progress;
+}
+
+describe('ResultRingReader', () => {
+  let reader: ResultRingReader | null = null;
+
+  afterEach(() => {
+    reader?.stop();
+    reader = null;
+  });
+
+  it('drains records in order and frees their space', () => {
+    const memory = sharedMemory();
+    const producer = new TestRingProducer(memory, 4096);
+    reader = new ResultRingReader(memory, RING_OFFSET);
+
+    for (let i = 0; i < 5; i++) {
+      expect(producer.publish(i, documentProgress(`doc-${i}`, i, i / 8))).toBe(true);
+    }
+
+    const received: Array<[number, FlatMessage]> = [];
+    expect(reader.drain((tag, message) => received.push([tag, message]))).toBe(5);
+    expect(received.map(([tag]) => tag)).toEqual([0, 1, 2, 3, 4]);
+    expect(received.map(([, message]) => progressOf(message))).toEqual([0, 0.125, 0.25, 0.375, 0.5]);
+    expect(producer.readCounter).toBe(producer.writeCounter);
+    expect(reader.drain(() => {})).toBe(0);
+  });
+
+  it('skips the wrap marker to the start of the data area', () => {
+    const memory = sharedMemory();
+    const capacity = 4096;
+    const producer = new TestRingProducer(memory, capacity);
+    reader = new ResultRingReader(memory, RING_OFFSET);
+
+    // Long document ids push the write position near the end of the area
+    const filler = documentProgress('x'.repeat(1200), 0, 0);
+    for (let i = 0; i < 3; i++) expect(producer.publish(1, filler)).toBe(true);
+    expect(reader.drain(() => {})).toBe(3);
+
+    const position = producer.writeCounter & (capacity - 1);
+    const wrapping = documentProgress('y'.repeat(capacity - position), 2, 0.75);
+    expect(producer.publish(7, wrapping)).toBe(true);
+
+    const received: FlatMessage[] = [];
+    expect(reader.drain((tag, message) => {
+      expect(tag).toBe(7);
+      received.push(message);
+    })).toBe(1);
+    expect(progressOf(received[0])).toBe(0.75);
+    expect(producer.readCounter).toBe(producer.writeCounter);
+    expect(producer.writeCounter & (capacity - 1)).toBe(8 + ((wrapping.length + 3) & ~3));
+  });
+
+  it('follows counters across the 2^32 wrap', () => {
+    const memory = sharedMemory();
+    const producer = new TestRingProducer(memory, 4096, 0xfffffff0);
+    reader = new ResultRingReader(memory, RING_OFFSET);
+
+    for (let i = 0; i < 4; i++) expect(producer.publish(i, documentProgress('d', i, 1))).toBe(true);
+    expect(producer.writeCounter).toBeLessThan(0xfffffff0);
+    expect(reader.drain(() => {})).toBe(4);
+    expect(producer.readCounter).toBe(producer.writeCounter);
+  });
+
+  it('rebuilds its views after memory growth', () => {
+    const memory = sharedMemory();
+    const producer = new TestRingProducer(memory, 4096);
+    reader = new ResultRingReader(memory, RING_OFFSET);
+    expect(reader.drain(() => {})).toBe(0);
+
+    memory.grow(1);
+    expect(producer.publish(3, documentProgress('after-grow', 1, 0.5))).toBe(true);
+    const tags: number[] = [];
+    expect(reader.drain((tag) => tags.push(tag))).toBe(1);
+    expect(tags).toEqual([3]);
+  });
+
+  it('wakes on the producer notify', async () => {
+    const memory = sharedMemory();
+    const producer = new TestRingProducer(memory, 4096);
+    reader = new ResultRingReader(memory, RING_OFFSET);
+
+    const received: number[] = [];
+    reader.start((tag) => received.push(tag));
+    await Promise.resolve();
+    expect(received).toEqual([]);
+
+    producer.publish(1, documentProgress('first', 1, 0.1));
+    await vi.waitFor(() => expect(received).toEqual([1]), { timeout: 1000 });
+    producer.publish(2, documentProgress('second', 1, 0.2));
+    await vi.waitFor(() => expect(received).toEqual([1, 2]), { timeout: 1000 });
+  });
+
+  it('does not sleep on a record published while it was draining', async () => {
+    const memory = sharedMemory();
+    const producer = new TestRingProducer(memory, 4096);
+    reader = new ResultRingReader(memory, RING_OFFSET);
+
+    // The second record lands after drain() sampled the write counter, and
+    // its notify fires before the reader waits again, so only the counter
+    // says that it is there
+    const received: number[] = [];
+    reader.start((tag) => {
+      received.push(tag);
+      if (tag === 1) producer.publish(2, documentProgress('raced', 1, 0.2), false);
+    });
+
+    producer.publish(1, documentProgress('first', 1, 0.1));
+    await vi.waitFor(() => expect(received).toEqual([1, 2]), { timeout: 1000 });
+  });
+});
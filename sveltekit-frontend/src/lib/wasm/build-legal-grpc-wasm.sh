@@ -16,19 +16,89 @@ OUTPUT_DIR="$SCRIPT_DIR/../../../static/wasm"
 EMSCRIPTEN_ROOT="${EMSCRIPTEN_ROOT:-$HOME/emsdk/upstream/emscripten}"
 export PATH="$EMSCRIPTEN_ROOT:$PATH"
 
+# Build profile. "dev" (default) is -O3 with debug info and source maps.
+# "release" optimizes for download and compile time: -Oz with LTO, no debug
+# info, protobuf-lite and a final wasm-opt pass. Each release step can be
+# turned off on its own (LEGAL_GRPC_LTO=0, LEGAL_GRPC_PROTO_LITE=0,
+# LEGAL_GRPC_WASM_OPT=0) to measure it; every build's sizes are appended to
+# $BUILD_DIR/size-history.tsv and compared with the last plain dev build.
+BUILD_PROFILE="${BUILD_PROFILE:-dev}"
+case "$BUILD_PROFILE" in
+    dev)     PROFILE_DEFAULT=0 ;;
+    release) PROFILE_DEFAULT=1 ;;
+    *)
+        echo "❌ Unknown BUILD_PROFILE '$BUILD_PROFILE' (expected dev or release)"
+        exit 1
+        ;;
+esac
+USE_LTO="${LEGAL_GRPC_LTO:-$PROFILE_DEFAULT}"
+USE_PROTO_LITE="${LEGAL_GRPC_PROTO_LITE:-$PROFILE_DEFAULT}"
+USE_WASM_OPT="${LEGAL_GRPC_WASM_OPT:-$PROFILE_DEFAULT}"
+BUILD_CONFIG="profile=$BUILD_PROFILE lto=$USE_LTO lite=$USE_PROTO_LITE wasm_opt=$USE_WASM_OPT"
+
 # Create build directories
 mkdir -p "$BUILD_DIR"
 mkdir -p "$OUTPUT_DIR"
 
 echo "📁 Build directory: $BUILD_DIR"
 echo "📁 Output directory: $OUTPUT_DIR"
+echo "🎛️  Build configuration: $BUILD_CONFIG"
+
+SIZE_HISTORY="$BUILD_DIR/size-history.tsv"
+
+file_size() {
+    wc -c < "$1" | tr -d ' '
+}
+
+# Record the module's raw and compressed sizes after a build stage and
+# compare them with the most recent dev build using the original flags
+report_size() {
+    local stage="$1"
+    local wasm="$OUTPUT_DIR/legal_grpc_client.wasm"
+    local js="$OUTPUT_DIR/legal_grpc_client.js"
+    local raw gzipped brotlied js_gzipped baseline
+    
+    raw=$(file_size "$wasm")
+    gzipped=$(gzip -9 -c "$wasm" | wc -c | tr -d ' ')
+    if command -v brotli > /dev/null; then
+        brotlied=$(brotli -q 11 -c "$wasm" | wc -c | tr -d ' ')
+    else
+        brotlied="-"
+    fi
+    js_gzipped=$(gzip -9 -c "$js" | wc -c | tr -d ' ')
+    
+    if [ ! -f "$SIZE_HISTORY" ]; then
+        printf 'date\tconfig\tstage\twasm_bytes\twasm_gzip\twasm_brotli\tjs_gzip\n' > "$SIZE_HISTORY"
+    fi
+    baseline=$(awk -F'\t' '$2 == "profile=dev lto=0 lite=0 wasm_opt=0" && $3 == "final" { size = $5 } END { print size }' "$SIZE_HISTORY")
+    printf '%s\t%s\t%s\t%s\t%s\t%s\t%s\n' "$(date -u +%Y-%m-%dT%H:%M:%SZ)" "$BUILD_CONFIG" "$stage" \
+        "$raw" "$gzipped" "$brotlied" "$js_gzipped" >> "$SIZE_HISTORY"
+    
+    echo "📏 $stage: wasm $raw bytes, $gzipped gzip, $brotlied brotli; js $js_gzipped gzip"
+    if [ -n "$baseline" ] && [ "$BUILD_CONFIG" != "profile=dev lto=0 lite=0 wasm_opt=0" ]; then
+        echo "   gzip size is $((gzipped * 100 / baseline))% of the dev build's $baseline bytes"
+    fi
+}
 
 # Generate protocol buffer files
 echo "⚙️  Generating protobuf files..."
-cd "$PROJECT_ROOT/proto"
+PROTO_SOURCE_DIR="$PROJECT_ROOT/proto"
+
+# The client uses neither reflection nor the JSON utilities, so its messages
+# can be generated for the lite runtime. The shared proto is left alone; the
+# native load driver needs the full runtime.
+if [ "$USE_PROTO_LITE" = "1" ]; then
+    PROTO_SOURCE_DIR="$BUILD_DIR/proto-lite"
+    mkdir -p "$PROTO_SOURCE_DIR"
+    awk '!/^option optimize_for/ { print } /^package / { print "option optimize_for = LITE_RUNTIME;" }' \
+        "$PROJECT_ROOT/proto/legal_cuda_streaming.proto" > "$PROTO_SOURCE_DIR/legal_cuda_streaming.proto"
+fi
+cd "$PROTO_SOURCE_DIR"
 
 # Generate C++ protobuf files
-protoc --cpp_out="$BUILD_DIR" \
+protoc --proto_path="$PROTO_SOURCE_DIR" \
+       --proto_path="$PROJECT_ROOT/proto" \
+       --cpp_out="$BUILD_DIR" \
        --grpc_out="$BUILD_DIR" \
        --plugin=protoc-gen-grpc=`which grpc_cpp_plugin` \
        legal_cuda_streaming.proto
@@ -37,6 +107,19 @@ echo "✅ Protobuf files generated"
 
 # Copy source files to build directory
 cp "$SCRIPT_DIR/legal_grpc_client.cpp" "$BUILD_DIR/"
+cp "$SCRIPT_DIR/legal_client_core.h" "$BUILD_DIR/"
+cp "$SCRIPT_DIR/legal_bulk_queue.h" "$BUILD_DIR/"
+cp "$SCRIPT_DIR/legal_client_metrics.h" "$BUILD_DIR/"
+cp "$SCRIPT_DIR/legal_embedding_cache.h" "$BUILD_DIR/"
+cp "$SCRIPT_DIR/legal_flat_message.h" "$BUILD_DIR/"
+cp "$SCRIPT_DIR/legal_request_arenas.h" "$BUILD_DIR/"
+cp "$SCRIPT_DIR/legal_session_map.h" "$BUILD_DIR/"
+cp "$SCRIPT_DIR/legal_simd_kernels.h" "$BUILD_DIR/"
+cp "$SCRIPT_DIR/legal_result_ring.h" "$BUILD_DIR/"
+cp "$SCRIPT_DIR/legal_vector_index.h" "$BUILD_DIR/"
+cp "$SCRIPT_DIR/legal_similarity_matrix.h" "$BUILD_DIR/"
+cp "$SCRIPT_DIR/legal_allocation_counter.h" "$BUILD_DIR/"
+cp "$SCRIPT_DIR/legal_bench_messages.h" "$BUILD_DIR/"
 
 # Emscripten compile settings
 EMCC_FLAGS=(
@@ -67,14 +150,13 @@ EMCC_FLAGS=(
     "-s" "USE_LIBCXX=1"
     "-s" "DISABLE_EXCEPTION_CATCHING=0"
     
-    # Optimization
-    "-O3"
+    # Optimization (level set by the build profile below)
     "-s" "ASSERTIONS=0"
     "-s" "SAFE_HEAP=0"
     
     # Export settings
     "-s" "EXPORTED_FUNCTIONS=['_main']"
-    "-s" "EXPORTED_RUNTIME_METHODS=['ccall','cwrap','getValue','setValue']"
+    "-s" "EXPORTED_RUNTIME_METHODS=['ccall','cwrap','getValue','setValue','wasmMemory']"
     "-s" "EXTRA_EXPORTED_RUNTIME_METHODS=['addOnInit','addOnExit']"
     
     # Module settings
@@ -93,11 +175,30 @@ EMCC_FLAGS=(
     # C++ standard
     "-std=c++17"
     
-    # Debug info (for development)
-    "-g"
-    "--source-map-base" "http://localhost:5173/"
+    # WebAssembly SIMD for the local scoring kernels (legal_simd_kernels.h)
+    "-msimd128"
 )
 
+if [ "$BUILD_PROFILE" = "release" ]; then
+    EMCC_FLAGS+=("-Oz")
+else
+    # Debug info (for development)
+    EMCC_FLAGS+=(
+        "-O3"
+        "-g"
+        "--source-map-base" "http://localhost:5173/"
+    )
+fi
+if [ "$USE_LTO" = "1" ]; then
+    EMCC_FLAGS+=("-flto")
+fi
+if [ "$USE_PROTO_LITE" = "1" ]; then
+    EMCC_FLAGS+=("-DGRPC_USE_PROTO_LITE=1")
+    PROTOBUF_LIB="-lprotobuf-lite"
+else
+    PROTOBUF_LIB="-lprotobuf"
+fi
+
 # gRPC-Web library paths (adjust based on your gRPC-Web installation)
 GRPC_WEB_ROOT="${GRPC_WEB_ROOT:-$HOME/grpc-web}"
 if [ -d "$GRPC_WEB_ROOT" ]; then
@@ -112,10 +213,17 @@ else
     EMCC_FLAGS+=(
         "-lgrpc++"
         "-lgrpc"
-        "-lprotobuf"
+        "$PROTOBUF_LIB"
     )
 fi
 
+# LEGAL_GRPC_BENCH=1 adds the benchmark entry points and allocation counting
+# used by /dev/legal-grpc-bench; leave it off for production builds
+if [ "${LEGAL_GRPC_BENCH:-0}" = "1" ]; then
+    echo "⏱️  Including benchmark entry points"
+    EMCC_FLAGS+=("-DLEGAL_GRPC_BENCH")
+fi
+
 echo "🔨 Compiling with Emscripten..."
 echo "Command: emcc ${EMCC_FLAGS[*]}"
 
@@ -126,6 +234,26 @@ emcc "${EMCC_FLAGS[@]}"
 
 if [ $? -eq 0 ]; then
     echo "✅ WebAssembly compilation successful!"
+    
+    # emcc already runs wasm-opt at -Oz; converging a second pass with the
+    # debug and producer sections stripped typically takes off a few percent more
+    if [ "$USE_WASM_OPT" = "1" ]; then
+        report_size "emcc"
+        WASM_OPT="${WASM_OPT:-$EMSCRIPTEN_ROOT/../bin/wasm-opt}"
+        if [ ! -x "$WASM_OPT" ]; then
+            WASM_OPT="$(command -v wasm-opt || true)"
+        fi
+        if [ -n "$WASM_OPT" ]; then
+            echo "🗜️  Running wasm-opt..."
+            "$WASM_OPT" -Oz --converge --strip-debug --strip-producers \
+                --enable-threads --enable-bulk-memory --enable-simd \
+                --enable-sign-ext --enable-mutable-globals --enable-nontrapping-float-to-int \
+                "$OUTPUT_DIR/legal_grpc_client.wasm" -o "$OUTPUT_DIR/legal_grpc_client.wasm"
+        else
+            echo "⚠️  wasm-opt not found; skipping the extra pass"
+        fi
+    fi
+    report_size "final"
     echo "📦 Generated files:"
     ls -la "$OUTPUT_DIR"/legal_grpc_client.*
     
@@ -135,40 +263,364 @@ if [ $? -eq 0 ]; then
 // TypeScript definitions for Legal gRPC WebAssembly client
 
 export interface LegalGrpcClient {
-  new(endpoint: string): LegalGrpcClient;
+  new(endpoint: string, options?: ClientOptions): LegalGrpcClient;
   
   setResponseCallback(callback: (response: string) => void): void;
   setErrorCallback(callback: (error: string) => void): void;
   setCompletionCallback(callback: () => void): void;
+  // When enabled, callbacks receive a Uint8Array for decodeFlatMessage
+  // (legal-grpc-decoder.ts) instead of JSON; it is valid only during the call
+  setBinaryDelivery(enabled: boolean): void;
+  // The Float32Array is a view over WASM memory, valid only during the call
+  setEmbeddingCallback(callback: (sessionId: string, embedding: Float32Array) => void): void;
+  // Fires when a session that refused a send for backpressure has drained
+  setDrainCallback(callback: (sessionId: string) => void): void;
+  
+  acquireEmbeddingBuffer(dims: number): Float32Array;
+  releaseEmbeddingBuffer(buffer: Float32Array): boolean;
   
   startBidirectionalStream(sessionId: string): string;
-  sendEmbeddingRequest(sessionId: string, text: string, isFinal?: boolean): boolean;
+  // Dropped sessions reconnect with backoff and replay unacknowledged
+  // requests; the error/completion callbacks fire only once they give up
+  setReconnectPolicy(policy: ReconnectPolicy): void;
+  setReconnectCallback(callback: (sessionId: string, attempt: number, delayMs: number) => void): void;
+  getStreamReplayState(sessionId: string): StreamReplayState | null;
+  // Applies to calls and sessions started afterwards; per-call overrides
+  // go in StreamCallOptions.compression
+  setCompressionPolicy(policy: CompressionPolicy): void;
+  // Worker-hosted mode: results go to a shared-memory ring read by
+  // legal-grpc-result-ring.ts instead of callbacks; a result over half the
+  // capacity still goes to its callback (the response callback for stream
+  // results) as a flat message
+  attachResultRing(capacityBytes: number): { offset: number; capacity: number };
+  // Presets are applied by name; "default" is used when options are omitted
+  setCudaPreset(name: string, options: CudaCallOptions): void;
+  setProcessingPreset(name: string, options: ProcessingOptions): void;
+  
+  sendEmbeddingRequest(sessionId: string, text: string, isFinal?: boolean,
+                       options?: string | CudaCallOptions): boolean;
+  sendEmbeddingBatch(sessionId: string, texts: string[], isFinal?: boolean,
+                     options?: string | CudaCallOptions): boolean;
+  // Buffer single sends for up to maxItems texts or maxDelayUs microseconds
+  setEmbeddingCoalescing(sessionId: string, maxItems: number, maxDelayUs: number): boolean;
+  // Sends return false while bufferedAmount is at the mark (0 = unbounded)
+  setStreamHighWaterMark(sessionId: string, highWaterMarkBytes: number): boolean;
+  getBufferedAmount(sessionId: string): number;
+  isWriteBlocked(sessionId: string): boolean;
+  
+  // LRU of text hash -> embedding checked before each embed request (0 disables)
+  setEmbeddingCacheCapacity(maxEntries: number): void;
+  getEmbeddingCacheStats(): { hits: number; misses: number; size: number; capacity: number };
+  clearEmbeddingCache(): void;
+  exportEmbeddingCache(): Uint8Array;
+  importEmbeddingCache(snapshot: Uint8Array): number;
+  // Session embeddings indexed in WASM: exhaustive below hnswThreshold
+  // vectors, HNSW above (capacity 0 disables)
+  setLocalIndexOptions(options: LocalIndexOptions): void;
+  searchLocal(vector: Float32Array | number[], k: number): LocalSearchHit[];
+  getLocalIndexStats(): LocalIndexStats;
+  clearLocalIndex(): void;
   sendSearchRequest(sessionId: string, embedding: number[], isFinal?: boolean): boolean;
+  sendSearchRequestView(sessionId: string, embedding: Float32Array, isFinal?: boolean): boolean;
   
+  // Streaming calls return a handle for cancelCall. With callOptions.batch
+  // the callback receives arrays of messages instead of one at a time.
   processLegalDocument(
     documentId: string,
     content: string,
     type: string,
-    progressCallback: (response: DocumentProgress) => void
-  ): void;
+    progressCallback: (response: DocumentProgress) => void,
+    options?: string | ProcessingOptions,  // e.g. 'embeddings_only'
+    callOptions?: StreamCallOptions
+  ): number;
+  processLegalDocument(
+    documentId: string,
+    content: string,
+    type: string,
+    progressCallback: (responses: DocumentProgress[]) => void,
+    options: string | ProcessingOptions,
+    callOptions: BatchedCallOptions
+  ): number;
+  
+  // Chunked upload over StreamLegalDocument; progress arrives as for
+  // processLegalDocument. sendDocumentChunk returns false while backed up
+  // (isWriteBlocked) until the drain callback fires for documentId.
+  setDocumentChunkSize(bytes: number): void;
+  startDocumentUpload(
+    documentId: string,
+    type: string,
+    progressCallback: (response: DocumentProgress) => void,
+    options?: string | ProcessingOptions
+  ): boolean;
+  sendDocumentChunk(documentId: string, chunk: string | Uint8Array): boolean;
+  finishDocumentUpload(documentId: string): boolean;
+  cancelDocumentUpload(documentId: string): boolean;
   
+  // Compact encoding requested for returned embeddings. Servers without
+  // support keep sending float32; search queries switch once the server has
+  // answered in the compact form. Callbacks always receive float32.
+  setEmbeddingEncoding(encoding: EmbeddingEncoding): boolean;
+  getEmbeddingEncoding(): EmbeddingEncoding;
+  
+  // Identical concurrent searches share one server stream; completed results
+  // are also reused for ttlMs (0, the default, disables the result cache)
+  setSearchCacheTtl(ttlMs: number): void;
   performSemanticSearch(
     query: string,
     collection: string,
     topK: number,
-    resultsCallback: (results: SearchResults) => void
-  ): void;
+    resultsCallback: (results: SearchResults) => void,
+    callOptions?: StreamCallOptions
+  ): number;
+  performSemanticSearch(
+    query: string,
+    collection: string,
+    topK: number,
+    resultsCallback: (results: SearchResults[]) => void,
+    callOptions: BatchedCallOptions
+  ): number;
   
   analyzeCaseSimilarity(
     baseCaseId: string,
     compareCaseIds: string[],
-    similarityCallback: (similarity: CaseSimilarity) => void
-  ): void;
+    similarityCallback: (similarity: CaseSimilarity) => void,
+    callOptions?: StreamCallOptions
+  ): number;
+  analyzeCaseSimilarity(
+    baseCaseId: string,
+    compareCaseIds: string[],
+    similarityCallback: (similarities: CaseSimilarity[]) => void,
+    callOptions: BatchedCallOptions
+  ): number;
+  
+  // N x N similarity: fetches the embeddings of cases not yet in the matrix
+  // in one call and computes the matrix locally. Returns 0 without calling
+  // back when nothing needs fetching.
+  buildSimilarityMatrix(
+    caseIds: string[],
+    similarityCallback: (similarity: CaseSimilarity) => void,
+    callOptions?: StreamCallOptions
+  ): number;
+  buildSimilarityMatrix(
+    caseIds: string[],
+    similarityCallback: (similarities: CaseSimilarity[]) => void,
+    callOptions: BatchedCallOptions
+  ): number;
+  addCaseEmbedding(caseId: string, embedding: Float32Array | number[]): boolean;
+  removeCaseFromMatrix(caseId: string): boolean;
+  getSimilarityMatrix(): SimilarityMatrix;
+  getNearestCases(caseId: string, k: number): CaseNeighbor[];
+  getSimilarityMatrixStats(): SimilarityMatrixStats;
+  clearSimilarityMatrix(): void;
+  
+  // Cancel a streaming call; shared searches stay open for other callers
+  cancelCall(handle: number): boolean;
+  setDefaultDeadline(deadlineMs: number): void;
+  
+  // Local SIMD re-scoring; matches cosine_similarity_kernel on the server
+  rerankLastSearch(
+    query: Float32Array,
+    k: number,
+    metadataFilter?: Record<string, string>
+  ): Array<{ document_id: string; score: number; server_score: number }>;
+  scoreTopK(query: Float32Array, candidates: Float32Array, k: number): Array<{ index: number; score: number }>;
   
   closeStream(sessionId: string): boolean;
+  
+  // Client-measured timings, to separate network, server and WASM-side cost
+  getMetrics(): ClientMetrics;
+  resetMetrics(): void;
+  
+  // Start TCP/TLS/HTTP2 setup on every pooled channel ahead of the first call
+  warmUp(): void;
+  getChannelStats(): Array<{ state: string; interactive: number; bulk: number }>;
+  // Background calls queue behind interactive ones; see BulkQueueOptions
+  setBulkQueueOptions(options: BulkQueueOptions): void;
+  getBulkQueueStats(): BulkQueueStats;
   isConnected(): boolean;
 }
 
+// Present only in LEGAL_GRPC_BENCH=1 builds (legal-grpc-bench.ts)
+export interface LegalGrpcBenchExports {
+  benchFlatMessage(kind: 'cuda' | 'search', size: number): Uint8Array;
+  benchDispatch(
+    kind: 'cuda' | 'search',
+    binary: boolean,
+    size: number,
+    messages: number,
+    batch: number,
+    callback: (message: any) => void
+  ): BenchDispatchResult;
+  benchAllocations(): { count: number; bytes: number };
+}
+
+export interface BenchDispatchResult {
+  messages: number;
+  nsPerMessage: number;
+  bytesPerMessage: number;
+  allocationsPerMessage: number;
+  metrics: RpcMetrics;
+}
+
+export interface LatencySummary {
+  count: number;
+  min?: number;
+  max?: number;
+  mean?: number;
+  p50?: number;
+  p90?: number;
+  p99?: number;
+  p999?: number;
+}
+
+export interface RpcMetrics {
+  time_to_first_message_us: LatencySummary;
+  inter_message_gap_us: LatencySummary;
+  serialization_us: LatencySummary;
+  dispatch_us: LatencySummary;
+}
+
+export interface ClientMetrics {
+  stream: RpcMetrics;
+  document: RpcMetrics;
+  search: RpcMetrics;
+  similarity: RpcMetrics;
+}
+
+export interface ClientOptions {
+  // Document processing and uploads stay off channel 0 when channels > 1
+  channels?: number;
+  preconnect?: boolean;
+  policy?: 'least_loaded' | 'round_robin';
+  // Default for calls whose policy is 'default' (default 'none')
+  compression?: 'none' | 'gzip' | 'deflate';
+}
+
+// 'default' uses the channel's compression; deflate needs server support
+export type Compression = 'default' | 'none' | 'gzip' | 'deflate';
+
+export interface CompressionPolicy {
+  documents?: Compression;   // default 'gzip': processLegalDocument and uploads
+  stream?: Compression;      // default 'default': bidirectional sessions
+  search?: Compression;      // default 'default'
+  similarity?: Compression;  // default 'default'
+  // Smaller messages, and stream requests carrying query vectors, are
+  // always sent uncompressed (default 1024)
+  minMessageBytes?: number;
+}
+
+export interface ReconnectPolicy {
+  maxAttempts?: number;        // default 6; 0 disables reconnects
+  initialBackoffMs?: number;   // default 250, doubled per attempt
+  maxBackoffMs?: number;       // default 10000
+  // Default 8 MiB; 0 reconnects without replay. Used only once the server
+  // has acknowledged a request (ack_sequence)
+  replayBufferBytes?: number;
+}
+
+export interface StreamReplayState {
+  nextSequence: number;
+  lastAcked: number;
+  unacked: number;
+  unackedBytes: number;
+  replayDropped: number;  // requests given up because the buffer was full
+  reconnectAttempts: number;
+  reconnecting: boolean;
+}
+
+export interface LocalIndexOptions {
+  capacity?: number;        // vectors kept, oldest dropped first; 0 disables
+  hnswThreshold?: number;   // default 4096
+  maxLinks?: number;        // HNSW M, default 16
+  efConstruction?: number;  // default 100
+  efSearch?: number;        // default 64
+}
+
+export interface LocalSearchHit {
+  text: string;
+  sessionId: string;
+  score: number;
+}
+
+export interface LocalIndexStats {
+  size: number;
+  dims: number;
+  capacity: number;
+  levels: number;
+  inserts: number;
+  searches: number;
+}
+
+export interface SimilarityMatrix {
+  caseIds: string[];
+  similarities: Float32Array;  // caseIds.length squared, row-major
+}
+
+export interface CaseNeighbor {
+  caseId: string;
+  similarity: number;
+}
+
+export interface SimilarityMatrixStats {
+  size: number;
+  dims: number;
+  rowsComputed: number;
+}
+
+export type EmbeddingEncoding = 'float32' | 'fp16' | 'int8';
+
+export interface StreamCallOptions {
+  deadlineMs?: number;
+  // Starting a call cancels the previous call in the same group (type-ahead)
+  latestWins?: string;
+  // Buffer messages and deliver them as one array per animation frame
+  // ('frame', at most batchMax per array if set) or every N messages;
+  // anything left is flushed when the call completes
+  batch?: 'frame' | number;
+  batchMax?: number;
+  // Overrides the compression policy for this call
+  compression?: Compression;
+  // Sent to the server as x-request-priority. Background calls wait in the
+  // bulk queue; the default is 'background' for processLegalDocument and
+  // 'interactive' otherwise
+  priority?: 'interactive' | 'background';
+}
+
+// Background calls (including uploads) start at most maxConcurrent at a
+// time and startsPerSecond, and only once no interactive call has been in
+// flight for yieldMs, unless they have already waited maxYieldMs
+export interface BulkQueueOptions {
+  maxConcurrent?: number;    // default 2
+  startsPerSecond?: number;  // default 10; 0 is unlimited
+  yieldMs?: number;          // default 100
+  maxYieldMs?: number;       // default 5000
+}
+
+export interface BulkQueueStats {
+  queued: number;
+  running: number;
+  interactive: number;  // interactive calls in flight
+  started: number;
+  yielded: number;      // background calls held back for interactive ones
+  waitUs: LatencySummary;
+}
+
+export type BatchedCallOptions = StreamCallOptions & { batch: 'frame' | number };
+
+export interface CudaCallOptions {
+  useTensorCores?: boolean;
+  batchSize?: number;  // 0 or omitted: number of texts in the request
+  enableMemoryPool?: boolean;
+}
+
+export interface ProcessingOptions {
+  extractEntities?: boolean;
+  generateSummary?: boolean;
+  computeEmbeddings?: boolean;
+  analyzeSentiment?: boolean;
+  detectClauses?: boolean;  // omitted: only for contracts
+}
+
 export interface DocumentProgress {
   document_id: string;
   stage: ProcessingStage;
@@ -221,11 +673,22 @@ export enum ProcessingStage {
   FINALIZATION = 5
 }
 
+// Emscripten Module overrides accepted by the factory (legal-grpc-loader.ts)
+export interface LegalGrpcModuleOverrides {
+  instantiateWasm?(
+    imports: WebAssembly.Imports,
+    receiveInstance: (instance: WebAssembly.Instance, module: WebAssembly.Module) => void
+  ): WebAssembly.Exports | {};
+  locateFile?(path: string, prefix: string): string;
+  mainScriptUrlOrBlob?: string | Blob;
+}
+
 declare global {
   interface Window {
-    LegalGrpcModule: () => Promise<{
-      LegalGrpcWebClient: new (endpoint: string) => LegalGrpcClient;
-    }>;
+    LegalGrpcModule: (overrides?: LegalGrpcModuleOverrides) => Promise<{
+      LegalGrpcWebClient: new (endpoint: string, options?: ClientOptions) => LegalGrpcClient;
+      VectorFloat: new () => { push_back(value: number): void; size(): number; delete(): void };
+    } & Partial<LegalGrpcBenchExports>>;
   }
 }
 
@@ -238,37 +701,41 @@ EOF
     echo "🔧 Creating integration helper..."
     cat > "$SCRIPT_DIR/../services/legal-cuda-grpc-client.ts" << 'EOF'
 // Integration helper for Legal CUDA gRPC WebAssembly client
-import type { LegalGrpcClient, CudaResponse, DocumentProgress, SearchResults } from '../wasm/legal_grpc_client';
+import type { LegalGrpcClient, CudaResponse, DocumentProgress, SearchResults, StreamCallOptions } from '../wasm/legal_grpc_client';
+import { loadLegalGrpcModule, prefetchLegalGrpcModule } from '../wasm/legal-grpc-loader';
 
 export class LegalCudaGrpcService {
     private client: LegalGrpcClient | null = null;
-    private moduleReady: Promise<void>;
+    private moduleReady: Promise<void> | null = null;
+    private drainWaiters = new Map<string, Array<() => void>>();
     
-    constructor(private endpoint: string = 'http://localhost:50052') {
-        this.moduleReady = this.initializeModule();
+    // The WebAssembly module is not loaded until the first call
+    constructor(private endpoint: string = 'http://localhost:50052') {}
+    
+    // Start downloading and compiling the module ahead of the first call
+    prefetch(): void {
+        prefetchLegalGrpcModule();
+    }
+    
+    private ready(): Promise<void> {
+        this.moduleReady ??= this.initializeModule().catch((error) => {
+            this.moduleReady = null;
+            throw error;
+        });
+        return this.moduleReady;
     }
     
     private async initializeModule(): Promise<void> {
-        if (typeof window === 'undefined') {
-            throw new Error('Legal CUDA gRPC client only works in browser environment');
-        }
-        
-        // Load WebAssembly module
-        const script = document.createElement('script');
-        script.src = '/wasm/legal_grpc_client.js';
-        document.head.appendChild(script);
-        
-        return new Promise((resolve, reject) => {
-            script.onload = async () => {
-                try {
-                    const module = await window.LegalGrpcModule();
-                    this.client = new module.LegalGrpcWebClient(this.endpoint);
-                    resolve();
-                } catch (error) {
-                    reject(error);
-                }
-            };
-            script.onerror = reject;
+        const module = await loadLegalGrpcModule();
+        // A second channel keeps document streams off the search connection
+        this.client = new module.LegalGrpcWebClient(this.endpoint, {
+            channels: 2,
+            preconnect: true
+        });
+        this.client.setDrainCallback((sessionId: string) => {
+            const waiters = this.drainWaiters.get(sessionId) ?? [];
+            this.drainWaiters.delete(sessionId);
+            waiters.forEach((wake) => wake());
         });
     }
     
@@ -278,7 +745,7 @@ export class LegalCudaGrpcService {
         onError: (error: string) => void,
         onComplete: () => void
     ): Promise<string> {
-        await this.moduleReady;
+        await this.ready();
         if (!this.client) throw new Error('Client not initialized');
         
         this.client.setResponseCallback(onResponse);
@@ -289,56 +756,153 @@ export class LegalCudaGrpcService {
     }
     
     async sendTextForEmbedding(sessionId: string, text: string, isFinal = false): Promise<boolean> {
-        await this.moduleReady;
+        await this.ready();
         if (!this.client) throw new Error('Client not initialized');
         
         return this.client.sendEmbeddingRequest(sessionId, text, isFinal);
     }
     
+    // Send that waits out backpressure instead of failing; resolves false only
+    // once the stream is closed. Pair with setStreamHighWaterMark.
+    async sendTextForEmbeddingPaced(sessionId: string, text: string, isFinal = false): Promise<boolean> {
+        await this.ready();
+        if (!this.client) throw new Error('Client not initialized');
+        
+        while (!this.client.sendEmbeddingRequest(sessionId, text, isFinal)) {
+            if (!this.client.isWriteBlocked(sessionId)) return false;
+            await this.waitForDrain(sessionId);
+        }
+        return true;
+    }
+    
+    private waitForDrain(id: string): Promise<void> {
+        return new Promise<void>((resolve) => {
+            const waiters = this.drainWaiters.get(id) ?? [];
+            waiters.push(resolve);
+            this.drainWaiters.set(id, waiters);
+        });
+    }
+    
+    async setHighWaterMark(sessionId: string, bytes: number): Promise<boolean> {
+        await this.ready();
+        if (!this.client) throw new Error('Client not initialized');
+        
+        return this.client.setStreamHighWaterMark(sessionId, bytes);
+    }
+    
     async processDocument(
         documentId: string,
         content: string,
         type: string,
         onProgress: (progress: DocumentProgress) => void
-    ): Promise<void> {
-        await this.moduleReady;
+    ): Promise<number> {
+        await this.ready();
         if (!this.client) throw new Error('Client not initialized');
         
         return this.client.processLegalDocument(documentId, content, type, onProgress);
     }
     
+    // Stream a Blob or ReadableStream to the server in chunks, paced by the
+    // upload's backpressure, without ever holding the whole text in memory
+    async uploadDocument(
+        documentId: string,
+        source: Blob | ReadableStream<Uint8Array>,
+        type: string,
+        onProgress: (progress: DocumentProgress) => void
+    ): Promise<void> {
+        await this.ready();
+        if (!this.client) throw new Error('Client not initialized');
+        
+        if (!this.client.startDocumentUpload(documentId, type, onProgress)) {
+            throw new Error(`Upload already in progress for ${documentId}`);
+        }
+        
+        const reader = (source instanceof Blob ? source.stream() : source).getReader();
+        try {
+            for (;;) {
+                const { done, value } = await reader.read();
+                if (done) break;
+                
+                while (!this.client.sendDocumentChunk(documentId, value)) {
+                    if (!this.client.isWriteBlocked(documentId)) {
+                        throw new Error(`Upload of ${documentId} was closed`);
+                    }
+                    await this.waitForDrain(documentId);
+                }
+            }
+            this.client.finishDocumentUpload(documentId);
+        } catch (error) {
+            this.client.cancelDocumentUpload(documentId);
+            await reader.cancel();
+            throw error;
+        } finally {
+            reader.releaseLock();
+        }
+    }
+    
     async searchSemantic(
         query: string,
         collection: string,
         topK: number,
-        onResults: (results: SearchResults) => void
-    ): Promise<void> {
-        await this.moduleReady;
+        onResults: (results: SearchResults) => void,
+        callOptions?: StreamCallOptions
+    ): Promise<number> {
+        await this.ready();
         if (!this.client) throw new Error('Client not initialized');
         
-        return this.client.performSemanticSearch(query, collection, topK, onResults);
+        return this.client.performSemanticSearch(query, collection, topK, onResults, callOptions);
+    }
+    
+    // Type-ahead search: each call supersedes and cancels the previous one
+    async searchAsYouType(
+        query: string,
+        collection: string,
+        topK: number,
+        onResults: (results: SearchResults) => void
+    ): Promise<number> {
+        return this.searchSemantic(query, collection, topK, onResults, { latestWins: 'typeahead' });
+    }
+    
+    async cancel(handle: number): Promise<boolean> {
+        await this.ready();
+        if (!this.client) return false;
+        
+        return this.client.cancelCall(handle);
     }
     
     async analyzeCases(
         baseCaseId: string,
         compareCaseIds: string[],
         onSimilarity: (similarity: any) => void
-    ): Promise<void> {
-        await this.moduleReady;
+    ): Promise<number> {
+        await this.ready();
         if (!this.client) throw new Error('Client not initialized');
         
         return this.client.analyzeCaseSimilarity(baseCaseId, compareCaseIds, onSimilarity);
     }
     
+    // Large comparisons stream faster than the UI can repaint, so results
+    // arrive as one array per animation frame
+    async analyzeCasesPerFrame(
+        baseCaseId: string,
+        compareCaseIds: string[],
+        onSimilarities: (similarities: any[]) => void
+    ): Promise<number> {
+        await this.ready();
+        if (!this.client) throw new Error('Client not initialized');
+        
+        return this.client.analyzeCaseSimilarity(baseCaseId, compareCaseIds, onSimilarities, { batch: 'frame' });
+    }
+    
     async closeStream(sessionId: string): Promise<boolean> {
-        await this.moduleReady;
+        await this.ready();
         if (!this.client) throw new Error('Client not initialized');
         
         return this.client.closeStream(sessionId);
     }
     
+    // False until a call has loaded the module; does not load it itself
     async isConnected(): Promise<boolean> {
-        await this.moduleReady;
         if (!this.client) return false;
         
         return this.client.isConnected();
@@ -365,7 +929,8 @@ EOF
     onMount(async () => {
         try {
             cudaService = new LegalCudaGrpcService('http://localhost:50052');
-            isConnected = await cudaService.isConnected();
+            // Download and compile in the background; instantiated on first use
+            cudaService.prefetch();
         } catch (error) {
             console.error('Failed to initialize CUDA gRPC service:', error);
         }
@@ -393,6 +958,7 @@ EOF
                     processing = false;
                 }
             );
+            isConnected = await cudaService.isConnected();
         } catch (error) {
             console.error('Failed to start embedding stream:', error);
             processing = false;
@@ -442,11 +1008,11 @@ EOF
     </div>
     
     <div class="controls">
-        <button on:click={startEmbeddingSession} disabled={!isConnected || processing}>
+        <button on:click={startEmbeddingSession} disabled={processing}>
             {processing ? '⏳ Processing...' : '🚀 Start Embedding Session'}
         </button>
         
-        <button on:click={performSearch} disabled={!isConnected}>
+        <button on:click={performSearch}>
             🔍 Test Semantic Search
         </button>
     </div>
@@ -0,0 +1,191 @@
+/**
+ * Browser microbenchmarks for the WASM client's marshalling paths, run from
+ * /dev/legal-grpc-bench against a build made with LEGAL_GRPC_BENCH=1
+ * (native equivalents: native/legal_client_benchmarks.cpp). Covers what only
+ * exists in the browser: embind vector conversion for search queries, flat
+ * message decoding, and delivery of synthetic responses through the real
+ * ResponseFanout to a JS callback as JSON or flat binary, per message and
+ * batched. Times are wall clock per message; bytes and allocations are those
+ * of the WASM heap (operator new), as JS heap usage is not observable per call.
+ */
+
+import { decodeFlatMessage } from './legal-grpc-decoder';
+import { loadLegalGrpcModule, type LegalGrpcModuleInstance } from './legal-grpc-loader';
+import type { LegalGrpcBenchExports, LegalGrpcClient } from './legal_grpc_client';
+
+export interface BenchResult {
+  name: string;
+  messages: number;
+  nsPerMessage: number;
+  wasmBytesPerMessage?: number;
+  wasmAllocationsPerMessage?: number;
+}
+
+export interface BenchOptions {
+  vectorDims?: number[];     // default 384, 768, 1024
+  searchHits?: number[];     // default 10, 100, 1000
+  onResult?: (result: BenchResult) => void;
+}
+
+// Sends to a session that does not exist convert their arguments and return
+// false without touching the network
+const NO_SESSION = 'bench-no-session';
+
+function hasBenchExports(module: LegalGrpcModuleInstance): module is LegalGrpcModuleInstance & LegalGrpcBenchExports {
+  return typeof module.benchDispatch === 'function';
+}
+
+function randomVector(dims: number): Float32Array {
+  const vector = new Float32Array(dims);
+  for (let i = 0; i < dims; i++) vector[i] = Math.random() * 2 - 1;
+  return vector;
+}
+
+export class LegalGrpcBench {
+  private constructor(
+    private module: LegalGrpcModuleInstance & LegalGrpcBenchExports,
+    private client: LegalGrpcClient,
+    private minTimeMs: number
+  ) {}
+
+  static async create(minTimeMs = 200): Promise<LegalGrpcBench> {
+    const module = await loadLegalGrpcModule();
+    if (!hasBenchExports(module)) {
+      throw new Error('legal_grpc_client.wasm was built without LEGAL_GRPC_BENCH=1');
+    }
+    // Nothing is sent, so the endpoint is never contacted
+    const client = new module.LegalGrpcWebClient('http://localhost:50052', { channels: 1 });
+    return new LegalGrpcBench(module, client, minTimeMs);
+  }
+
+  async runAll(options: BenchOptions = {}): Promise<BenchResult[]> {
+    const dims = options.vectorDims ?? [384, 768, 1024];
+    const hits = options.searchHits ?? [10, 100, 1000];
+    const suites: Array<() => BenchResult> = [];
+
+    for (const d of dims) {
+      suites.push(() => this.vectorFloat(d), () => this.float32Copy(d), () => this.heapView(d));
+      suites.push(() => this.decode('cuda', d));
+      for (const binary of [false, true]) {
+        suites.push(() => this.dispatch('cuda', binary, d, 0));
+      }
+    }
+    for (const h of hits) {
+      suites.push(() => this.decode('search', h));
+      for (const binary of [false, true]) {
+        suites.push(() => this.dispatch('search', binary, h, 0), () => this.dispatch('search', binary, h, 32));
+      }
+    }
+
+    const results: BenchResult[] = [];
+    for (const suite of suites) {
+      const result = suite();
+      results.push(result);
+      options.onResult?.(result);
+      // Let the page repaint between benchmarks
+      await new Promise((resolve) => setTimeout(resolve, 0));
+    }
+    return results;
+  }
+
+  // sendSearchRequest: the query is built into a VectorFloat element by element
+  vectorFloat(dims: number): BenchResult {
+    const source = randomVector(dims);
+    return this.measure(`search query VectorFloat ${dims}d`, () => {
+      const vector = new this.module.VectorFloat();
+      for (let i = 0; i < dims; i++) vector.push_back(source[i]);
+      this.client.sendSearchRequest(NO_SESSION, vector as unknown as number[]);
+      vector.delete();
+    });
+  }
+
+  // sendSearchRequestView with a Float32Array outside the heap: one copy in
+  float32Copy(dims: number): BenchResult {
+    const source = randomVector(dims);
+    return this.measure(`search query Float32Array copy ${dims}d`, () => {
+      this.client.sendSearchRequestView(NO_SESSION, source);
+    });
+  }
+
+  // sendSearchRequestView with an acquireEmbeddingBuffer view: read in place
+  heapView(dims: number): BenchResult {
+    const source = randomVector(dims);
+    const buffer = this.client.acquireEmbeddingBuffer(dims);
+    try {
+      return this.measure(`search query heap view ${dims}d`, () => {
+        buffer.set(source);
+        this.client.sendSearchRequestView(NO_SESSION, buffer);
+      });
+    } finally {
+      this.client.releaseEmbeddingBuffer(buffer);
+    }
+  }
+
+  decode(kind: 'cuda' | 'search', size: number): BenchResult {
+    const bytes = this.module.benchFlatMessage(kind, size);
+    return this.measure(`decodeFlatMessage ${label(kind, size)}`, () => {
+      decodeFlatMessage(bytes);
+    });
+  }
+
+  // ResponseFanout delivery to a callback that touches each message the way
+  // a consumer would: JSON callbacks get parsed objects, binary ones decode
+  dispatch(kind: 'cuda' | 'search', binary: boolean, size: number, batch: number): BenchResult {
+    let received = 0;
+    const consume = (message: any) => {
+      if (binary) decodeFlatMessage(message);
+      received++;
+    };
+    // Batches arrive as arrays of parsed objects or of flat message views
+    const callback = batch > 0 ? (messages: any[]) => messages.forEach(consume) : consume;
+
+    const name = `dispatch ${binary ? 'binary' : 'json'} ${label(kind, size)}${batch > 0 ? ` batch ${batch}` : ''}`;
+
+    // Size the run so it takes roughly minTimeMs
+    const probe = this.module.benchDispatch(kind, binary, size, 16, batch, callback);
+    const messages = Math.max(16, Math.round((this.minTimeMs * 1e6) / Math.max(probe.nsPerMessage, 1)));
+    received = 0;
+
+    const start = performance.now();
+    const run = this.module.benchDispatch(kind, binary, size, messages, batch, callback);
+    const elapsedMs = performance.now() - start;
+    if (received !== messages) {
+      throw new Error(`${name}: delivered ${received} of ${messages} messages`);
+    }
+
+    return {
+      name,
+      messages,
+      nsPerMessage: (elapsedMs * 1e6) / messages,
+      wasmBytesPerMessage: run.bytesPerMessage,
+      wasmAllocationsPerMessage: run.allocationsPerMessage
+    };
+  }
+
+  // Repeats body in doubling rounds until one round takes minTimeMs
+  private measure(name: string, body: () => void): BenchResult {
+    for (let i = 0; i < 64; i++) body();  // warm up
+    let iterations = 64;
+    for (;;) {
+      const before = this.module.benchAllocations();
+      const start = performance.now();
+      for (let i = 0; i < iterations; i++) body();
+      const elapsedMs = performance.now() - start;
+      if (elapsedMs >= this.minTimeMs || iterations >= 1 << 24) {
+        const after = this.module.benchAllocations();
+        return {
+          name,
+          messages: iterations,
+          nsPerMessage: (elapsedMs * 1e6) / iterations,
+          wasmBytesPerMessage: (after.bytes - before.bytes) / iterations,
+          wasmAllocationsPerMessage: (after.count - before.count) / iterations
+        };
+      }
+      iterations *= 2;
+    }
+  }
+}
+
+function label(kind: 'cuda' | 'search', size: number): string {
+  return kind === 'cuda' ? `embed ${size}d` : `search ${size} hits`;
+}
@@ -0,0 +1,238 @@
+/**
+ * Decoder for the flat binary delivery format of the Legal gRPC WebAssembly client
+ * Mirrors FlatMessageWriter and the *ResponseToFlat helpers in legal_grpc_client.cpp
+ */
+
+export enum FlatMessageKind {
+  CudaResponse = 1,
+  DocumentResponse = 2,
+  SearchResponse = 3,
+  SimilarityResponse = 4,
+  EmbeddingCacheSnapshot = 5,
+  CallComplete = 6
+}
+
+export interface FlatCudaResponse {
+  kind: FlatMessageKind.CudaResponse;
+  session_id: string;
+  operation_type: string;
+  status: number;
+  embeddings: Float32Array;
+  performance?: {
+    processing_time_us: number;
+    gpu_utilization: number;
+    gpu_model: string;
+  };
+}
+
+export interface FlatDocumentResponse {
+  kind: FlatMessageKind.DocumentResponse;
+  document_id: string;
+  stage: number;
+  progress: number;
+}
+
+export interface FlatSearchMatch {
+  document_id: string;
+  similarity_score: number;
+  title: string;
+  snippet: string;
+  metadata: Record<string, string>;
+}
+
+export interface FlatSearchResponse {
+  kind: FlatMessageKind.SearchResponse;
+  query_id: string;
+  total_matches: number;
+  is_complete: boolean;
+  scores: Float32Array;
+  matches: FlatSearchMatch[];
+}
+
+export interface FlatCaseSimilarity {
+  case_id: string;
+  similarity: number;
+  metrics: Record<string, number>;
+}
+
+export interface FlatSimilarityResponse {
+  kind: FlatMessageKind.SimilarityResponse;
+  base_case_id: string;
+  scores: Float32Array;
+  similarities: FlatCaseSimilarity[];
+}
+
+/** Last record of a streaming call in the result ring (legal-grpc-result-ring.ts) */
+export interface FlatCallComplete {
+  kind: FlatMessageKind.CallComplete;
+  ok: boolean;
+}
+
+export type FlatMessage =
+  | FlatCudaResponse
+  | FlatDocumentResponse
+  | FlatSearchResponse
+  | FlatSimilarityResponse
+  | FlatCallComplete;
+
+/**
+ * Sequential little-endian reader. The bytes handed to client callbacks are a
+ * view over WASM memory, so everything returned here is copied out and stays
+ * valid after the callback returns.
+ */
+class FlatReader {
+  private view: DataView;
+  private offset = 0;
+  // TextDecoder rejects views over a SharedArrayBuffer (pthread builds)
+  private static textDecoder = new TextDecoder();
+
+  constructor(private bytes: Uint8Array) {
+    this.view = new DataView(bytes.buffer, bytes.byteOffset, bytes.byteLength);
+  }
+
+  private advance(size: number): number {
+    const start = this.offset;
+    this.offset += (size + 3) & ~3;
+    return start;
+  }
+
+  u32(): number {
+    return this.view.getUint32(this.advance(4), true);
+  }
+
+  i32(): number {
+    return this.view.getInt32(this.advance(4), true);
+  }
+
+  f32(): number {
+    return this.view.getFloat32(this.advance(4), true);
+  }
+
+  f64(): number {
+    return this.view.getFloat64(this.advance(8), true);
+  }
+
+  string(): string {
+    const length = this.u32();
+    const start = this.advance(length);
+    return FlatReader.textDecoder.decode(this.bytes.slice(start, start + length));
+  }
+
+  floats(count = this.u32()): Float32Array {
+    const start = this.advance(count * 4);
+    const copy = new Float32Array(count);
+    new Uint8Array(copy.buffer).set(this.bytes.subarray(start, start + count * 4));
+    return copy;
+  }
+}
+
+function decodeCudaResponse(reader: FlatReader): FlatCudaResponse {
+  const session_id = reader.string();
+  const operation_type = reader.string();
+  const status = reader.i32();
+  const embeddings = reader.floats();
+
+  const response: FlatCudaResponse = {
+    kind: FlatMessageKind.CudaResponse,
+    session_id,
+    operation_type,
+    status,
+    embeddings
+  };
+
+  if (reader.u32() === 1) {
+    response.performance = {
+      processing_time_us: reader.f64(),
+      gpu_utilization: reader.f32(),
+      gpu_model: reader.string()
+    };
+  }
+
+  return response;
+}
+
+function decodeDocumentResponse(reader: FlatReader): FlatDocumentResponse {
+  return {
+    kind: FlatMessageKind.DocumentResponse,
+    document_id: reader.string(),
+    stage: reader.i32(),
+    progress: reader.f32()
+  };
+}
+
+function decodeSearchResponse(reader: FlatReader): FlatSearchResponse {
+  const query_id = reader.string();
+  const total_matches = reader.i32();
+  const is_complete = reader.u32() === 1;
+  const count = reader.u32();
+  const scores = reader.floats(count);
+
+  const matches: FlatSearchMatch[] = new Array(count);
+  for (let i = 0; i < count; i++) {
+    const document_id = reader.string();
+    const title = reader.string();
+    const snippet = reader.string();
+    const metadata: Record<string, string> = {};
+    for (let m = reader.u32(); m > 0; m--) {
+      const key = reader.string();
+      metadata[key] = reader.string();
+    }
+    matches[i] = { document_id, similarity_score: scores[i], title, snippet, metadata };
+  }
+
+  return {
+    kind: FlatMessageKind.SearchResponse,
+    query_id,
+    total_matches,
+    is_complete,
+    scores,
+    matches
+  };
+}
+
+function decodeSimilarityResponse(reader: FlatReader): FlatSimilarityResponse {
+  const base_case_id = reader.string();
+  const count = reader.u32();
+  const scores = reader.floats(count);
+
+  const similarities: FlatCaseSimilarity[] = new Array(count);
+  for (let i = 0; i < count; i++) {
+    const case_id = reader.string();
+    const metrics: Record<string, number> = {};
+    for (let m = reader.u32(); m > 0; m--) {
+      const key = reader.string();
+      metrics[key] = reader.f32();
+    }
+    similarities[i] = { case_id, similarity: scores[i], metrics };
+  }
+
+  return {
+    kind: FlatMessageKind.SimilarityResponse,
+    base_case_id,
+    scores,
+    similarities
+  };
+}
+
+/**
+ * Decode one message delivered while setBinaryDelivery(true) is active
+ */
+export function decodeFlatMessage(bytes: Uint8Array): FlatMessage {
+  const reader = new FlatReader(bytes);
+  const kind = reader.u32();
+
+  switch (kind) {
+    case FlatMessageKind.CudaResponse:
+      return decodeCudaResponse(reader);
+    case FlatMessageKind.DocumentResponse:
+      return decodeDocumentResponse(reader);
+    case FlatMessageKind.SearchResponse:
+      return decodeSearchResponse(reader);
+    case FlatMessageKind.SimilarityResponse:
+      return decodeSimilarityResponse(reader);
+    case FlatMessageKind.CallComplete:
+      return { kind: FlatMessageKind.CallComplete, ok: reader.u32() === 1 };
+    default:
+      throw new Error(`Unknown flat message kind: ${kind}`);
+  }
+}
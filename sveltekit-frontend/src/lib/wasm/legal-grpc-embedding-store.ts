@@ -0,0 +1,73 @@
+/**
+ * IndexedDB persistence for the Legal gRPC client's embedding cache
+ * Stores the snapshot produced by exportEmbeddingCache() so cached clause
+ * embeddings survive page reloads
+ */
+
+const DB_NAME = 'LegalGrpcEmbeddingCache';
+const STORE_NAME = 'snapshots';
+const SNAPSHOT_KEY = 'embeddings';
+
+export interface EmbeddingCacheClient {
+  exportEmbeddingCache(): Uint8Array;
+  importEmbeddingCache(snapshot: Uint8Array): number;
+}
+
+function openDatabase(): Promise<IDBDatabase> {
+  return new Promise((resolve, reject) => {
+    const request = indexedDB.open(DB_NAME, 1);
+
+    request.onerror = () => reject(request.error);
+    request.onsuccess = () => resolve(request.result);
+    request.onupgradeneeded = () => {
+      const db = request.result;
+      if (!db.objectStoreNames.contains(STORE_NAME)) {
+        db.createObjectStore(STORE_NAME);
+      }
+    };
+  });
+}
+
+/**
+ * Persist the client's current cache contents
+ */
+export async function saveEmbeddingCache(client: EmbeddingCacheClient): Promise<void> {
+  const snapshot = client.exportEmbeddingCache();
+  const db = await openDatabase();
+
+  try {
+    await new Promise<void>((resolve, reject) => {
+      const tx = db.transaction(STORE_NAME, 'readwrite');
+      tx.objectStore(STORE_NAME).put(snapshot.buffer, SNAPSHOT_KEY);
+      tx.oncomplete = () => resolve();
+      tx.onerror = () => reject(tx.error);
+    });
+  } finally {
+    db.close();
+  }
+}
+
+/**
+ * Load a previously saved snapshot into the client; resolves to the number
+ * of entries restored (0 when nothing was saved)
+ */
+export async function loadEmbeddingCache(client: EmbeddingCacheClient): Promise<number> {
+  if (typeof indexedDB === 'undefined') return 0;
+
+  const db = await openDatabase();
+
+  try {
+    const buffer = await new Promise<ArrayBuffer | undefined>((resolve, reject) => {
+      const request = db.transaction(STORE_NAME, 'readonly').objectStore(STORE_NAME).get(SNAPSHOT_KEY);
+      request.onsuccess = () => resolve(request.result as ArrayBuffer | undefined);
+      request.onerror = () => reject(request.error);
+    });
+
+    return buffer ? client.importEmbeddingCache(new Uint8Array(buffer)) : 0;
+  } catch (error) {
+    console.warn('Failed to load embedding cache snapshot:', error);
+    return 0;
+  } finally {
+    db.close();
+  }
+}
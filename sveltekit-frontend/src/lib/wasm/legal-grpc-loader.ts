@@ -0,0 +1,95 @@
+/**
+ * On-demand loading of the Legal gRPC WebAssembly module. Nothing is fetched
+ * at import time: the first call to loadLegalGrpcModule (normally from the
+ * first RPC) downloads the JS glue and streams the .wasm through
+ * WebAssembly.compileStreaming in parallel, so compilation overlaps the
+ * download, then instantiates it. prefetchLegalGrpcModule can start the
+ * download and compile earlier (e.g. when a search box gains focus) without
+ * paying for instantiation, which allocates the heap and the pthread pool.
+ */
+
+import type { LegalGrpcModuleOverrides } from './legal_grpc_client';
+
+export type LegalGrpcModuleInstance = Awaited<ReturnType<Window['LegalGrpcModule']>>;
+
+const SCRIPT_URL = '/wasm/legal_grpc_client.js';
+const WASM_URL = '/wasm/legal_grpc_client.wasm';
+
+let script: Promise<void> | null = null;
+let compiled: Promise<WebAssembly.Module> | null = null;
+let instance: Promise<LegalGrpcModuleInstance> | null = null;
+
+function loadScript(): Promise<void> {
+  script ??= new Promise<void>((resolve, reject) => {
+    if (window.LegalGrpcModule) {
+      resolve();
+      return;
+    }
+    const element = document.createElement('script');
+    element.src = SCRIPT_URL;
+    element.async = true;
+    element.onload = () => resolve();
+    element.onerror = () => {
+      script = null;
+      reject(new Error(`Failed to load ${SCRIPT_URL}`));
+    };
+    document.head.appendChild(element);
+  });
+  return script;
+}
+
+// compileStreaming needs an application/wasm response; servers that send
+// another type fall back to compiling the downloaded bytes
+function compileModule(): Promise<WebAssembly.Module> {
+  compiled ??= (async () => {
+    const response = fetch(WASM_URL, { credentials: 'same-origin' });
+    try {
+      return await WebAssembly.compileStreaming(response);
+    } catch {
+      const fallback = await fetch(WASM_URL, { credentials: 'same-origin' });
+      if (!fallback.ok) throw new Error(`Failed to fetch ${WASM_URL}: ${fallback.status}`);
+      return WebAssembly.compile(await fallback.arrayBuffer());
+    }
+  })().catch((error) => {
+    compiled = null;
+    throw error;
+  });
+  return compiled;
+}
+
+/** Start downloading and compiling the module without instantiating it */
+export function prefetchLegalGrpcModule(): void {
+  if (typeof window === 'undefined' || instance) return;
+  void loadScript().catch(() => {});
+  void compileModule().catch(() => {});
+}
+
+/** The instantiated module, loading it on first use */
+export function loadLegalGrpcModule(): Promise<LegalGrpcModuleInstance> {
+  if (typeof window === 'undefined') {
+    return Promise.reject(new Error('Legal CUDA gRPC client only works in browser environment'));
+  }
+  instance ??= (async () => {
+    const [module] = await Promise.all([compileModule(), loadScript()]);
+    // The factory never settles when instantiateWasm fails, so a failure
+    // rejects this promise instead
+    let instantiateFailed!: (error: unknown) => void;
+    const failure = new Promise<never>((_, reject) => {
+      instantiateFailed = reject;
+    });
+    const overrides: LegalGrpcModuleOverrides = {
+      // Emscripten hands the module on to its pthread workers as well
+      instantiateWasm(imports, receiveInstance) {
+        WebAssembly.instantiate(module, imports)
+          .then((created) => receiveInstance(created, module))
+          .catch(instantiateFailed);
+        return {};
+      }
+    };
+    return Promise.race([window.LegalGrpcModule(overrides), failure]);
+  })().catch((error) => {
+    instance = null;
+    throw error;
+  });
+  return instance;
+}
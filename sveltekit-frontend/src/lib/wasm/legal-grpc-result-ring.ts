@@ -0,0 +1,123 @@
+/**
+ * Reader for the shared-memory result ring of a worker-hosted Legal gRPC client
+ * Mirrors the layout documented in legal_result_ring.h. The ring lives in the
+ * worker's WASM memory, which the UI maps directly, so reading a result costs
+ * no postMessage copy.
+ */
+
+import { decodeFlatMessage, type FlatMessage } from './legal-grpc-decoder';
+
+const WRITE_INDEX = 0;      // byte offset 0
+const READ_INDEX = 16;      // byte offset 64
+const CAPACITY_INDEX = 32;  // byte offset 128
+const OVERFLOWED_INDEX = 33;
+const HEADER_SIZE = 192;
+const WRAP_MARKER = 0xffffffff;
+
+export interface ResultRingInfo {
+  offset: number;
+  capacity: number;
+}
+
+/**
+ * Single consumer of one ring. Records are decoded (and so copied out) before
+ * the read counter moves past them, after which the producer may reuse them.
+ */
+export class ResultRingReader {
+  private buffer: ArrayBufferLike | null = null;
+  private header!: Int32Array;
+  private bytes!: Uint8Array;
+  private view!: DataView;
+  private capacity = 0;
+  private running = false;
+
+  constructor(private memory: WebAssembly.Memory, private offset: number) {
+    this.refresh();
+  }
+
+  /** Records the producer had to hold back because the ring was full */
+  get overflowed(): number {
+    this.refresh();
+    return this.header[OVERFLOWED_INDEX] >>> 0;
+  }
+
+  /**
+   * Read every available record; returns how many were read
+   */
+  drain(onMessage: (tag: number, message: FlatMessage) => void): number {
+    this.refresh();
+    const write = Atomics.load(this.header, WRITE_INDEX) >>> 0;
+    let read = Atomics.load(this.header, READ_INDEX) >>> 0;
+    let count = 0;
+
+    while (read !== write) {
+      const position = read & (this.capacity - 1);
+      const at = this.offset + HEADER_SIZE + position;
+      const size = this.view.getUint32(at, true);
+      if (size === WRAP_MARKER) {
+        read = (read + this.capacity - position) >>> 0;
+        continue;
+      }
+
+      const tag = this.view.getUint32(at + 4, true);
+      const message = decodeFlatMessage(this.bytes.subarray(at + 8, at + 8 + size));
+      read = (read + 8 + ((size + 3) & ~3)) >>> 0;
+      Atomics.store(this.header, READ_INDEX, read | 0);
+      count++;
+      onMessage(tag, message);
+    }
+    return count;
+  }
+
+  /**
+   * Deliver records as they arrive, waking on the producer's notify where
+   * Atomics.waitAsync exists and polling once per animation frame otherwise
+   */
+  start(onMessage: (tag: number, message: FlatMessage) => void): void {
+    if (this.running) return;
+    this.running = true;
+
+    const waitAsync = (Atomics as any).waitAsync as
+      | ((array: Int32Array, index: number, value: number) => { async: boolean; value: any })
+      | undefined;
+
+    const loop = () => {
+      if (!this.running) return;
+      if (!waitAsync) {
+        this.drain(onMessage);
+        requestAnimationFrame(loop);
+        return;
+      }
+
+      // The counter is sampled before draining: a record published after
+      // the drain's last look changes it, so the wait returns at once
+      // instead of sleeping until the next publish
+      this.refresh();
+      const seen = Atomics.load(this.header, WRITE_INDEX);
+      this.drain(onMessage);
+
+      const result = waitAsync(this.header, WRITE_INDEX, seen);
+      if (result.async) {
+        result.value.then(loop);
+      } else {
+        queueMicrotask(loop);
+      }
+    };
+    loop();
+  }
+
+  stop(): void {
+    this.running = false;
+  }
+
+  // Memory growth replaces the underlying SharedArrayBuffer, so views are
+  // rebuilt whenever it changes
+  private refresh(): void {
+    if (this.buffer === this.memory.buffer) return;
+    this.buffer = this.memory.buffer;
+    this.header = new Int32Array(this.buffer, this.offset, HEADER_SIZE / 4);
+    this.bytes = new Uint8Array(this.buffer);
+    this.view = new DataView(this.buffer);
+    this.capacity = this.header[CAPACITY_INDEX] >>> 0;
+  }
+}
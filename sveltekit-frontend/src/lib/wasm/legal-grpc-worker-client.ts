@@ -0,0 +1,271 @@
+/**
+ * Main-thread handle on a Legal gRPC client hosted in a dedicated worker
+ * (static/workers/legal-grpc-worker.js). Method calls are forwarded with
+ * postMessage; results are read from the worker's shared-memory result ring,
+ * so decoding and networking stay off the UI thread and results are not
+ * copied between threads. The few results too large for the ring are posted
+ * by the worker instead and routed the same way. Requires a cross-origin isolated page, as the
+ * pthread build already does.
+ */
+
+import { ResultRingReader, type ResultRingInfo } from './legal-grpc-result-ring';
+import {
+  decodeFlatMessage,
+  FlatMessageKind,
+  type FlatCudaResponse,
+  type FlatDocumentResponse,
+  type FlatMessage,
+  type FlatSearchResponse,
+  type FlatSimilarityResponse
+} from './legal-grpc-decoder';
+
+const STREAM_TAG = 0;
+const ORPHAN_TTL_MS = 30000;
+
+export interface WorkerClientOptions {
+  channels?: number;
+  preconnect?: boolean;
+  policy?: 'least_loaded' | 'round_robin';
+  ringBytes?: number;  // default 4 MiB
+  workerUrl?: string;  // default /workers/legal-grpc-worker.js
+}
+
+export interface WorkerClientEvents {
+  error?: (error: string) => void;
+  complete?: () => void;
+  drain?: (sessionId: string) => void;
+  reconnect?: (sessionId: string, attempt: number, delayMs: number) => void;
+}
+
+interface CallListener {
+  onMessage: (message: FlatMessage) => void;
+  onComplete?: (ok: boolean) => void;
+}
+
+export class LegalGrpcWorkerClient {
+  private worker: Worker;
+  private ring: ResultRingReader | null = null;
+  private nextId = 1;
+  private pending = new Map<number, { resolve: (value: any) => void; reject: (error: Error) => void }>();
+  private calls = new Map<number, CallListener>();
+  private uploads = new Map<string, (message: FlatDocumentResponse) => void>();
+  // Records can reach the ring before the call's handle reaches us
+  private orphans = new Map<number, { at: number; messages: FlatMessage[] }>();
+  private streamListener: ((message: FlatCudaResponse) => void) | null = null;
+  readonly ready: Promise<void>;
+
+  constructor(endpoint: string, options: WorkerClientOptions = {}, private events: WorkerClientEvents = {}) {
+    this.worker = new Worker(options.workerUrl ?? '/workers/legal-grpc-worker.js');
+
+    this.ready = new Promise((resolve, reject) => {
+      this.worker.onmessage = (event: MessageEvent) => {
+        const message = event.data;
+        switch (message.type) {
+          case 'ready':
+            this.attachRing(message.memory, message.ring);
+            resolve();
+            break;
+          case 'failed':
+            reject(new Error(message.error));
+            break;
+          case 'result':
+            this.settle(message);
+            break;
+          case 'event':
+            (this.events as any)[message.name]?.(...message.args);
+            break;
+          case 'record':
+            this.routeRecord(message.tag, decodeFlatMessage(message.bytes));
+            break;
+        }
+      };
+      this.worker.onerror = (event) => reject(new Error(event.message));
+    });
+
+    const { ringBytes, workerUrl, ...clientOptions } = options;
+    this.worker.postMessage({ type: 'init', endpoint, options: clientOptions, ringBytes });
+  }
+
+  /**
+   * Forward any LegalGrpcWebClient method that takes no callback
+   */
+  async call<T = unknown>(method: string, ...args: unknown[]): Promise<T> {
+    await this.ready;
+    return this.send<T>(method, args);
+  }
+
+  /** Bidirectional stream responses, decoded from the ring */
+  onStreamResponse(listener: ((message: FlatCudaResponse) => void) | null): void {
+    this.streamListener = listener;
+  }
+
+  startBidirectionalStream(sessionId: string): Promise<string> {
+    return this.call('startBidirectionalStream', sessionId);
+  }
+
+  processLegalDocument(
+    documentId: string,
+    content: string,
+    type: string,
+    onProgress: (message: FlatDocumentResponse) => void,
+    options: unknown = 'default',
+    callOptions: unknown = {},
+    onComplete?: (ok: boolean) => void
+  ): Promise<number> {
+    return this.streamingCall('processLegalDocument',
+      [documentId, content, type, null, options, callOptions], 3, onProgress, onComplete);
+  }
+
+  performSemanticSearch(
+    query: string,
+    collection: string,
+    topK: number,
+    onResults: (message: FlatSearchResponse) => void,
+    callOptions: unknown = {},
+    onComplete?: (ok: boolean) => void
+  ): Promise<number> {
+    return this.streamingCall('performSemanticSearch',
+      [query, collection, topK, null, callOptions], 3, onResults, onComplete);
+  }
+
+  analyzeCaseSimilarity(
+    baseCaseId: string,
+    compareCaseIds: string[],
+    onSimilarity: (message: FlatSimilarityResponse) => void,
+    callOptions: unknown = {},
+    onComplete?: (ok: boolean) => void
+  ): Promise<number> {
+    return this.streamingCall('analyzeCaseSimilarity',
+      [baseCaseId, compareCaseIds, null, callOptions], 2, onSimilarity, onComplete);
+  }
+
+  /**
+   * Progress of a chunked upload is matched by document id, since uploads
+   * have no call handle
+   */
+  async startDocumentUpload(
+    documentId: string,
+    type: string,
+    onProgress: (message: FlatDocumentResponse) => void,
+    options: unknown = 'default'
+  ): Promise<boolean> {
+    await this.ready;
+    this.uploads.set(documentId, onProgress);
+    const started = await this.send<boolean>('startDocumentUpload',
+      [documentId, type, null, options], 2);
+    if (!started) this.uploads.delete(documentId);
+    return started;
+  }
+
+  async finishDocumentUpload(documentId: string): Promise<boolean> {
+    const finished = await this.call<boolean>('finishDocumentUpload', documentId);
+    return finished;
+  }
+
+  cancelCall(handle: number): Promise<boolean> {
+    this.calls.delete(handle);
+    return this.call('cancelCall', handle);
+  }
+
+  terminate(): void {
+    this.ring?.stop();
+    this.worker.terminate();
+    for (const { reject } of this.pending.values()) {
+      reject(new Error('Worker terminated'));
+    }
+    this.pending.clear();
+  }
+
+  private async streamingCall<M extends FlatMessage>(
+    method: string,
+    args: unknown[],
+    callbackIndex: number,
+    onMessage: (message: M) => void,
+    onComplete?: (ok: boolean) => void
+  ): Promise<number> {
+    await this.ready;
+    const handle = await this.send<number>(method, args, callbackIndex);
+    const listener: CallListener = { onMessage: onMessage as (message: FlatMessage) => void, onComplete };
+    this.calls.set(handle, listener);
+
+    const early = this.orphans.get(handle);
+    if (early) {
+      this.orphans.delete(handle);
+      early.messages.forEach((message) => this.route(handle, message));
+    }
+    return handle;
+  }
+
+  private send<T>(method: string, args: unknown[], callbackIndex?: number): Promise<T> {
+    const id = this.nextId++;
+    return new Promise<T>((resolve, reject) => {
+      this.pending.set(id, { resolve, reject });
+      this.worker.postMessage({ type: 'call', id, method, args, callbackIndex });
+    });
+  }
+
+  private settle(message: { id: number; value?: unknown; error?: string }): void {
+    const waiter = this.pending.get(message.id);
+    if (!waiter) return;
+    this.pending.delete(message.id);
+    if (message.error !== undefined) {
+      waiter.reject(new Error(message.error));
+    } else {
+      waiter.resolve(message.value);
+    }
+  }
+
+  private attachRing(memory: WebAssembly.Memory, info: ResultRingInfo): void {
+    this.ring = new ResultRingReader(memory, info.offset);
+    this.ring.start((tag, message) => this.route(tag, message));
+  }
+
+  /** A posted result; uploads have no call handle and come untagged */
+  private routeRecord(tag: number | undefined, message: FlatMessage): void {
+    if (tag !== undefined) {
+      this.route(tag, message);
+    } else if (message.kind === FlatMessageKind.DocumentResponse) {
+      this.uploads.get(message.document_id)?.(message);
+    }
+  }
+
+  private route(tag: number, message: FlatMessage): void {
+    if (tag === STREAM_TAG) {
+      if (message.kind === FlatMessageKind.CudaResponse) {
+        this.streamListener?.(message);
+      }
+      return;
+    }
+
+    const listener = this.calls.get(tag);
+    if (listener) {
+      if (message.kind === FlatMessageKind.CallComplete) {
+        this.calls.delete(tag);
+        listener.onComplete?.(message.ok);
+      } else {
+        listener.onMessage(message);
+      }
+      return;
+    }
+
+    if (message.kind === FlatMessageKind.DocumentResponse) {
+      const upload = this.uploads.get(message.document_id);
+      if (upload) {
+        upload(message);
+        return;
+      }
+    }
+    this.keepOrphan(tag, message);
+  }
+
+  private keepOrphan(tag: number, message: FlatMessage): void {
+    const now = performance.now();
+    for (const [handle, orphan] of this.orphans) {
+      if (now - orphan.at > ORPHAN_TTL_MS) this.orphans.delete(handle);
+    }
+
+    const orphan = this.orphans.get(tag) ?? { at: now, messages: [] };
+    orphan.messages.push(message);
+    this.orphans.set(tag, orphan);
+  }
+}
@@ -0,0 +1,54 @@
+// legal_allocation_counter.h - Heap allocation counting for the marshalling benchmarks
+//
+// Replaces the global (unaligned) operator new/delete with counting versions
+// so benchmarks can report bytes and allocations per message. Because it
+// defines the replacement functions, include it from exactly one translation
+// unit of a benchmark build: native/legal_client_benchmarks.cpp, or
+// legal_grpc_client.cpp when built with LEGAL_GRPC_BENCH.
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+namespace legal_cuda_streaming {
+namespace bench {
+
+struct AllocationCounts {
+    uint64_t count;
+    uint64_t bytes;
+};
+
+inline std::atomic<uint64_t> allocation_count{0};
+inline std::atomic<uint64_t> allocated_bytes{0};
+
+inline AllocationCounts allocations() {
+    return {allocation_count.load(std::memory_order_relaxed),
+            allocated_bytes.load(std::memory_order_relaxed)};
+}
+
+inline void* countedAllocate(std::size_t size) {
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+    if (void* memory = std::malloc(size > 0 ? size : 1)) {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+} // namespace bench
+} // namespace legal_cuda_streaming
+
+void* operator new(std::size_t size) {
+    return legal_cuda_streaming::bench::countedAllocate(size);
+}
+
+void* operator new[](std::size_t size) {
+    return legal_cuda_streaming::bench::countedAllocate(size);
+}
+
+void operator delete(void* memory) noexcept { std::free(memory); }
+void operator delete[](void* memory) noexcept { std::free(memory); }
+void operator delete(void* memory, std::size_t) noexcept { std::free(memory); }
+void operator delete[](void* memory, std::size_t) noexcept { std::free(memory); }
@@ -0,0 +1,65 @@
+// legal_bench_messages.h - Synthetic responses shared by the native and browser benchmarks
+#pragma once
+
+#include "legal_cuda_streaming.pb.h"
+
+#include <random>
+#include <string>
+#include <vector>
+
+namespace legal_cuda_streaming {
+namespace bench {
+
+constexpr size_t kSearchDims = 768;
+
+inline std::vector<float> randomVector(size_t dims, uint32_t seed) {
+    std::minstd_rand random(seed);
+    std::normal_distribution<float> normal;
+    std::vector<float> vector(dims);
+    for (float& value : vector) {
+        value = normal(random);
+    }
+    return vector;
+}
+
+// An embed result as returned on the bidirectional stream
+inline CudaResponse makeEmbedResponse(size_t dims) {
+    CudaResponse response;
+    response.set_session_id("bench-session");
+    response.set_operation_type("embed");
+    response.set_status(1);
+    const auto vector = randomVector(dims, 1);
+    response.mutable_computed_embedding()->Add(vector.begin(), vector.end());
+    auto* metrics = response.mutable_cuda_metrics();
+    metrics->set_total_processing_time_us(1250);
+    metrics->set_gpu_utilization(0.72f);
+    metrics->set_gpu_model("RTX 3060");
+    return response;
+}
+
+// hits matches with typical titles, snippets and metadata, optionally
+// carrying kSearchDims-dim embeddings for local re-scoring
+inline SearchResponse makeSearchResponse(size_t hits, bool with_embeddings) {
+    SearchResponse response;
+    response.set_query_id("bench-query");
+    response.set_total_matches(static_cast<int>(hits));
+    response.set_is_complete(true);
+    for (size_t i = 0; i < hits; ++i) {
+        auto* match = response.add_matches();
+        match->set_document_id("doc-" + std::to_string(i));
+        match->set_similarity_score(1.0f - static_cast<float>(i) / (hits + 1));
+        match->set_title("Smith v. Jones, 512 F.3d " + std::to_string(100 + i));
+        match->set_snippet("The court held that the indemnification clause was enforceable "
+                           "notwithstanding the limitation of liability provision.");
+        (*match->mutable_metadata())["jurisdiction"] = "federal";
+        (*match->mutable_metadata())["year"] = std::to_string(1990 + i % 30);
+        if (with_embeddings) {
+            const auto vector = randomVector(kSearchDims, static_cast<uint32_t>(i + 1));
+            match->mutable_embedding()->Add(vector.begin(), vector.end());
+        }
+    }
+    return response;
+}
+
+} // namespace bench
+} // namespace legal_cuda_streaming
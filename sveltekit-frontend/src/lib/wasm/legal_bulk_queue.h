@@ -0,0 +1,179 @@
+// legal_bulk_queue.h - Admission of background calls behind interactive ones
+#pragma once
+
+#include "legal_client_metrics.h"
+
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+namespace legal_cuda_streaming {
+
+// Admission control for background calls (document processing and uploads
+// unless a call asks otherwise). They wait here in FIFO order. At most
+// max_concurrent run at once, and they start at no more than
+// starts_per_second. A waiting call is also held while interactive calls
+// are in flight and for yield_ms after the last one ends, so a bulk ingest
+// fills the gaps between searches instead of queueing ahead of them. After
+// max_yield_ms of waiting, a call no longer yields, so a steady stream of
+// searches cannot starve ingest. Calls that are already running are not
+// paused.
+//
+// Starts run on the thread calling pump (the main thread in the browser).
+// The counters may be updated from any thread.
+class BulkQueue {
+public:
+    struct Limits {
+        uint32_t max_concurrent = 2;
+        double starts_per_second = 10;  // 0: unlimited
+        uint32_t yield_ms = 100;
+        uint32_t max_yield_ms = 5000;
+    };
+    
+    struct Stats {
+        size_t queued;
+        uint32_t running;
+        uint32_t interactive;
+        uint64_t started;
+        uint64_t yielded;  // times the head of the queue was held for interactive calls
+    };
+    
+    void setLimits(const Limits& limits) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        limits_ = limits;
+        limits_.max_concurrent = std::max<uint32_t>(limits_.max_concurrent, 1);
+        tokens_ = std::min(tokens_, bucketSize());
+    }
+    
+    Limits limits() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return limits_;
+    }
+    
+    // Queue a call's start; it runs from a later pump. A start that decides
+    // not to call after all must still call finished().
+    void submit(std::function<void()> start) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        waiting_.push_back({std::move(start), MetricsClock::now(), false});
+    }
+    
+    void interactiveStarted() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ++interactive_;
+    }
+    
+    void interactiveFinished() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (interactive_ > 0) --interactive_;
+        last_interactive_end_ = MetricsClock::now();
+    }
+    
+    // A started bulk call has ended
+    void finished() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (running_ > 0) --running_;
+    }
+    
+    // Run every start that is allowed now. Returns how long to wait before
+    // pumping again for the rate limit or a yield to run out, or 0 when only
+    // a call finishing or a new submit can change anything.
+    std::chrono::milliseconds pump() {
+        for (;;) {
+            std::vector<std::function<void()>> starts;
+            std::chrono::milliseconds retry{0};
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                retry = admit(MetricsClock::now(), starts);
+            }
+            if (starts.empty()) return retry;
+            
+            // Outside the lock: a start may finish at once and call finished()
+            for (auto& start : starts) {
+                start();
+            }
+        }
+    }
+    
+    Stats stats() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return {waiting_.size(), running_, interactive_, started_, yielded_};
+    }
+    
+    // Submit to start, in microseconds
+    const LatencyHistogram& waits() const { return waits_; }
+
+private:
+    struct Waiting {
+        std::function<void()> start;
+        MetricsClock::time_point queued_at;
+        bool yielded;
+    };
+    
+    mutable std::mutex mutex_;
+    Limits limits_;
+    std::deque<Waiting> waiting_;
+    uint32_t running_ = 0;
+    uint32_t interactive_ = 0;
+    MetricsClock::time_point last_interactive_end_{};
+    double tokens_ = Limits().max_concurrent;
+    MetricsClock::time_point refilled_at_ = MetricsClock::now();
+    uint64_t started_ = 0;
+    uint64_t yielded_ = 0;
+    LatencyHistogram waits_;
+    
+    // Tokens saved up while idle allow one concurrency-sized burst
+    double bucketSize() const { return static_cast<double>(limits_.max_concurrent); }
+    
+    // Requires mutex_
+    std::chrono::milliseconds admit(MetricsClock::time_point now, std::vector<std::function<void()>>& starts) {
+        using std::chrono::milliseconds;
+        if (limits_.starts_per_second > 0) {
+            const double seconds = std::chrono::duration<double>(now - refilled_at_).count();
+            tokens_ = std::min(bucketSize(), tokens_ + seconds * limits_.starts_per_second);
+        }
+        refilled_at_ = now;
+        
+        while (!waiting_.empty() && running_ < limits_.max_concurrent) {
+            Waiting& head = waiting_.front();
+            const int64_t waited = std::chrono::duration_cast<milliseconds>(now - head.queued_at).count();
+            const int64_t max_yield = limits_.max_yield_ms;
+            
+            if (waited < max_yield) {
+                const int64_t quiet = std::chrono::duration_cast<milliseconds>(now - last_interactive_end_).count();
+                const int64_t yield = limits_.yield_ms;
+                if (interactive_ > 0 || quiet < yield) {
+                    if (!head.yielded) {
+                        head.yielded = true;
+                        ++yielded_;
+                    }
+                    // With calls in flight, their finish pumps; otherwise the quiet period runs out
+                    const int64_t until_quiet = interactive_ > 0 ? INT64_MAX : yield - quiet;
+                    return milliseconds(std::max<int64_t>(std::min(until_quiet, max_yield - waited), 1));
+                }
+            }
+            
+            if (limits_.starts_per_second > 0) {
+                if (tokens_ < 1.0) {
+                    const double seconds = (1.0 - tokens_) / limits_.starts_per_second;
+                    return milliseconds(std::max<int64_t>(static_cast<int64_t>(std::ceil(seconds * 1000.0)), 1));
+                }
+                tokens_ -= 1.0;
+            }
+            
+            waits_.record(elapsedMicros(head.queued_at, now));
+            starts.push_back(std::move(head.start));
+            waiting_.pop_front();
+            ++running_;
+            ++started_;
+        }
+        return milliseconds(0);
+    }
+};
+
+} // namespace legal_cuda_streaming
@@ -0,0 +1,780 @@
+// legal_client_core.h - Transport-independent core of the Legal gRPC client
+//
+// Request construction, batching, caching, embedding encode/decode, metrics
+// and response conversion shared by the WebAssembly client
+// (legal_grpc_client.cpp) and the native load driver (native/). Nothing here
+// depends on emscripten; JS delivery, main-thread proxying and the bindings
+// stay in legal_grpc_client.cpp.
+#pragma once
+
+#include "legal_bulk_queue.h"
+#include "legal_client_metrics.h"
+#include "legal_cuda_streaming.grpc.pb.h"
+#include "legal_embedding_cache.h"
+#include "legal_flat_message.h"
+#include "legal_request_arenas.h"
+#include "legal_session_map.h"
+#include "legal_simd_kernels.h"
+#include <google/protobuf/arena.h>
+#include <grpcpp/grpcpp.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace legal_cuda_streaming {
+
+using grpc::Channel;
+using grpc::ClientAsyncReader;
+using grpc::ClientAsyncReaderWriter;
+using grpc::ClientContext;
+using grpc::CompletionQueue;
+using grpc::Status;
+
+// Single completion-queue thread that drives every in-flight RPC, so the
+// number of concurrent calls is independent of PTHREAD_POOL_SIZE. Each async
+// operation is tagged with a pointer to the handler that resumes it.
+class RpcReactor {
+public:
+    using Tag = std::function<void(bool)>;
+    
+    RpcReactor() : thread_([this]() { run(); }) {}
+    
+    ~RpcReactor() {
+        cq_.Shutdown();
+        thread_.join();
+    }
+    
+    CompletionQueue* queue() { return &cq_; }
+    
+    // Run work on the reactor thread after the current handler returns. Only
+    // valid from inside a handler.
+    void defer(std::function<void()> work) {
+        deferred_.push_back(std::move(work));
+    }
+
+private:
+    CompletionQueue cq_;
+    std::vector<std::function<void()>> deferred_;
+    std::thread thread_;
+    
+    void run() {
+        void* tag;
+        bool ok;
+        while (cq_.Next(&tag, &ok)) {
+            (*static_cast<Tag*>(tag))(ok);
+            
+            for (auto& work : deferred_) {
+                work();
+            }
+            deferred_.clear();
+        }
+    }
+};
+
+// Server-streaming RPC driven by the reactor. Owns its ClientContext for the
+// lifetime of the call and deletes itself once Finish completes.
+template <typename Response>
+class ServerStreamCall {
+public:
+    using MessageHandler = std::function<void(Response&)>;
+    using DoneHandler = std::function<void(const Status&)>;
+    
+    ServerStreamCall(MessageHandler on_message, DoneHandler on_done)
+        : on_message_(std::move(on_message)), on_done_(std::move(on_done)) {}
+    
+    ClientContext* context() { return &context_; }
+    
+    void start(std::unique_ptr<ClientAsyncReader<Response>> reader) {
+        reader_ = std::move(reader);
+        reader_->StartCall(&on_started_);
+    }
+
+private:
+    ClientContext context_;
+    std::unique_ptr<ClientAsyncReader<Response>> reader_;
+    Response response_;
+    Status status_;
+    MessageHandler on_message_;
+    DoneHandler on_done_;
+    
+    RpcReactor::Tag on_started_ = [this](bool ok) {
+        ok ? readNext() : finish();
+    };
+    
+    RpcReactor::Tag on_read_ = [this](bool ok) {
+        if (!ok) {
+            finish();
+            return;
+        }
+        on_message_(response_);
+        readNext();
+    };
+    
+    RpcReactor::Tag on_finished_ = [this](bool) {
+        on_done_(status_);
+        delete this;
+    };
+    
+    void readNext() {
+        response_.Clear();
+        reader_->Read(&response_, &on_read_);
+    }
+    
+    void finish() {
+        reader_->Finish(&status_, &on_finished_);
+    }
+};
+
+// Compact embedding encodings. Requests advertise the encoding the client
+// accepts in accept_encoding; a server that supports it answers with a
+// QuantizedEmbedding instead of the repeated float field, and one that
+// doesn't keeps sending floats. data holds the vectors back to back, as int8
+// with one scale per vector or as little-endian fp16.
+inline size_t encodedElementSize(EmbeddingEncoding encoding) {
+    switch (encoding) {
+        case EMBEDDING_FLOAT32: return sizeof(float);
+        case EMBEDDING_FLOAT16: return sizeof(uint16_t);
+        case EMBEDDING_INT8: return sizeof(int8_t);
+        default: return 0;
+    }
+}
+
+// Encode count row-major vectors of dims floats
+inline void encodeEmbedding(const float* data, size_t count, size_t dims,
+                            EmbeddingEncoding encoding, QuantizedEmbedding* out) {
+    out->set_encoding(encoding);
+    out->set_dims(static_cast<uint32_t>(dims));
+    out->clear_scales();
+    
+    std::string* bytes = out->mutable_data();
+    bytes->resize(count * dims * encodedElementSize(encoding));
+    if (bytes->empty()) return;
+    
+    switch (encoding) {
+        case EMBEDDING_INT8: {
+            auto* quantized = reinterpret_cast<int8_t*>(&(*bytes)[0]);
+            out->mutable_scales()->Reserve(static_cast<int>(count));
+            for (size_t i = 0; i < count; ++i) {
+                out->add_scales(simd::quantizeInt8(data + i * dims, dims, quantized + i * dims));
+            }
+            break;
+        }
+        case EMBEDDING_FLOAT16:
+            simd::floatsToHalves(data, count * dims, reinterpret_cast<uint16_t*>(&(*bytes)[0]));
+            break;
+        default:
+            std::memcpy(&(*bytes)[0], data, bytes->size());
+            break;
+    }
+}
+
+// Decode into out, replacing its contents. Returns false for a malformed or
+// unknown encoding, leaving out empty.
+inline bool decodeEmbedding(const QuantizedEmbedding& in, google::protobuf::RepeatedField<float>* out) {
+    out->Clear();
+    const size_t dims = in.dims();
+    const size_t stride = dims * encodedElementSize(in.encoding());
+    if (stride == 0 || in.data().size() % stride != 0) {
+        return false;
+    }
+    
+    const size_t count = in.data().size() / stride;
+    if (in.encoding() == EMBEDDING_INT8 && static_cast<size_t>(in.scales_size()) != count) {
+        return false;
+    }
+    
+    out->Resize(static_cast<int>(count * dims), 0.0f);
+    float* values = out->mutable_data();
+    const char* bytes = in.data().data();
+    switch (in.encoding()) {
+        case EMBEDDING_INT8:
+            for (size_t i = 0; i < count; ++i) {
+                simd::dequantizeInt8(reinterpret_cast<const int8_t*>(bytes) + i * dims, dims,
+                                     in.scales(static_cast<int>(i)), values + i * dims);
+            }
+            break;
+        case EMBEDDING_FLOAT16:
+            simd::halvesToFloats(reinterpret_cast<const uint16_t*>(bytes), count * dims, values);
+            break;
+        default:
+            std::memcpy(values, bytes, in.data().size());
+            break;
+    }
+    return true;
+}
+
+// Ring of the most recent search matches that carried embeddings, kept so
+// results can be re-scored locally against a new query vector. Vectors stay
+// in the encoding they arrived in and are scored without widening them
+// first; int8 scales are dropped since cosine scores don't depend on them.
+class SearchCandidateSet {
+public:
+    struct Candidate {
+        std::string document_id;
+        float server_score = 0.0f;
+        std::map<std::string, std::string> metadata;
+    };
+    
+    explicit SearchCandidateSet(size_t capacity = 1000) : capacity_(capacity) {}
+    
+    void add(const SearchResponse& response) {
+        for (const auto& match : response.matches()) {
+            EmbeddingEncoding encoding = EMBEDDING_FLOAT32;
+            size_t dims = match.embedding_size();
+            const void* vector = match.embedding().data();
+            if (match.has_quantized_embedding()) {
+                const QuantizedEmbedding& quantized = match.quantized_embedding();
+                encoding = quantized.encoding();
+                dims = quantized.dims();
+                vector = quantized.data().data();
+                // An encoding this client doesn't know has no element size
+                const size_t element_size = encodedElementSize(encoding);
+                if (element_size == 0 || quantized.data().size() != dims * element_size) continue;
+            }
+            if (dims == 0) continue;
+            
+            // A different embedding model or encoding invalidates what was kept so far
+            if (dims != dims_ || encoding != encoding_) {
+                clear();
+                dims_ = dims;
+                encoding_ = encoding;
+                stride_ = dims * encodedElementSize(encoding);
+                vectors_.resize(capacity_ * stride_);
+                candidates_.resize(capacity_);
+            }
+            
+            const size_t slot = next_ % capacity_;
+            Candidate& candidate = candidates_[slot];
+            candidate.document_id = match.document_id();
+            candidate.server_score = match.similarity_score();
+            candidate.metadata.clear();
+            candidate.metadata.insert(match.metadata().begin(), match.metadata().end());
+            std::memcpy(vectors_.data() + slot * stride_, vector, stride_);
+            
+            ++next_;
+        }
+    }
+    
+    void clear() {
+        candidates_.clear();
+        vectors_.clear();
+        dims_ = 0;
+        stride_ = 0;
+        next_ = 0;
+    }
+    
+    size_t size() const { return std::min(next_, capacity_); }
+    size_t dims() const { return dims_; }
+    const Candidate& candidate(size_t index) const { return candidates_[index]; }
+    
+    // Cosine of query (dims floats) against every kept vector
+    void score(const float* query, float* scores) const {
+        const uint8_t* vectors = vectors_.data();
+        switch (encoding_) {
+            case EMBEDDING_INT8:
+                simd::cosineBatchInt8(query, reinterpret_cast<const int8_t*>(vectors), size(), dims_, scores);
+                break;
+            case EMBEDDING_FLOAT16:
+                simd::cosineBatchHalf(query, reinterpret_cast<const uint16_t*>(vectors), size(), dims_, scores);
+                break;
+            default:
+                simd::cosineBatch(query, reinterpret_cast<const float*>(vectors), size(), dims_, scores);
+                break;
+        }
+    }
+
+private:
+    size_t capacity_;
+    size_t dims_ = 0;
+    size_t stride_ = 0;
+    size_t next_ = 0;
+    EmbeddingEncoding encoding_ = EMBEDDING_FLOAT32;
+    std::vector<Candidate> candidates_;
+    std::vector<uint8_t> vectors_;
+};
+
+// Free list of cleared messages, handed out as shared_ptrs that come back to
+// the pool on release. Clear() keeps string and repeated-field capacity, so a
+// recycled message absorbs the next Swap without reallocating.
+template <typename Message>
+class MessagePool : public std::enable_shared_from_this<MessagePool<Message>> {
+public:
+    explicit MessagePool(size_t max_free = 32) : max_free_(max_free) {}
+    
+    std::shared_ptr<Message> acquire() {
+        Message* message = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!free_.empty()) {
+                message = free_.back().release();
+                free_.pop_back();
+            }
+        }
+        if (!message) {
+            message = new Message();
+        }
+        
+        std::weak_ptr<MessagePool> pool = this->shared_from_this();
+        return std::shared_ptr<Message>(message, [pool](Message* released) {
+            if (auto owner = pool.lock()) {
+                owner->recycle(released);
+            } else {
+                delete released;
+            }
+        });
+    }
+
+private:
+    size_t max_free_;
+    std::vector<std::unique_ptr<Message>> free_;
+    std::mutex mutex_;
+    
+    void recycle(Message* message) {
+        message->Clear();
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (free_.size() < max_free_) {
+            free_.emplace_back(message);
+        } else {
+            delete message;
+        }
+    }
+};
+
+// Interactive calls (searches, similarity, embedding streams) versus bulk
+// document traffic, which is kept apart from them on the channel pool
+enum class RpcClass { Interactive, Bulk };
+
+// Fixed set of channels, each with its own connection (a local subchannel
+// pool), that calls are spread over. With more than one channel, bulk calls
+// stay off channel 0 and interactive calls prefer channels carrying no bulk
+// streams, so long document uploads don't head-of-line block searches.
+class ChannelPool {
+public:
+    enum class Policy { LeastLoaded, RoundRobin };
+    
+    // Counts one call against its channel for as long as it is held
+    class Lease {
+    public:
+        Lease(ChannelPool& pool, size_t index, RpcClass rpc_class)
+            : pool_(pool), index_(index), rpc_class_(rpc_class) {}
+        ~Lease() { pool_.release(index_, rpc_class_); }
+        
+        Lease(const Lease&) = delete;
+        Lease& operator=(const Lease&) = delete;
+        
+        LegalCudaService::Stub* stub() const { return pool_.entries_[index_]->stub.get(); }
+        size_t index() const { return index_; }
+    
+    private:
+        ChannelPool& pool_;
+        size_t index_;
+        RpcClass rpc_class_;
+    };
+    
+    // grpc_web selects the gRPC-Web framing used from the browser; native
+    // clients (the load driver) talk plain HTTP/2 gRPC. compression is the
+    // channels' default for calls that do not set their own.
+    void init(const std::string& endpoint, size_t count, Policy policy, bool grpc_web = true,
+              grpc_compression_algorithm compression = GRPC_COMPRESS_NONE) {
+        policy_ = policy;
+        for (size_t i = 0; i < std::max<size_t>(count, 1); ++i) {
+            grpc::ChannelArguments args;
+            if (grpc_web) {
+                args.SetString("grpc.http2.method", "POST");
+                args.SetString("grpc.http2.scheme", "https");
+            }
+            if (compression != GRPC_COMPRESS_NONE) {
+                args.SetCompressionAlgorithm(compression);
+            }
+            // Without this, channels with equal arguments share one connection
+            args.SetInt("grpc.use_local_subchannel_pool", 1);
+            
+            auto entry = std::make_unique<Entry>();
+            entry->channel = grpc::CreateCustomChannel(
+                endpoint,
+                grpc::InsecureChannelCredentials(),
+                args
+            );
+            entry->stub = LegalCudaService::NewStub(entry->channel);
+            entries_.push_back(std::move(entry));
+        }
+    }
+    
+    std::shared_ptr<Lease> acquire(RpcClass rpc_class) {
+        const size_t index = pick(rpc_class);
+        Entry& entry = *entries_[index];
+        (rpc_class == RpcClass::Bulk ? entry.bulk : entry.interactive)
+            .fetch_add(1, std::memory_order_relaxed);
+        return std::make_shared<Lease>(*this, index, rpc_class);
+    }
+    
+    size_t size() const { return entries_.size(); }
+    
+    // Start connecting every idle channel and watch each on cq until it is
+    // READY, calling on_ready(index) from the reactor thread when it is
+    void warmUp(CompletionQueue* cq, std::function<void(size_t)> on_ready) {
+        for (size_t i = 0; i < entries_.size(); ++i) {
+            Entry* entry = entries_[i].get();
+            if (entry->watching.exchange(true)) continue;
+            
+            entry->on_state_change = [this, entry, cq, on_ready, i](bool) {
+                const grpc_connectivity_state state = entry->channel->GetState(true);
+                if (state == GRPC_CHANNEL_READY) {
+                    entry->watching = false;
+                    on_ready(i);
+                } else if (stopping_) {
+                    entry->watching = false;
+                } else {
+                    watch(*entry, state, cq);
+                }
+            };
+            watch(*entry, entry->channel->GetState(true), cq);
+        }
+    }
+    
+    // Stop re-arming warm-up watches, so the reactor can drain
+    void stop() { stopping_ = true; }
+    
+    struct ChannelStats {
+        const char* state;
+        uint32_t interactive;
+        uint32_t bulk;
+    };
+    
+    std::vector<ChannelStats> stats() const {
+        static const char* const kStateNames[] = {"idle", "connecting", "ready",
+                                                  "transient_failure", "shutdown"};
+        std::vector<ChannelStats> result;
+        result.reserve(entries_.size());
+        for (const auto& entry : entries_) {
+            result.push_back({kStateNames[entry->channel->GetState(false)],
+                              entry->interactive.load(std::memory_order_relaxed),
+                              entry->bulk.load(std::memory_order_relaxed)});
+        }
+        return result;
+    }
+
+private:
+    struct Entry {
+        std::shared_ptr<Channel> channel;
+        std::unique_ptr<LegalCudaService::Stub> stub;
+        std::atomic<uint32_t> interactive{0};
+        std::atomic<uint32_t> bulk{0};
+        std::atomic<bool> watching{false};
+        RpcReactor::Tag on_state_change;
+    };
+    
+    std::vector<std::unique_ptr<Entry>> entries_;
+    Policy policy_ = Policy::LeastLoaded;
+    std::atomic<size_t> next_{0};
+    std::atomic<bool> stopping_{false};
+    
+    // Short watch deadlines so a stopping client never waits long on one
+    static void watch(Entry& entry, grpc_connectivity_state state, CompletionQueue* cq) {
+        entry.channel->NotifyOnStateChange(
+            state, std::chrono::system_clock::now() + std::chrono::milliseconds(250),
+            cq, &entry.on_state_change);
+    }
+    
+    size_t pick(RpcClass rpc_class) {
+        const size_t count = entries_.size();
+        const size_t first = (rpc_class == RpcClass::Bulk && count > 1) ? 1 : 0;
+        const size_t candidates = count - first;
+        
+        if (policy_ == Policy::RoundRobin) {
+            return first + next_.fetch_add(1, std::memory_order_relaxed) % candidates;
+        }
+        
+        // Least loaded: bulk calls balance on bulk streams, interactive calls
+        // avoid channels with bulk streams and then balance on their own kind
+        size_t best = first;
+        auto load = [&](size_t index) {
+            const Entry& entry = *entries_[index];
+            const uint32_t bulk = entry.bulk.load(std::memory_order_relaxed);
+            const uint32_t interactive = entry.interactive.load(std::memory_order_relaxed);
+            return rpc_class == RpcClass::Bulk
+                ? std::make_pair(bulk, interactive)
+                : std::make_pair(bulk > 0 ? 1u : 0u, interactive);
+        };
+        for (size_t i = first + 1; i < count; ++i) {
+            if (load(i) < load(best)) best = i;
+        }
+        return best;
+    }
+    
+    void release(size_t index, RpcClass rpc_class) {
+        Entry& entry = *entries_[index];
+        (rpc_class == RpcClass::Bulk ? entry.bulk : entry.interactive)
+            .fetch_sub(1, std::memory_order_relaxed);
+    }
+};
+
+// Per-call CUDA settings for embedding requests. Defaults match what every
+// request used to hardcode.
+struct CudaCallOptions {
+    bool use_tensor_cores = true;
+    int batch_size = 0;  // 0 sends the real number of texts
+    bool enable_memory_pool = true;
+    
+    bool operator==(const CudaCallOptions& other) const {
+        return use_tensor_cores == other.use_tensor_cores &&
+               batch_size == other.batch_size &&
+               enable_memory_pool == other.enable_memory_pool;
+    }
+    bool operator!=(const CudaCallOptions& other) const { return !(*this == other); }
+};
+
+// Per-call ProcessingFlags for processLegalDocument
+struct DocumentProcessingOptions {
+    bool extract_entities = true;
+    bool generate_summary = true;
+    bool compute_embeddings = true;
+    bool analyze_sentiment = true;
+    std::optional<bool> detect_clauses;  // unset: only for contracts
+};
+
+// How a bidirectional session recovers from a dropped connection: up to
+// max_attempts reconnects (0 disables them), backing off exponentially from
+// initial_backoff to max_backoff with +/-20% jitter. Written requests are
+// kept for replay until acknowledged, up to replay_buffer_bytes.
+struct ReconnectPolicy {
+    uint32_t max_attempts = 6;
+    std::chrono::milliseconds initial_backoff{250};
+    std::chrono::milliseconds max_backoff{10000};
+    size_t replay_buffer_bytes = 8 * 1024 * 1024;
+};
+
+// Message compression. A call left at Default uses its channel's setting;
+// any other value is set on the call itself. A server that lacks an
+// algorithm fails the call with UNIMPLEMENTED, so deflate is opt-in.
+enum class Compression { Default, None, Deflate, Gzip };
+
+// Compression per kind of RPC. By default only document text is
+// compressed: legal prose shrinks 5-8x, while dense float vectors barely
+// compress and would only cost CPU on both ends.
+struct CompressionPolicy {
+    Compression documents = Compression::Gzip;   // ProcessLegalDocument and uploads
+    Compression stream = Compression::Default;   // bidirectional sessions
+    Compression search = Compression::Default;
+    Compression similarity = Compression::Default;
+    // On compressed calls, smaller messages are still written uncompressed
+    size_t min_message_bytes = 1024;
+};
+
+inline grpc_compression_algorithm compressionAlgorithm(Compression compression) {
+    switch (compression) {
+        case Compression::Deflate: return GRPC_COMPRESS_DEFLATE;
+        case Compression::Gzip: return GRPC_COMPRESS_GZIP;
+        default: return GRPC_COMPRESS_NONE;
+    }
+}
+
+// "none", "deflate" or "gzip"; anything else (e.g. "default") is Default
+inline Compression compressionFromName(const std::string& name) {
+    if (name == "none") return Compression::None;
+    if (name == "deflate") return Compression::Deflate;
+    if (name == "gzip") return Compression::Gzip;
+    return Compression::Default;
+}
+
+inline void applyCompression(ClientContext& context, Compression compression) {
+    if (compression != Compression::Default) {
+        context.set_compression_algorithm(compressionAlgorithm(compression));
+    }
+}
+
+// Write options for one message on a call that may compress: small
+// messages, and stream requests carrying a query vector, skip compression
+inline grpc::WriteOptions messageWriteOptions(size_t bytes, size_t min_compressed_bytes,
+                                              bool dense_vector = false) {
+    grpc::WriteOptions options;
+    if (dense_vector || bytes < min_compressed_bytes) {
+        options.set_no_compression();
+    }
+    return options;
+}
+
+inline bool carriesQueryVector(const CudaRequest& request) {
+    return request.embedding_vector_size() > 0 || request.has_quantized_embedding_vector();
+}
+
+inline void fillEmbeddingBatch(CudaRequest& request,
+                               const std::string& session_id,
+                               const std::vector<std::string>& texts,
+                               bool is_final,
+                               const CudaCallOptions& options,
+                               EmbeddingEncoding accept_encoding) {
+    request.set_session_id(session_id);
+    request.set_operation_type("embed");
+    request.set_is_final_chunk(is_final);
+    request.set_accept_encoding(accept_encoding);
+    request.mutable_raw_texts()->Reserve(static_cast<int>(texts.size()));
+    for (const auto& text : texts) {
+        request.add_raw_texts(text);
+    }
+    
+    // The real batch size lets the server launch one batched kernel
+    auto* cuda_options = request.mutable_cuda_options();
+    cuda_options->set_use_tensor_cores(options.use_tensor_cores);
+    cuda_options->set_batch_size(options.batch_size > 0 ? options.batch_size
+                                                        : static_cast<int>(texts.size()));
+    cuda_options->set_enable_memory_pool(options.enable_memory_pool);
+}
+
+// Query vector for a search request, in encoding (float32 as the plain field)
+inline void setQueryVector(CudaRequest& request, const float* data, size_t length,
+                           EmbeddingEncoding encoding) {
+    request.set_accept_encoding(encoding);
+    if (encoding == EMBEDDING_FLOAT32) {
+        request.mutable_embedding_vector()->Add(data, data + length);
+    } else {
+        encodeEmbedding(data, 1, length, encoding, request.mutable_quantized_embedding_vector());
+    }
+}
+
+// Transport-level failures that a fresh stream may get past
+inline bool isRetryable(const Status& status) {
+    switch (status.error_code()) {
+        case grpc::UNAVAILABLE:
+        case grpc::ABORTED:
+        case grpc::INTERNAL:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// JSON conversion helpers
+inline std::string cudaResponseToJson(const CudaResponse& response,
+                                      bool include_embeddings = true) {
+    // Convert protobuf to JSON string
+    std::string json = "{";
+    json += "\"session_id\":\"" + response.session_id() + "\",";
+    json += "\"operation_type\":\"" + response.operation_type() + "\",";
+    json += "\"status\":" + std::to_string(response.status()) + ",";
+    
+    if (include_embeddings && response.computed_embedding_size() > 0) {
+        json += "\"embeddings\":[";
+        for (int i = 0; i < response.computed_embedding_size(); ++i) {
+            if (i > 0) json += ",";
+            json += std::to_string(response.computed_embedding(i));
+        }
+        json += "],";
+    }
+    
+    if (response.has_cuda_metrics()) {
+        const auto& metrics = response.cuda_metrics();
+        json += "\"performance\":{";
+        json += "\"processing_time_us\":" + std::to_string(metrics.total_processing_time_us()) + ",";
+        json += "\"gpu_utilization\":" + std::to_string(metrics.gpu_utilization()) + ",";
+        json += "\"gpu_model\":\"" + metrics.gpu_model() + "\"";
+        json += "}";
+    }
+    
+    json += "}";
+    return json;
+}
+
+inline std::string documentResponseToJson(const DocumentResponse& response) {
+    // Simplified JSON conversion
+    return "{\"document_id\":\"" + response.document_id() + "\"}";
+}
+
+inline std::string searchResponseToJson(const SearchResponse& response) {
+    // Simplified JSON conversion
+    return "{\"query_id\":\"" + response.query_id() + "\"}";
+}
+
+inline std::string similarityResponseToJson(const SimilarityResponse& response) {
+    // Simplified JSON conversion
+    return "{\"base_case_id\":\"" + response.base_case_id() + "\"}";
+}
+
+// Flat binary conversion helpers (layouts mirrored in legal-grpc-decoder.ts)
+inline void cudaResponseToFlat(const CudaResponse& response, FlatMessageWriter& writer,
+                               bool include_embeddings = true) {
+    writer.reset(FlatMessageKind::CudaResponse);
+    writer.writeString(response.session_id());
+    writer.writeString(response.operation_type());
+    writer.writeI32(static_cast<int32_t>(response.status()));
+    
+    if (include_embeddings) {
+        writer.writeFloats(response.computed_embedding().data(), response.computed_embedding_size());
+    } else {
+        writer.writeFloats(nullptr, 0);
+    }
+    
+    writer.writeU32(response.has_cuda_metrics() ? 1 : 0);
+    if (response.has_cuda_metrics()) {
+        const auto& metrics = response.cuda_metrics();
+        writer.writeF64(static_cast<double>(metrics.total_processing_time_us()));
+        writer.writeF32(metrics.gpu_utilization());
+        writer.writeString(metrics.gpu_model());
+    }
+}
+
+inline void documentResponseToFlat(const DocumentResponse& response, FlatMessageWriter& writer) {
+    writer.reset(FlatMessageKind::DocumentResponse);
+    writer.writeString(response.document_id());
+    writer.writeI32(static_cast<int32_t>(response.stage()));
+    writer.writeF32(response.progress());
+}
+
+inline void searchResponseToFlat(const SearchResponse& response, FlatMessageWriter& writer) {
+    writer.reset(FlatMessageKind::SearchResponse);
+    writer.writeString(response.query_id());
+    writer.writeI32(response.total_matches());
+    writer.writeU32(response.is_complete() ? 1 : 0);
+    
+    // Scores first as one contiguous array, then the per-match strings
+    const int count = response.matches_size();
+    writer.writeU32(static_cast<uint32_t>(count));
+    for (int i = 0; i < count; ++i) {
+        writer.writeF32(response.matches(i).similarity_score());
+    }
+    for (int i = 0; i < count; ++i) {
+        const auto& match = response.matches(i);
+        writer.writeString(match.document_id());
+        writer.writeString(match.title());
+        writer.writeString(match.snippet());
+        writer.writeU32(static_cast<uint32_t>(match.metadata_size()));
+        for (const auto& entry : match.metadata()) {
+            writer.writeString(entry.first);
+            writer.writeString(entry.second);
+        }
+    }
+}
+
+inline void similarityResponseToFlat(const SimilarityResponse& response, FlatMessageWriter& writer) {
+    writer.reset(FlatMessageKind::SimilarityResponse);
+    writer.writeString(response.base_case_id());
+    
+    const int count = response.similarities_size();
+    writer.writeU32(static_cast<uint32_t>(count));
+    for (int i = 0; i < count; ++i) {
+        writer.writeF32(response.similarities(i).similarity());
+    }
+    for (int i = 0; i < count; ++i) {
+        const auto& similarity = response.similarities(i);
+        writer.writeString(similarity.case_id());
+        writer.writeU32(static_cast<uint32_t>(similarity.metrics_size()));
+        for (const auto& metric : similarity.metrics()) {
+            writer.writeString(metric.first);
+            writer.writeF32(metric.second);
+        }
+    }
+}
+
+} // namespace legal_cuda_streaming
@@ -0,0 +1,170 @@
+// legal_client_metrics.h - Client-side latency histograms per RPC type
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+namespace legal_cuda_streaming {
+
+// HDR-style log-linear histogram of microsecond durations: 32 linear
+// sub-buckets per power of two (~3% resolution) up to 2^33 us (~2.4 hours),
+// with larger values clamped into the last bucket. Recording is lock-free so
+// the reactor and main threads can both feed the same histogram.
+class LatencyHistogram {
+public:
+    void record(uint64_t micros) {
+        counts_[bucketFor(micros)].fetch_add(1, std::memory_order_relaxed);
+        count_.fetch_add(1, std::memory_order_relaxed);
+        sum_.fetch_add(micros, std::memory_order_relaxed);
+        
+        uint64_t seen = max_.load(std::memory_order_relaxed);
+        while (micros > seen && !max_.compare_exchange_weak(seen, micros, std::memory_order_relaxed)) {}
+        seen = min_.load(std::memory_order_relaxed);
+        while (micros < seen && !min_.compare_exchange_weak(seen, micros, std::memory_order_relaxed)) {}
+    }
+    
+    void reset() {
+        for (auto& bucket : counts_) {
+            bucket.store(0, std::memory_order_relaxed);
+        }
+        count_.store(0, std::memory_order_relaxed);
+        sum_.store(0, std::memory_order_relaxed);
+        max_.store(0, std::memory_order_relaxed);
+        min_.store(UINT64_MAX, std::memory_order_relaxed);
+    }
+    
+    // All in microseconds; only count is meaningful while it is 0
+    struct Summary {
+        uint64_t count = 0;
+        uint64_t min = 0;
+        uint64_t max = 0;
+        double mean = 0.0;
+        uint64_t p50 = 0;
+        uint64_t p90 = 0;
+        uint64_t p99 = 0;
+        uint64_t p999 = 0;
+    };
+    
+    Summary summary() const {
+        Summary result;
+        result.count = count_.load(std::memory_order_relaxed);
+        if (result.count == 0) {
+            return result;
+        }
+        
+        result.min = min_.load(std::memory_order_relaxed);
+        result.max = max_.load(std::memory_order_relaxed);
+        result.mean = static_cast<double>(sum_.load(std::memory_order_relaxed)) / result.count;
+        result.p50 = percentile(0.50);
+        result.p90 = percentile(0.90);
+        result.p99 = percentile(0.99);
+        result.p999 = percentile(0.999);
+        return result;
+    }
+
+private:
+    static constexpr unsigned kSubBucketBits = 5;
+    static constexpr uint64_t kSubBuckets = 1ull << kSubBucketBits;
+    static constexpr unsigned kMaxShift = 32 - kSubBucketBits;
+    static constexpr size_t kBucketCount = kSubBuckets + (kMaxShift + 1) * kSubBuckets;
+    
+    std::array<std::atomic<uint64_t>, kBucketCount> counts_{};
+    std::atomic<uint64_t> count_{0};
+    std::atomic<uint64_t> sum_{0};
+    std::atomic<uint64_t> max_{0};
+    std::atomic<uint64_t> min_{UINT64_MAX};
+    
+    static size_t bucketFor(uint64_t value) {
+        if (value < kSubBuckets) return static_cast<size_t>(value);
+        
+        const unsigned shift = (63 - __builtin_clzll(value)) - kSubBucketBits;
+        if (shift > kMaxShift) return kBucketCount - 1;
+        return static_cast<size_t>(shift * kSubBuckets + (value >> shift));
+    }
+    
+    // Upper edge of a bucket, so percentiles never under-report
+    static uint64_t bucketUpperBound(size_t index) {
+        if (index < kSubBuckets) return index;
+        
+        const unsigned shift = static_cast<unsigned>(index / kSubBuckets) - 1;
+        const uint64_t sub = index % kSubBuckets + kSubBuckets;
+        return ((sub + 1) << shift) - 1;
+    }
+    
+    uint64_t percentile(double fraction) const {
+        const uint64_t count = count_.load(std::memory_order_relaxed);
+        const uint64_t target = std::max<uint64_t>(1, static_cast<uint64_t>(fraction * count + 0.5));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < kBucketCount; ++i) {
+            seen += counts_[i].load(std::memory_order_relaxed);
+            if (seen >= target) {
+                return std::min(bucketUpperBound(i), max_.load(std::memory_order_relaxed));
+            }
+        }
+        return max_.load(std::memory_order_relaxed);
+    }
+};
+
+// Client-measured timings for one RPC type. Message timings are taken on the
+// reactor thread as reads complete; conversion and dispatch on the main thread.
+struct RpcMetrics {
+    LatencyHistogram time_to_first_message;  // call start to first response
+    LatencyHistogram inter_message_gap;      // between consecutive responses
+    LatencyHistogram serialization;          // protobuf to JSON or flat format
+    LatencyHistogram dispatch;               // JS callbacks, including JSON.parse
+    
+    void reset() {
+        time_to_first_message.reset();
+        inter_message_gap.reset();
+        serialization.reset();
+        dispatch.reset();
+    }
+
+};
+
+struct ClientMetrics {
+    RpcMetrics stream;
+    RpcMetrics document;
+    RpcMetrics search;
+    RpcMetrics similarity;
+};
+
+using MetricsClock = std::chrono::steady_clock;
+
+inline uint64_t elapsedMicros(MetricsClock::time_point since,
+                              MetricsClock::time_point now = MetricsClock::now()) {
+    return static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::microseconds>(now - since).count());
+}
+
+// Feeds time_to_first_message and inter_message_gap as responses arrive.
+// Used from a single thread (the reactor).
+class MessageTimer {
+public:
+    void start() {
+        started_at_ = MetricsClock::now();
+        received_any_ = false;
+    }
+    
+    void onMessage(RpcMetrics& metrics) {
+        const auto now = MetricsClock::now();
+        if (received_any_) {
+            metrics.inter_message_gap.record(elapsedMicros(last_message_at_, now));
+        } else {
+            metrics.time_to_first_message.record(elapsedMicros(started_at_, now));
+            received_any_ = true;
+        }
+        last_message_at_ = now;
+    }
+
+private:
+    MetricsClock::time_point started_at_;
+    MetricsClock::time_point last_message_at_;
+    bool received_any_ = false;
+};
+
+} // namespace legal_cuda_streaming
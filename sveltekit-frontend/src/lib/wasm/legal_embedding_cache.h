@@ -0,0 +1,170 @@
+// legal_embedding_cache.h - Client-side LRU of computed embeddings
+//
+// Answers repeated texts without a round trip. Snapshots use the flat
+// format, so legal-grpc-embedding-store.ts can persist them as they are.
+#pragma once
+
+#include "legal_flat_message.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace legal_cuda_streaming {
+
+// Bounded LRU of text hash -> embedding. Keys are 64-bit FNV-1a hashes, which
+// stay stable across builds so snapshots can be persisted between page loads.
+class EmbeddingCache {
+public:
+    static uint64_t keyFor(const std::string& text) {
+        uint64_t hash = 14695981039346656037ull;
+        for (unsigned char c : text) {
+            hash ^= c;
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+    
+    // A capacity of 0 disables the cache
+    void setCapacity(size_t capacity) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        capacity_ = capacity;
+        evict();
+    }
+    
+    bool enabled() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return capacity_ > 0;
+    }
+    
+    bool get(uint64_t key, std::vector<float>& out) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (capacity_ == 0) return false;
+        
+        auto it = index_.find(key);
+        if (it == index_.end()) {
+            ++misses_;
+            return false;
+        }
+        
+        ++hits_;
+        lru_.splice(lru_.begin(), lru_, it->second);
+        out = it->second->embedding;
+        return true;
+    }
+    
+    void put(uint64_t key, const float* data, size_t dims) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (capacity_ == 0) return;
+        
+        auto it = index_.find(key);
+        if (it != index_.end()) {
+            it->second->embedding.assign(data, data + dims);
+            lru_.splice(lru_.begin(), lru_, it->second);
+            return;
+        }
+        
+        lru_.push_front(Entry{key, std::vector<float>(data, data + dims)});
+        index_[key] = lru_.begin();
+        evict();
+    }
+    
+    void clear() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        lru_.clear();
+        index_.clear();
+        hits_ = 0;
+        misses_ = 0;
+    }
+    
+    struct Stats {
+        uint64_t hits;
+        uint64_t misses;
+        size_t size;
+        size_t capacity;
+    };
+    
+    Stats stats() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return {hits_, misses_, lru_.size(), capacity_};
+    }
+    
+    // Snapshot, most recently used first: u32 count, then per entry the key
+    // as two u32 halves followed by the embedding as a float array
+    void serialize(FlatMessageWriter& writer) const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        writer.reset(FlatMessageKind::EmbeddingCacheSnapshot);
+        writer.writeU32(static_cast<uint32_t>(lru_.size()));
+        for (const Entry& entry : lru_) {
+            writer.writeU32(static_cast<uint32_t>(entry.key));
+            writer.writeU32(static_cast<uint32_t>(entry.key >> 32));
+            writer.writeFloats(entry.embedding.data(), entry.embedding.size());
+        }
+    }
+    
+    // Merge a snapshot; returns the number of entries read
+    size_t deserialize(const uint8_t* data, size_t size) {
+        size_t offset = 0;
+        auto readU32 = [&](uint32_t& value) {
+            if (offset + sizeof(value) > size) return false;
+            std::memcpy(&value, data + offset, sizeof(value));
+            offset += sizeof(value);
+            return true;
+        };
+        
+        uint32_t kind = 0, count = 0;
+        if (!readU32(kind) || kind != static_cast<uint32_t>(FlatMessageKind::EmbeddingCacheSnapshot) ||
+            !readU32(count)) {
+            return 0;
+        }
+        
+        // Entries arrive most recent first, so insert them in reverse
+        std::vector<std::pair<uint64_t, std::vector<float>>> entries;
+        entries.reserve(count);
+        for (uint32_t i = 0; i < count; ++i) {
+            uint32_t low = 0, high = 0, dims = 0;
+            if (!readU32(low) || !readU32(high) || !readU32(dims) ||
+                offset + size_t(dims) * sizeof(float) > size) {
+                break;
+            }
+            std::vector<float> embedding(dims);
+            std::memcpy(embedding.data(), data + offset, size_t(dims) * sizeof(float));
+            offset += size_t(dims) * sizeof(float);
+            entries.emplace_back((uint64_t(high) << 32) | low, std::move(embedding));
+        }
+        
+        for (auto it = entries.rbegin(); it != entries.rend(); ++it) {
+            put(it->first, it->second.data(), it->second.size());
+        }
+        return entries.size();
+    }
+
+private:
+    struct Entry {
+        uint64_t key;
+        std::vector<float> embedding;
+    };
+    
+    std::list<Entry> lru_;
+    std::unordered_map<uint64_t, std::list<Entry>::iterator> index_;
+    size_t capacity_ = 0;
+    uint64_t hits_ = 0;
+    uint64_t misses_ = 0;
+    mutable std::mutex mutex_;
+    
+    // Requires mutex_
+    void evict() {
+        while (lru_.size() > capacity_) {
+            index_.erase(lru_.back().key);
+            lru_.pop_back();
+        }
+    }
+};
+
+} // namespace legal_cuda_streaming
@@ -0,0 +1,66 @@
+// legal_flat_message.h - Writer for the flat binary delivery format
+//
+// The format callbacks and the result ring carry when binary delivery is on,
+// decoded in JS by legal-grpc-decoder.ts. The per-response layouts are
+// written by the *ToFlat helpers in legal_client_core.h.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace legal_cuda_streaming {
+
+// Message kinds for the flat binary delivery format (see legal-grpc-decoder.ts)
+enum class FlatMessageKind : uint32_t {
+    CudaResponse = 1,
+    DocumentResponse = 2,
+    SearchResponse = 3,
+    SimilarityResponse = 4,
+    EmbeddingCacheSnapshot = 5,
+    CallComplete = 6  // result ring only: u32 ok
+};
+
+// Little-endian, 4-byte aligned struct-of-arrays encoder. Strings are a u32
+// byte length followed by UTF-8 padded to 4 bytes; float arrays are a u32
+// count followed by raw f32 data so JS can view them without parsing.
+class FlatMessageWriter {
+private:
+    std::vector<uint8_t> buffer_;
+    
+    void append(const void* data, size_t size) {
+        const size_t offset = buffer_.size();
+        buffer_.resize(offset + ((size + 3) & ~size_t(3)));
+        if (size > 0) {
+            std::memcpy(buffer_.data() + offset, data, size);
+        }
+    }
+
+public:
+    void reset(FlatMessageKind kind) {
+        buffer_.clear();  // keeps capacity, so steady-state messages don't allocate
+        writeU32(static_cast<uint32_t>(kind));
+    }
+    
+    void writeU32(uint32_t value) { append(&value, sizeof(value)); }
+    void writeI32(int32_t value) { append(&value, sizeof(value)); }
+    void writeF32(float value) { append(&value, sizeof(value)); }
+    void writeF64(double value) { append(&value, sizeof(value)); }
+    
+    void writeString(const std::string& value) {
+        writeU32(static_cast<uint32_t>(value.size()));
+        append(value.data(), value.size());
+    }
+    
+    void writeFloats(const float* data, size_t count) {
+        writeU32(static_cast<uint32_t>(count));
+        append(data, count * sizeof(float));
+    }
+    
+    const uint8_t* data() const { return buffer_.data(); }
+    size_t size() const { return buffer_.size(); }
+};
+
+} // namespace legal_cuda_streaming
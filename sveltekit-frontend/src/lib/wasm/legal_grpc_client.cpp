@@ -2,406 +2,3247 @@
 #include <emscripten.h>
 #include <emscripten/bind.h>
 #include <emscripten/fetch.h>
+#include <emscripten/html5.h>
+#include <emscripten/proxying.h>
+#include <emscripten/threading.h>
 
-#include "legal_cuda_streaming.grpc.pb.h"
-#include <grpcpp/grpcpp.h>
+#include "legal_client_core.h"
+#include "legal_result_ring.h"
+#include "legal_similarity_matrix.h"
+#include "legal_vector_index.h"
+#ifdef LEGAL_GRPC_BENCH
+#include "legal_allocation_counter.h"
+#include "legal_bench_messages.h"
+#endif
+#include <grpcpp/alarm.h>
 #include <grpc/support/log.h>
 
 #include <memory>
+#include <optional>
 #include <string>
 #include <vector>
 #include <functional>
-#include <thread>
-#include <atomic>
 #include <queue>
+#include <deque>
 #include <mutex>
-
-using grpc::Channel;
-using grpc::ClientContext;
-using grpc::ClientReader;
-using grpc::ClientReaderWriter;
-using grpc::Status;
+#include <random>
+#include <unordered_map>
+#include <unordered_set>
 
 namespace legal_cuda_streaming {
 
+// emscripten::val handles belong to the thread that created them. JS callbacks
+// are therefore only ever invoked on the main runtime thread, and are shared
+// behind a pointer whose final release is proxied back there as well.
+using JsCallback = std::shared_ptr<emscripten::val>;
+
+inline void runOnMainThread(std::function<void()> work) {
+    static emscripten::ProxyingQueue main_thread_queue;
+    main_thread_queue.proxyAsync(emscripten_main_runtime_thread_id(), std::move(work));
+}
+
+inline JsCallback makeJsCallback(emscripten::val callback) {
+    return JsCallback(new emscripten::val(std::move(callback)), [](emscripten::val* handle) {
+        if (emscripten_is_main_runtime_thread()) {
+            delete handle;
+        } else {
+            runOnMainThread([handle]() { delete handle; });
+        }
+    });
+}
+
+// { count, min, max, mean, p50, p90, p99, p999 }, all in microseconds
+inline emscripten::val histogramToJs(const LatencyHistogram& histogram) {
+    const LatencyHistogram::Summary summary = histogram.summary();
+    emscripten::val result = emscripten::val::object();
+    result.set("count", static_cast<double>(summary.count));
+    if (summary.count == 0) {
+        return result;
+    }
+    
+    result.set("min", static_cast<double>(summary.min));
+    result.set("max", static_cast<double>(summary.max));
+    result.set("mean", summary.mean);
+    result.set("p50", static_cast<double>(summary.p50));
+    result.set("p90", static_cast<double>(summary.p90));
+    result.set("p99", static_cast<double>(summary.p99));
+    result.set("p999", static_cast<double>(summary.p999));
+    return result;
+}
+
+inline emscripten::val rpcMetricsToJs(const RpcMetrics& metrics) {
+    emscripten::val result = emscripten::val::object();
+    result.set("time_to_first_message_us", histogramToJs(metrics.time_to_first_message));
+    result.set("inter_message_gap_us", histogramToJs(metrics.inter_message_gap));
+    result.set("serialization_us", histogramToJs(metrics.serialization));
+    result.set("dispatch_us", histogramToJs(metrics.dispatch));
+    return result;
+}
+
+// How a subscriber's messages are handed to JS. By default each message is
+// its own callback; batched subscribers instead get an array of the messages
+// buffered since the last flush, once per animation frame and/or every
+// max_messages messages. Whatever is still buffered is flushed when the call
+// completes.
+struct DispatchBatching {
+    bool per_frame = false;
+    uint32_t max_messages = 0;  // 0: no count limit
+    
+    bool enabled() const { return per_frame || max_messages > 0; }
+};
+
+// Main-thread fan-out state shared by every response type: who is
+// subscribed (each under the JS handle returned for its call), their
+// buffered batches, and how the underlying call ended.
+class ResponseFanoutBase : public std::enable_shared_from_this<ResponseFanoutBase> {
+public:
+    // Receives the handles still subscribed when the call finished
+    using CompletionHook = std::function<void(const std::vector<uint32_t>&)>;
+    // Takes a subscriber's flat messages in place of its JS callback (the
+    // result ring), followed by a CallComplete message when the call ends.
+    // False hands that message to the JS callback instead.
+    using Sink = std::function<bool(uint32_t handle, const FlatMessageWriter&)>;
+    
+    explicit ResponseFanoutBase(bool binary) : binary_(binary) {}
+    virtual ~ResponseFanoutBase() = default;
+    
+    void setCallId(uint32_t call_id) { call_id_ = call_id; }
+    uint32_t callId() const { return call_id_; }
+    
+    void addOnComplete(CompletionHook hook) {
+        on_complete_.push_back(std::move(hook));
+    }
+    
+    bool unsubscribe(uint32_t handle) {
+        for (auto it = subscribers_.begin(); it != subscribers_.end(); ++it) {
+            if (it->handle == handle) {
+                // A flush already iterating a snapshot must not deliver these
+                if (it->batch) it->batch->clear();
+                subscribers_.erase(it);
+                return true;
+            }
+        }
+        return false;
+    }
+    
+    size_t subscriberCount() const { return subscribers_.size(); }
+    
+    // Marks a call whose last subscriber left, so nobody joins it any more
+    void cancel() { cancelled_ = true; }
+    bool cancelled() const { return cancelled_; }
+    
+    void complete(bool ok) {
+        flushBatches(false);
+        done_ = true;
+        ok_ = ok && !cancelled_;
+        completed_at_ = MetricsClock::now();
+        
+        std::vector<uint32_t> handles;
+        for (const auto& subscriber : subscribers_) {
+            handles.push_back(subscriber.handle);
+            if (subscriber.sink) {
+                sinkCompletion(subscriber);
+            }
+        }
+        subscribers_.clear();
+        for (const auto& hook : on_complete_) {
+            hook(handles);
+        }
+    }
+    
+    bool done() const { return done_; }
+    bool ok() const { return ok_; }
+    MetricsClock::time_point completedAt() const { return completed_at_; }
+
+protected:
+    // Converted messages waiting for a batched subscriber's next flush: a
+    // JSON array under construction, or flat messages back to back with
+    // their start offsets
+    struct PendingBatch {
+        std::string json;
+        std::vector<uint8_t> flat;
+        std::vector<uint32_t> offsets;
+        size_t count = 0;
+        
+        void clear() {
+            json.clear();
+            flat.clear();
+            offsets.clear();
+            count = 0;
+        }
+    };
+    
+    struct Subscriber {
+        uint32_t handle;
+        JsCallback callback;
+        DispatchBatching batching;
+        std::shared_ptr<PendingBatch> batch;  // set when batching is enabled
+        Sink sink;
+    };
+    
+    bool binary_;
+    std::vector<Subscriber> subscribers_;
+    uint32_t call_id_ = 0;
+    std::vector<CompletionHook> on_complete_;
+    bool cancelled_ = false;
+    bool done_ = false;
+    bool ok_ = false;
+    bool frame_scheduled_ = false;
+    MetricsClock::time_point completed_at_;
+    
+    // Hand one converted message to a subscriber, directly or via its batch
+    void dispatch(const Subscriber& subscriber, const FlatMessageWriter& writer,
+                  const std::string& json) {
+        if (subscriber.sink) {
+            if (!subscriber.sink(subscriber.handle, writer)) {
+                dispatchOne(*subscriber.callback, writer, json);
+            }
+            return;
+        }
+        if (!subscriber.batch) {
+            dispatchOne(*subscriber.callback, writer, json);
+            return;
+        }
+        
+        PendingBatch& batch = *subscriber.batch;
+        appendToBatch(batch, writer, json);
+        if (subscriber.batching.max_messages > 0 && batch.count >= subscriber.batching.max_messages) {
+            dispatchBatch(*subscriber.callback, batch);
+        } else if (subscriber.batching.per_frame) {
+            scheduleFrame();
+        }
+    }
+    
+    void appendToBatch(PendingBatch& batch, const FlatMessageWriter& writer, const std::string& json) {
+        if (binary_) {
+            batch.offsets.push_back(static_cast<uint32_t>(batch.flat.size()));
+            batch.flat.insert(batch.flat.end(), writer.data(), writer.data() + writer.size());
+        } else {
+            batch.json += batch.count == 0 ? '[' : ',';
+            batch.json += json;
+        }
+        ++batch.count;
+    }
+    
+    void sinkCompletion(const Subscriber& subscriber) {
+        FlatMessageWriter completion;
+        completion.reset(FlatMessageKind::CallComplete);
+        completion.writeU32(ok_ ? 1 : 0);
+        if (!subscriber.sink(subscriber.handle, completion)) {
+            dispatchOne(*subscriber.callback, completion, std::string());
+        }
+    }
+    
+    // Deliver every pending batch, or with frame_only just the per-frame ones
+    void flushBatches(bool frame_only) {
+        const auto subscribers = subscribers_;
+        for (const auto& subscriber : subscribers) {
+            if (subscriber.batch && (!frame_only || subscriber.batching.per_frame)) {
+                dispatchBatch(*subscriber.callback, *subscriber.batch);
+            }
+        }
+    }
+
+    void dispatchBatch(const emscripten::val& callback, PendingBatch& pending) {
+        if (pending.count == 0) return;
+        
+        // The callback may subscribe or unsubscribe, so take the batch first
+        PendingBatch batch;
+        std::swap(batch, pending);
+        
+        if (binary_) {
+            batch.offsets.push_back(static_cast<uint32_t>(batch.flat.size()));
+            EM_ASM({
+                var callback = Module['getObject']($0);
+                var offsets = HEAPU32.subarray($3 >> 2, ($3 >> 2) + $4 + 1);
+                var messages = new Array($4);
+                for (var i = 0; i < $4; ++i) {
+                    messages[i] = HEAPU8.subarray($1 + offsets[i], $1 + offsets[i + 1]);
+                }
+                callback(messages);
+            }, callback.as_handle(), batch.flat.data(), batch.flat.size(),
+               batch.offsets.data(), batch.count);
+        } else {
+            batch.json += ']';
+            EM_ASM({
+                var callback = Module['getObject']($0);
+                callback(JSON.parse(UTF8ToString($1)));
+            }, callback.as_handle(), batch.json.c_str());
+        }
+        
+        // Hand the buffers back so steady-state batches don't reallocate
+        if (pending.count == 0) {
+            batch.clear();
+            std::swap(batch, pending);
+        }
+    }
+    
+private:
+    void scheduleFrame() {
+        if (frame_scheduled_) return;
+        frame_scheduled_ = true;
+        
+        // The frame callback only holds a weak reference, so it is a no-op
+        // for a fanout that has gone away by then
+        auto* weak_self = new std::weak_ptr<ResponseFanoutBase>(shared_from_this());
+        emscripten_request_animation_frame([](double, void* user_data) -> EM_BOOL {
+            std::unique_ptr<std::weak_ptr<ResponseFanoutBase>> weak(
+                static_cast<std::weak_ptr<ResponseFanoutBase>*>(user_data));
+            if (auto self = weak->lock()) {
+                self->frame_scheduled_ = false;
+                self->flushBatches(true);
+            }
+            return EM_FALSE;
+        }, weak_self);
+    }
+    
+    void dispatchOne(const emscripten::val& callback, const FlatMessageWriter& writer,
+                     const std::string& json) {
+        if (binary_) {
+            EM_ASM({
+                var callback = Module['getObject']($0);
+                callback(HEAPU8.subarray($1, $1 + $2));
+            }, callback.as_handle(), writer.data(), writer.size());
+            return;
+        }
+        
+        // Each subscriber parses its own copy, so none can mutate another's
+        EM_ASM({
+            var callback = Module['getObject']($0);
+            var response = JSON.parse(UTF8ToString($1));
+            callback(response);
+        }, callback.as_handle(), json.c_str());
+    }
+};
+
+// Delivery of one call's responses to its JS callbacks. Each response is
+// converted once and handed to every subscriber. With retain, responses are
+// kept so that a subscriber joining later is caught up first.
+template <typename Response>
+class ResponseFanout : public ResponseFanoutBase {
+public:
+    using ToJson = std::string (*)(const Response&);
+    using ToFlat = void (*)(const Response&, FlatMessageWriter&);
+    
+    ResponseFanout(bool binary, bool retain, ToJson to_json, ToFlat to_flat)
+        : ResponseFanoutBase(binary), retain_(retain), to_json_(to_json), to_flat_(to_flat) {}
+    
+    // A sink requires flat (binary) conversion and replaces batching
+    void subscribe(JsCallback callback, uint32_t handle, DispatchBatching batching = {},
+                   Sink sink = nullptr) {
+        const bool batched = batching.enabled() && !sink;
+        Subscriber subscriber{handle, std::move(callback), batching,
+                              batched ? std::make_shared<PendingBatch>() : nullptr, std::move(sink)};
+        
+        // Replays use their own buffers in case this runs from inside a
+        // dispatch; a batched subscriber gets them as one batch
+        FlatMessageWriter writer;
+        std::string json;
+        for (const auto& response : responses_) {
+            convert(*response, writer, json);
+            if (subscriber.batch) {
+                appendToBatch(*subscriber.batch, writer, json);
+            } else {
+                dispatch(subscriber, writer, json);
+            }
+        }
+        if (subscriber.batch) {
+            dispatchBatch(*subscriber.callback, *subscriber.batch);
+        }
+        if (!done_) {
+            subscribers_.push_back(std::move(subscriber));
+        } else if (subscriber.sink) {
+            sinkCompletion(subscriber);
+        }
+    }
+    
+    void deliver(std::shared_ptr<Response> response, RpcMetrics& metrics) {
+        const auto convert_start = MetricsClock::now();
+        convert(*response, writer_, json_);
+        const auto dispatch_start = MetricsClock::now();
+        metrics.serialization.record(elapsedMicros(convert_start, dispatch_start));
+        
+        // Callbacks may subscribe or cancel callers, so iterate over a snapshot
+        const auto subscribers = subscribers_;
+        for (const auto& subscriber : subscribers) {
+            dispatch(subscriber, writer_, json_);
+        }
+        metrics.dispatch.record(elapsedMicros(dispatch_start));
+        
+        if (retain_) {
+            responses_.push_back(std::move(response));
+        }
+    }
+
+private:
+    bool retain_;
+    ToJson to_json_;
+    ToFlat to_flat_;
+    std::vector<std::shared_ptr<Response>> responses_;
+    FlatMessageWriter writer_;
+    std::string json_;
+    
+    void convert(const Response& response, FlatMessageWriter& writer, std::string& json) {
+        if (binary_) {
+            to_flat_(response, writer);
+        } else {
+            json = to_json_(response);
+        }
+    }
+};
+
+// Contexts of in-flight server-streaming calls, so they can be cancelled from
+// JS handles and by the client's destructor. Calls remove themselves before
+// their context is destroyed; both happen under the lock.
+class CallRegistry {
+public:
+    uint32_t reserve() {
+        return next_id_.fetch_add(1, std::memory_order_relaxed);
+    }
+    
+    void add(uint32_t id, ClientContext* context) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        calls_[id] = context;
+    }
+    
+    void remove(uint32_t id) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        calls_.erase(id);
+    }
+    
+    bool cancel(uint32_t id) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = calls_.find(id);
+        if (it == calls_.end()) return false;
+        
+        it->second->TryCancel();
+        return true;
+    }
+    
+    void cancelAll() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto& call : calls_) {
+            call.second->TryCancel();
+        }
+    }
+
+private:
+    std::mutex mutex_;
+    std::unordered_map<uint32_t, ClientContext*> calls_;
+    std::atomic<uint32_t> next_id_{1};
+};
+
+// Per-call deadline, latest-wins group and compression for the streaming RPCs
+struct StreamCallOptions {
+    uint32_t deadline_ms = 0;        // 0: no deadline
+    std::string latest_wins_group;  // a new call cancels the group's previous one
+    DispatchBatching batching;
+    std::optional<Compression> compression;  // unset: the policy's for the RPC
+    std::optional<RpcClass> priority;        // unset: the RPC's own class
+};
+
 class LegalGrpcWebClient {
 private:
-    std::unique_ptr<LegalCudaService::Stub> stub_;
-    std::shared_ptr<Channel> channel_;
+    // Declared first so channels outlive every call holding a lease on them
+    ChannelPool channels_;
     std::atomic<bool> connected_{false};
+    std::atomic<bool> binary_delivery_{false};
     std::string server_endpoint_;
     
-    // Callback management
-    std::function<void(const std::string&)> response_callback_;
-    std::function<void(const std::string&)> error_callback_;
-    std::function<void()> completion_callback_;
+    // Callback management (invoked on the main thread only)
+    std::function<void(const std::string&)> response_callback_;
+    std::function<void(const uint8_t*, size_t)> binary_response_callback_;
+    std::function<void(const std::string&)> error_callback_;
+    std::function<void()> completion_callback_;
+    std::function<void(const std::string&, const float*, size_t)> embedding_callback_;
+    std::function<void(const std::string&)> drain_callback_;
+    std::function<void(const std::string&, uint32_t, uint32_t)> reconnect_callback_;
+    
+    // Named option presets; "default" is used when a call passes no options.
+    // Only touched from JS-facing methods, i.e. on the main thread.
+    std::unordered_map<std::string, CudaCallOptions> cuda_presets_;
+    std::unordered_map<std::string, DocumentProcessingOptions> processing_presets_;
+    
+    EmbeddingCache embedding_cache_;
+    
+    // Embeddings received on bidirectional sessions, for searchLocal. Filled
+    // on the reactor thread, searched on the main thread.
+    LocalVectorIndex local_index_;
+    
+    // Pairwise similarities of the cases added by buildSimilarityMatrix and
+    // addCaseEmbedding, and the cases whose embeddings are still being
+    // fetched. Main thread only.
+    CaseSimilarityMatrix similarity_matrix_;
+    std::unordered_set<std::string> matrix_fetches_;
+    
+    // Copied into each bidirectional session when it starts
+    ReconnectPolicy reconnect_policy_;
+    
+    // Read on the main thread as calls start; sessions and uploads copy
+    // what their writes need
+    CompressionPolicy compression_;
+    
+    // Background calls waiting for a slot, and when the main-thread timer
+    // that pumps them next is due
+    BulkQueue bulk_queue_;
+    MetricsClock::time_point bulk_timer_due_{};
+    
+    // Worker-hosted mode: results go to this ring instead of JS callbacks.
+    // Bidirectional stream responses are tagged kStreamRingTag, streaming
+    // calls with their handle. Main (runtime) thread only.
+    static constexpr uint32_t kStreamRingTag = 0;
+    std::unique_ptr<ResultRing> result_ring_;
+    bool ring_retry_armed_ = false;
+    
+    // Encoding advertised in accept_encoding for embeddings the server returns
+    std::atomic<EmbeddingEncoding> embedding_encoding_{EMBEDDING_FLOAT32};
+    
+    // Filled from semantic search results on the main thread
+    SearchCandidateSet search_candidates_;
+    
+    // JS call handles -> the delivery they subscribe to, and the latest handle
+    // per latest-wins group. Main thread only.
+    CallRegistry active_calls_;
+    std::unordered_map<uint32_t, std::weak_ptr<ResponseFanoutBase>> call_handles_;
+    std::unordered_map<std::string, uint32_t> latest_wins_;
+    uint32_t next_handle_ = 1;
+    uint32_t default_deadline_ms_ = 0;
+    
+    // Single-flight searches and their short-lived result cache, keyed by
+    // searchFlightKey. Main thread only.
+    std::unordered_map<std::string, std::shared_ptr<ResponseFanout<SearchResponse>>> search_flights_;
+    std::chrono::milliseconds search_cache_ttl_{0};
+    
+    // Shared with in-flight call closures, which may outlive the client
+    std::shared_ptr<ClientMetrics> metrics_ = std::make_shared<ClientMetrics>();
+    
+    // Cache keys of an embed request's texts, plus the texts themselves
+    // while the local index is enabled, and the request's sequence number
+    struct PendingEmbed {
+        std::vector<uint64_t> keys;
+        std::vector<std::string> texts;
+        uint64_t sequence = 0;
+    };
+    
+    // Active streaming contexts. Each session has its own locks, so writers on
+    // one session never wait on another session's reads or writes.
+    struct StreamContext {
+        std::unique_ptr<ClientContext> context;
+        std::unique_ptr<ClientAsyncReaderWriter<CudaRequest, CudaResponse>> stream;
+        std::atomic<bool> active{false};
+        std::string session_id;
+        
+        // Reactor-side read state
+        CudaResponse response;
+        Status status;
+        MessageTimer timer;
+        RpcReactor::Tag on_started, on_read, on_write, on_writes_done, on_finished;
+        
+        // Set once the server has replied with a compact embedding encoding;
+        // until then search queries go out as floats
+        std::atomic<bool> peer_quantized{false};
+        
+        // Async streams allow one outstanding write, so later ones queue here.
+        // Queued requests live in request_arenas until their write completes.
+        struct PendingWrite {
+            RequestArenas<CudaRequest>::Slot slot;
+            size_t bytes;
+            uint64_t sequence;
+        };
+        std::mutex write_mutex;
+        RequestArenas<CudaRequest> request_arenas;
+        std::deque<PendingWrite> pending_writes;
+        
+        // Flow control. buffered_bytes counts queued requests and coalesced
+        // texts not yet handed to gRPC. While it is at high_water_mark (0 is
+        // unbounded) sends are refused and drain_pending is set; drain fires
+        // once the backlog is back down to half the mark.
+        size_t buffered_bytes = 0;
+        size_t coalesced_bytes = 0;
+        size_t high_water_mark = 0;
+        bool drain_pending = false;
+        
+        // Texts of each embed request in flight, in send order, so the
+        // returned embeddings can be cached and indexed against the texts
+        // they came from. embedding_dims is the size of one vector, learnt
+        // from answers to single texts. embeds_unpaired is set once an answer
+        // fails to line up with its request; nothing more is cached from the
+        // session after that.
+        std::deque<PendingEmbed> pending_embeds;
+        size_t embedding_dims = 0;
+        bool embeds_unpaired = false;
+        bool started = false;
+        bool write_in_flight = false;
+        bool half_close_requested = false;
+        bool half_closed = false;
+        bool finished = false;
+        bool retired = false;
+        
+        // Reconnect and replay. Every request carries the next sequence number;
+        // once written it moves to unacked until a response's ack_sequence
+        // covers it. A resumed stream writes unacked again ahead of
+        // pending_writes, and responses older than last_acked are duplicates.
+        // Nothing is retained until peer_sequenced: a server that never
+        // acknowledges would otherwise pin the whole replay buffer and get
+        // requests it already answered replayed.
+        ReconnectPolicy reconnect;
+        Compression compression = Compression::Default;
+        size_t compress_min_bytes = 0;
+        uint64_t next_sequence = 1;
+        uint64_t last_acked = 0;
+        bool peer_sequenced = false;
+        std::deque<PendingWrite> unacked;
+        size_t unacked_bytes = 0;
+        uint64_t replay_dropped = 0;
+        uint32_t reconnect_attempts = 0;
+        bool reconnecting = false;
+        bool reconnect_timer_armed = false;
+        grpc::Alarm reconnect_alarm;
+        RpcReactor::Tag on_reconnect;
+        
+        // Client-side coalescing of single embed requests into one batch,
+        // flushed at max_items or after max_delay (disabled while max_items is 0)
+        size_t coalesce_max_items = 0;
+        std::chrono::microseconds coalesce_max_delay{0};
+        std::vector<std::string> coalesced_texts;
+        CudaCallOptions coalesced_options;
+        grpc::Alarm coalesce_alarm;
+        bool coalesce_timer_armed = false;
+        RpcReactor::Tag on_coalesce_timeout;
+        
+        // Keeps the context alive while the RPC has operations in flight,
+        // independently of whether it is still registered in active_streams_
+        std::shared_ptr<ChannelPool::Lease> lease;
+        std::shared_ptr<StreamContext> self;
+    };
+    
+    ShardedSessionMap<StreamContext> active_streams_;
+    
+    // Chunked document uploads over StreamLegalDocument. JS feeds the text in
+    // whatever pieces it reads; they are re-cut into chunk_size messages on
+    // UTF-8 boundaries. A piece is refused once kUploadQueuedChunks chunks
+    // are queued, so WASM memory holds at most that many chunks plus the
+    // last piece accepted, the carry of less than a chunk, and the header.
+    struct DocumentUpload {
+        ClientContext context;
+        std::unique_ptr<ClientAsyncReaderWriter<DocumentRequest, DocumentResponse>> stream;
+        std::string upload_id;
+        
+        DocumentResponse response;
+        Status status;
+        std::function<void(DocumentResponse&)> on_message;
+        std::function<void(const Status&)> on_done;
+        RpcReactor::Tag on_started, on_read, on_write, on_writes_done, on_finished;
+        
+        // The first chunk also carries the document type and processing flags
+        std::mutex write_mutex;
+        DocumentRequest header;
+        bool header_sent = false;
+        std::string carry;  // received text not yet cut into a chunk
+        size_t chunk_size = 0;
+        size_t compress_min_bytes = 0;
+        std::deque<DocumentRequest> pending_writes;
+        
+        // Same flow control as StreamContext, bounded at kUploadQueuedChunks
+        size_t buffered_bytes = 0;
+        bool drain_pending = false;
+        bool started = false;
+        bool write_in_flight = false;
+        bool half_close_requested = false;
+        bool half_closed = false;
+        bool finished = false;
+        bool retired = false;
+        
+        std::shared_ptr<ChannelPool::Lease> lease;
+        std::shared_ptr<DocumentUpload> self;
+    };
+    
+    static constexpr size_t kUploadQueuedChunks = 8;
+    ShardedSessionMap<DocumentUpload> active_uploads_;
+    size_t document_chunk_size_ = 64 * 1024;
+    
+    // Pooled heap buffers handed to JS as Float32Array views so query vectors
+    // can be written in place and sent without an intermediate copy
+    std::unordered_map<size_t, std::vector<std::unique_ptr<float[]>>> free_embedding_buffers_;
+    std::unordered_map<const float*, size_t> leased_embedding_buffers_;
+    std::mutex buffers_mutex_;
+    
+    // Main-thread state for bidirectional stream delivery. Closures posted to
+    // the main thread check lifetime_ in case the client was deleted first.
+    FlatMessageWriter main_thread_writer_;
+    std::shared_ptr<MessagePool<CudaResponse>> response_pool_ =
+        std::make_shared<MessagePool<CudaResponse>>();
+    
+    // Initial block for arenas that build one-shot RPC requests. Those are
+    // serialized when the call is prepared, so the block is free again as soon
+    // as the call has started. Main thread only.
+    alignas(8) char request_scratch_[16 * 1024];
+    std::shared_ptr<bool> lifetime_ = std::make_shared<bool>(true);
+    
+    // Declared last so the reactor thread stops before the state it touches
+    RpcReactor reactor_;
+
+public:
+    LegalGrpcWebClient(const std::string& endpoint)
+        : LegalGrpcWebClient(endpoint, emscripten::val::undefined()) {}
+    
+    // options: { channels = 1, preconnect = false,
+    //            policy = 'least_loaded' | 'round_robin',
+    //            compression = 'none' | 'gzip' | 'deflate' }. With preconnect,
+    // every channel starts its handshake now and isConnected() turns true
+    // once the first one is ready. compression is the channels' default for
+    // calls whose policy (setCompressionPolicy) is 'default'.
+    LegalGrpcWebClient(const std::string& endpoint, emscripten::val options)
+        : server_endpoint_(endpoint) {
+        size_t channel_count = 1;
+        bool preconnect = false;
+        ChannelPool::Policy policy = ChannelPool::Policy::LeastLoaded;
+        Compression channel_compression = Compression::None;
+        if (!options.isUndefined() && !options.isNull()) {
+            if (options["channels"].isNumber()) {
+                channel_count = std::max(1, options["channels"].as<int>());
+            }
+            readBool(options, "preconnect", preconnect);
+            if (options["policy"].isString() && options["policy"].as<std::string>() == "round_robin") {
+                policy = ChannelPool::Policy::RoundRobin;
+            }
+            if (options["compression"].isString()) {
+                channel_compression = compressionFromName(options["compression"].as<std::string>());
+            }
+        }
+        
+        channels_.init(endpoint, channel_count, policy, true, compressionAlgorithm(channel_compression));
+        if (preconnect) {
+            warmUp();
+        } else {
+            connected_ = true;
+        }
+        
+        cuda_presets_["default"] = CudaCallOptions{};
+        processing_presets_["default"] = DocumentProcessingOptions{};
+        
+        DocumentProcessingOptions embeddings_only;
+        embeddings_only.extract_entities = false;
+        embeddings_only.generate_summary = false;
+        embeddings_only.analyze_sentiment = false;
+        embeddings_only.detect_clauses = false;
+        processing_presets_["embeddings_only"] = embeddings_only;
+        
+        EM_ASM({
+            console.log('🚀 Legal gRPC-Web Client initialized for endpoint: ' + 
+                       UTF8ToString($0));
+        }, endpoint.c_str());
+    }
+    
+    ~LegalGrpcWebClient() {
+        channels_.stop();
+
+        // Cancelled streams drain through the reactor before it joins
+        active_streams_.forEach([](StreamContext& stream) {
+            std::lock_guard<std::mutex> write_lock(stream.write_mutex);
+            stream.active = false;
+            stream.context->TryCancel();
+            if (stream.reconnect_timer_armed) {
+                stream.reconnect_alarm.Cancel();
+            }
+        });
+        active_uploads_.forEach([](DocumentUpload& upload) {
+            upload.context.TryCancel();
+        });
+        active_calls_.cancelAll();
+        
+        std::lock_guard<std::mutex> lock(buffers_mutex_);
+        for (auto& leased : leased_embedding_buffers_) {
+            delete[] leased.first;
+        }
+    }
+    
+    // JavaScript-accessible methods
+    void setResponseCallback(emscripten::val callback) {
+        response_callback_ = [callback](const std::string& response) {
+            callback(response);
+        };
+        binary_response_callback_ = [callback](const uint8_t* data, size_t size) {
+            callback(emscripten::val(emscripten::typed_memory_view(size, data)));
+        };
+    }
+    
+    // Switch every callback from JSON to the flat binary format. Callbacks then
+    // receive a Uint8Array over WASM memory that is only valid for the duration
+    // of the call; decode it with legal-grpc-decoder.ts.
+    void setBinaryDelivery(bool enabled) {
+        binary_delivery_ = enabled;
+    }
+    
+    void setErrorCallback(emscripten::val callback) {
+        error_callback_ = [callback](const std::string& error) {
+            callback(error);
+        };
+    }
+    
+    void setCompletionCallback(emscripten::val callback) {
+        completion_callback_ = [callback]() {
+            callback();
+        };
+    }
+    
+    // Receives computed embeddings as a Float32Array view over the response's
+    // repeated-field storage. The view is only valid for the duration of the
+    // callback; copy it (e.g. with slice()) to keep it. While set, embeddings
+    // are left out of the JSON passed to the response callback.
+    void setEmbeddingCallback(emscripten::val callback) {
+        embedding_callback_ = [callback](const std::string& session_id,
+                                         const float* data, size_t size) {
+            callback(session_id, emscripten::val(emscripten::typed_memory_view(size, data)));
+        };
+    }
+    
+    // Called with the session (or upload) id once one that refused a send
+    // because its queue was full has drained to half its high-water mark, or
+    // has ended
+    void setDrainCallback(emscripten::val callback) {
+        drain_callback_ = [callback](const std::string& session_id) {
+            callback(session_id);
+        };
+    }
+    
+    // Called with (sessionId, attempt, delayMs) each time a dropped
+    // bidirectional session schedules a reconnect
+    void setReconnectCallback(emscripten::val callback) {
+        reconnect_callback_ = [callback](const std::string& session_id, uint32_t attempt,
+                                         uint32_t delay_ms) {
+            callback(session_id, attempt, delay_ms);
+        };
+    }
+    
+    // Reconnect settings for sessions started after this call. Fields missing
+    // from the object keep their current values; maxAttempts 0 disables
+    // reconnects, replayBufferBytes 0 reconnects without replaying. Requests
+    // are only kept for replay on sessions whose server sends ack_sequence.
+    void setReconnectPolicy(emscripten::val options) {
+        if (options["maxAttempts"].isNumber()) {
+            reconnect_policy_.max_attempts = options["maxAttempts"].as<uint32_t>();
+        }
+        if (options["initialBackoffMs"].isNumber()) {
+            reconnect_policy_.initial_backoff = std::chrono::milliseconds(options["initialBackoffMs"].as<uint32_t>());
+        }
+        if (options["maxBackoffMs"].isNumber()) {
+            reconnect_policy_.max_backoff = std::chrono::milliseconds(options["maxBackoffMs"].as<uint32_t>());
+        }
+        if (options["replayBufferBytes"].isNumber()) {
+            reconnect_policy_.replay_buffer_bytes = options["replayBufferBytes"].as<size_t>();
+        }
+    }
+    
+    // Compression for calls started after this one: { documents = 'gzip',
+    // stream, search, similarity = 'default', minMessageBytes = 1024 }, each
+    // 'default' (the channel's), 'none', 'gzip' or 'deflate'. Missing fields
+    // keep their current values. Stream requests carrying query vectors and
+    // messages under minMessageBytes are always sent uncompressed.
+    void setCompressionPolicy(emscripten::val options) {
+        auto read = [&](const char* key, Compression& out) {
+            if (options[key].isString()) {
+                out = compressionFromName(options[key].as<std::string>());
+            }
+        };
+        read("documents", compression_.documents);
+        read("stream", compression_.stream);
+        read("search", compression_.search);
+        read("similarity", compression_.similarity);
+        if (options["minMessageBytes"].isNumber()) {
+            compression_.min_message_bytes = options["minMessageBytes"].as<size_t>();
+        }
+    }
+    
+    // Deliver results from now on through a shared-memory ring of at least
+    // capacity bytes instead of the JS callbacks; returns { offset, capacity }
+    // for legal-grpc-result-ring.ts. All results are then flat messages, and
+    // each streaming call ends with a CallComplete record under its handle.
+    // A record over half the capacity goes to its call's callback instead,
+    // or to the response callback for stream results, still as a flat message.
+    // Meant for a client hosted in a worker whose memory the UI shares.
+    emscripten::val attachResultRing(size_t capacity) {
+        if (!result_ring_) {
+            result_ring_ = std::make_unique<ResultRing>(capacity);
+        }
+        emscripten::val info = emscripten::val::object();
+        info.set("offset", static_cast<double>(reinterpret_cast<uintptr_t>(result_ring_->base())));
+        info.set("capacity", result_ring_->capacity());
+        return info;
+    }
+    
+    // Sequence and replay state of a bidirectional session, or null if unknown
+    emscripten::val getStreamReplayState(const std::string& session_id) const {
+        auto ctx = active_streams_.find(session_id);
+        if (!ctx) {
+            return emscripten::val::null();
+        }
+        
+        std::lock_guard<std::mutex> lock(ctx->write_mutex);
+        emscripten::val state = emscripten::val::object();
+        state.set("nextSequence", static_cast<double>(ctx->next_sequence));
+        state.set("lastAcked", static_cast<double>(ctx->last_acked));
+        state.set("unacked", static_cast<double>(ctx->unacked.size()));
+        state.set("unackedBytes", static_cast<double>(ctx->unacked_bytes));
+        state.set("replayDropped", static_cast<double>(ctx->replay_dropped));
+        state.set("reconnectAttempts", ctx->reconnect_attempts);
+        state.set("reconnecting", ctx->reconnecting);
+        return state;
+    }
+    
+    // Lease a heap-backed Float32Array that JS can fill in place and pass to
+    // sendSearchRequestView without any copying. Heap views are detached when
+    // memory grows, so re-acquire rather than caching them across awaits.
+    emscripten::val acquireEmbeddingBuffer(size_t dims) {
+        std::lock_guard<std::mutex> lock(buffers_mutex_);
+        
+        std::unique_ptr<float[]> buffer;
+        auto& pool = free_embedding_buffers_[dims];
+        if (!pool.empty()) {
+            buffer = std::move(pool.back());
+            pool.pop_back();
+        } else {
+            buffer.reset(new float[dims]());
+        }
+        
+        float* data = buffer.release();
+        leased_embedding_buffers_[data] = dims;
+        return emscripten::val(emscripten::typed_memory_view(dims, data));
+    }
+    
+    // Return a buffer obtained from acquireEmbeddingBuffer to the pool
+    bool releaseEmbeddingBuffer(emscripten::val view) {
+        const float* data = heapFloatPointer(view);
+        if (!data) return false;
+        
+        std::lock_guard<std::mutex> lock(buffers_mutex_);
+        
+        auto it = leased_embedding_buffers_.find(data);
+        if (it == leased_embedding_buffers_.end()) return false;
+        
+        free_embedding_buffers_[it->second].emplace_back(const_cast<float*>(data));
+        leased_embedding_buffers_.erase(it);
+        return true;
+    }
+    
+    // Start bidirectional streaming session
+    std::string startBidirectionalStream(const std::string& session_id) {
+        auto existing = active_streams_.find(session_id);
+        if (existing && existing->active) {
+            return session_id;
+        }
+        
+        auto context = std::make_shared<StreamContext>();
+        context->session_id = session_id;
+        context->reconnect = reconnect_policy_;
+        context->compression = compression_.stream;
+        context->compress_min_bytes = compression_.min_message_bytes;
+        context->active = true;
+        context->self = context;
+        
+        StreamContext* ctx = context.get();
+        ctx->on_started = [this, ctx](bool ok) {
+            if (!ok) {
+                ctx->stream->Finish(&ctx->status, &ctx->on_finished);
+                return;
+            }
+            {
+                std::lock_guard<std::mutex> write_lock(ctx->write_mutex);
+                ctx->started = true;
+                pumpWrites(*ctx);
+            }
+            ctx->stream->Read(&ctx->response, &ctx->on_read);
+        };
+        ctx->on_read = [this, ctx](bool ok) {
+            if (!ok) {
+                ctx->stream->Finish(&ctx->status, &ctx->on_finished);
+                return;
+            }
+            ctx->timer.onMessage(metrics_->stream);
+            if (!acknowledge(*ctx, ctx->response.ack_sequence())) {
+                // Answer to a request replayed after its response already arrived
+                ctx->stream->Read(&ctx->response, &ctx->on_read);
+                return;
+            }
+            decodeStreamEmbedding(*ctx, ctx->response);
+            retainStreamEmbeddings(*ctx, ctx->response);
+            deliverStreamResponse(ctx->response);
+            ctx->stream->Read(&ctx->response, &ctx->on_read);
+        };
+        ctx->on_write = [this, ctx](bool ok) {
+            std::lock_guard<std::mutex> write_lock(ctx->write_mutex);
+            ctx->write_in_flight = false;
+            const StreamContext::PendingWrite written = ctx->pending_writes.front();
+            ctx->pending_writes.pop_front();
+            ctx->buffered_bytes -= written.bytes;
+            // A failed write may still have reached the server, so it is
+            // kept for replay like a successful one
+            retainForReplay(*ctx, written);
+            if (!ok) {
+                // The stream is broken; the read side will observe it and finish
+                if (canReconnect(*ctx)) {
+                    ctx->started = false;  // keep the queue for the resumed stream
+                } else {
+                    releasePendingWrites(*ctx);
+                    ctx->half_closed = true;
+                }
+            }
+            notifyDrain(*ctx);
+            pumpWrites(*ctx);
+            scheduleReconnect(ctx);
+            retireIfIdle(ctx);
+        };
+        ctx->on_writes_done = [this, ctx](bool) {
+            std::lock_guard<std::mutex> write_lock(ctx->write_mutex);
+            ctx->write_in_flight = false;
+            scheduleReconnect(ctx);
+            retireIfIdle(ctx);
+        };
+        ctx->on_reconnect = [this, ctx](bool ok) {
+            {
+                std::lock_guard<std::mutex> write_lock(ctx->write_mutex);
+                ctx->reconnect_timer_armed = false;
+                if (ok && ctx->active) {
+                    resumeStream(*ctx);
+                    return;
+                }
+                ctx->reconnecting = false;
+            }
+            finishStream(ctx);
+        };
+        ctx->on_coalesce_timeout = [this, ctx](bool ok) {
+            std::lock_guard<std::mutex> write_lock(ctx->write_mutex);
+            ctx->coalesce_timer_armed = false;
+            if (ok) {
+                flushCoalesced(*ctx, false);
+            } else if (!ctx->coalesced_texts.empty() && !ctx->finished) {
+                // Texts buffered after a flush cancelled this timer still need one
+                armCoalesceTimer(*ctx);
+            }
+            retireIfIdle(ctx);
+        };
+        ctx->on_finished = [this, ctx](bool) {
+            onStreamFinished(ctx);
+        };
+        
+        // Registered before the call starts so a server-side close can find it
+        active_streams_.assign(session_id, context);
+        startStreamCall(*ctx, false);
+        
+        EM_ASM({
+            console.log('📡 Started bidirectional stream for session: ' + 
+                       UTF8ToString($0));
+        }, session_id.c_str());
+        
+        return session_id;
+    }
+    
+    // Define or replace a named CudaOptions preset. Fields missing from the
+    // object keep their defaults; redefining "default" changes what calls
+    // without options use.
+    void setCudaPreset(const std::string& name, emscripten::val options) {
+        cuda_presets_[name] = cudaOptionsFromJs(options);
+    }
+    
+    // Define or replace a named ProcessingFlags preset ("default" and
+    // "embeddings_only" are built in)
+    void setProcessingPreset(const std::string& name, emscripten::val options) {
+        processing_presets_[name] = processingOptionsFromJs(options);
+    }
+    
+    // Send embedding request. With coalescing enabled the text is buffered and
+    // sent as part of the next batch instead.
+    bool sendEmbeddingRequest(const std::string& session_id, 
+                             const std::string& text, 
+                             bool is_final = false) {
+        return sendEmbeddingRequestWithOptions(session_id, text, is_final, cuda_presets_["default"]);
+    }
+    
+    // Same, with a preset name or options object for this call
+    bool sendEmbeddingRequest(const std::string& session_id,
+                             const std::string& text,
+                             bool is_final,
+                             emscripten::val options) {
+        return sendEmbeddingRequestWithOptions(session_id, text, is_final, cudaOptionsFromJs(options));
+    }
+    
+    // Send several texts (a JS string array) as one batched embedding request
+    bool sendEmbeddingBatch(const std::string& session_id,
+                           emscripten::val texts,
+                           bool is_final = false) {
+        return sendEmbeddingBatchWithOptions(session_id, emscripten::vecFromJSArray<std::string>(texts),
+                                             is_final, cuda_presets_["default"]);
+    }
+    
+    bool sendEmbeddingBatch(const std::string& session_id,
+                           emscripten::val texts,
+                           bool is_final,
+                           emscripten::val options) {
+        return sendEmbeddingBatchWithOptions(session_id, emscripten::vecFromJSArray<std::string>(texts),
+                                             is_final, cudaOptionsFromJs(options));
+    }
+    
+    // Bound the client-side embedding cache to max_entries texts; 0 (the
+    // default) disables it. Hits are answered without a round-trip and may be
+    // delivered ahead of earlier requests still in flight.
+    void setEmbeddingCacheCapacity(size_t max_entries) {
+        embedding_cache_.setCapacity(max_entries);
+    }
+    
+    // { hits, misses, size, capacity }
+    emscripten::val getEmbeddingCacheStats() const {
+        const EmbeddingCache::Stats stats = embedding_cache_.stats();
+        emscripten::val result = emscripten::val::object();
+        result.set("hits", static_cast<double>(stats.hits));
+        result.set("misses", static_cast<double>(stats.misses));
+        result.set("size", static_cast<double>(stats.size));
+        result.set("capacity", static_cast<double>(stats.capacity));
+        return result;
+    }
+    
+    void clearEmbeddingCache() {
+        embedding_cache_.clear();
+    }
+    
+    // Snapshot of the cache as a JS-owned Uint8Array, e.g. for IndexedDB
+    // (see legal-grpc-embedding-store.ts)
+    emscripten::val exportEmbeddingCache() const {
+        FlatMessageWriter writer;
+        embedding_cache_.serialize(writer);
+        return emscripten::val(emscripten::typed_memory_view(writer.size(), writer.data()))
+            .call<emscripten::val>("slice");
+    }
+    
+    // Merge a snapshot from exportEmbeddingCache; returns entries loaded
+    size_t importEmbeddingCache(emscripten::val snapshot) {
+        const size_t length = snapshot["length"].as<size_t>();
+        std::vector<uint8_t> bytes(length);
+        emscripten::val(emscripten::typed_memory_view(length, bytes.data()))
+            .call<void>("set", snapshot);
+        return embedding_cache_.deserialize(bytes.data(), bytes.size());
+    }
+    
+    // Index embeddings received on bidirectional sessions for searchLocal.
+    // { capacity, hnswThreshold, maxLinks, efConstruction, efSearch }; a
+    // capacity of 0 (the default) disables the index and drops its contents.
+    // Only embeddings requested after the index is enabled are indexed.
+    void setLocalIndexOptions(emscripten::val options) {
+        LocalVectorIndex::Options parsed;
+        auto read = [&](const char* key, size_t& out) {
+            if (options[key].isNumber()) out = options[key].as<size_t>();
+        };
+        read("capacity", parsed.capacity);
+        read("hnswThreshold", parsed.hnsw_threshold);
+        read("maxLinks", parsed.max_links);
+        read("efConstruction", parsed.ef_construction);
+        read("efSearch", parsed.ef_search);
+        local_index_.configure(parsed);
+    }
+    
+    // The k indexed texts whose embeddings are closest to vector, as
+    // [{ text, sessionId, score }] best first
+    emscripten::val searchLocal(emscripten::val vector, size_t k) {
+        emscripten::val results = emscripten::val::array();
+        
+        std::vector<float> staging;
+        const float* data = floatArrayData(vector, staging);
+        auto hits = local_index_.search(data, vector["length"].as<size_t>(), k);
+        for (size_t i = 0; i < hits.size(); ++i) {
+            emscripten::val entry = emscripten::val::object();
+            entry.set("text", hits[i].label);
+            entry.set("sessionId", hits[i].session_id);
+            entry.set("score", hits[i].score);
+            results.set(i, entry);
+        }
+        return results;
+    }
+    
+    // { size, dims, capacity, levels, inserts, searches }; levels is 0 while
+    // the index is still searched exhaustively
+    emscripten::val getLocalIndexStats() const {
+        const LocalVectorIndex::Stats stats = local_index_.stats();
+        emscripten::val result = emscripten::val::object();
+        result.set("size", static_cast<double>(stats.size));
+        result.set("dims", static_cast<double>(stats.dims));
+        result.set("capacity", static_cast<double>(stats.capacity));
+        result.set("levels", static_cast<double>(stats.levels));
+        result.set("inserts", static_cast<double>(stats.inserts));
+        result.set("searches", static_cast<double>(stats.searches));
+        return result;
+    }
+    
+    void clearLocalIndex() {
+        local_index_.clear();
+    }
+    
+    // Buffer single sendEmbeddingRequest calls on this session for up to
+    // max_items texts or max_delay_us microseconds, whichever comes first,
+    // and send them as one batch. max_items of 0 or 1 disables coalescing.
+    bool setEmbeddingCoalescing(const std::string& session_id,
+                               size_t max_items,
+                               uint32_t max_delay_us) {
+        auto ctx = active_streams_.find(session_id);
+        if (!ctx || !ctx->active) {
+            return false;
+        }
+        
+        std::lock_guard<std::mutex> lock(ctx->write_mutex);
+        
+        // Anything buffered under the old settings goes out now
+        flushCoalesced(*ctx, false);
+        ctx->coalesce_max_items = max_items > 1 ? max_items : 0;
+        ctx->coalesce_max_delay = std::chrono::microseconds(max_delay_us);
+        return true;
+    }
+    
+    // Bound the bytes a session may have queued but not yet written. Once the
+    // backlog reaches high_water_mark_bytes further sends return false until
+    // the drain callback fires; a single send larger than the mark is still
+    // accepted into an empty queue. 0 (the default) leaves the queue unbounded.
+    bool setStreamHighWaterMark(const std::string& session_id, size_t high_water_mark_bytes) {
+        auto ctx = active_streams_.find(session_id);
+        if (!ctx) {
+            return false;
+        }
+        
+        std::lock_guard<std::mutex> lock(ctx->write_mutex);
+        ctx->high_water_mark = high_water_mark_bytes;
+        notifyDrain(*ctx);
+        return true;
+    }
+    
+    // Bytes queued on the session but not yet written, like WebSocket.bufferedAmount
+    size_t getBufferedAmount(const std::string& session_id) const {
+        auto ctx = active_streams_.find(session_id);
+        if (!ctx) {
+            auto upload = active_uploads_.find(session_id);
+            if (!upload) return 0;
+            
+            std::lock_guard<std::mutex> lock(upload->write_mutex);
+            return upload->buffered_bytes + upload->carry.size();
+        }
+        
+        std::lock_guard<std::mutex> lock(ctx->write_mutex);
+        return ctx->buffered_bytes;
+    }
+    
+    // True while sends on the session are refused for backpressure; a send
+    // that returned false for any other reason means the stream is closed
+    bool isWriteBlocked(const std::string& session_id) const {
+        auto ctx = active_streams_.find(session_id);
+        if (!ctx) {
+            auto upload = active_uploads_.find(session_id);
+            if (!upload) return false;
+            
+            std::lock_guard<std::mutex> lock(upload->write_mutex);
+            return upload->drain_pending;
+        }
+        
+        std::lock_guard<std::mutex> lock(ctx->write_mutex);
+        return ctx->drain_pending;
+    }
+    
+    // Send search request
+    bool sendSearchRequest(const std::string& session_id,
+                          const std::vector<float>& embedding_vector,
+                          bool is_final = true) {
+        const EmbeddingEncoding encoding = queryEncoding(session_id);
+        return enqueueWrite(session_id, false, [&](CudaRequest& request) {
+            request.set_session_id(session_id);
+            request.set_operation_type("search");
+            request.set_is_final_chunk(is_final);
+            setQueryVector(request, embedding_vector.data(), embedding_vector.size(), encoding);
+        });
+    }
+    
+    // Send search request from a Float32Array. Views over the WASM heap (such
+    // as those from acquireEmbeddingBuffer) are read in place; any other typed
+    // array is copied once into the heap first.
+    bool sendSearchRequestView(const std::string& session_id,
+                               emscripten::val embedding,
+                               bool is_final = true) {
+        const size_t length = embedding["length"].as<size_t>();
+        std::vector<float> staging;
+        const float* data = floatArrayData(embedding, staging);
+        
+        const EmbeddingEncoding encoding = queryEncoding(session_id);
+        return enqueueWrite(session_id, false, [&](CudaRequest& request) {
+            request.set_session_id(session_id);
+            request.set_operation_type("search");
+            request.set_is_final_chunk(is_final);
+            setQueryVector(request, data, length, encoding);
+        });
+    }
+    
+    // Document processing (non-streaming). Like the other streaming calls it
+    // returns a handle for cancelCall.
+    uint32_t processLegalDocument(const std::string& document_id,
+                                  const std::string& document_content,
+                                  const std::string& document_type,
+                                  emscripten::val progress_callback) {
+        return processLegalDocumentWithOptions(document_id, document_content, document_type,
+                                               std::move(progress_callback),
+                                               processing_presets_["default"],
+                                               StreamCallOptions{});
+    }
+    
+    // Same, with a preset name (e.g. "embeddings_only") or flags object
+    uint32_t processLegalDocument(const std::string& document_id,
+                                  const std::string& document_content,
+                                  const std::string& document_type,
+                                  emscripten::val progress_callback,
+                                  emscripten::val options) {
+        return processLegalDocumentWithOptions(document_id, document_content, document_type,
+                                               std::move(progress_callback),
+                                               processingOptionsFromJs(options),
+                                               StreamCallOptions{});
+    }
+    
+    // ...and { deadlineMs, latestWins } call options
+    uint32_t processLegalDocument(const std::string& document_id,
+                                  const std::string& document_content,
+                                  const std::string& document_type,
+                                  emscripten::val progress_callback,
+                                  emscripten::val options,
+                                  emscripten::val call_options) {
+        return processLegalDocumentWithOptions(document_id, document_content, document_type,
+                                               std::move(progress_callback),
+                                               processingOptionsFromJs(options),
+                                               streamCallOptionsFromJs(call_options));
+    }
+    
+    uint32_t processLegalDocumentWithOptions(const std::string& document_id,
+                                             const std::string& document_content,
+                                             const std::string& document_type,
+                                             emscripten::val progress_callback,
+                                             const DocumentProcessingOptions& options,
+                                             const StreamCallOptions& call_options) {
+        
+        google::protobuf::Arena arena(scratchArenaOptions());
+        std::optional<DocumentRequest> queued;
+        auto* request = newCallRequest(arena, queued, RpcClass::Bulk, call_options);
+        request->set_document_id(document_id);
+        request->set_document_content(document_content);
+        request->set_document_type(document_type);
+        
+        // Set processing flags
+        auto* flags = request->mutable_flags();
+        flags->set_extract_entities(options.extract_entities);
+        flags->set_generate_summary(options.generate_summary);
+        flags->set_compute_embeddings(options.compute_embeddings);
+        flags->set_analyze_sentiment(options.analyze_sentiment);
+        flags->set_detect_clauses(options.detect_clauses.value_or(document_type == "contract"));
+        
+        // A short document is sent as is
+        const Compression compression = request->ByteSizeLong() < compression_.min_message_bytes
+            ? Compression::None : compression_.documents;
+        
+        auto fanout = makeFanout<DocumentResponse>(&documentResponseToJson, &documentResponseToFlat);
+        const uint32_t handle = subscribeCall(fanout, std::move(progress_callback), call_options);
+        startServerStream<DocumentResponse>(
+            "Document processing", &ClientMetrics::document, RpcClass::Bulk, compression,
+            fanout, call_options, std::move(*request),
+            [this](LegalCudaService::Stub* stub, ClientContext* context, const DocumentRequest& request) {
+                return stub->PrepareAsyncProcessLegalDocument(context, request, reactor_.queue());
+            });
+        return handle;
+    }
+    
+    // Size of the content chunks uploads are cut into (default 64 KiB)
+    void setDocumentChunkSize(size_t bytes) {
+        document_chunk_size_ = std::max<size_t>(bytes, 1024);
+    }
+    
+    // Start a chunked upload of document_id; feed it with sendDocumentChunk and
+    // end it with finishDocumentUpload. The server sees the text as it arrives
+    // and streams progress back through progress_callback as usual.
+    bool startDocumentUpload(const std::string& document_id,
+                             const std::string& document_type,
+                             emscripten::val progress_callback) {
+        return startDocumentUploadWithOptions(document_id, document_type,
+                                              std::move(progress_callback),
+                                              processing_presets_["default"]);
+    }
+    
+    bool startDocumentUpload(const std::string& document_id,
+                             const std::string& document_type,
+                             emscripten::val progress_callback,
+                             emscripten::val options) {
+        return startDocumentUploadWithOptions(document_id, document_type,
+                                              std::move(progress_callback),
+                                              processingOptionsFromJs(options));
+    }
+    
+    // Append a piece of the document (a string or UTF-8 Uint8Array, e.g. a
+    // ReadableStream read). Returns false without consuming it while the
+    // upload is backed up (see isWriteBlocked and the drain callback) or once
+    // it has been finished.
+    bool sendDocumentChunk(const std::string& document_id, emscripten::val chunk) {
+        auto upload = active_uploads_.find(document_id);
+        if (!upload) {
+            return false;
+        }
+        
+        std::lock_guard<std::mutex> lock(upload->write_mutex);
+        if (upload->half_close_requested || upload->finished) {
+            return false;
+        }
+        if (upload->buffered_bytes > 0 &&
+            upload->buffered_bytes >= kUploadQueuedChunks * upload->chunk_size) {
+            upload->drain_pending = true;
+            return false;
+        }
+        
+        if (chunk.isString()) {
+            upload->carry += chunk.as<std::string>();
+        } else {
+            const size_t length = chunk["length"].as<size_t>();
+            const size_t offset = upload->carry.size();
+            upload->carry.resize(offset + length);
+            emscripten::val(emscripten::typed_memory_view(
+                length, reinterpret_cast<uint8_t*>(&upload->carry[offset])))
+                .call<void>("set", chunk);
+        }
+        
+        cutUploadChunks(*upload, false);
+        pumpUploadWrites(*upload);
+        return true;
+    }
+    
+    // Send what is left of the document and half-close the upload
+    bool finishDocumentUpload(const std::string& document_id) {
+        auto upload = active_uploads_.find(document_id);
+        if (!upload) {
+            return false;
+        }
+        
+        std::lock_guard<std::mutex> lock(upload->write_mutex);
+        if (upload->half_close_requested || upload->finished) {
+            return false;
+        }
+        cutUploadChunks(*upload, true);
+        upload->half_close_requested = true;
+        pumpUploadWrites(*upload);
+        return true;
+    }
+    
+    // Semantic search (streaming)
+    uint32_t performSemanticSearch(const std::string& query,
+                                   const std::string& collection_name,
+                                   int top_k,
+                                   emscripten::val results_callback) {
+        return performSemanticSearchWithOptions(query, collection_name, top_k,
+                                                std::move(results_callback), StreamCallOptions{});
+    }
+    
+    // Same, with { deadlineMs, latestWins } call options. For type-ahead, pass
+    // e.g. { latestWins: 'typeahead' } so each keystroke cancels the last search.
+    uint32_t performSemanticSearch(const std::string& query,
+                                   const std::string& collection_name,
+                                   int top_k,
+                                   emscripten::val results_callback,
+                                   emscripten::val call_options) {
+        return performSemanticSearchWithOptions(query, collection_name, top_k,
+                                                std::move(results_callback),
+                                                streamCallOptionsFromJs(call_options));
+    }
+    
+    uint32_t performSemanticSearchWithOptions(const std::string& query,
+                                              const std::string& collection_name,
+                                              int top_k,
+                                              emscripten::val results_callback,
+                                              const StreamCallOptions& call_options) {
+        
+        google::protobuf::Arena arena(scratchArenaOptions());
+        std::optional<SearchRequest> queued;
+        auto* request = newCallRequest(arena, queued, RpcClass::Interactive, call_options);
+        request->set_query(query);
+        request->set_collection_name(collection_name);
+        request->set_top_k(top_k);
+        request->set_enable_reranking(true);
+        request->set_accept_encoding(embedding_encoding_.load());
+        
+        // Set search filters
+        auto* filters = request->mutable_filters();
+        // Add default filters if needed
+        
+        // Identical searches share one stream; joiners are caught up on the
+        // results delivered so far and share its deadline
+        const std::string key = searchFlightKey(*request);
+        auto flight = search_flights_.find(key);
+        if (flight != search_flights_.end()) {
+            const auto& fanout = flight->second;
+            if ((!fanout->done() && !fanout->cancelled()) ||
+                (fanout->ok() && MetricsClock::now() - fanout->completedAt() < search_cache_ttl_)) {
+                return subscribeCall(fanout, std::move(results_callback), call_options);
+            }
+        }
+        pruneSearchFlights();
+        
+        auto fanout = makeFanout<SearchResponse>(&searchResponseToJson, &searchResponseToFlat, true);
+        search_flights_[key] = fanout;
+        
+        std::weak_ptr<bool> alive = lifetime_;
+        std::weak_ptr<ResponseFanout<SearchResponse>> weak_fanout = fanout;
+        fanout->addOnComplete([this, alive, key, weak_fanout](const std::vector<uint32_t>&) {
+            if (alive.expired()) return;
+            auto it = search_flights_.find(key);
+            if (it == search_flights_.end() || it->second != weak_fanout.lock()) return;
+            if (!it->second->ok() || search_cache_ttl_.count() == 0) {
+                search_flights_.erase(it);
+            }
+        });
+        
+        const uint32_t handle = subscribeCall(fanout, std::move(results_callback), call_options);
+        startServerStream<SearchResponse>(
+            "Semantic search", &ClientMetrics::search, RpcClass::Interactive, compression_.search,
+            fanout, call_options, std::move(*request),
+            [this](LegalCudaService::Stub* stub, ClientContext* context, const SearchRequest& request) {
+                return stub->PrepareAsyncStreamSemanticSearch(context, request, reactor_.queue());
+            },
+            [this, alive](const SearchResponse& response) {
+                if (!alive.expired()) {
+                    search_candidates_.add(response);
+                }
+            });
+        return handle;
+    }
+    
+    // Stop delivering a call started by processLegalDocument,
+    // performSemanticSearch or analyzeCaseSimilarity. The RPC itself is
+    // cancelled unless other identical searches still share it, and one still
+    // in the bulk queue completes without starting. Returns false if the call
+    // had already finished.
+    bool cancelCall(uint32_t handle) {
+        auto it = call_handles_.find(handle);
+        if (it == call_handles_.end()) {
+            return false;
+        }
+        
+        auto fanout = it->second.lock();
+        call_handles_.erase(it);
+        if (!fanout || fanout->done() || !fanout->unsubscribe(handle)) {
+            return false;
+        }
+        if (fanout->subscriberCount() == 0) {
+            fanout->cancel();
+            active_calls_.cancel(fanout->callId());
+        }
+        return true;
+    }
+    
+    // Deadline for calls that don't pass deadlineMs; 0 (the default) means none
+    void setDefaultDeadline(uint32_t deadline_ms) {
+        default_deadline_ms_ = deadline_ms;
+    }
+    
+    // Abort a chunked upload; the server sees the call cancelled
+    bool cancelDocumentUpload(const std::string& document_id) {
+        auto upload = active_uploads_.find(document_id);
+        if (!upload) {
+            return false;
+        }
+        upload->context.TryCancel();
+        return true;
+    }
+    
+    // Ask the server for embeddings as "fp16" or "int8" (one scale per
+    // vector) instead of "float32". Servers that don't support the encoding
+    // keep replying with floats, and search queries on a stream switch to it
+    // once the server has replied with it. Returns false for an unknown name.
+    bool setEmbeddingEncoding(const std::string& name) {
+        if (name == "float32") {
+            embedding_encoding_ = EMBEDDING_FLOAT32;
+        } else if (name == "fp16") {
+            embedding_encoding_ = EMBEDDING_FLOAT16;
+        } else if (name == "int8") {
+            embedding_encoding_ = EMBEDDING_INT8;
+        } else {
+            return false;
+        }
+        return true;
+    }
+    
+    std::string getEmbeddingEncoding() const {
+        switch (embedding_encoding_.load()) {
+            case EMBEDDING_FLOAT16: return "fp16";
+            case EMBEDDING_INT8: return "int8";
+            default: return "float32";
+        }
+    }
+    
+    // Keep completed search results for ttl_ms and answer identical searches
+    // from them; 0 (the default) only shares searches that are still in flight
+    void setSearchCacheTtl(uint32_t ttl_ms) {
+        search_cache_ttl_ = std::chrono::milliseconds(ttl_ms);
+        pruneSearchFlights();
+    }
+    
+    // Case similarity analysis; compare_case_ids is a JS string array
+    uint32_t analyzeCaseSimilarity(const std::string& base_case_id,
+                                   emscripten::val compare_case_ids,
+                                   emscripten::val similarity_callback) {
+        return analyzeCaseSimilarityWithOptions(base_case_id,
+                                                emscripten::vecFromJSArray<std::string>(compare_case_ids),
+                                                std::move(similarity_callback), StreamCallOptions{});
+    }
+    
+    uint32_t analyzeCaseSimilarity(const std::string& base_case_id,
+                                   emscripten::val compare_case_ids,
+                                   emscripten::val similarity_callback,
+                                   emscripten::val call_options) {
+        return analyzeCaseSimilarityWithOptions(base_case_id,
+                                                emscripten::vecFromJSArray<std::string>(compare_case_ids),
+                                                std::move(similarity_callback),
+                                                streamCallOptionsFromJs(call_options));
+    }
+    
+    uint32_t analyzeCaseSimilarityWithOptions(const std::string& base_case_id,
+                                              const std::vector<std::string>& compare_case_ids,
+                                              emscripten::val similarity_callback,
+                                              const StreamCallOptions& call_options) {
+        
+        google::protobuf::Arena arena(scratchArenaOptions());
+        std::optional<SimilarityRequest> queued;
+        auto* request = newCallRequest(arena, queued, RpcClass::Interactive, call_options);
+        request->set_base_case_id(base_case_id);
+        
+        for (const auto& case_id : compare_case_ids) {
+            request->add_compare_case_ids(case_id);
+        }
+        
+        // Set similarity metrics
+        auto* metrics = request->mutable_requested_metrics();
+        metrics->set_factual_similarity(true);
+        metrics->set_legal_precedent_similarity(true);
+        metrics->set_outcome_similarity(true);
+        metrics->set_procedural_similarity(true);
+        
+        auto fanout = makeFanout<SimilarityResponse>(&similarityResponseToJson, &similarityResponseToFlat);
+        const uint32_t handle = subscribeCall(fanout, std::move(similarity_callback), call_options);
+        startServerStream<SimilarityResponse>(
+            "Case similarity analysis", &ClientMetrics::similarity, RpcClass::Interactive,
+            compression_.similarity, fanout, call_options, std::move(*request),
+            [this](LegalCudaService::Stub* stub, ClientContext* context, const SimilarityRequest& request) {
+                return stub->PrepareAsyncAnalyzeCaseSimilarity(context, request, reactor_.queue());
+            });
+        return handle;
+    }
+    
+    // N x N similarity for a set of cases: each case's embedding is fetched
+    // once, in a single AnalyzeCaseSimilarity call for all the cases not yet
+    // in the matrix, and the matrix is computed locally, each arriving case
+    // adding only its own row and column. callback receives the call's
+    // SimilarityResponses after their cases are in the matrix (read it with
+    // getSimilarityMatrix). Returns the call handle, or 0 without calling
+    // back when every case is already present or being fetched. case_ids is a
+    // JS string array.
+    uint32_t buildSimilarityMatrix(emscripten::val case_ids, emscripten::val callback) {
+        return buildSimilarityMatrixWithOptions(emscripten::vecFromJSArray<std::string>(case_ids),
+                                                std::move(callback), StreamCallOptions{});
+    }
+    
+    uint32_t buildSimilarityMatrix(emscripten::val case_ids,
+                                   emscripten::val callback,
+                                   emscripten::val call_options) {
+        return buildSimilarityMatrixWithOptions(emscripten::vecFromJSArray<std::string>(case_ids),
+                                                std::move(callback),
+                                                streamCallOptionsFromJs(call_options));
+    }
+    
+    uint32_t buildSimilarityMatrixWithOptions(const std::vector<std::string>& case_ids,
+                                              emscripten::val callback,
+                                              const StreamCallOptions& call_options) {
+        std::vector<std::string> missing;
+        for (const auto& case_id : case_ids) {
+            if (!similarity_matrix_.contains(case_id) && matrix_fetches_.insert(case_id).second) {
+                missing.push_back(case_id);
+            }
+        }
+        if (missing.empty()) {
+            return 0;
+        }
+        
+        google::protobuf::Arena arena(scratchArenaOptions());
+        std::optional<SimilarityRequest> queued;
+        auto* request = newCallRequest(arena, queued, RpcClass::Interactive, call_options);
+        request->set_base_case_id(missing.front());
+        for (const auto& case_id : missing) {
+            request->add_compare_case_ids(case_id);
+        }
+        request->set_include_embeddings(true);
+        
+        auto fanout = makeFanout<SimilarityResponse>(&similarityResponseToJson, &similarityResponseToFlat);
+        std::weak_ptr<bool> alive = lifetime_;
+        fanout->addOnComplete([this, alive, missing](const std::vector<uint32_t>&) {
+            if (alive.expired()) return;
+            for (const auto& case_id : missing) {
+                matrix_fetches_.erase(case_id);
+            }
+        });
+        
+        const uint32_t handle = subscribeCall(fanout, std::move(callback), call_options);
+        startServerStream<SimilarityResponse>(
+            "Similarity matrix embeddings", &ClientMetrics::similarity, RpcClass::Interactive,
+            compression_.similarity, fanout, call_options, std::move(*request),
+            [this](LegalCudaService::Stub* stub, ClientContext* context, const SimilarityRequest& request) {
+                return stub->PrepareAsyncAnalyzeCaseSimilarity(context, request, reactor_.queue());
+            },
+            [this, alive](const SimilarityResponse& response) {
+                if (!alive.expired()) {
+                    addSimilarityEmbeddings(response);
+                }
+            });
+        return handle;
+    }
+    
+    // Add or replace one case from an embedding the caller already has (a
+    // Float32Array). Returns false for an empty vector.
+    bool addCaseEmbedding(const std::string& case_id, emscripten::val embedding) {
+        std::vector<float> staging;
+        const float* data = floatArrayData(embedding, staging);
+        return similarity_matrix_.add({case_id}, data, embedding["length"].as<size_t>()) > 0;
+    }
+    
+    bool removeCaseFromMatrix(const std::string& case_id) {
+        return similarity_matrix_.remove(case_id);
+    }
+    
+    // { caseIds, similarities }: similarities is a caseIds.length squared
+    // Float32Array, row-major in caseIds order
+    emscripten::val getSimilarityMatrix() const {
+        const auto& case_ids = similarity_matrix_.caseIds();
+        emscripten::val ids = emscripten::val::array();
+        for (size_t i = 0; i < case_ids.size(); ++i) {
+            ids.set(i, case_ids[i]);
+        }
+        const std::vector<float> packed = similarity_matrix_.packed();
+        
+        emscripten::val result = emscripten::val::object();
+        result.set("caseIds", ids);
+        result.set("similarities",
+                   emscripten::val(emscripten::typed_memory_view(packed.size(), packed.data()))
+                       .call<emscripten::val>("slice"));
+        return result;
+    }
+    
+    // The k cases in the matrix most similar to case_id, as
+    // [{ caseId, similarity }] best first
+    emscripten::val getNearestCases(const std::string& case_id, size_t k) const {
+        emscripten::val results = emscripten::val::array();
+        const auto nearest = similarity_matrix_.nearest(case_id, k);
+        for (size_t i = 0; i < nearest.size(); ++i) {
+            emscripten::val entry = emscripten::val::object();
+            entry.set("caseId", nearest[i].case_id);
+            entry.set("similarity", nearest[i].similarity);
+            results.set(i, entry);
+        }
+        return results;
+    }
+    
+    // { size, dims, rowsComputed }
+    emscripten::val getSimilarityMatrixStats() const {
+        const CaseSimilarityMatrix::Stats stats = similarity_matrix_.stats();
+        emscripten::val result = emscripten::val::object();
+        result.set("size", static_cast<double>(stats.size));
+        result.set("dims", static_cast<double>(stats.dims));
+        result.set("rowsComputed", static_cast<double>(stats.rows_computed));
+        return result;
+    }
+    
+    void clearSimilarityMatrix() {
+        similarity_matrix_.clear();
+    }
+    
+    // Re-score the most recent search candidates (up to 1000 that carried
+    // embeddings) against query locally and return the best k as
+    // [{ document_id, score, server_score }]. An optional filter object keeps
+    // only candidates whose metadata matches every key/value pair.
+    emscripten::val rerankLastSearch(emscripten::val query, size_t k, emscripten::val filter) {
+        emscripten::val results = emscripten::val::array();
+        
+        const size_t count = search_candidates_.size();
+        const size_t dims = search_candidates_.dims();
+        if (count == 0 || query["length"].as<size_t>() != dims) {
+            return results;
+        }
+        
+        std::vector<float> staging;
+        const float* query_data = floatArrayData(query, staging);
+        
+        std::vector<float> scores(count);
+        search_candidates_.score(query_data, scores.data());
+        
+        std::vector<std::pair<std::string, std::string>> required;
+        if (!filter.isUndefined() && !filter.isNull()) {
+            emscripten::val keys = emscripten::val::global("Object").call<emscripten::val>("keys", filter);
+            const size_t key_count = keys["length"].as<size_t>();
+            for (size_t i = 0; i < key_count; ++i) {
+                std::string key = keys[i].as<std::string>();
+                required.emplace_back(key, filter[key].as<std::string>());
+            }
+        }
+        
+        auto matches_filter = [&](size_t index) {
+            const auto& metadata = search_candidates_.candidate(index).metadata;
+            for (const auto& pair : required) {
+                auto it = metadata.find(pair.first);
+                if (it == metadata.end() || it->second != pair.second) return false;
+            }
+            return true;
+        };
+        
+        auto best = simd::topK(scores.data(), count, k,
+                               required.empty() ? std::function<bool(size_t)>() : matches_filter);
+        for (size_t i = 0; i < best.size(); ++i) {
+            const auto& candidate = search_candidates_.candidate(best[i].index);
+            emscripten::val entry = emscripten::val::object();
+            entry.set("document_id", candidate.document_id);
+            entry.set("score", best[i].score);
+            entry.set("server_score", candidate.server_score);
+            results.set(i, entry);
+        }
+        return results;
+    }
+    
+    // Score a row-major Float32Array of candidate vectors against query and
+    // return the best k as [{ index, score }]
+    emscripten::val scoreTopK(emscripten::val query, emscripten::val candidates, size_t k) {
+        emscripten::val results = emscripten::val::array();
+        
+        const size_t dims = query["length"].as<size_t>();
+        const size_t total = candidates["length"].as<size_t>();
+        if (dims == 0 || total % dims != 0) {
+            return results;
+        }
+        
+        std::vector<float> query_staging, candidate_staging;
+        const float* query_data = floatArrayData(query, query_staging);
+        const float* candidate_data = floatArrayData(candidates, candidate_staging);
+        
+        const size_t count = total / dims;
+        std::vector<float> scores(count);
+        simd::cosineBatch(query_data, candidate_data, count, dims, scores.data());
+        
+        auto best = simd::topK(scores.data(), count, k);
+        for (size_t i = 0; i < best.size(); ++i) {
+            emscripten::val entry = emscripten::val::object();
+            entry.set("index", best[i].index);
+            entry.set("score", best[i].score);
+            results.set(i, entry);
+        }
+        return results;
+    }
+    
+    // Close streaming session. Queued and coalesced writes are flushed before
+    // the half-close; the final status arrives through the error/completion
+    // callbacks.
+    bool closeStream(const std::string& session_id) {
+        auto ctx = active_streams_.remove(session_id);
+        if (ctx && ctx->active) {
+            ctx->active = false;
+            {
+                std::lock_guard<std::mutex> write_lock(ctx->write_mutex);
+                if (ctx->reconnect_timer_armed) {
+                    // Closing abandons a pending reconnect; the session finishes now
+                    ctx->reconnect_alarm.Cancel();
+                }
+                flushCoalesced(*ctx, false);
+                ctx->half_close_requested = true;
+                pumpWrites(*ctx);
+            }
+            
+            EM_ASM({
+                console.log('🔌 Closed stream for session: ' + UTF8ToString($0));
+            }, session_id.c_str());
+            
+            return true;
+        }
+        
+        return false;
+    }
+    
+    // Client-measured latency histograms per RPC type:
+    // { stream, document, search, similarity }, each holding
+    // { time_to_first_message_us, inter_message_gap_us, serialization_us, dispatch_us }
+    emscripten::val getMetrics() const {
+        emscripten::val result = emscripten::val::object();
+        result.set("stream", rpcMetricsToJs(metrics_->stream));
+        result.set("document", rpcMetricsToJs(metrics_->document));
+        result.set("search", rpcMetricsToJs(metrics_->search));
+        result.set("similarity", rpcMetricsToJs(metrics_->similarity));
+        return result;
+    }
+    
+    void resetMetrics() {
+        metrics_->stream.reset();
+        metrics_->document.reset();
+        metrics_->search.reset();
+        metrics_->similarity.reset();
+    }
+    
+    // Begin connecting every channel ahead of the first call, e.g. on page
+    // load or when a search box gains focus. Safe to call repeatedly.
+    void warmUp() {
+        std::weak_ptr<bool> alive = lifetime_;
+        channels_.warmUp(reactor_.queue(), [this, alive](size_t index) {
+            connected_ = true;
+            runOnMainThread([alive, index]() {
+                if (alive.expired()) return;
+                EM_ASM({
+                    console.log('🔗 gRPC channel ' + $0 + ' ready');
+                }, index);
+            });
+        });
+    }
+    
+    // [{ state, interactive, bulk }] for each pooled channel
+    emscripten::val getChannelStats() const {
+        emscripten::val result = emscripten::val::array();
+        const auto channels = channels_.stats();
+        for (size_t i = 0; i < channels.size(); ++i) {
+            emscripten::val channel = emscripten::val::object();
+            channel.set("state", std::string(channels[i].state));
+            channel.set("interactive", channels[i].interactive);
+            channel.set("bulk", channels[i].bulk);
+            result.set(i, channel);
+        }
+        return result;
+    }
+    
+    // Limits for background calls (document processing and uploads unless
+    // a call sets priority): { maxConcurrent = 2, startsPerSecond = 10
+    // (0: unlimited), yieldMs = 100, maxYieldMs = 5000 }. Waiting calls
+    // start only once no interactive call has been in flight for yieldMs,
+    // or after waiting maxYieldMs.
+    void setBulkQueueOptions(emscripten::val options) {
+        BulkQueue::Limits limits = bulk_queue_.limits();
+        if (options["maxConcurrent"].isNumber()) {
+            limits.max_concurrent = options["maxConcurrent"].as<uint32_t>();
+        }
+        if (options["startsPerSecond"].isNumber()) {
+            limits.starts_per_second = std::max(0.0, options["startsPerSecond"].as<double>());
+        }
+        if (options["yieldMs"].isNumber()) {
+            limits.yield_ms = options["yieldMs"].as<uint32_t>();
+        }
+        if (options["maxYieldMs"].isNumber()) {
+            limits.max_yield_ms = options["maxYieldMs"].as<uint32_t>();
+        }
+        bulk_queue_.setLimits(limits);
+        pumpBulkQueue();
+    }
+    
+    // { queued, running, interactive, started, yielded, waitUs }
+    emscripten::val getBulkQueueStats() const {
+        const BulkQueue::Stats stats = bulk_queue_.stats();
+        emscripten::val result = emscripten::val::object();
+        result.set("queued", stats.queued);
+        result.set("running", stats.running);
+        result.set("interactive", stats.interactive);
+        result.set("started", static_cast<double>(stats.started));
+        result.set("yielded", static_cast<double>(stats.yielded));
+        result.set("waitUs", histogramToJs(bulk_queue_.waits()));
+        return result;
+    }
+    
+    // Connection status
+    bool isConnected() const {
+        return connected_;
+    }
+
+private:
+    // Resolve a per-call options argument: a preset name, or an object whose
+    // fields override the "default" preset
+    CudaCallOptions cudaOptionsFromJs(const emscripten::val& options) {
+        if (options.isString()) {
+            auto preset = cuda_presets_.find(options.as<std::string>());
+            if (preset != cuda_presets_.end()) {
+                return preset->second;
+            }
+            EM_ASM({
+                console.warn('Unknown CUDA options preset: ' + UTF8ToString($0));
+            }, options.as<std::string>().c_str());
+            return cuda_presets_["default"];
+        }
+        
+        CudaCallOptions result = cuda_presets_["default"];
+        if (options.isUndefined() || options.isNull()) {
+            return result;
+        }
+        readBool(options, "useTensorCores", result.use_tensor_cores);
+        readBool(options, "enableMemoryPool", result.enable_memory_pool);
+        if (options["batchSize"].isNumber()) {
+            result.batch_size = options["batchSize"].as<int>();
+        }
+        return result;
+    }
+    
+    DocumentProcessingOptions processingOptionsFromJs(const emscripten::val& options) {
+        if (options.isString()) {
+            auto preset = processing_presets_.find(options.as<std::string>());
+            if (preset != processing_presets_.end()) {
+                return preset->second;
+            }
+            EM_ASM({
+                console.warn('Unknown processing preset: ' + UTF8ToString($0));
+            }, options.as<std::string>().c_str());
+            return processing_presets_["default"];
+        }
+        
+        DocumentProcessingOptions result = processing_presets_["default"];
+        if (options.isUndefined() || options.isNull()) {
+            return result;
+        }
+        readBool(options, "extractEntities", result.extract_entities);
+        readBool(options, "generateSummary", result.generate_summary);
+        readBool(options, "computeEmbeddings", result.compute_embeddings);
+        readBool(options, "analyzeSentiment", result.analyze_sentiment);
+        if (!options["detectClauses"].isUndefined()) {
+            bool detect_clauses = false;
+            readBool(options, "detectClauses", detect_clauses);
+            result.detect_clauses = detect_clauses;
+        }
+        return result;
+    }
+    
+    static void readBool(const emscripten::val& object, const char* key, bool& out) {
+        emscripten::val value = object[key];
+        if (!value.isUndefined() && !value.isNull()) {
+            out = value.as<bool>();
+        }
+    }
+    
+    bool sendEmbeddingRequestWithOptions(const std::string& session_id,
+                                         const std::string& text,
+                                         bool is_final,
+                                         const CudaCallOptions& options) {
+        auto ctx = active_streams_.find(session_id);
+        if (!ctx || !ctx->active) {
+            return false;
+        }
+        
+        const uint64_t key = EmbeddingCache::keyFor(text);
+        std::vector<float> cached;
+        if (embedding_cache_.get(key, cached)) {
+            deliverCachedEmbedding(session_id, cached);
+            if (is_final) {
+                requestHalfClose(*ctx);
+            }
+            return true;
+        }
+        
+        if (ctx->coalesce_max_items > 0) {
+            return coalesceEmbedding(*ctx, text, is_final, options);
+        }
+        
+        return enqueueWrite(session_id, is_final, [&](CudaRequest& request) {
+            request.set_session_id(session_id);
+            request.set_operation_type("embed");
+            request.set_raw_text(text);
+            request.set_is_final_chunk(is_final);
+            request.set_accept_encoding(embedding_encoding_.load());
+            
+            // Set CUDA options
+            auto* cuda_options = request.mutable_cuda_options();
+            cuda_options->set_use_tensor_cores(options.use_tensor_cores);
+            cuda_options->set_batch_size(options.batch_size > 0 ? options.batch_size : 1);
+            cuda_options->set_enable_memory_pool(options.enable_memory_pool);
+        }, pendingEmbed({key}, {text}));
+    }
+    
+    bool sendEmbeddingBatchWithOptions(const std::string& session_id,
+                                       const std::vector<std::string>& texts,
+                                       bool is_final,
+                                       const CudaCallOptions& options) {
+        if (texts.empty()) {
+            return false;
+        }
+        
+        // Cached texts are answered locally; only the misses go to the server
+        std::vector<std::string> misses;
+        std::vector<uint64_t> keys;
+        std::vector<float> cached;
+        for (const auto& text : texts) {
+            const uint64_t key = EmbeddingCache::keyFor(text);
+            if (embedding_cache_.get(key, cached)) {
+                deliverCachedEmbedding(session_id, cached);
+            } else {
+                misses.push_back(text);
+                keys.push_back(key);
+            }
+        }
+        
+        if (misses.empty()) {
+            auto ctx = active_streams_.find(session_id);
+            if (ctx && is_final) {
+                requestHalfClose(*ctx);
+            }
+            return ctx != nullptr;
+        }
+        return enqueueWrite(session_id, is_final, [&](CudaRequest& request) {
+            fillEmbeddingBatch(request, session_id, misses, is_final, options, embedding_encoding_.load());
+        }, pendingEmbed(std::move(keys), misses));
+    }
+    
+    // Answer an embed request from the cache as if the server had replied
+    void deliverCachedEmbedding(const std::string& session_id, const std::vector<float>& embedding) {
+        CudaResponse response;
+        response.set_session_id(session_id);
+        response.set_operation_type("embed");
+        response.mutable_computed_embedding()->Add(embedding.begin(), embedding.end());
+        deliverStreamResponse(response);
+    }
+    
+    void requestHalfClose(StreamContext& ctx) {
+        std::lock_guard<std::mutex> lock(ctx.write_mutex);
+        flushCoalesced(ctx, false);
+        ctx.half_close_requested = true;
+        pumpWrites(ctx);
+    }
+    
+    // Runs on the reactor thread for every stream response, before caching.
+    // Compact embeddings are widened into computed_embedding here so caching
+    // and delivery only deal in floats.
+    void decodeStreamEmbedding(StreamContext& ctx, CudaResponse& response) {
+        if (!response.has_quantized_embedding()) {
+            return;
+        }
+        ctx.peer_quantized = true;
+        decodeEmbedding(response.quantized_embedding(), response.mutable_computed_embedding());
+        response.clear_quantized_embedding();
+    }
+    
+    // Search queries use the client's encoding only once the server on this
+    // stream has shown it understands one
+    EmbeddingEncoding queryEncoding(const std::string& session_id) const {
+        auto ctx = active_streams_.find(session_id);
+        return (ctx && ctx->peer_quantized) ? embedding_encoding_.load() : EMBEDDING_FLOAT32;
+    }
+    
+    // Runs on the reactor thread for every stream response. Every answer to
+    // an embed request, including an error or an empty one, settles the
+    // request's pending entry. A non-zero ack_sequence names the answered
+    // request; otherwise answers are taken in send order. The embeddings (one
+    // per text, concatenated) are cached and indexed only when they split
+    // into vectors of the session's known size. Otherwise the entry is
+    // dropped. An answer taken in order that does not line up ends caching
+    // for the session instead of guessing.
+    void retainStreamEmbeddings(StreamContext& ctx, const CudaResponse& response) {
+        const bool embed_answer = response.operation_type() == "embed";
+        const uint64_t ack = response.ack_sequence();
+        
+        std::unique_lock<std::mutex> lock(ctx.write_mutex);
+        if (ctx.embeds_unpaired) return;
+        
+        if (ack > 0) {
+            // Requests before the acknowledged one were answered already
+            while (!ctx.pending_embeds.empty() && ctx.pending_embeds.front().sequence < ack) {
+                ctx.pending_embeds.pop_front();
+            }
+            if (ctx.pending_embeds.empty() || ctx.pending_embeds.front().sequence != ack) return;
+        } else if (!embed_answer) {
+            // An error for an unknown request may have answered an embed
+            if (response.status() != 0) abandonEmbedPairing(ctx);
+            return;
+        } else if (ctx.pending_embeds.empty()) {
+            return;
+        }
+        
+        PendingEmbed embed = std::move(ctx.pending_embeds.front());
+        ctx.pending_embeds.pop_front();
+        
+        const size_t total = response.computed_embedding_size();
+        if (!embed_answer || response.status() != 0 || total == 0 || embed.keys.empty()) {
+            return;
+        }
+        
+        const size_t count = embed.keys.size();
+        if (count == 1 && ctx.embedding_dims == 0) {
+            ctx.embedding_dims = total;
+        }
+        if (ctx.embedding_dims == 0 || total != count * ctx.embedding_dims) {
+            // Unverifiable or misaligned; only an acknowledged answer is
+            // known to have been for this request
+            if (ack == 0) abandonEmbedPairing(ctx);
+            return;
+        }
+        
+        const size_t dims = ctx.embedding_dims;
+        lock.unlock();
+        
+        const float* data = response.computed_embedding().data();
+        const bool indexed = embed.texts.size() == count;
+        for (size_t i = 0; i < count; ++i) {
+            embedding_cache_.put(embed.keys[i], data + i * dims, dims);
+            if (indexed) {
+                local_index_.add(data + i * dims, dims, std::move(embed.texts[i]), ctx.session_id);
+            }
+        }
+    }
+    
+    // Requires write_mutex
+    static void abandonEmbedPairing(StreamContext& ctx) {
+        ctx.embeds_unpaired = true;
+        ctx.pending_embeds.clear();
+    }
     
-    // Active streaming contexts
-    struct StreamContext {
-        std::unique_ptr<ClientContext> context;
-        std::unique_ptr<ClientReaderWriter<CudaRequest, CudaResponse>> stream;
-        std::atomic<bool> active{false};
-        std::string session_id;
-    };
+    // Texts only travel with the keys while someone will index them
+    PendingEmbed pendingEmbed(std::vector<uint64_t> keys, const std::vector<std::string>& texts) const {
+        PendingEmbed embed{std::move(keys), {}};
+        if (local_index_.enabled()) {
+            embed.texts = texts;
+        }
+        return embed;
+    }
     
-    std::map<std::string, std::unique_ptr<StreamContext>> active_streams_;
-    std::mutex streams_mutex_;
-
-public:
-    LegalGrpcWebClient(const std::string& endpoint) : server_endpoint_(endpoint) {
-        // Create gRPC-Web channel
-        grpc::ChannelArguments args;
-        args.SetString("grpc.http2.method", "POST");
-        args.SetString("grpc.http2.scheme", "https");
+    // Queue a request on the stream, issuing it immediately if the stream is
+    // idle. build fills in a request allocated from the stream's arenas. With
+    // half_close the stream is half-closed once it has been sent.
+    template <typename Build>
+    bool enqueueWrite(const std::string& session_id, bool half_close, Build build,
+                      PendingEmbed embed = {}) {
+        auto ctx = active_streams_.find(session_id);
+        if (!ctx || !ctx->active) {
+            return false;
+        }
         
-        channel_ = grpc::CreateCustomChannel(
-            endpoint,
-            grpc::InsecureChannelCredentials(),
-            args
-        );
+        std::lock_guard<std::mutex> lock(ctx->write_mutex);
+        if (ctx->half_close_requested || ctx->half_closed || ctx->finished) {
+            return false;
+        }
         
-        stub_ = LegalCudaService::NewStub(channel_);
-        connected_ = true;
+        RequestArenas<CudaRequest>::Slot slot = ctx->request_arenas.create();
+        build(*slot.request);
+        const uint64_t sequence = ctx->next_sequence;
+        slot.request->set_sequence(sequence);
+        const size_t bytes = slot.request->ByteSizeLong();
+        if (!reserveBuffer(*ctx, bytes)) {
+            ctx->request_arenas.release(slot);
+            return false;
+        }
+        ++ctx->next_sequence;
+        ctx->pending_writes.push_back({slot, bytes, sequence});
+        if (!embed.keys.empty() && !ctx->embeds_unpaired) {
+            embed.sequence = sequence;
+            ctx->pending_embeds.push_back(std::move(embed));
+        }
+        ctx->half_close_requested = half_close;
+        pumpWrites(*ctx);
+        return true;
+    }
+    
+    bool coalesceEmbedding(StreamContext& ctx, const std::string& text, bool is_final,
+                           const CudaCallOptions& options) {
+        std::lock_guard<std::mutex> lock(ctx.write_mutex);
+        if (!ctx.active || ctx.half_close_requested || ctx.half_closed || ctx.finished) {
+            return false;
+        }
         
-        EM_ASM({
-            console.log('🚀 Legal gRPC-Web Client initialized for endpoint: ' + 
-                       UTF8ToString($0));
-        }, endpoint.c_str());
+        // A batch carries one set of options, so a change starts a new batch
+        if (!ctx.coalesced_texts.empty() && ctx.coalesced_options != options) {
+            flushCoalesced(ctx, false);
+        }
+        if (!reserveBuffer(ctx, text.size())) {
+            return false;
+        }
+        ctx.coalesced_options = options;
+        ctx.coalesced_texts.push_back(text);
+        ctx.coalesced_bytes += text.size();
+        if (is_final || ctx.coalesced_texts.size() >= ctx.coalesce_max_items) {
+            flushCoalesced(ctx, is_final);
+        } else if (!ctx.coalesce_timer_armed) {
+            armCoalesceTimer(ctx);
+        }
+        return true;
     }
     
-    // JavaScript-accessible methods
-    void setResponseCallback(emscripten::val callback) {
-        response_callback_ = [callback](const std::string& response) {
-            callback(response);
-        };
+    // Requires write_mutex
+    void armCoalesceTimer(StreamContext& ctx) {
+        ctx.coalesce_timer_armed = true;
+        ctx.coalesce_alarm.Set(reactor_.queue(),
+                               std::chrono::system_clock::now() + ctx.coalesce_max_delay,
+                               &ctx.on_coalesce_timeout);
     }
     
-    void setErrorCallback(emscripten::val callback) {
-        error_callback_ = [callback](const std::string& error) {
-            callback(error);
-        };
+    // Send buffered texts as one batch. Requires write_mutex.
+    void flushCoalesced(StreamContext& ctx, bool is_final) {
+        if (ctx.coalesce_timer_armed) {
+            // The timeout handler still runs (with ok=false) and clears the flag
+            ctx.coalesce_alarm.Cancel();
+        }
+        if (ctx.coalesced_texts.empty()) {
+            return;
+        }
+        
+        std::vector<std::string> texts;
+        texts.swap(ctx.coalesced_texts);
+        RequestArenas<CudaRequest>::Slot slot = ctx.request_arenas.create();
+        fillEmbeddingBatch(*slot.request, ctx.session_id, texts, is_final, ctx.coalesced_options,
+                           embedding_encoding_.load());
+        const uint64_t sequence = ctx.next_sequence++;
+        slot.request->set_sequence(sequence);
+        const size_t bytes = slot.request->ByteSizeLong();
+        ctx.pending_writes.push_back({slot, bytes, sequence});
+        ctx.buffered_bytes += bytes - ctx.coalesced_bytes;
+        ctx.coalesced_bytes = 0;
+        
+        if (!ctx.embeds_unpaired) {
+            std::vector<uint64_t> keys;
+            keys.reserve(texts.size());
+            for (const auto& text : texts) {
+                keys.push_back(EmbeddingCache::keyFor(text));
+            }
+            PendingEmbed embed = pendingEmbed(std::move(keys), texts);
+            embed.sequence = sequence;
+            ctx.pending_embeds.push_back(std::move(embed));
+        }
+        ctx.half_close_requested = ctx.half_close_requested || is_final;
+        pumpWrites(ctx);
     }
     
-    void setCompletionCallback(emscripten::val callback) {
-        completion_callback_ = [callback]() {
-            callback();
-        };
+    // Account for bytes about to be queued, refusing them while the session is
+    // at its high-water mark. Requires write_mutex.
+    bool reserveBuffer(StreamContext& ctx, size_t bytes) {
+        if (ctx.high_water_mark > 0 && ctx.buffered_bytes > 0 &&
+            ctx.buffered_bytes + bytes > ctx.high_water_mark) {
+            ctx.drain_pending = true;
+            return false;
+        }
+        ctx.buffered_bytes += bytes;
+        return true;
     }
     
-    // Start bidirectional streaming session
-    std::string startBidirectionalStream(const std::string& session_id) {
-        std::lock_guard<std::mutex> lock(streams_mutex_);
-        
-        auto context = std::make_unique<StreamContext>();
-        context->context = std::make_unique<ClientContext>();
-        context->session_id = session_id;
-        context->stream = stub_->BidirectionalLegalStream(context->context.get());
-        context->active = true;
-        
-        // Start reading responses in a separate thread (emulated with async)
-        std::thread([this, session_id]() {
-            readStreamResponses(session_id);
-        }).detach();
+    // Fire the drain callback if a refused producer is waiting and the backlog
+    // has fallen to the low-water mark or the stream has ended. Requires write_mutex.
+    void notifyDrain(StreamContext& ctx) {
+        if (!ctx.drain_pending) return;
+        if (!ctx.finished && !ctx.half_closed && ctx.high_water_mark > 0 &&
+            ctx.buffered_bytes > ctx.high_water_mark / 2) {
+            return;
+        }
         
-        active_streams_[session_id] = std::move(context);
+        ctx.drain_pending = false;
+        std::string session_id = ctx.session_id;
+        std::weak_ptr<bool> alive = lifetime_;
+        runOnMainThread([this, alive, session_id]() {
+            if (alive.expired() || !drain_callback_) return;
+            drain_callback_(session_id);
+        });
+    }
+    
+    // Issue the next queued write or pending half-close. Requires write_mutex.
+    void pumpWrites(StreamContext& ctx) {
+        if (!ctx.started || ctx.write_in_flight || ctx.half_closed) return;
         
-        EM_ASM({
-            console.log('📡 Started bidirectional stream for session: ' + 
-                       UTF8ToString($0));
-        }, session_id.c_str());
+        if (!ctx.pending_writes.empty()) {
+            const auto& next = ctx.pending_writes.front();
+            ctx.write_in_flight = true;
+            ctx.stream->Write(*next.slot.request,
+                              messageWriteOptions(next.bytes, ctx.compress_min_bytes,
+                                                  carriesQueryVector(*next.slot.request)),
+                              &ctx.on_write);
+        } else if (ctx.half_close_requested) {
+            ctx.write_in_flight = true;
+            ctx.half_closed = true;
+            ctx.stream->WritesDone(&ctx.on_writes_done);
+        }
+    }
+    
+    // Runs on the reactor thread; conversion and callbacks happen on the main thread
+    void deliverStreamResponse(CudaResponse& stream_response) {
+        auto response = response_pool_->acquire();
+        response->Swap(&stream_response);
         
-        return session_id;
+        std::weak_ptr<bool> alive = lifetime_;
+        runOnMainThread([this, alive, response]() {
+            if (alive.expired()) return;
+            
+            RpcMetrics& metrics = metrics_->stream;
+            if (result_ring_) {
+                const auto convert_start = MetricsClock::now();
+                cudaResponseToFlat(*response, main_thread_writer_, true);
+                const auto dispatch_start = MetricsClock::now();
+                metrics.serialization.record(elapsedMicros(convert_start, dispatch_start));
+                // Too large for the ring: the response callback takes the
+                // same flat record
+                if (!publishToRing(kStreamRingTag, main_thread_writer_) && binary_response_callback_) {
+                    binary_response_callback_(main_thread_writer_.data(), main_thread_writer_.size());
+                }
+                metrics.dispatch.record(elapsedMicros(dispatch_start));
+                return;
+            }
+            
+            auto dispatch_start = MetricsClock::now();
+            uint64_t dispatch_us = 0;
+            if (embedding_callback_ && response->computed_embedding_size() > 0) {
+                embedding_callback_(response->session_id(),
+                                    response->computed_embedding().data(),
+                                    response->computed_embedding_size());
+                dispatch_us += elapsedMicros(dispatch_start);
+            }
+            if (binary_delivery_ && binary_response_callback_) {
+                const auto convert_start = MetricsClock::now();
+                cudaResponseToFlat(*response, main_thread_writer_, !embedding_callback_);
+                dispatch_start = MetricsClock::now();
+                metrics.serialization.record(elapsedMicros(convert_start, dispatch_start));
+                binary_response_callback_(main_thread_writer_.data(), main_thread_writer_.size());
+                dispatch_us += elapsedMicros(dispatch_start);
+            } else if (response_callback_) {
+                const auto convert_start = MetricsClock::now();
+                std::string json_response = cudaResponseToJson(*response, !embedding_callback_);
+                dispatch_start = MetricsClock::now();
+                metrics.serialization.record(elapsedMicros(convert_start, dispatch_start));
+                response_callback_(json_response);
+                dispatch_us += elapsedMicros(dispatch_start);
+            }
+            metrics.dispatch.record(dispatch_us);
+        });
     }
     
-    // Send embedding request
-    bool sendEmbeddingRequest(const std::string& session_id, 
-                             const std::string& text, 
-                             bool is_final = false) {
-        std::lock_guard<std::mutex> lock(streams_mutex_);
+    void onStreamFinished(StreamContext* ctx) {
+        {
+            std::lock_guard<std::mutex> write_lock(ctx->write_mutex);
+            ctx->started = false;
+            if (canReconnect(*ctx) && isRetryable(ctx->status)) {
+                ctx->reconnecting = true;
+                scheduleReconnect(ctx);
+                return;
+            }
+        }
+        finishStream(ctx);
+    }
+    
+    // Requires write_mutex
+    bool canReconnect(const StreamContext& ctx) const {
+        return ctx.active && ctx.reconnect_attempts < ctx.reconnect.max_attempts;
+    }
+    
+    // Arm the backoff timer for a broken stream once its last write has
+    // completed. A session closed in the meantime retries immediately, which
+    // finishes it. Requires write_mutex.
+    void scheduleReconnect(StreamContext* ctx) {
+        if (!ctx->reconnecting || ctx->write_in_flight || ctx->reconnect_timer_armed) {
+            return;
+        }
         
-        auto it = active_streams_.find(session_id);
-        if (it == active_streams_.end() || !it->second->active) {
-            return false;
+        const uint32_t attempt = ++ctx->reconnect_attempts;
+        std::chrono::milliseconds delay{0};
+        if (ctx->active) {
+            const auto& policy = ctx->reconnect;
+            const double base = std::min<double>(
+                policy.max_backoff.count(),
+                policy.initial_backoff.count() * std::pow(2.0, double(attempt - 1)));
+            thread_local std::minstd_rand jitter_source(std::random_device{}());
+            std::uniform_real_distribution<double> jitter(0.8, 1.2);
+            delay = std::chrono::milliseconds(static_cast<int64_t>(base * jitter(jitter_source)));
+            
+            std::string session_id = ctx->session_id;
+            const uint32_t delay_ms = static_cast<uint32_t>(delay.count());
+            std::weak_ptr<bool> alive = lifetime_;
+            runOnMainThread([this, alive, session_id, attempt, delay_ms]() {
+                if (alive.expired() || !reconnect_callback_) return;
+                reconnect_callback_(session_id, attempt, delay_ms);
+            });
         }
         
-        CudaRequest request;
-        request.set_session_id(session_id);
-        request.set_operation_type("embed");
-        request.set_raw_text(text);
-        request.set_is_final_chunk(is_final);
+        ctx->reconnect_timer_armed = true;
+        ctx->reconnect_alarm.Set(reactor_.queue(), std::chrono::system_clock::now() + delay,
+                                 &ctx->on_reconnect);
+    }
+    
+    // Open the session's RPC on a fresh context. A resumed stream names the
+    // session it continues and the last request the client saw acknowledged.
+    void startStreamCall(StreamContext& ctx, bool resume) {
+        ctx.stream.reset();
+        ctx.context = std::make_unique<ClientContext>();
+        applyCompression(*ctx.context, ctx.compression);
+        if (resume) {
+            ctx.context->AddMetadata("x-resume-session", ctx.session_id);
+            ctx.context->AddMetadata("x-resume-after", std::to_string(ctx.last_acked));
+        }
         
-        // Set CUDA options
-        auto* cuda_options = request.mutable_cuda_options();
-        cuda_options->set_use_tensor_cores(true);
-        cuda_options->set_batch_size(1);
-        cuda_options->set_enable_memory_pool(true);
+        applyPriority(*ctx.context, RpcClass::Interactive);
         
-        bool success = it->second->stream->Write(request);
+        ctx.timer.start();
+        ctx.lease = channels_.acquire(RpcClass::Interactive);
+        ctx.stream = ctx.lease->stub()->PrepareAsyncBidirectionalLegalStream(ctx.context.get(),
+                                                                             reactor_.queue());
+        ctx.stream->StartCall(&ctx.on_started);
+    }
+    
+    // Reconnect a broken session: unacknowledged requests are written again,
+    // in order, ahead of anything queued while disconnected, and a half-close
+    // the application already asked for is repeated after them. Requires
+    // write_mutex.
+    void resumeStream(StreamContext& ctx) {
+        ctx.reconnecting = false;
+        ctx.half_closed = false;
+        ctx.pending_writes.insert(ctx.pending_writes.begin(), ctx.unacked.begin(), ctx.unacked.end());
+        ctx.buffered_bytes += ctx.unacked_bytes;
+        ctx.unacked.clear();
+        ctx.unacked_bytes = 0;
         
-        if (is_final) {
-            it->second->stream->WritesDone();
+        // Embeds written before the break and not sent again will not be answered
+        const uint64_t resent = ctx.pending_writes.empty() ? ctx.next_sequence
+                                                           : ctx.pending_writes.front().sequence;
+        while (!ctx.pending_embeds.empty() && ctx.pending_embeds.front().sequence < resent) {
+            ctx.pending_embeds.pop_front();
+        }
+        startStreamCall(ctx, true);
+    }
+    
+    // Hold a written request until it is acknowledged, or release it at once
+    // if replay is off, the server has not acknowledged anything yet, the
+    // session is over or its answer already arrived.
+    // The oldest requests are given up once the buffer is full. Requires
+    // write_mutex.
+    void retainForReplay(StreamContext& ctx, const StreamContext::PendingWrite& written) {
+        if (ctx.finished || !ctx.peer_sequenced || ctx.reconnect.max_attempts == 0 ||
+            ctx.reconnect.replay_buffer_bytes == 0 || written.sequence <= ctx.last_acked) {
+            ctx.request_arenas.release(written.slot);
+            return;
         }
         
-        return success;
+        ctx.unacked.push_back(written);
+        ctx.unacked_bytes += written.bytes;
+        while (ctx.unacked_bytes > ctx.reconnect.replay_buffer_bytes) {
+            ctx.request_arenas.release(ctx.unacked.front().slot);
+            ctx.unacked_bytes -= ctx.unacked.front().bytes;
+            ctx.unacked.pop_front();
+            ++ctx.replay_dropped;
+        }
     }
     
-    // Send search request
-    bool sendSearchRequest(const std::string& session_id,
-                          const std::vector<float>& embedding_vector,
-                          bool is_final = true) {
-        std::lock_guard<std::mutex> lock(streams_mutex_);
+    // Runs on the reactor thread for every stream response. Drops requests
+    // covered by ack_sequence from the replay buffer; returns false for a
+    // duplicate answering a request older than the latest acknowledged one.
+    // Servers that don't sequence their answers send 0, which is never a
+    // duplicate.
+    bool acknowledge(StreamContext& ctx, uint64_t ack_sequence) {
+        std::lock_guard<std::mutex> lock(ctx.write_mutex);
+        ctx.reconnect_attempts = 0;
+        if (ack_sequence == 0) return true;
+        if (ack_sequence < ctx.last_acked) return false;
         
-        auto it = active_streams_.find(session_id);
-        if (it == active_streams_.end() || !it->second->active) {
-            return false;
+        ctx.peer_sequenced = true;
+        ctx.last_acked = ack_sequence;
+        while (!ctx.unacked.empty() && ctx.unacked.front().sequence <= ack_sequence) {
+            ctx.request_arenas.release(ctx.unacked.front().slot);
+            ctx.unacked_bytes -= ctx.unacked.front().bytes;
+            ctx.unacked.pop_front();
         }
+        return true;
+    }
+    
+    // Release queued requests when the session cannot continue; a write
+    // still in flight keeps its entry until it completes. Requires write_mutex.
+    void releasePendingWrites(StreamContext& ctx) {
+        const size_t keep = ctx.write_in_flight ? 1 : 0;
+        while (ctx.pending_writes.size() > keep) {
+            ctx.request_arenas.release(ctx.pending_writes.back().slot);
+            ctx.buffered_bytes -= ctx.pending_writes.back().bytes;
+            ctx.pending_writes.pop_back();
+        }
+        for (const auto& retained : ctx.unacked) {
+            ctx.request_arenas.release(retained.slot);
+        }
+        ctx.unacked.clear();
+        ctx.unacked_bytes = 0;
+    }
+    
+    void finishStream(StreamContext* ctx) {
+        Status status = ctx->status;
+        std::weak_ptr<bool> alive = lifetime_;
+        runOnMainThread([this, alive, status]() {
+            if (alive.expired()) return;
+            
+            if (!status.ok() && error_callback_) {
+                error_callback_(status.error_message());
+            }
+            if (completion_callback_) {
+                completion_callback_();
+            }
+        });
         
-        CudaRequest request;
-        request.set_session_id(session_id);
-        request.set_operation_type("search");
-        request.set_is_final_chunk(is_final);
+        // Sessions that ended server-side are dropped from the active set here
+        active_streams_.removeIf(ctx->session_id, ctx);
         
-        for (float val : embedding_vector) {
-            request.add_embedding_vector(val);
+        std::lock_guard<std::mutex> write_lock(ctx->write_mutex);
+        ctx->finished = true;
+        releasePendingWrites(*ctx);
+        ctx->coalesced_texts.clear();
+        ctx->buffered_bytes -= ctx->coalesced_bytes;
+        ctx->coalesced_bytes = 0;
+        notifyDrain(*ctx);
+        if (ctx->coalesce_timer_armed) {
+            ctx->coalesce_alarm.Cancel();
+        }
+        retireIfIdle(ctx);
+    }
+    
+    // Drop the in-flight reference once no operation or timer still uses the
+    // stream. Called from its own handlers with write_mutex held, so the
+    // release is deferred until the handler has returned.
+    void retireIfIdle(StreamContext* ctx) {
+        if (!ctx->finished || ctx->retired || ctx->write_in_flight || ctx->coalesce_timer_armed ||
+            ctx->reconnect_timer_armed) {
+            return;
         }
+        ctx->retired = true;
+        reactor_.defer([ctx]() { ctx->self.reset(); });
+    }
+    
+    google::protobuf::ArenaOptions scratchArenaOptions() {
+        google::protobuf::ArenaOptions options;
+        options.initial_block = request_scratch_;
+        options.initial_block_size = sizeof(request_scratch_);
+        return options;
+    }
+    
+    // The request fields that determine results, plus the delivery format
+    // since joiners receive responses converted once for everyone
+    std::string searchFlightKey(const SearchRequest& request) const {
+        std::string key = request.query();
+        key += '\0';
+        key += request.collection_name();
+        key += '\0';
+        key += std::to_string(request.top_k());
+        key += '\0';
+        key += request.enable_reranking() ? 'r' : '-';
+        key += flatDelivery() ? 'b' : 'j';
         
-        return it->second->stream->Write(request);
+        // Map iteration order is unspecified, so sort the filters first
+        std::map<std::string, std::string> metadata(request.filters().metadata().begin(),
+                                                    request.filters().metadata().end());
+        for (const auto& pair : metadata) {
+            key += '\0';
+            key += pair.first;
+            key += '=';
+            key += pair.second;
+        }
+        return key;
     }
     
-    // Document processing (non-streaming)
-    void processLegalDocument(const std::string& document_id,
-                             const std::string& document_content,
-                             const std::string& document_type,
-                             emscripten::val progress_callback) {
+    void pruneSearchFlights() {
+        const auto now = MetricsClock::now();
+        for (auto it = search_flights_.begin(); it != search_flights_.end();) {
+            const auto& fanout = it->second;
+            if (fanout->done() && (!fanout->ok() || now - fanout->completedAt() >= search_cache_ttl_)) {
+                it = search_flights_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+    
+    bool startDocumentUploadWithOptions(const std::string& document_id,
+                                        const std::string& document_type,
+                                        emscripten::val progress_callback,
+                                        const DocumentProcessingOptions& options) {
+        if (active_uploads_.find(document_id)) {
+            return false;
+        }
         
-        DocumentRequest request;
-        request.set_document_id(document_id);
-        request.set_document_content(document_content);
-        request.set_document_type(document_type);
+        auto upload = std::make_shared<DocumentUpload>();
+        upload->upload_id = document_id;
+        upload->chunk_size = document_chunk_size_;
+        upload->compress_min_bytes = compression_.min_message_bytes;
+        applyCompression(upload->context, compression_.documents);
+        upload->self = upload;
         
-        // Set processing flags
-        auto* flags = request.mutable_flags();
-        flags->set_extract_entities(true);
-        flags->set_generate_summary(true);
-        flags->set_compute_embeddings(true);
-        flags->set_analyze_sentiment(true);
-        flags->set_detect_clauses(document_type == "contract");
+        upload->header.set_document_id(document_id);
+        upload->header.set_document_type(document_type);
+        auto* flags = upload->header.mutable_flags();
+        flags->set_extract_entities(options.extract_entities);
+        flags->set_generate_summary(options.generate_summary);
+        flags->set_compute_embeddings(options.compute_embeddings);
+        flags->set_analyze_sentiment(options.analyze_sentiment);
+        flags->set_detect_clauses(options.detect_clauses.value_or(document_type == "contract"));
         
-        ClientContext context;
-        std::unique_ptr<ClientReader<DocumentResponse>> reader(
-            stub_->ProcessLegalDocument(&context, request));
-        
-        // Process streaming responses
-        std::thread([reader = std::move(reader), progress_callback]() mutable {
-            DocumentResponse response;
-            while (reader->Read(&response)) {
-                // Convert response to JSON for JavaScript
-                std::string json_response = documentResponseToJson(response);
-                
-                EM_ASM({
-                    var callback = Module['getObject']($0);
-                    var response = JSON.parse(UTF8ToString($1));
-                    callback(response);
-                }, progress_callback.as_handle(), json_response.c_str());
+        auto fanout = makeFanout<DocumentResponse>(&documentResponseToJson, &documentResponseToFlat);
+        subscribeCall(fanout, std::move(progress_callback), StreamCallOptions{});
+        
+        DocumentUpload* up = upload.get();
+        up->on_started = [this, up](bool ok) {
+            if (!ok) {
+                up->stream->Finish(&up->status, &up->on_finished);
+                return;
+            }
+            {
+                std::lock_guard<std::mutex> lock(up->write_mutex);
+                up->started = true;
+                pumpUploadWrites(*up);
+            }
+            up->stream->Read(&up->response, &up->on_read);
+        };
+        up->on_read = [up](bool ok) {
+            if (!ok) {
+                up->stream->Finish(&up->status, &up->on_finished);
+                return;
             }
+            up->on_message(up->response);
+            up->response.Clear();
+            up->stream->Read(&up->response, &up->on_read);
+        };
+        up->on_write = [this, up](bool ok) {
+            std::lock_guard<std::mutex> lock(up->write_mutex);
+            up->write_in_flight = false;
+            up->buffered_bytes -= up->pending_writes.front().document_content().size();
+            up->pending_writes.pop_front();
+            if (!ok) {
+                up->pending_writes.clear();
+                up->buffered_bytes = 0;
+                up->half_closed = true;
+            }
+            notifyUploadDrain(*up);
+            pumpUploadWrites(*up);
+            retireUploadIfIdle(up);
+        };
+        up->on_writes_done = [this, up](bool) {
+            std::lock_guard<std::mutex> lock(up->write_mutex);
+            up->write_in_flight = false;
+            retireUploadIfIdle(up);
+        };
+        std::weak_ptr<bool> alive = lifetime_;
+        up->on_finished = [this, up, alive](bool) {
+            up->on_done(up->status);
+            active_uploads_.removeIf(up->upload_id, up);
+            onCallFinished(alive, RpcClass::Bulk);
             
-            Status status = reader->Finish();
-            if (!status.ok()) {
-                EM_ASM({
-                    console.error('Document processing failed: ' + 
-                                 UTF8ToString($0));
-                }, status.error_message().c_str());
+            std::lock_guard<std::mutex> lock(up->write_mutex);
+            up->finished = true;
+            up->carry.clear();
+            notifyUploadDrain(*up);
+            retireUploadIfIdle(up);
+        };
+        
+        active_uploads_.assign(document_id, upload);
+        
+        // Chunks sent while the upload waits in bulk_queue_ are buffered as
+        // usual; one cancelled meanwhile fails as soon as it starts
+        applyPriority(up->context, RpcClass::Bulk);
+        bulk_queue_.submit([this, up, fanout]() {
+            // Made on admission, so time to first message leaves out the wait
+            auto handlers = makeResponseHandlers<DocumentResponse>("Document upload",
+                                                                   &ClientMetrics::document, fanout);
+            up->on_message = std::move(handlers.first);
+            up->on_done = std::move(handlers.second);
+            up->lease = channels_.acquire(RpcClass::Bulk);
+            up->stream = up->lease->stub()->PrepareAsyncStreamLegalDocument(&up->context, reactor_.queue());
+            up->stream->StartCall(&up->on_started);
+        });
+        pumpBulkQueue();
+        return true;
+    }
+    
+    // Move whole chunks out of carry, cutting before any UTF-8 continuation
+    // byte so every message holds valid text. With last, the remainder goes
+    // too. Requires write_mutex.
+    static void cutUploadChunks(DocumentUpload& upload, bool last) {
+        size_t offset = 0;
+        auto emit = [&](size_t length) {
+            DocumentRequest request;
+            if (!upload.header_sent) {
+                request = upload.header;
+                upload.header_sent = true;
+            } else {
+                request.set_document_id(upload.upload_id);
+            }
+            request.set_document_content(upload.carry.substr(offset, length));
+            upload.buffered_bytes += length;
+            upload.pending_writes.push_back(std::move(request));
+            offset += length;
+        };
+        
+        while (upload.carry.size() - offset >= upload.chunk_size) {
+            size_t cut = upload.chunk_size;
+            while (cut > 0 && (static_cast<unsigned char>(upload.carry[offset + cut]) & 0xC0) == 0x80) {
+                --cut;
             }
-        }).detach();
+            emit(cut > 0 ? cut : upload.chunk_size);
+        }
+        if (last && (upload.carry.size() > offset || !upload.header_sent)) {
+            emit(upload.carry.size() - offset);
+        }
+        upload.carry.erase(0, offset);
     }
     
-    // Semantic search (streaming)
-    void performSemanticSearch(const std::string& query,
-                              const std::string& collection_name,
-                              int top_k,
-                              emscripten::val results_callback) {
+    // Requires write_mutex
+    void pumpUploadWrites(DocumentUpload& upload) {
+        if (!upload.started || upload.write_in_flight || upload.half_closed) return;
         
-        SearchRequest request;
-        request.set_query(query);
-        request.set_collection_name(collection_name);
-        request.set_top_k(top_k);
-        request.set_enable_reranking(true);
+        if (!upload.pending_writes.empty()) {
+            const DocumentRequest& next = upload.pending_writes.front();
+            upload.write_in_flight = true;
+            upload.stream->Write(next,
+                                 messageWriteOptions(next.document_content().size(),
+                                                     upload.compress_min_bytes),
+                                 &upload.on_write);
+        } else if (upload.half_close_requested) {
+            upload.write_in_flight = true;
+            upload.half_closed = true;
+            upload.stream->WritesDone(&upload.on_writes_done);
+        }
+    }
+    
+    // Requires write_mutex
+    void notifyUploadDrain(DocumentUpload& upload) {
+        if (!upload.drain_pending) return;
+        if (!upload.finished && !upload.half_closed &&
+            upload.buffered_bytes > kUploadQueuedChunks * upload.chunk_size / 2) {
+            return;
+        }
         
-        // Set search filters
-        auto* filters = request.mutable_filters();
-        // Add default filters if needed
+        upload.drain_pending = false;
+        std::string upload_id = upload.upload_id;
+        std::weak_ptr<bool> alive = lifetime_;
+        runOnMainThread([this, alive, upload_id]() {
+            if (alive.expired() || !drain_callback_) return;
+            drain_callback_(upload_id);
+        });
+    }
+    
+    // Requires write_mutex; see retireIfIdle
+    void retireUploadIfIdle(DocumentUpload* upload) {
+        if (!upload->finished || upload->retired || upload->write_in_flight) {
+            return;
+        }
+        upload->retired = true;
+        reactor_.defer([upload]() { upload->self.reset(); });
+    }
+    
+    // Delivery in the current format; subscribe callers with subscribeCall
+    bool flatDelivery() const {
+        return binary_delivery_ || result_ring_ != nullptr;
+    }
+    
+    // Main thread only. Records that don't fit yet are retried every few
+    // milliseconds until the reader has made room; false for a record over
+    // the ring's maximum, which the caller delivers through its callback.
+    bool publishToRing(uint32_t tag, const FlatMessageWriter& writer) {
+        if (!result_ring_->publish(tag, writer.data(), writer.size())) {
+            EM_ASM({
+                console.warn('Result too large for the result ring (' + $0 + ' bytes), using its callback');
+            }, writer.size());
+            return false;
+        }
+        emscripten_futex_wake(result_ring_->writeCounter(), INT_MAX);
+        if (result_ring_->hasOverflow()) {
+            scheduleRingRetry();
+        }
+        return true;
+    }
+    
+    void scheduleRingRetry() {
+        if (ring_retry_armed_) return;
+        ring_retry_armed_ = true;
         
-        ClientContext context;
-        std::unique_ptr<ClientReader<SearchResponse>> reader(
-            stub_->StreamSemanticSearch(&context, request));
-        
-        // Process streaming search results
-        std::thread([reader = std::move(reader), results_callback]() mutable {
-            SearchResponse response;
-            while (reader->Read(&response)) {
-                std::string json_response = searchResponseToJson(response);
-                
-                EM_ASM({
-                    var callback = Module['getObject']($0);
-                    var response = JSON.parse(UTF8ToString($1));
-                    callback(response);
-                }, results_callback.as_handle(), json_response.c_str());
-            }
+        struct Retry {
+            LegalGrpcWebClient* client;
+            std::weak_ptr<bool> alive;
+        };
+        emscripten_async_call([](void* arg) {
+            std::unique_ptr<Retry> retry(static_cast<Retry*>(arg));
+            if (retry->alive.expired()) return;
             
-            Status status = reader->Finish();
-            if (!status.ok()) {
-                EM_ASM({
-                    console.error('Semantic search failed: ' + 
-                                 UTF8ToString($0));
-                }, status.error_message().c_str());
+            LegalGrpcWebClient* client = retry->client;
+            client->ring_retry_armed_ = false;
+            const bool waiting = client->result_ring_->flushOverflow();
+            emscripten_futex_wake(client->result_ring_->writeCounter(), INT_MAX);
+            if (waiting) {
+                client->scheduleRingRetry();
             }
-        }).detach();
+        }, new Retry{this, lifetime_}, 4);
     }
     
-    // Case similarity analysis
-    void analyzeCaseSimilarity(const std::string& base_case_id,
-                              const std::vector<std::string>& compare_case_ids,
-                              emscripten::val similarity_callback) {
-        
-        SimilarityRequest request;
-        request.set_base_case_id(base_case_id);
-        
-        for (const auto& case_id : compare_case_ids) {
-            request.add_compare_case_ids(case_id);
+    template <typename Response>
+    std::shared_ptr<ResponseFanout<Response>> makeFanout(std::string (*to_json)(const Response&),
+                                                         void (*to_flat)(const Response&, FlatMessageWriter&),
+                                                         bool retain = false) {
+        auto fanout = std::make_shared<ResponseFanout<Response>>(flatDelivery(), retain,
+                                                                 to_json, to_flat);
+        std::weak_ptr<bool> alive = lifetime_;
+        fanout->addOnComplete([this, alive](const std::vector<uint32_t>& handles) {
+            if (alive.expired()) return;
+            for (uint32_t handle : handles) {
+                call_handles_.erase(handle);
+            }
+        });
+        return fanout;
+    }
+    
+    // Subscribe callback under a new JS handle, then cancel the previous call
+    // of its latest-wins group. Subscribing first keeps a shared search alive
+    // when the superseded call was waiting on the same stream.
+    template <typename Response>
+    uint32_t subscribeCall(const std::shared_ptr<ResponseFanout<Response>>& fanout,
+                           emscripten::val callback,
+                           const StreamCallOptions& call_options) {
+        const uint32_t handle = next_handle_++;
+        ResponseFanoutBase::Sink sink;
+        if (result_ring_) {
+            std::weak_ptr<bool> alive = lifetime_;
+            sink = [this, alive](uint32_t tag, const FlatMessageWriter& writer) {
+                return alive.expired() || publishToRing(tag, writer);
+            };
+        }
+        fanout->subscribe(makeJsCallback(std::move(callback)), handle, call_options.batching,
+                          std::move(sink));
+        if (!fanout->done()) {
+            call_handles_[handle] = fanout;
         }
         
-        // Set similarity metrics
-        auto* metrics = request.mutable_requested_metrics();
-        metrics->set_factual_similarity(true);
-        metrics->set_legal_precedent_similarity(true);
-        metrics->set_outcome_similarity(true);
-        metrics->set_procedural_similarity(true);
-        
-        ClientContext context;
-        std::unique_ptr<ClientReader<SimilarityResponse>> reader(
-            stub_->AnalyzeCaseSimilarity(&context, request));
-        
-        // Process streaming similarity results
-        std::thread([reader = std::move(reader), similarity_callback]() mutable {
-            SimilarityResponse response;
-            while (reader->Read(&response)) {
-                std::string json_response = similarityResponseToJson(response);
-                
-                EM_ASM({
-                    var callback = Module['getObject']($0);
-                    var response = JSON.parse(UTF8ToString($1));
-                    callback(response);
-                }, similarity_callback.as_handle(), json_response.c_str());
+        if (!call_options.latest_wins_group.empty()) {
+            auto previous = latest_wins_.find(call_options.latest_wins_group);
+            if (previous != latest_wins_.end()) {
+                cancelCall(previous->second);
             }
-            
-            Status status = reader->Finish();
-            if (!status.ok()) {
-                EM_ASM({
-                    console.error('Case similarity analysis failed: ' + 
-                                 UTF8ToString($0));
-                }, status.error_message().c_str());
+            latest_wins_[call_options.latest_wins_group] = handle;
+        }
+        return handle;
+    }
+    
+    StreamCallOptions streamCallOptionsFromJs(const emscripten::val& options) const {
+        StreamCallOptions result;
+        if (options.isUndefined() || options.isNull()) {
+            return result;
+        }
+        if (options["deadlineMs"].isNumber()) {
+            result.deadline_ms = options["deadlineMs"].as<uint32_t>();
+        }
+        if (options["latestWins"].isString()) {
+            result.latest_wins_group = options["latestWins"].as<std::string>();
+        }
+        if (options["compression"].isString()) {
+            result.compression = compressionFromName(options["compression"].as<std::string>());
+        }
+        if (options["priority"].isString()) {
+            result.priority = options["priority"].as<std::string>() == "background"
+                ? RpcClass::Bulk : RpcClass::Interactive;
+        }
+        
+        // batch: 'frame' flushes once per animation frame (batchMax caps a
+        // frame's batch); a number flushes every that many messages
+        emscripten::val batch = options["batch"];
+        if (batch.isString() && batch.as<std::string>() == "frame") {
+            result.batching.per_frame = true;
+            if (options["batchMax"].isNumber()) {
+                result.batching.max_messages = options["batchMax"].as<uint32_t>();
             }
-        }).detach();
+        } else if (batch.isNumber()) {
+            result.batching.max_messages = batch.as<uint32_t>();
+        }
+        return result;
     }
     
-    // Close streaming session
-    bool closeStream(const std::string& session_id) {
-        std::lock_guard<std::mutex> lock(streams_mutex_);
+    // Message and completion handlers that deliver a streaming call's
+    // responses through fanout. The message handler runs on the reactor
+    // thread; observe, conversion and the JS callbacks run on the main thread.
+    template <typename Response>
+    std::pair<std::function<void(Response&)>, std::function<void(const Status&)>>
+    makeResponseHandlers(const char* label, RpcMetrics ClientMetrics::*rpc_metrics,
+                         std::shared_ptr<ResponseFanout<Response>> fanout,
+                         std::function<void(const Response&)> observe = nullptr) {
+        auto pool = std::make_shared<MessagePool<Response>>(4);
+        std::shared_ptr<ClientMetrics> metrics = metrics_;
+        MessageTimer timer;
+        timer.start();
         
-        auto it = active_streams_.find(session_id);
-        if (it != active_streams_.end()) {
-            it->second->active = false;
-            it->second->stream->WritesDone();
-            Status status = it->second->stream->Finish();
-            
-            active_streams_.erase(it);
-            
-            EM_ASM({
-                console.log('🔌 Closed stream for session: ' + UTF8ToString($0));
-            }, session_id.c_str());
+        auto on_message = [fanout, observe, pool, metrics, rpc_metrics,
+                           timer](Response& stream_response) mutable {
+            timer.onMessage((*metrics).*rpc_metrics);
+            auto response = pool->acquire();
+            response->Swap(&stream_response);
             
-            return status.ok();
-        }
+            runOnMainThread([fanout, observe, response, metrics, rpc_metrics]() {
+                if (observe) {
+                    observe(*response);
+                }
+                fanout->deliver(response, (*metrics).*rpc_metrics);
+            });
+        };
         
-        return false;
+        auto on_done = [label, fanout](const Status& status) {
+            const bool ok = status.ok();
+            // Cancellation is requested by the caller, so it is not reported
+            const bool report = !ok && status.error_code() != grpc::StatusCode::CANCELLED;
+            std::string message = report ? std::string(label) + " failed: " + status.error_message()
+                                         : std::string();
+            runOnMainThread([fanout, ok, report, message]() {
+                if (report) {
+                    EM_ASM({
+                        console.error(UTF8ToString($0));
+                    }, message.c_str());
+                }
+                fanout->complete(ok);
+            });
+        };
+        
+        return {std::move(on_message), std::move(on_done)};
     }
     
-    // Connection status
-    bool isConnected() const {
-        return connected_;
+    // Request for a server-streaming call, on the scratch arena when the call
+    // is sent right away. A background call waits in bulk_queue_ with its
+    // request, so that one is built in heap to be moved there instead.
+    template <typename Request>
+    static Request* newCallRequest(google::protobuf::Arena& arena, std::optional<Request>& heap,
+                                   RpcClass rpc_class, const StreamCallOptions& call_options) {
+        if (call_options.priority.value_or(rpc_class) == RpcClass::Bulk) {
+            return &heap.emplace();
+        }
+        return google::protobuf::Arena::CreateMessage<Request>(&arena);
     }
-
-private:
-    void readStreamResponses(const std::string& session_id) {
-        std::lock_guard<std::mutex> lock(streams_mutex_);
+    
+    // Start a server-streaming RPC on the reactor, registered in
+    // active_calls_ until it finishes so its handles can cancel it.
+    // compression applies unless the call options name their own, and
+    // rpc_class unless they set a priority. Background calls wait their turn
+    // in bulk_queue_, taking request with them: build it with newCallRequest
+    // so that it can be moved there. A deadline counts from now.
+    template <typename Response, typename Request, typename Prepare>
+    void startServerStream(const char* label, RpcMetrics ClientMetrics::*rpc_metrics,
+                           RpcClass rpc_class, Compression compression,
+                           std::shared_ptr<ResponseFanout<Response>> fanout,
+                           const StreamCallOptions& call_options,
+                           Request&& request,
+                           Prepare prepare,
+                           std::function<void(const Response&)> observe = nullptr) {
+        rpc_class = call_options.priority.value_or(rpc_class);
+        const uint32_t deadline_ms = call_options.deadline_ms > 0 ? call_options.deadline_ms
+                                                                  : default_deadline_ms_;
+        std::optional<std::chrono::system_clock::time_point> deadline;
+        if (deadline_ms > 0) {
+            deadline = std::chrono::system_clock::now() + std::chrono::milliseconds(deadline_ms);
+        }
+        const Compression call_compression = call_options.compression.value_or(compression);
         
-        auto it = active_streams_.find(session_id);
-        if (it == active_streams_.end()) return;
+        if (rpc_class == RpcClass::Interactive) {
+            bulk_queue_.interactiveStarted();
+            launchServerStream<Response>(label, rpc_metrics, rpc_class, call_compression,
+                                         std::move(fanout), deadline, request, prepare,
+                                         std::move(observe));
+            return;
+        }
         
-        CudaResponse response;
-        while (it->second->active && it->second->stream->Read(&response)) {
-            if (response_callback_) {
-                std::string json_response = cudaResponseToJson(response);
-                response_callback_(json_response);
+        // A swap between heap messages exchanges their fields without copying
+        auto queued = std::make_shared<Request>();
+        queued->Swap(&request);
+        bulk_queue_.submit([this, label, rpc_metrics, rpc_class, call_compression, fanout,
+                            deadline, queued, prepare, observe]() {
+            // Cancelled while waiting: complete it without a call
+            if (fanout->cancelled()) {
+                bulk_queue_.finished();
+                fanout->complete(false);
+                return;
             }
-        }
+            launchServerStream<Response>(label, rpc_metrics, rpc_class, call_compression,
+                                         fanout, deadline, *queued, prepare, observe);
+        });
+        pumpBulkQueue();
+    }
+    
+    template <typename Response, typename Request, typename Prepare>
+    void launchServerStream(const char* label, RpcMetrics ClientMetrics::*rpc_metrics,
+                            RpcClass rpc_class, Compression compression,
+                            std::shared_ptr<ResponseFanout<Response>> fanout,
+                            std::optional<std::chrono::system_clock::time_point> deadline,
+                            const Request& request, const Prepare& prepare,
+                            std::function<void(const Response&)> observe) {
+        const uint32_t call_id = active_calls_.reserve();
+        fanout->setCallId(call_id);
         
-        Status status = it->second->stream->Finish();
-        if (!status.ok() && error_callback_) {
-            error_callback_(status.error_message());
-        }
+        auto handlers = makeResponseHandlers<Response>(label, rpc_metrics, std::move(fanout),
+                                                       std::move(observe));
+        // The lease is released with the handler, when the call deletes itself
+        auto lease = channels_.acquire(rpc_class);
+        std::weak_ptr<bool> alive = lifetime_;
+        auto on_done = [this, alive, call_id, rpc_class, lease,
+                        done = std::move(handlers.second)](const Status& status) {
+            active_calls_.remove(call_id);
+            onCallFinished(alive, rpc_class);
+            done(status);
+        };
+        auto* call = new ServerStreamCall<Response>(std::move(handlers.first), std::move(on_done));
         
-        if (completion_callback_) {
-            completion_callback_();
+        if (deadline) {
+            call->context()->set_deadline(*deadline);
         }
+        applyCompression(*call->context(), compression);
+        applyPriority(*call->context(), rpc_class);
+        active_calls_.add(call_id, call->context());
+        call->start(prepare(lease->stub(), call->context(), request));
     }
     
-    // JSON conversion helpers
-    static std::string cudaResponseToJson(const CudaResponse& response) {
-        // Convert protobuf to JSON string
-        std::string json = "{";
-        json += "\"session_id\":\"" + response.session_id() + "\",";
-        json += "\"operation_type\":\"" + response.operation_type() + "\",";
-        json += "\"status\":" + std::to_string(response.status()) + ",";
-        
-        if (response.computed_embedding_size() > 0) {
-            json += "\"embeddings\":[";
-            for (int i = 0; i < response.computed_embedding_size(); ++i) {
-                if (i > 0) json += ",";
-                json += std::to_string(response.computed_embedding(i));
-            }
-            json += "],";
+    static void applyPriority(ClientContext& context, RpcClass rpc_class) {
+        context.AddMetadata("x-request-priority",
+                            rpc_class == RpcClass::Bulk ? "background" : "interactive");
+    }
+    
+    // Reactor thread: a call counted by bulk_queue_ has ended, which may let
+    // a waiting background call start
+    void onCallFinished(const std::weak_ptr<bool>& alive, RpcClass rpc_class) {
+        if (rpc_class == RpcClass::Bulk) {
+            bulk_queue_.finished();
+        } else {
+            bulk_queue_.interactiveFinished();
         }
+        runOnMainThread([this, alive]() {
+            if (!alive.expired()) pumpBulkQueue();
+        });
+    }
+    
+    // Main thread only. Starts what bulk_queue_ admits, and checks again
+    // once a rate limit or yield runs out.
+    void pumpBulkQueue() {
+        const std::chrono::milliseconds retry = bulk_queue_.pump();
+        if (retry.count() == 0) return;
         
-        if (response.has_cuda_metrics()) {
-            const auto& metrics = response.cuda_metrics();
-            json += "\"performance\":{";
-            json += "\"processing_time_us\":" + std::to_string(metrics.total_processing_time_us()) + ",";
-            json += "\"gpu_utilization\":" + std::to_string(metrics.gpu_utilization()) + ",";
-            json += "\"gpu_model\":\"" + metrics.gpu_model() + "\"";
-            json += "}";
-        }
+        // A timer already due no later covers this one
+        const auto now = MetricsClock::now();
+        const auto due = now + retry;
+        if (bulk_timer_due_ > now && bulk_timer_due_ <= due) return;
+        bulk_timer_due_ = due;
         
-        json += "}";
-        return json;
+        struct Retry {
+            LegalGrpcWebClient* client;
+            std::weak_ptr<bool> alive;
+        };
+        emscripten_async_call([](void* arg) {
+            std::unique_ptr<Retry> retry(static_cast<Retry*>(arg));
+            if (retry->alive.expired()) return;
+            retry->client->pumpBulkQueue();
+        }, new Retry{this, lifetime_}, static_cast<int>(std::min<int64_t>(retry.count(), INT_MAX)));
     }
     
-    static std::string documentResponseToJson(const DocumentResponse& response) {
-        // Simplified JSON conversion
-        return "{\"document_id\":\"" + response.document_id() + "\"}";
+    // Add the embeddings a buildSimilarityMatrix response carried, all in one
+    // kernel pass. Scores without an embedding, or of another dimension than
+    // the first, are left out.
+    void addSimilarityEmbeddings(const SimilarityResponse& response) {
+        std::vector<std::string> case_ids;
+        std::vector<float> vectors;
+        size_t dims = 0;
+        google::protobuf::RepeatedField<float> decoded;
+        for (const auto& score : response.similarities()) {
+            const google::protobuf::RepeatedField<float>* embedding = &score.embedding();
+            if (embedding->empty() && score.has_quantized_embedding()) {
+                decodeEmbedding(score.quantized_embedding(), &decoded);
+                embedding = &decoded;
+            }
+            if (embedding->empty()) continue;
+            if (dims == 0) dims = embedding->size();
+            if (static_cast<size_t>(embedding->size()) != dims) continue;
+            
+            case_ids.push_back(score.case_id());
+            vectors.insert(vectors.end(), embedding->begin(), embedding->end());
+            matrix_fetches_.erase(score.case_id());
+        }
+        similarity_matrix_.add(case_ids, vectors.data(), dims);
     }
     
-    static std::string searchResponseToJson(const SearchResponse& response) {
-        // Simplified JSON conversion
-        return "{\"query_id\":\"" + response.query_id() + "\"}";
+    // Heap address of a typed array viewing the WASM memory, or nullptr if the
+    // array is backed by some other ArrayBuffer
+    static const float* heapFloatPointer(const emscripten::val& view) {
+        emscripten::val heap = emscripten::val::module_property("HEAPU8");
+        if (!view["buffer"].equals(heap["buffer"])) {
+            return nullptr;
+        }
+        return reinterpret_cast<const float*>(view["byteOffset"].as<uintptr_t>());
     }
     
-    static std::string similarityResponseToJson(const SimilarityResponse& response) {
-        // Simplified JSON conversion
-        return "{\"base_case_id\":\"" + response.base_case_id() + "\"}";
+    // Pointer to a Float32Array's data: in place for views over the WASM heap,
+    // otherwise copied once into staging
+    static const float* floatArrayData(const emscripten::val& array, std::vector<float>& staging) {
+        const float* data = heapFloatPointer(array);
+        if (data) return data;
+        
+        const size_t length = array["length"].as<size_t>();
+        staging.resize(length);
+        emscripten::val(emscripten::typed_memory_view(length, staging.data()))
+            .call<void>("set", array);
+        return staging.data();
     }
 };
 
+#ifdef LEGAL_GRPC_BENCH
+// Entry points for the browser benchmark harness (legal-grpc-bench.ts),
+// compiled in with LEGAL_GRPC_BENCH=1. They drive the same conversion and
+// fan-out code as live calls, with synthetic responses and no network.
+namespace bench {
+
+// kind: "cuda" (size = embedding dims) or "search" (size = hits)
+inline void writeBenchFlat(const std::string& kind, size_t size, FlatMessageWriter& writer) {
+    if (kind == "search") {
+        searchResponseToFlat(makeSearchResponse(size, false), writer);
+    } else {
+        cudaResponseToFlat(makeEmbedResponse(size), writer);
+    }
+}
+
+// A flat message of the given shape, copied out for decoder benchmarks
+inline emscripten::val benchFlatMessage(const std::string& kind, size_t size) {
+    FlatMessageWriter writer;
+    writeBenchFlat(kind, size, writer);
+    return emscripten::val(emscripten::typed_memory_view(writer.size(), writer.data()))
+        .call<emscripten::val>("slice");
+}
+
+inline emscripten::val benchAllocations() {
+    const AllocationCounts counts = allocations();
+    emscripten::val result = emscripten::val::object();
+    result.set("count", static_cast<double>(counts.count));
+    result.set("bytes", static_cast<double>(counts.bytes));
+    return result;
+}
+
+template <typename Response>
+emscripten::val runDispatch(const Response& prototype, bool binary, uint32_t messages,
+                            uint32_t batch, emscripten::val callback,
+                            typename ResponseFanout<Response>::ToJson to_json,
+                            typename ResponseFanout<Response>::ToFlat to_flat) {
+    auto response = std::make_shared<Response>(prototype);
+    auto fanout = std::make_shared<ResponseFanout<Response>>(binary, false, to_json, to_flat);
+    DispatchBatching batching;
+    batching.max_messages = batch;
+    fanout->subscribe(makeJsCallback(std::move(callback)), 1, batching);
+    
+    RpcMetrics metrics;
+    const AllocationCounts before = allocations();
+    const auto start = MetricsClock::now();
+    for (uint32_t i = 0; i < messages; ++i) {
+        fanout->deliver(response, metrics);
+    }
+    fanout->complete(true);
+    const uint64_t elapsed_us = elapsedMicros(start);
+    const AllocationCounts after = allocations();
+    
+    const double count = messages > 0 ? messages : 1;
+    emscripten::val result = emscripten::val::object();
+    result.set("messages", messages);
+    result.set("nsPerMessage", static_cast<double>(elapsed_us) * 1000.0 / count);
+    result.set("bytesPerMessage", static_cast<double>(after.bytes - before.bytes) / count);
+    result.set("allocationsPerMessage", static_cast<double>(after.count - before.count) / count);
+    result.set("metrics", rpcMetricsToJs(metrics));
+    return result;
+}
+
+// Delivers messages copies of one synthetic response through a ResponseFanout
+// to callback (batched every batch messages when non-zero), as JSON or flat
+// binary, and reports the C++-side cost per message including the callback
+inline emscripten::val benchDispatch(const std::string& kind, bool binary, size_t size,
+                                     uint32_t messages, uint32_t batch, emscripten::val callback) {
+    if (kind == "search") {
+        return runDispatch(makeSearchResponse(size, false), binary, messages, batch,
+                           std::move(callback), &searchResponseToJson, &searchResponseToFlat);
+    }
+    return runDispatch(makeEmbedResponse(size), binary, messages, batch, std::move(callback),
+                       +[](const CudaResponse& r) { return cudaResponseToJson(r); },
+                       +[](const CudaResponse& r, FlatMessageWriter& w) { cudaResponseToFlat(r, w); });
+}
+
+} // namespace bench
+#endif
+
 } // namespace legal_cuda_streaming
 
 // Emscripten bindings
@@ -411,18 +3252,102 @@ using namespace legal_cuda_streaming;
 EMSCRIPTEN_BINDINGS(legal_grpc_client) {
     class_<LegalGrpcWebClient>("LegalGrpcWebClient")
         .constructor<const std::string&>()
+        .constructor<const std::string&, val>()
         .function("setResponseCallback", &LegalGrpcWebClient::setResponseCallback)
         .function("setErrorCallback", &LegalGrpcWebClient::setErrorCallback)
         .function("setCompletionCallback", &LegalGrpcWebClient::setCompletionCallback)
+        .function("setEmbeddingCallback", &LegalGrpcWebClient::setEmbeddingCallback)
+        .function("setBinaryDelivery", &LegalGrpcWebClient::setBinaryDelivery)
+        .function("setDrainCallback", &LegalGrpcWebClient::setDrainCallback)
+        .function("setReconnectCallback", &LegalGrpcWebClient::setReconnectCallback)
+        .function("setReconnectPolicy", &LegalGrpcWebClient::setReconnectPolicy)
+        .function("setCompressionPolicy", &LegalGrpcWebClient::setCompressionPolicy)
+        .function("getStreamReplayState", &LegalGrpcWebClient::getStreamReplayState)
+        .function("attachResultRing", &LegalGrpcWebClient::attachResultRing)
+        .function("acquireEmbeddingBuffer", &LegalGrpcWebClient::acquireEmbeddingBuffer)
+        .function("releaseEmbeddingBuffer", &LegalGrpcWebClient::releaseEmbeddingBuffer)
         .function("startBidirectionalStream", &LegalGrpcWebClient::startBidirectionalStream)
-        .function("sendEmbeddingRequest", &LegalGrpcWebClient::sendEmbeddingRequest)
+        .function("setCudaPreset", &LegalGrpcWebClient::setCudaPreset)
+        .function("setProcessingPreset", &LegalGrpcWebClient::setProcessingPreset)
+        .function("sendEmbeddingRequest", select_overload<bool(const std::string&, const std::string&, bool)>(
+            &LegalGrpcWebClient::sendEmbeddingRequest))
+        .function("sendEmbeddingRequest", select_overload<bool(const std::string&, const std::string&, bool, val)>(
+            &LegalGrpcWebClient::sendEmbeddingRequest))
+        .function("sendEmbeddingBatch", select_overload<bool(const std::string&, val, bool)>(
+            &LegalGrpcWebClient::sendEmbeddingBatch))
+        .function("sendEmbeddingBatch", select_overload<bool(const std::string&, val, bool, val)>(
+            &LegalGrpcWebClient::sendEmbeddingBatch))
+        .function("setEmbeddingCoalescing", &LegalGrpcWebClient::setEmbeddingCoalescing)
+        .function("setStreamHighWaterMark", &LegalGrpcWebClient::setStreamHighWaterMark)
+        .function("getBufferedAmount", &LegalGrpcWebClient::getBufferedAmount)
+        .function("isWriteBlocked", &LegalGrpcWebClient::isWriteBlocked)
+        .function("setEmbeddingCacheCapacity", &LegalGrpcWebClient::setEmbeddingCacheCapacity)
+        .function("getEmbeddingCacheStats", &LegalGrpcWebClient::getEmbeddingCacheStats)
+        .function("clearEmbeddingCache", &LegalGrpcWebClient::clearEmbeddingCache)
+        .function("exportEmbeddingCache", &LegalGrpcWebClient::exportEmbeddingCache)
+        .function("importEmbeddingCache", &LegalGrpcWebClient::importEmbeddingCache)
+        .function("setLocalIndexOptions", &LegalGrpcWebClient::setLocalIndexOptions)
+        .function("searchLocal", &LegalGrpcWebClient::searchLocal)
+        .function("getLocalIndexStats", &LegalGrpcWebClient::getLocalIndexStats)
+        .function("clearLocalIndex", &LegalGrpcWebClient::clearLocalIndex)
         .function("sendSearchRequest", &LegalGrpcWebClient::sendSearchRequest)
-        .function("processLegalDocument", &LegalGrpcWebClient::processLegalDocument)
-        .function("performSemanticSearch", &LegalGrpcWebClient::performSemanticSearch)
-        .function("analyzeCaseSimilarity", &LegalGrpcWebClient::analyzeCaseSimilarity)
+        .function("sendSearchRequestView", &LegalGrpcWebClient::sendSearchRequestView)
+        .function("processLegalDocument", select_overload<uint32_t(const std::string&, const std::string&, const std::string&, val)>(
+            &LegalGrpcWebClient::processLegalDocument))
+        .function("processLegalDocument", select_overload<uint32_t(const std::string&, const std::string&, const std::string&, val, val)>(
+            &LegalGrpcWebClient::processLegalDocument))
+        .function("processLegalDocument", select_overload<uint32_t(const std::string&, const std::string&, const std::string&, val, val, val)>(
+            &LegalGrpcWebClient::processLegalDocument))
+        .function("setDocumentChunkSize", &LegalGrpcWebClient::setDocumentChunkSize)
+        .function("startDocumentUpload", select_overload<bool(const std::string&, const std::string&, val)>(
+            &LegalGrpcWebClient::startDocumentUpload))
+        .function("startDocumentUpload", select_overload<bool(const std::string&, const std::string&, val, val)>(
+            &LegalGrpcWebClient::startDocumentUpload))
+        .function("sendDocumentChunk", &LegalGrpcWebClient::sendDocumentChunk)
+        .function("finishDocumentUpload", &LegalGrpcWebClient::finishDocumentUpload)
+        .function("cancelDocumentUpload", &LegalGrpcWebClient::cancelDocumentUpload)
+        .function("performSemanticSearch", select_overload<uint32_t(const std::string&, const std::string&, int, val)>(
+            &LegalGrpcWebClient::performSemanticSearch))
+        .function("performSemanticSearch", select_overload<uint32_t(const std::string&, const std::string&, int, val, val)>(
+            &LegalGrpcWebClient::performSemanticSearch))
+        .function("setEmbeddingEncoding", &LegalGrpcWebClient::setEmbeddingEncoding)
+        .function("getEmbeddingEncoding", &LegalGrpcWebClient::getEmbeddingEncoding)
+        .function("setSearchCacheTtl", &LegalGrpcWebClient::setSearchCacheTtl)
+        .function("analyzeCaseSimilarity", select_overload<uint32_t(const std::string&, val, val)>(
+            &LegalGrpcWebClient::analyzeCaseSimilarity))
+        .function("analyzeCaseSimilarity", select_overload<uint32_t(const std::string&, val, val, val)>(
+            &LegalGrpcWebClient::analyzeCaseSimilarity))
+        .function("buildSimilarityMatrix", select_overload<uint32_t(val, val)>(
+            &LegalGrpcWebClient::buildSimilarityMatrix))
+        .function("buildSimilarityMatrix", select_overload<uint32_t(val, val, val)>(
+            &LegalGrpcWebClient::buildSimilarityMatrix))
+        .function("addCaseEmbedding", &LegalGrpcWebClient::addCaseEmbedding)
+        .function("removeCaseFromMatrix", &LegalGrpcWebClient::removeCaseFromMatrix)
+        .function("getSimilarityMatrix", &LegalGrpcWebClient::getSimilarityMatrix)
+        .function("getNearestCases", &LegalGrpcWebClient::getNearestCases)
+        .function("getSimilarityMatrixStats", &LegalGrpcWebClient::getSimilarityMatrixStats)
+        .function("clearSimilarityMatrix", &LegalGrpcWebClient::clearSimilarityMatrix)
+        .function("cancelCall", &LegalGrpcWebClient::cancelCall)
+        .function("setDefaultDeadline", &LegalGrpcWebClient::setDefaultDeadline)
+        .function("rerankLastSearch", &LegalGrpcWebClient::rerankLastSearch)
+        .function("scoreTopK", &LegalGrpcWebClient::scoreTopK)
         .function("closeStream", &LegalGrpcWebClient::closeStream)
+        .function("getMetrics", &LegalGrpcWebClient::getMetrics)
+        .function("resetMetrics", &LegalGrpcWebClient::resetMetrics)
+        .function("warmUp", &LegalGrpcWebClient::warmUp)
+        .function("getChannelStats", &LegalGrpcWebClient::getChannelStats)
+        .function("setBulkQueueOptions", &LegalGrpcWebClient::setBulkQueueOptions)
+        .function("getBulkQueueStats", &LegalGrpcWebClient::getBulkQueueStats)
         .function("isConnected", &LegalGrpcWebClient::isConnected);
         
     register_vector<float>("VectorFloat");
     register_vector<std::string>("VectorString");
-}
\ No newline at end of file
+}
+
+#ifdef LEGAL_GRPC_BENCH
+EMSCRIPTEN_BINDINGS(legal_grpc_bench) {
+    function("benchFlatMessage", &bench::benchFlatMessage);
+    function("benchDispatch", &bench::benchDispatch);
+    function("benchAllocations", &bench::benchAllocations);
+}
+#endif
@@ -0,0 +1,66 @@
+// legal_request_arenas.h - Reused protobuf arenas for outgoing stream requests
+#pragma once
+
+#include <google/protobuf/arena.h>
+
+#include <cstddef>
+#include <memory>
+
+namespace legal_cuda_streaming {
+
+// Double-buffered arenas for outgoing stream requests. Requests are built in
+// the active arena and released once written; an arena is reset when its last
+// request has gone out, and the two swap roles when the active one outgrows
+// its initial block, so a steady stream reuses the same memory instead of
+// heap-allocating every string and repeated field.
+// Not thread-safe: callers hold the owning stream's write_mutex.
+template <typename Request>
+class RequestArenas {
+public:
+    struct Slot {
+        Request* request;
+        int arena;
+    };
+    
+    explicit RequestArenas(size_t block_size = 64 * 1024) : block_size_(block_size) {
+        for (int i = 0; i < 2; ++i) {
+            blocks_[i].reset(new char[block_size_]);
+            arenas_[i] = makeArena(blocks_[i].get());
+        }
+    }
+    
+    Slot create() {
+        const int other = 1 - active_;
+        if (arenas_[active_]->SpaceUsed() > block_size_ && live_[other] == 0) {
+            active_ = other;
+        }
+        ++live_[active_];
+        return Slot{google::protobuf::Arena::CreateMessage<Request>(arenas_[active_].get()),
+                    active_};
+    }
+    
+    // Reset keeps the initial block, so a drained arena starts over allocation-free
+    void release(const Slot& slot) {
+        if (--live_[slot.arena] == 0) {
+            arenas_[slot.arena]->Reset();
+        }
+    }
+
+private:
+    size_t block_size_;
+    std::unique_ptr<char[]> blocks_[2];
+    std::unique_ptr<google::protobuf::Arena> arenas_[2];
+    size_t live_[2] = {0, 0};
+    int active_ = 0;
+    
+    std::unique_ptr<google::protobuf::Arena> makeArena(char* block) {
+        google::protobuf::ArenaOptions options;
+        options.initial_block = block;
+        options.initial_block_size = block_size_;
+        options.start_block_size = block_size_;
+        options.max_block_size = 4 * block_size_;
+        return std::make_unique<google::protobuf::Arena>(options);
+    }
+};
+
+} // namespace legal_cuda_streaming
@@ -0,0 +1,162 @@
+// legal_result_ring.h - Single-producer/single-consumer record ring in shared memory
+//
+// In worker-hosted mode the client writes flat messages (see FlatMessageWriter)
+// into a ring inside its own WASM heap, which is a SharedArrayBuffer under
+// SHARED_MEMORY builds. The UI thread maps the same memory and reads records
+// with Atomics, so results reach it without postMessage copies. The reader
+// side lives in legal-grpc-result-ring.ts and must match the layout below.
+//
+// Layout (all fields little-endian u32, offsets from the ring base):
+//   0    write counter   bytes ever written, advanced by the producer
+//   64   read counter    bytes ever consumed, advanced by the consumer
+//   128  capacity        size of the data area, a power of two
+//   132  overflowed      records that waited in the producer's overflow queue
+//   192  data area
+// Counters wrap at 2^32; position = counter & (capacity - 1). Each record is
+// u32 payload size, u32 tag, then the payload padded to 4 bytes, and never
+// straddles the end of the data area: a size of kWrapMarker means the rest
+// of the area up to the end is padding.
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <new>
+#include <vector>
+
+namespace legal_cuda_streaming {
+
+class ResultRing {
+public:
+    static constexpr size_t kWriteOffset = 0;
+    static constexpr size_t kReadOffset = 64;
+    static constexpr size_t kCapacityOffset = 128;
+    static constexpr size_t kOverflowedOffset = 132;
+    static constexpr size_t kHeaderSize = 192;
+    static constexpr uint32_t kWrapMarker = 0xffffffffu;
+    static constexpr size_t kRecordHeader = 8;
+
+    // capacity is rounded up to a power of two, at least 4 KiB
+    explicit ResultRing(size_t capacity) {
+        size_t rounded = 4096;
+        while (rounded < capacity && rounded < (size_t(1) << 30)) {
+            rounded <<= 1;
+        }
+        capacity_ = static_cast<uint32_t>(rounded);
+
+        // 64-byte alignment keeps the two counters on separate cache lines
+        storage_.reset(new (std::align_val_t(64)) uint8_t[kHeaderSize + capacity_]);
+        std::memset(storage_.get(), 0, kHeaderSize);
+        std::memcpy(storage_.get() + kCapacityOffset, &capacity_, sizeof(capacity_));
+        new (storage_.get() + kWriteOffset) std::atomic<uint32_t>(0);
+        new (storage_.get() + kReadOffset) std::atomic<uint32_t>(0);
+    }
+
+    ResultRing(const ResultRing&) = delete;
+    ResultRing& operator=(const ResultRing&) = delete;
+
+    const uint8_t* base() const { return storage_.get(); }
+    uint32_t capacity() const { return capacity_; }
+
+    // Address the producer bumps after each publish, for futex-style wakeups
+    std::atomic<uint32_t>* writeCounter() { return counter(kWriteOffset); }
+
+    // Largest record publish() accepts. A record that wraps also pays for
+    // the padding up to the end of the area, always less than the record
+    // itself, so up to half the ring every record fits once it has drained.
+    size_t maxRecordSize() const { return capacity_ / 2; }
+
+    // Queue one record. Records that don't fit yet wait, in order, in an
+    // overflow queue that flushOverflow() retries; false for a record larger
+    // than maxRecordSize(), which the caller must deliver some other way.
+    // Producer thread only.
+    bool publish(uint32_t tag, const uint8_t* data, size_t size) {
+        if (recordSize(size) > maxRecordSize()) {
+            return false;
+        }
+        if (overflow_.empty() && tryWrite(tag, data, size)) {
+            return true;
+        }
+
+        overflow_.push_back({tag, std::vector<uint8_t>(data, data + size)});
+        uint32_t overflowed;
+        std::memcpy(&overflowed, storage_.get() + kOverflowedOffset, sizeof(overflowed));
+        ++overflowed;
+        std::memcpy(storage_.get() + kOverflowedOffset, &overflowed, sizeof(overflowed));
+        return true;
+    }
+
+    // Move as much of the overflow queue as now fits into the ring; returns
+    // true if records are still waiting. Producer thread only.
+    bool flushOverflow() {
+        while (!overflow_.empty()) {
+            const Pending& pending = overflow_.front();
+            if (!tryWrite(pending.tag, pending.payload.data(), pending.payload.size())) {
+                return true;
+            }
+            overflow_.pop_front();
+        }
+        return false;
+    }
+
+    bool hasOverflow() const { return !overflow_.empty(); }
+
+private:
+    struct AlignedDelete {
+        void operator()(uint8_t* p) const { ::operator delete[](p, std::align_val_t(64)); }
+    };
+
+    struct Pending {
+        uint32_t tag;
+        std::vector<uint8_t> payload;
+    };
+
+    std::unique_ptr<uint8_t[], AlignedDelete> storage_;
+    uint32_t capacity_ = 0;
+    std::deque<Pending> overflow_;
+
+    static size_t recordSize(size_t payload) {
+        return kRecordHeader + ((payload + 3) & ~size_t(3));
+    }
+
+    std::atomic<uint32_t>* counter(size_t offset) {
+        return reinterpret_cast<std::atomic<uint32_t>*>(storage_.get() + offset);
+    }
+
+    uint8_t* data() { return storage_.get() + kHeaderSize; }
+
+    bool tryWrite(uint32_t tag, const uint8_t* payload, size_t size) {
+        const uint32_t record = static_cast<uint32_t>(recordSize(size));
+        const uint32_t write = counter(kWriteOffset)->load(std::memory_order_relaxed);
+        const uint32_t read = counter(kReadOffset)->load(std::memory_order_acquire);
+        const uint32_t used = write - read;
+
+        const uint32_t position = write & (capacity_ - 1);
+        const uint32_t until_end = capacity_ - position;
+        const uint32_t padding = (record > until_end) ? until_end : 0;
+        if (used + padding + record > capacity_) {
+            return false;
+        }
+
+        uint32_t at = position;
+        if (padding > 0) {
+            std::memcpy(data() + at, &kWrapMarker, sizeof(kWrapMarker));
+            at = 0;
+        }
+        const uint32_t payload_size = static_cast<uint32_t>(size);
+        std::memcpy(data() + at, &payload_size, sizeof(payload_size));
+        std::memcpy(data() + at + 4, &tag, sizeof(tag));
+        if (size > 0) {
+            std::memcpy(data() + at + kRecordHeader, payload, size);
+        }
+
+        // Publishes the record bytes written above to the consumer
+        counter(kWriteOffset)->store(write + padding + record, std::memory_order_release);
+        return true;
+    }
+};
+
+} // namespace legal_cuda_streaming
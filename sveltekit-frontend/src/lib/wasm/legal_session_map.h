@@ -0,0 +1,81 @@
+// legal_session_map.h - Sharded registry of live sessions and uploads
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace legal_cuda_streaming {
+
+// Session-id keyed map split across independently locked shards, so lookups
+// for one session never wait on another session's insert or removal
+template <typename T, size_t ShardCount = 16>
+class ShardedSessionMap {
+public:
+    std::shared_ptr<T> find(const std::string& id) const {
+        const Shard& shard = shardFor(id);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.entries.find(id);
+        return it != shard.entries.end() ? it->second : nullptr;
+    }
+    
+    void assign(const std::string& id, std::shared_ptr<T> value) {
+        Shard& shard = shardFor(id);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.entries[id] = std::move(value);
+    }
+    
+    std::shared_ptr<T> remove(const std::string& id) {
+        Shard& shard = shardFor(id);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.entries.find(id);
+        if (it == shard.entries.end()) return nullptr;
+        
+        std::shared_ptr<T> value = std::move(it->second);
+        shard.entries.erase(it);
+        return value;
+    }
+    
+    // Remove the entry only if it still refers to expected
+    bool removeIf(const std::string& id, const T* expected) {
+        Shard& shard = shardFor(id);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.entries.find(id);
+        if (it == shard.entries.end() || it->second.get() != expected) return false;
+        
+        shard.entries.erase(it);
+        return true;
+    }
+    
+    template <typename Fn>
+    void forEach(Fn fn) const {
+        for (const Shard& shard : shards_) {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            for (const auto& entry : shard.entries) {
+                fn(*entry.second);
+            }
+        }
+    }
+
+private:
+    struct Shard {
+        mutable std::mutex mutex;
+        std::unordered_map<std::string, std::shared_ptr<T>> entries;
+    };
+    
+    std::array<Shard, ShardCount> shards_;
+    
+    Shard& shardFor(const std::string& id) {
+        return shards_[std::hash<std::string>{}(id) % ShardCount];
+    }
+    
+    const Shard& shardFor(const std::string& id) const {
+        return shards_[std::hash<std::string>{}(id) % ShardCount];
+    }
+};
+
+} // namespace legal_cuda_streaming
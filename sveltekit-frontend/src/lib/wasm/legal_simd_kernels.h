@@ -0,0 +1,441 @@
+// legal_simd_kernels.h - WASM SIMD vector kernels for client-side scoring
+//
+// Scores mirror cosine_similarity_kernel in go-enhanced-rag-service/cuda_kernels.cu
+// (dot / (sqrt(|q|^2) * sqrt(|d|^2)), 0 when either norm is zero) so locally
+// re-ranked results order the same way as server-side GPU scoring.
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <vector>
+
+#ifdef __wasm_simd128__
+#include <wasm_simd128.h>
+#endif
+
+namespace legal_cuda_streaming {
+namespace simd {
+
+#ifdef __wasm_simd128__
+inline float horizontalSum(v128_t v) {
+    return wasm_f32x4_extract_lane(v, 0) + wasm_f32x4_extract_lane(v, 1) +
+           wasm_f32x4_extract_lane(v, 2) + wasm_f32x4_extract_lane(v, 3);
+}
+#endif
+
+inline float dot(const float* a, const float* b, size_t n) {
+    size_t i = 0;
+    float sum = 0.0f;
+#ifdef __wasm_simd128__
+    v128_t acc = wasm_f32x4_splat(0.0f);
+    for (; i + 4 <= n; i += 4) {
+        acc = wasm_f32x4_add(acc, wasm_f32x4_mul(wasm_v128_load(a + i), wasm_v128_load(b + i)));
+    }
+    sum = horizontalSum(acc);
+#endif
+    for (; i < n; ++i) {
+        sum += a[i] * b[i];
+    }
+    return sum;
+}
+
+inline float squaredNorm(const float* a, size_t n) {
+    return dot(a, a, n);
+}
+
+// Dot product and document norm in one pass, for a query whose norm is known
+inline float cosineWithQueryNorm(const float* query, float query_norm,
+                                 const float* doc, size_t n) {
+    size_t i = 0;
+    float dot_product = 0.0f;
+    float doc_norm = 0.0f;
+#ifdef __wasm_simd128__
+    v128_t dot_acc = wasm_f32x4_splat(0.0f);
+    v128_t norm_acc = wasm_f32x4_splat(0.0f);
+    for (; i + 4 <= n; i += 4) {
+        v128_t q = wasm_v128_load(query + i);
+        v128_t d = wasm_v128_load(doc + i);
+        dot_acc = wasm_f32x4_add(dot_acc, wasm_f32x4_mul(q, d));
+        norm_acc = wasm_f32x4_add(norm_acc, wasm_f32x4_mul(d, d));
+    }
+    dot_product = horizontalSum(dot_acc);
+    doc_norm = horizontalSum(norm_acc);
+#endif
+    for (; i < n; ++i) {
+        dot_product += query[i] * doc[i];
+        doc_norm += doc[i] * doc[i];
+    }
+
+    float norm_product = query_norm * std::sqrt(doc_norm);
+    return (norm_product > 0.0f) ? (dot_product / norm_product) : 0.0f;
+}
+
+inline float cosine(const float* a, const float* b, size_t n) {
+    return cosineWithQueryNorm(a, std::sqrt(squaredNorm(a, n)), b, n);
+}
+
+// Score num_docs row-major vectors against one query
+inline void cosineBatch(const float* query, const float* docs, size_t num_docs,
+                        size_t dims, float* scores) {
+    const float query_norm = std::sqrt(squaredNorm(query, dims));
+    for (size_t d = 0; d < num_docs; ++d) {
+        scores[d] = cosineWithQueryNorm(query, query_norm, docs + d * dims, dims);
+    }
+}
+
+// Quantized wire formats. int8 vectors are symmetric with one scale per vector
+// (value = q * scale, scale = max|x| / 127); fp16 is IEEE binary16 with
+// round-to-nearest-even. Cosine scores are computed on the quantized form
+// directly: an int8 vector's scale cancels out of the cosine, so it is not
+// needed for scoring at all.
+
+inline uint32_t floatBits(float f) {
+    uint32_t bits;
+    std::memcpy(&bits, &f, sizeof(bits));
+    return bits;
+}
+
+inline float bitsFloat(uint32_t bits) {
+    float f;
+    std::memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+inline uint16_t floatToHalf(float value) {
+    uint32_t x = floatBits(value);
+    const uint32_t sign = x & 0x80000000u;
+    x ^= sign;
+
+    uint32_t half;
+    if (x >= 0x47800000u) {
+        // Overflows to infinity; NaN stays a quiet NaN
+        half = (x > 0x7f800000u) ? 0x7e00u : 0x7c00u;
+    } else if (x < 0x38800000u) {
+        // Subnormal or zero: let the FPU round the mantissa into place
+        half = floatBits(bitsFloat(x) + bitsFloat(0x3f000000u)) - 0x3f000000u;
+    } else {
+        // Rebias the exponent (127 -> 15) and round to nearest even
+        const uint32_t mantissa_odd = (x >> 13) & 1u;
+        half = (x + 0xc8000fffu + mantissa_odd) >> 13;
+    }
+    return static_cast<uint16_t>(half | (sign >> 16));
+}
+
+inline float halfToFloat(uint16_t half) {
+    uint32_t x = (uint32_t(half) & 0x7fffu) << 13;
+    const uint32_t exponent = x & 0x0f800000u;
+    x += 0x38000000u;
+    if (exponent == 0x0f800000u) {
+        x += 0x38000000u;  // infinity / NaN
+    } else if (exponent == 0) {
+        x = floatBits(bitsFloat(x + 0x00800000u) - bitsFloat(0x38800000u));  // subnormal
+    }
+    return bitsFloat(x | ((uint32_t(half) & 0x8000u) << 16));
+}
+
+#ifdef __wasm_simd128__
+// Four lanes of floatToHalf, results in the low 16 bits of each u32 lane
+inline v128_t floatToHalf4(v128_t value) {
+    const v128_t sign = wasm_v128_and(value, wasm_i32x4_splat(int32_t(0x80000000u)));
+    const v128_t x = wasm_v128_xor(value, sign);
+
+    const v128_t special = wasm_v128_bitselect(wasm_i32x4_splat(0x7e00), wasm_i32x4_splat(0x7c00),
+                                               wasm_i32x4_gt(x, wasm_i32x4_splat(0x7f800000)));
+    const v128_t subnormal = wasm_i32x4_sub(wasm_f32x4_add(x, wasm_i32x4_splat(0x3f000000)),
+                                            wasm_i32x4_splat(0x3f000000));
+    const v128_t mantissa_odd = wasm_v128_and(wasm_u32x4_shr(x, 13), wasm_i32x4_splat(1));
+    const v128_t normal = wasm_u32x4_shr(
+        wasm_i32x4_add(wasm_i32x4_add(x, wasm_i32x4_splat(int32_t(0xc8000fffu))), mantissa_odd), 13);
+
+    v128_t half = wasm_v128_bitselect(subnormal, normal, wasm_i32x4_lt(x, wasm_i32x4_splat(0x38800000)));
+    half = wasm_v128_bitselect(special, half, wasm_i32x4_ge(x, wasm_i32x4_splat(0x47800000)));
+    return wasm_v128_or(half, wasm_u32x4_shr(sign, 16));
+}
+
+// Four lanes of halfToFloat, halves in the low 16 bits of each u32 lane
+inline v128_t halfToFloat4(v128_t half) {
+    v128_t x = wasm_i32x4_shl(wasm_v128_and(half, wasm_i32x4_splat(0x7fff)), 13);
+    const v128_t exponent = wasm_v128_and(x, wasm_i32x4_splat(0x0f800000));
+    x = wasm_i32x4_add(x, wasm_i32x4_splat(0x38000000));
+
+    const v128_t special = wasm_i32x4_add(x, wasm_i32x4_splat(0x38000000));
+    const v128_t subnormal = wasm_f32x4_sub(wasm_i32x4_add(x, wasm_i32x4_splat(0x00800000)),
+                                            wasm_i32x4_splat(0x38800000));
+    x = wasm_v128_bitselect(special, x, wasm_i32x4_eq(exponent, wasm_i32x4_splat(0x0f800000)));
+    x = wasm_v128_bitselect(subnormal, x, wasm_i32x4_eq(exponent, wasm_i32x4_splat(0)));
+    return wasm_v128_or(x, wasm_i32x4_shl(wasm_v128_and(half, wasm_i32x4_splat(0x8000)), 16));
+}
+#endif
+
+inline void floatsToHalves(const float* src, size_t n, uint16_t* dst) {
+    size_t i = 0;
+#ifdef __wasm_simd128__
+    for (; i + 8 <= n; i += 8) {
+        const v128_t low = floatToHalf4(wasm_v128_load(src + i));
+        const v128_t high = floatToHalf4(wasm_v128_load(src + i + 4));
+        wasm_v128_store(dst + i, wasm_u16x8_narrow_i32x4(low, high));
+    }
+#endif
+    for (; i < n; ++i) {
+        dst[i] = floatToHalf(src[i]);
+    }
+}
+
+inline void halvesToFloats(const uint16_t* src, size_t n, float* dst) {
+    size_t i = 0;
+#ifdef __wasm_simd128__
+    for (; i + 8 <= n; i += 8) {
+        const v128_t halves = wasm_v128_load(src + i);
+        wasm_v128_store(dst + i, halfToFloat4(wasm_u32x4_extend_low_u16x8(halves)));
+        wasm_v128_store(dst + i + 4, halfToFloat4(wasm_u32x4_extend_high_u16x8(halves)));
+    }
+#endif
+    for (; i < n; ++i) {
+        dst[i] = halfToFloat(src[i]);
+    }
+}
+
+// Quantize one vector to int8 and return its scale (0 for an all-zero vector)
+inline float quantizeInt8(const float* src, size_t n, int8_t* dst) {
+    size_t i = 0;
+    float max_abs = 0.0f;
+#ifdef __wasm_simd128__
+    v128_t max_acc = wasm_f32x4_splat(0.0f);
+    for (; i + 4 <= n; i += 4) {
+        max_acc = wasm_f32x4_max(max_acc, wasm_f32x4_abs(wasm_v128_load(src + i)));
+    }
+    max_abs = std::max(std::max(wasm_f32x4_extract_lane(max_acc, 0), wasm_f32x4_extract_lane(max_acc, 1)),
+                       std::max(wasm_f32x4_extract_lane(max_acc, 2), wasm_f32x4_extract_lane(max_acc, 3)));
+#endif
+    for (; i < n; ++i) {
+        max_abs = std::max(max_abs, std::fabs(src[i]));
+    }
+
+    const float scale = max_abs / 127.0f;
+    const float inverse = (scale > 0.0f) ? 1.0f / scale : 0.0f;
+
+    i = 0;
+#ifdef __wasm_simd128__
+    const v128_t inverse_v = wasm_f32x4_splat(inverse);
+    auto quantize4 = [&](size_t at) {
+        return wasm_i32x4_trunc_sat_f32x4(wasm_f32x4_nearest(wasm_f32x4_mul(wasm_v128_load(src + at), inverse_v)));
+    };
+    for (; i + 16 <= n; i += 16) {
+        const v128_t low = wasm_i16x8_narrow_i32x4(quantize4(i), quantize4(i + 4));
+        const v128_t high = wasm_i16x8_narrow_i32x4(quantize4(i + 8), quantize4(i + 12));
+        wasm_v128_store(dst + i, wasm_i8x16_narrow_i16x8(low, high));
+    }
+#endif
+    for (; i < n; ++i) {
+        dst[i] = static_cast<int8_t>(std::nearbyint(src[i] * inverse));
+    }
+    return scale;
+}
+
+inline void dequantizeInt8(const int8_t* src, size_t n, float scale, float* dst) {
+    size_t i = 0;
+#ifdef __wasm_simd128__
+    const v128_t scale_v = wasm_f32x4_splat(scale);
+    for (; i + 8 <= n; i += 8) {
+        const v128_t widened = wasm_i16x8_load8x8(src + i);
+        wasm_v128_store(dst + i, wasm_f32x4_mul(wasm_f32x4_convert_i32x4(wasm_i32x4_extend_low_i16x8(widened)), scale_v));
+        wasm_v128_store(dst + i + 4, wasm_f32x4_mul(wasm_f32x4_convert_i32x4(wasm_i32x4_extend_high_i16x8(widened)), scale_v));
+    }
+#endif
+    for (; i < n; ++i) {
+        dst[i] = float(src[i]) * scale;
+    }
+}
+
+// cosineWithQueryNorm against an int8 document; the document's scale cancels
+inline float cosineInt8WithQueryNorm(const float* query, float query_norm,
+                                     const int8_t* doc, size_t n) {
+    size_t i = 0;
+    float dot_product = 0.0f;
+    float doc_norm = 0.0f;
+#ifdef __wasm_simd128__
+    v128_t dot_acc = wasm_f32x4_splat(0.0f);
+    v128_t norm_acc = wasm_f32x4_splat(0.0f);
+    for (; i + 8 <= n; i += 8) {
+        const v128_t widened = wasm_i16x8_load8x8(doc + i);
+        const v128_t low = wasm_f32x4_convert_i32x4(wasm_i32x4_extend_low_i16x8(widened));
+        const v128_t high = wasm_f32x4_convert_i32x4(wasm_i32x4_extend_high_i16x8(widened));
+        dot_acc = wasm_f32x4_add(dot_acc, wasm_f32x4_mul(wasm_v128_load(query + i), low));
+        dot_acc = wasm_f32x4_add(dot_acc, wasm_f32x4_mul(wasm_v128_load(query + i + 4), high));
+        norm_acc = wasm_f32x4_add(norm_acc, wasm_f32x4_add(wasm_f32x4_mul(low, low), wasm_f32x4_mul(high, high)));
+    }
+    dot_product = horizontalSum(dot_acc);
+    doc_norm = horizontalSum(norm_acc);
+#endif
+    for (; i < n; ++i) {
+        const float d = float(doc[i]);
+        dot_product += query[i] * d;
+        doc_norm += d * d;
+    }
+
+    float norm_product = query_norm * std::sqrt(doc_norm);
+    return (norm_product > 0.0f) ? (dot_product / norm_product) : 0.0f;
+}
+
+// cosineWithQueryNorm against an fp16 document, widened lane by lane
+inline float cosineHalfWithQueryNorm(const float* query, float query_norm,
+                                     const uint16_t* doc, size_t n) {
+    size_t i = 0;
+    float dot_product = 0.0f;
+    float doc_norm = 0.0f;
+#ifdef __wasm_simd128__
+    v128_t dot_acc = wasm_f32x4_splat(0.0f);
+    v128_t norm_acc = wasm_f32x4_splat(0.0f);
+    for (; i + 8 <= n; i += 8) {
+        const v128_t halves = wasm_v128_load(doc + i);
+        const v128_t low = halfToFloat4(wasm_u32x4_extend_low_u16x8(halves));
+        const v128_t high = halfToFloat4(wasm_u32x4_extend_high_u16x8(halves));
+        dot_acc = wasm_f32x4_add(dot_acc, wasm_f32x4_mul(wasm_v128_load(query + i), low));
+        dot_acc = wasm_f32x4_add(dot_acc, wasm_f32x4_mul(wasm_v128_load(query + i + 4), high));
+        norm_acc = wasm_f32x4_add(norm_acc, wasm_f32x4_add(wasm_f32x4_mul(low, low), wasm_f32x4_mul(high, high)));
+    }
+    dot_product = horizontalSum(dot_acc);
+    doc_norm = horizontalSum(norm_acc);
+#endif
+    for (; i < n; ++i) {
+        const float d = halfToFloat(doc[i]);
+        dot_product += query[i] * d;
+        doc_norm += d * d;
+    }
+
+    float norm_product = query_norm * std::sqrt(doc_norm);
+    return (norm_product > 0.0f) ? (dot_product / norm_product) : 0.0f;
+}
+
+inline void cosineBatchInt8(const float* query, const int8_t* docs, size_t num_docs,
+                            size_t dims, float* scores) {
+    const float query_norm = std::sqrt(squaredNorm(query, dims));
+    for (size_t d = 0; d < num_docs; ++d) {
+        scores[d] = cosineInt8WithQueryNorm(query, query_norm, docs + d * dims, dims);
+    }
+}
+
+inline void cosineBatchHalf(const float* query, const uint16_t* docs, size_t num_docs,
+                            size_t dims, float* scores) {
+    const float query_norm = std::sqrt(squaredNorm(query, dims));
+    for (size_t d = 0; d < num_docs; ++d) {
+        scores[d] = cosineHalfWithQueryNorm(query, query_norm, docs + d * dims, dims);
+    }
+}
+
+// One 4x4 block of dot products, out[r * out_stride + c] = a_r . b_c for four
+// consecutive rows of a and of b. Each loaded chunk of a row feeds four
+// accumulators.
+inline void dotTile4x4(const float* a, const float* b, size_t dims,
+                       float* out, size_t out_stride) {
+    float sums[4][4] = {};
+    size_t k = 0;
+#ifdef __wasm_simd128__
+    v128_t acc[4][4];
+    for (size_t r = 0; r < 4; ++r) {
+        for (size_t c = 0; c < 4; ++c) {
+            acc[r][c] = wasm_f32x4_splat(0.0f);
+        }
+    }
+    for (; k + 4 <= dims; k += 4) {
+        v128_t columns[4];
+        for (size_t c = 0; c < 4; ++c) {
+            columns[c] = wasm_v128_load(b + c * dims + k);
+        }
+        for (size_t r = 0; r < 4; ++r) {
+            const v128_t row = wasm_v128_load(a + r * dims + k);
+            for (size_t c = 0; c < 4; ++c) {
+                acc[r][c] = wasm_f32x4_add(acc[r][c], wasm_f32x4_mul(row, columns[c]));
+            }
+        }
+    }
+    for (size_t r = 0; r < 4; ++r) {
+        for (size_t c = 0; c < 4; ++c) {
+            sums[r][c] = horizontalSum(acc[r][c]);
+        }
+    }
+#endif
+    for (; k < dims; ++k) {
+        for (size_t r = 0; r < 4; ++r) {
+            for (size_t c = 0; c < 4; ++c) {
+                sums[r][c] += a[r * dims + k] * b[c * dims + k];
+            }
+        }
+    }
+    for (size_t r = 0; r < 4; ++r) {
+        for (size_t c = 0; c < 4; ++c) {
+            out[r * out_stride + c] = sums[r][c];
+        }
+    }
+}
+
+// All-pairs dot products of n1 rows of a against n2 rows of b, written
+// row-major as out[i * out_stride + j]: the layout of pairwise_distances_kernel
+// in cuda_kernels.cu, which gives each (i, j) its own thread. Here pairs are
+// taken in 4x4 register tiles, and b is walked in panels small enough to stay
+// in cache while every row of a passes over them. For unit vectors the
+// results are cosine similarities; that kernel's distances are sqrt(2 - 2 dot).
+inline void pairwiseDots(const float* a, size_t n1, const float* b, size_t n2, size_t dims,
+                         float* out, size_t out_stride) {
+    constexpr size_t kTile = 4;
+    constexpr size_t kPanelRows = 64;
+    for (size_t j0 = 0; j0 < n2; j0 += kPanelRows) {
+        const size_t j_end = std::min(n2, j0 + kPanelRows);
+        size_t i = 0;
+        for (; i + kTile <= n1; i += kTile) {
+            size_t j = j0;
+            for (; j + kTile <= j_end; j += kTile) {
+                dotTile4x4(a + i * dims, b + j * dims, dims, out + i * out_stride + j, out_stride);
+            }
+            for (; j < j_end; ++j) {
+                for (size_t r = 0; r < kTile; ++r) {
+                    out[(i + r) * out_stride + j] = dot(a + (i + r) * dims, b + j * dims, dims);
+                }
+            }
+        }
+        for (; i < n1; ++i) {
+            for (size_t j = j0; j < j_end; ++j) {
+                out[i * out_stride + j] = dot(a + i * dims, b + j * dims, dims);
+            }
+        }
+    }
+}
+
+struct ScoredIndex {
+    float score;
+    uint32_t index;
+};
+
+// Bounded min-heap selection of the k best scores, returned best first.
+// Entries rejected by accept (if given) are skipped.
+inline std::vector<ScoredIndex> topK(const float* scores, size_t n, size_t k,
+                                     const std::function<bool(size_t)>& accept = nullptr) {
+    auto worse = [](const ScoredIndex& a, const ScoredIndex& b) { return a.score > b.score; };
+
+    std::vector<ScoredIndex> heap;
+    heap.reserve(std::min(k, n));
+    if (k == 0) return heap;
+
+    for (size_t i = 0; i < n; ++i) {
+        if (accept && !accept(i)) continue;
+
+        if (heap.size() < k) {
+            heap.push_back({scores[i], static_cast<uint32_t>(i)});
+            std::push_heap(heap.begin(), heap.end(), worse);
+        } else if (scores[i] > heap.front().score) {
+            std::pop_heap(heap.begin(), heap.end(), worse);
+            heap.back() = {scores[i], static_cast<uint32_t>(i)};
+            std::push_heap(heap.begin(), heap.end(), worse);
+        }
+    }
+
+    std::sort_heap(heap.begin(), heap.end(), worse);
+    return heap;
+}
+
+} // namespace simd
+} // namespace legal_cuda_streaming
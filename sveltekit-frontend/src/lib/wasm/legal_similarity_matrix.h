@@ -0,0 +1,194 @@
+// legal_similarity_matrix.h - Pairwise case similarity computed in WASM
+//
+// Holds one normalized embedding per case and the N x N matrix of their
+// cosine similarities, filled by simd::pairwiseDots. Adding cases computes
+// only their rows, against every case including each other, and mirrors
+// them into the columns, so growing a 200-case precedent view by one case
+// costs 200 dot products rather than a rebuild. Replacing a case's vector
+// recomputes just its row and column. Main thread only.
+#pragma once
+
+#include "legal_simd_kernels.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace legal_cuda_streaming {
+
+class CaseSimilarityMatrix {
+public:
+    struct Neighbour {
+        std::string case_id;
+        float similarity;
+    };
+
+    struct Stats {
+        size_t size;
+        size_t dims;
+        uint64_t rows_computed;  // rows filled by the kernel since the last clear
+    };
+
+    // Add or replace cases, vectors holding case_ids.size() rows of dims
+    // floats. A vector of another dimension (a new embedding model) starts
+    // the matrix over. Returns the number of rows computed.
+    size_t add(const std::vector<std::string>& case_ids, const float* vectors, size_t dims) {
+        if (case_ids.empty() || dims == 0) return 0;
+        if (dims != dims_) {
+            clear();
+            dims_ = dims;
+        }
+
+        std::vector<size_t> changed;
+        changed.reserve(case_ids.size());
+        for (size_t r = 0; r < case_ids.size(); ++r) {
+            auto it = index_.find(case_ids[r]);
+            size_t row;
+            if (it == index_.end()) {
+                row = ids_.size();
+                index_.emplace(case_ids[r], row);
+                ids_.push_back(case_ids[r]);
+                vectors_.resize(ids_.size() * dims_);
+            } else {
+                row = it->second;
+            }
+            normalize(vectors + r * dims, vectors_.data() + row * dims_);
+            changed.push_back(row);
+        }
+        std::sort(changed.begin(), changed.end());
+        changed.erase(std::unique(changed.begin(), changed.end()), changed.end());
+
+        const size_t n = ids_.size();
+        reserve(n);
+
+        // Appended cases are already contiguous; replaced ones are gathered
+        const float* rows = vectors_.data() + changed.front() * dims_;
+        if (changed.back() - changed.front() + 1 != changed.size()) {
+            gathered_.resize(changed.size() * dims_);
+            for (size_t r = 0; r < changed.size(); ++r) {
+                std::copy_n(vectors_.data() + changed[r] * dims_, dims_, gathered_.data() + r * dims_);
+            }
+            rows = gathered_.data();
+        }
+
+        block_.resize(changed.size() * n);
+        simd::pairwiseDots(rows, changed.size(), vectors_.data(), n, dims_, block_.data(), n);
+        for (size_t r = 0; r < changed.size(); ++r) {
+            const size_t row = changed[r];
+            const float* computed = block_.data() + r * n;
+            std::copy_n(computed, n, matrix_.data() + row * stride_);
+            for (size_t j = 0; j < n; ++j) {
+                matrix_[j * stride_ + row] = computed[j];
+            }
+        }
+        rows_computed_ += changed.size();
+        return changed.size();
+    }
+
+    bool remove(const std::string& case_id) {
+        auto it = index_.find(case_id);
+        if (it == index_.end()) return false;
+        const size_t removed = it->second;
+        const size_t n = ids_.size();
+        index_.erase(it);
+
+        // Close the gap left by the row and column, row by row in place
+        for (size_t i = 0, target = 0; i < n; ++i) {
+            if (i == removed) continue;
+            float* source = matrix_.data() + i * stride_;
+            float* destination = matrix_.data() + target * stride_;
+            std::copy(source, source + removed, destination);
+            std::copy(source + removed + 1, source + n, destination + removed);
+            ++target;
+        }
+        vectors_.erase(vectors_.begin() + removed * dims_, vectors_.begin() + (removed + 1) * dims_);
+        ids_.erase(ids_.begin() + removed);
+        for (size_t i = removed; i < ids_.size(); ++i) {
+            index_[ids_[i]] = i;
+        }
+        return true;
+    }
+
+    bool contains(const std::string& case_id) const { return index_.count(case_id) > 0; }
+    size_t size() const { return ids_.size(); }
+    size_t dims() const { return dims_; }
+    const std::vector<std::string>& caseIds() const { return ids_; }
+
+    float similarity(size_t i, size_t j) const { return matrix_[i * stride_ + j]; }
+
+    // size() x size(), row-major, in caseIds() order
+    std::vector<float> packed() const {
+        const size_t n = ids_.size();
+        std::vector<float> result(n * n);
+        for (size_t i = 0; i < n; ++i) {
+            std::copy_n(matrix_.data() + i * stride_, n, result.data() + i * n);
+        }
+        return result;
+    }
+
+    // Most similar other cases, highest first
+    std::vector<Neighbour> nearest(const std::string& case_id, size_t k) const {
+        std::vector<Neighbour> result;
+        auto it = index_.find(case_id);
+        if (it == index_.end()) return result;
+
+        const size_t self = it->second;
+        const auto best = simd::topK(matrix_.data() + self * stride_, ids_.size(), k,
+                                     [self](size_t j) { return j != self; });
+        result.reserve(best.size());
+        for (const auto& entry : best) {
+            result.push_back({ids_[entry.index], entry.score});
+        }
+        return result;
+    }
+
+    void clear() {
+        dims_ = 0;
+        ids_.clear();
+        index_.clear();
+        vectors_.clear();
+        matrix_.clear();
+        stride_ = 0;
+        rows_computed_ = 0;
+    }
+
+    Stats stats() const { return {ids_.size(), dims_, rows_computed_}; }
+
+private:
+    size_t dims_ = 0;
+    std::vector<std::string> ids_;
+    std::unordered_map<std::string, size_t> index_;
+    std::vector<float> vectors_;  // size() x dims_, unit length
+    std::vector<float> matrix_;   // stride_ x stride_, the first size() of each used
+    size_t stride_ = 0;
+    std::vector<float> block_;    // rows being computed
+    std::vector<float> gathered_;
+    uint64_t rows_computed_ = 0;
+
+    // Grow by half at a time, so adding cases one by one stays amortized
+    // without reserving quadratic space far beyond what is used
+    void reserve(size_t n) {
+        if (n <= stride_) return;
+        const size_t stride = std::max({n, stride_ + stride_ / 2, size_t(16)});
+        std::vector<float> matrix(stride * stride);
+        const size_t kept = std::min(stride_, n);
+        for (size_t i = 0; i < kept; ++i) {
+            std::copy_n(matrix_.data() + i * stride_, kept, matrix.data() + i * stride);
+        }
+        matrix_.swap(matrix);
+        stride_ = stride;
+    }
+
+    void normalize(const float* in, float* out) const {
+        const float norm = std::sqrt(simd::squaredNorm(in, dims_));
+        const float inverse = norm > 0.0f ? 1.0f / norm : 0.0f;
+        for (size_t i = 0; i < dims_; ++i) {
+            out[i] = in[i] * inverse;
+        }
+    }
+};
+
+} // namespace legal_cuda_streaming
@@ -0,0 +1,475 @@
+// legal_vector_index.h - Incremental in-memory index over session embeddings
+//
+// Embeddings returned to bidirectional sessions are kept here so follow-up
+// similarity queries over what the user just uploaded can be answered
+// without a round trip. Vectors are normalized on insert, so scores are
+// cosine similarities. Small indexes are scanned exhaustively with the SIMD
+// kernels; once an index passes hnsw_threshold vectors a hierarchical
+// navigable small world graph (Malkov & Yashunin) is built over it and grown
+// with every insert. When full, the oldest quarter is dropped: in the graph
+// those nodes become tombstones, routed through but never returned, while
+// the following inserts relink their neighbours around them a few nodes at
+// a time, so no eviction pays for a rebuild.
+#pragma once
+
+#include "legal_simd_kernels.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <mutex>
+#include <queue>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace legal_cuda_streaming {
+
+class LocalVectorIndex {
+public:
+    struct Options {
+        size_t capacity = 0;          // 0 disables the index
+        size_t hnsw_threshold = 4096; // exhaustive search below this size
+        size_t max_links = 16;        // M; twice that on the bottom layer
+        size_t ef_construction = 100;
+        size_t ef_search = 64;
+    };
+
+    struct Hit {
+        float score;
+        std::string label;
+        std::string session_id;
+    };
+
+    struct Stats {
+        size_t size;
+        size_t dims;
+        size_t capacity;
+        size_t levels; // 0 while searching exhaustively
+        uint64_t inserts;
+        uint64_t searches;
+    };
+
+    void configure(const Options& options) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        options_ = options;
+        options_.max_links = std::max<size_t>(options_.max_links, 2);
+        level_scale_ = 1.0 / std::log(static_cast<double>(options_.max_links));
+        if (options_.capacity == 0) {
+            clearLocked();
+        } else if (liveCount() > options_.capacity) {
+            evictLocked(liveCount() - options_.capacity);
+        } else if (useGraph() != !levels_.empty()) {
+            rebuildLocked();
+        }
+    }
+
+    bool enabled() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return options_.capacity > 0;
+    }
+
+    // A vector of a different dimension (a new embedding model) replaces
+    // the whole index
+    void add(const float* vector, size_t dims, std::string label, std::string session_id) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (options_.capacity == 0 || dims == 0) return;
+        if (dims != dims_) {
+            clearLocked();
+            dims_ = dims;
+        }
+        if (liveCount() >= options_.capacity) {
+            evictLocked(std::max<size_t>(options_.capacity / 4, 1));
+        }
+
+        const size_t id = labels_.size();
+        vectors_.resize((id + 1) * dims_);
+        normalize(vector, vectors_.data() + id * dims_);
+        labels_.push_back(std::move(label));
+        sessions_.push_back(std::move(session_id));
+        ++inserts_;
+
+        if (!levels_.empty()) {
+            insertNode(static_cast<uint32_t>(id));
+            if (dead_ > 0) repairStep(kRepairPerInsert);
+        } else if (useGraph()) {
+            rebuildLocked();
+        }
+    }
+
+    // Best k by cosine similarity, highest first
+    std::vector<Hit> search(const float* query, size_t dims, size_t k) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::vector<Hit> hits;
+        if (dims != dims_ || liveCount() == 0 || k == 0) return hits;
+        ++searches_;
+
+        std::vector<float> normalized(dims_);
+        normalize(query, normalized.data());
+
+        std::vector<simd::ScoredIndex> best;
+        if (levels_.empty()) {
+            // Tombstones only exist in the graph
+            const size_t count = labels_.size();
+            std::vector<float> scores(count);
+            for (size_t i = 0; i < count; ++i) {
+                scores[i] = simd::dot(normalized.data(), vectors_.data() + i * dims_, dims_);
+            }
+            best = simd::topK(scores.data(), count, k);
+        } else {
+            best = searchGraph(normalized.data(), k);
+        }
+
+        hits.reserve(best.size());
+        for (const auto& entry : best) {
+            hits.push_back({entry.score, labels_[entry.index], sessions_[entry.index]});
+        }
+        return hits;
+    }
+
+    void clear() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        clearLocked();
+    }
+
+    Stats stats() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        size_t levels = 0;
+        for (const auto& node_levels : levels_) {
+            levels = std::max(levels, node_levels.size());
+        }
+        return {liveCount(), dims_, options_.capacity, levels, inserts_, searches_};
+    }
+
+private:
+    using Candidate = std::pair<float, uint32_t>; // distance, node
+
+    // Nodes relinked per insert while tombstones remain. An eviction drops a
+    // quarter of the index, so this finishes well before the next one.
+    static constexpr size_t kRepairPerInsert = 8;
+
+    Options options_;
+    double level_scale_ = 1.0 / std::log(16.0);
+    size_t dims_ = 0;
+    std::vector<float> vectors_;
+    std::vector<std::string> labels_;
+    std::vector<std::string> sessions_;
+    // Eviction is oldest first, so tombstones are always the ids below dead_;
+    // repair_next_ is the next node to relink around them
+    size_t dead_ = 0;
+    size_t repair_next_ = 0;
+    uint64_t inserts_ = 0;
+    uint64_t searches_ = 0;
+
+    // Graph state, empty while searching exhaustively. levels_[node][layer]
+    // holds the node's neighbours on that layer.
+    std::vector<std::vector<std::vector<uint32_t>>> levels_;
+    uint32_t entry_point_ = 0;
+    size_t top_layer_ = 0;
+    std::vector<uint32_t> visited_;
+    uint32_t visit_epoch_ = 0;
+    std::minstd_rand random_{0x9e3779b9u};
+
+    mutable std::mutex mutex_;
+
+    size_t liveCount() const { return labels_.size() - dead_; }
+
+    bool useGraph() const {
+        return liveCount() >= std::max<size_t>(options_.hnsw_threshold, 2);
+    }
+
+    void normalize(const float* in, float* out) const {
+        const float norm = std::sqrt(simd::squaredNorm(in, dims_));
+        const float inverse = norm > 0.0f ? 1.0f / norm : 0.0f;
+        for (size_t i = 0; i < dims_; ++i) {
+            out[i] = in[i] * inverse;
+        }
+    }
+
+    float distance(const float* query, uint32_t node) const {
+        return 1.0f - simd::dot(query, vectors_.data() + size_t(node) * dims_, dims_);
+    }
+
+    // Requires mutex_
+    void clearLocked() {
+        dims_ = 0;
+        vectors_.clear();
+        labels_.clear();
+        sessions_.clear();
+        dead_ = 0;
+        repair_next_ = 0;
+        levels_.clear();
+        visited_.clear();
+        entry_point_ = 0;
+        top_layer_ = 0;
+    }
+
+    // Drop the oldest count vectors. Exhaustive search just erases them; the
+    // graph tombstones them and relinks around them a few nodes per insert.
+    // Requires mutex_.
+    void evictLocked(size_t count) {
+        count = std::min(count, liveCount());
+        if (levels_.empty()) {
+            eraseOldest(count);
+            return;
+        }
+
+        dead_ += count;
+        if (!useGraph()) {
+            rebuildLocked();
+            return;
+        }
+        // Nodes already relinked may point at the new tombstones
+        repair_next_ = dead_;
+    }
+
+    // Requires mutex_
+    void eraseOldest(size_t count) {
+        vectors_.erase(vectors_.begin(), vectors_.begin() + count * dims_);
+        labels_.erase(labels_.begin(), labels_.begin() + count);
+        sessions_.erase(sessions_.begin(), sessions_.begin() + count);
+    }
+
+    // Relink the next budget nodes, then once every live node is free of
+    // tombstones drop them and shift the ids down. Inserts never link to a
+    // tombstone, so nodes behind the cursor stay clean. Requires mutex_.
+    void repairStep(size_t budget) {
+        for (; budget > 0 && repair_next_ < levels_.size(); --budget) {
+            relink(static_cast<uint32_t>(repair_next_++));
+        }
+        if (repair_next_ < levels_.size()) return;
+
+        const uint32_t dead = static_cast<uint32_t>(dead_);
+        eraseOldest(dead_);
+        levels_.erase(levels_.begin(), levels_.begin() + dead_);
+        dead_ = 0;
+        repair_next_ = 0;
+        entry_point_ = 0;
+        top_layer_ = 0;
+        for (uint32_t node = 0; node < levels_.size(); ++node) {
+            for (auto& links : levels_[node]) {
+                for (uint32_t& other : links) other -= dead;
+            }
+            if (levels_[node].size() - 1 > top_layer_) {
+                top_layer_ = levels_[node].size() - 1;
+                entry_point_ = node;
+            }
+        }
+    }
+
+    // A node that linked to tombstones takes their live neighbours as
+    // candidates and reselects its links among them and its remaining
+    // ones, which keeps the routes the tombstones carried
+    void relink(uint32_t node) {
+        const uint32_t dead = static_cast<uint32_t>(dead_);
+        const float* base = vectors_.data() + size_t(node) * dims_;
+        for (size_t layer = 0; layer < levels_[node].size(); ++layer) {
+            auto& links = levels_[node][layer];
+            if (std::none_of(links.begin(), links.end(),
+                             [dead](uint32_t other) { return other < dead; })) {
+                continue;
+            }
+
+            std::vector<uint32_t> pool;
+            for (uint32_t other : links) {
+                if (other >= dead) {
+                    pool.push_back(other);
+                    continue;
+                }
+                for (uint32_t second : levels_[other][layer]) {
+                    if (second >= dead && second != node) pool.push_back(second);
+                }
+            }
+            std::sort(pool.begin(), pool.end());
+            pool.erase(std::unique(pool.begin(), pool.end()), pool.end());
+
+            std::vector<Candidate> candidates;
+            candidates.reserve(pool.size());
+            for (uint32_t other : pool) {
+                candidates.emplace_back(distance(base, other), other);
+            }
+            // As many as an insert would weigh
+            const size_t keep = std::min(candidates.size(), options_.ef_construction);
+            std::partial_sort(candidates.begin(), candidates.begin() + keep, candidates.end());
+            candidates.resize(keep);
+            links = selectNeighbours(candidates, maxLinks(layer));
+        }
+    }
+
+    // Requires mutex_
+    void rebuildLocked() {
+        eraseOldest(dead_);
+        dead_ = 0;
+        repair_next_ = 0;
+        levels_.clear();
+        entry_point_ = 0;
+        top_layer_ = 0;
+        if (!useGraph()) return;
+
+        for (size_t id = 0; id < labels_.size(); ++id) {
+            insertNode(static_cast<uint32_t>(id));
+        }
+    }
+
+    size_t maxLinks(size_t layer) const {
+        return layer == 0 ? options_.max_links * 2 : options_.max_links;
+    }
+
+    void insertNode(uint32_t node) {
+        const double uniform = std::uniform_real_distribution<double>(
+            std::numeric_limits<double>::min(), 1.0)(random_);
+        const size_t level = static_cast<size_t>(-std::log(uniform) * level_scale_);
+        levels_.emplace_back(level + 1);
+
+        if (levels_.size() == 1) {
+            entry_point_ = 0;
+            top_layer_ = level;
+            return;
+        }
+
+        const float* query = vectors_.data() + size_t(node) * dims_;
+        uint32_t entry = entry_point_;
+        for (size_t layer = top_layer_; layer > level; --layer) {
+            entry = greedyClosest(query, entry, layer);
+        }
+
+        for (size_t layer = std::min(level, top_layer_) + 1; layer-- > 0;) {
+            auto candidates = searchLayer(query, entry, options_.ef_construction, layer);
+            entry = candidates.front().second;
+            // Routed through, never linked to
+            const uint32_t dead = static_cast<uint32_t>(dead_);
+            candidates.erase(std::remove_if(candidates.begin(), candidates.end(),
+                                            [dead](const Candidate& c) { return c.second < dead; }),
+                             candidates.end());
+            auto neighbours = selectNeighbours(candidates, options_.max_links);
+            levels_[node][layer] = neighbours;
+            for (uint32_t neighbour : neighbours) {
+                link(neighbour, node, layer);
+            }
+        }
+
+        if (level > top_layer_) {
+            top_layer_ = level;
+            entry_point_ = node;
+        }
+    }
+
+    void link(uint32_t from, uint32_t to, size_t layer) {
+        auto& links = levels_[from][layer];
+        links.push_back(to);
+        if (links.size() <= maxLinks(layer)) return;
+
+        const float* base = vectors_.data() + size_t(from) * dims_;
+        std::vector<Candidate> candidates;
+        candidates.reserve(links.size());
+        for (uint32_t other : links) {
+            candidates.emplace_back(distance(base, other), other);
+        }
+        std::sort(candidates.begin(), candidates.end());
+        links = selectNeighbours(candidates, maxLinks(layer));
+    }
+
+    // Neighbour selection heuristic: a candidate (closest first) is kept only
+    // if it is closer to the base than to every neighbour already kept, which
+    // spreads links across clusters
+    std::vector<uint32_t> selectNeighbours(const std::vector<Candidate>& sorted, size_t limit) const {
+        std::vector<uint32_t> kept;
+        kept.reserve(limit);
+        for (const auto& candidate : sorted) {
+            if (kept.size() >= limit) break;
+            const float* vector = vectors_.data() + size_t(candidate.second) * dims_;
+            bool diverse = true;
+            for (uint32_t other : kept) {
+                if (distance(vector, other) < candidate.first) {
+                    diverse = false;
+                    break;
+                }
+            }
+            if (diverse) kept.push_back(candidate.second);
+        }
+        return kept;
+    }
+
+    uint32_t greedyClosest(const float* query, uint32_t entry, size_t layer) const {
+        float best = distance(query, entry);
+        for (bool improved = true; improved;) {
+            improved = false;
+            for (uint32_t neighbour : levels_[entry][layer]) {
+                const float d = distance(query, neighbour);
+                if (d < best) {
+                    best = d;
+                    entry = neighbour;
+                    improved = true;
+                }
+            }
+        }
+        return entry;
+    }
+
+    // Best-first search of one layer; returns up to ef candidates, closest first
+    std::vector<Candidate> searchLayer(const float* query, uint32_t entry, size_t ef, size_t layer) {
+        if (visited_.size() < levels_.size()) {
+            visited_.resize(levels_.size(), 0);
+        }
+        if (++visit_epoch_ == 0) {
+            std::fill(visited_.begin(), visited_.end(), 0);
+            visit_epoch_ = 1;
+        }
+
+        std::priority_queue<Candidate, std::vector<Candidate>, std::greater<Candidate>> frontier;
+        std::priority_queue<Candidate> results;
+        const float entry_distance = distance(query, entry);
+        frontier.emplace(entry_distance, entry);
+        results.emplace(entry_distance, entry);
+        visited_[entry] = visit_epoch_;
+
+        while (!frontier.empty()) {
+            const Candidate current = frontier.top();
+            if (current.first > results.top().first && results.size() >= ef) break;
+            frontier.pop();
+
+            for (uint32_t neighbour : levels_[current.second][layer]) {
+                if (visited_[neighbour] == visit_epoch_) continue;
+                visited_[neighbour] = visit_epoch_;
+
+                const float d = distance(query, neighbour);
+                if (results.size() < ef || d < results.top().first) {
+                    frontier.emplace(d, neighbour);
+                    results.emplace(d, neighbour);
+                    if (results.size() > ef) results.pop();
+                }
+            }
+        }
+
+        std::vector<Candidate> sorted(results.size());
+        for (size_t i = sorted.size(); i-- > 0;) {
+            sorted[i] = results.top();
+            results.pop();
+        }
+        return sorted;
+    }
+
+    std::vector<simd::ScoredIndex> searchGraph(const float* query, size_t k) {
+        uint32_t entry = entry_point_;
+        for (size_t layer = top_layer_; layer > 0; --layer) {
+            entry = greedyClosest(query, entry, layer);
+        }
+
+        // Tombstones are explored like any node but not returned, so the
+        // beam is widened by their share of the graph
+        const size_t ef = std::max(options_.ef_search, k);
+        auto candidates = searchLayer(query, entry, ef + ef * dead_ / levels_.size(), 0);
+        std::vector<simd::ScoredIndex> best;
+        best.reserve(std::min(k, candidates.size()));
+        for (size_t i = 0; i < candidates.size() && best.size() < k; ++i) {
+            if (candidates[i].second < dead_) continue;
+            best.push_back({1.0f - candidates[i].first, candidates[i].second});
+        }
+        return best;
+    }
+};
+
+} // namespace legal_cuda_streaming
@@ -0,0 +1,232 @@
+// legal_client_benchmarks.cpp - Microbenchmarks for the client's marshalling hot paths
+//
+// Covers what every message pays on its way between the wire and JS:
+// query vector construction (the embedding_vector fill), compact embedding
+// encode/decode, protobuf wire parse, and the JSON and flat conversions,
+// for 384/768/1024-dim vectors and search responses of 10-1000 hits. One
+// iteration is one message, so the reported time is ns per message; the
+// bytes/msg and allocs/msg counters come from legal_allocation_counter.h.
+// JS callback dispatch and the embind argument conversions only exist in
+// the WebAssembly build and are measured by the browser harness
+// (legal-grpc-bench.ts).
+//
+//   build-native/legal_client_benchmarks --benchmark_filter=Search
+//   build-native/legal_client_benchmarks --benchmark_format=json > baseline.json
+
+#include "legal_allocation_counter.h"
+#include "legal_bench_messages.h"
+#include "legal_client_core.h"
+
+#include <benchmark/benchmark.h>
+
+namespace legal_cuda_streaming {
+namespace {
+
+using bench::kSearchDims;
+using bench::makeEmbedResponse;
+using bench::makeSearchResponse;
+using bench::randomVector;
+
+const EmbeddingEncoding kEncodings[] = {EMBEDDING_FLOAT32, EMBEDDING_FLOAT16, EMBEDDING_INT8};
+const char* const kEncodingNames[] = {"float32", "fp16", "int8"};
+
+// Allocation counters over the timed loop, reported per message
+class AllocationScope {
+public:
+    explicit AllocationScope(benchmark::State& state) : state_(state), start_(bench::allocations()) {}
+
+    ~AllocationScope() {
+        const bench::AllocationCounts end = bench::allocations();
+        state_.counters["bytes/msg"] = benchmark::Counter(
+            static_cast<double>(end.bytes - start_.bytes), benchmark::Counter::kAvgIterations);
+        state_.counters["allocs/msg"] = benchmark::Counter(
+            static_cast<double>(end.count - start_.count), benchmark::Counter::kAvgIterations);
+        state_.SetItemsProcessed(state_.iterations());
+    }
+
+private:
+    benchmark::State& state_;
+    bench::AllocationCounts start_;
+};
+
+void VectorArgs(benchmark::internal::Benchmark* benchmark) {
+    for (int dims : {384, 768, 1024}) {
+        benchmark->Arg(dims);
+    }
+}
+
+void EncodedVectorArgs(benchmark::internal::Benchmark* benchmark) {
+    for (int encoding = 0; encoding < 3; ++encoding) {
+        for (int dims : {384, 768, 1024}) {
+            benchmark->Args({dims, encoding});
+        }
+    }
+}
+
+void HitArgs(benchmark::internal::Benchmark* benchmark) {
+    for (int hits : {10, 100, 1000}) {
+        benchmark->Arg(hits);
+    }
+}
+
+// Search request construction in the stream's request arenas, as
+// sendSearchRequest does it
+void BM_SetQueryVector(benchmark::State& state) {
+    const size_t dims = state.range(0);
+    const EmbeddingEncoding encoding = kEncodings[state.range(1)];
+    const auto vector = randomVector(dims, 7);
+    RequestArenas<CudaRequest> arenas;
+    state.SetLabel(kEncodingNames[state.range(1)]);
+
+    AllocationScope allocations(state);
+    for (auto _ : state) {
+        RequestArenas<CudaRequest>::Slot slot = arenas.create();
+        slot.request->set_session_id("bench-session");
+        slot.request->set_operation_type("search");
+        setQueryVector(*slot.request, vector.data(), dims, encoding);
+        benchmark::DoNotOptimize(slot.request->ByteSizeLong());
+        arenas.release(slot);
+    }
+}
+BENCHMARK(BM_SetQueryVector)->Apply(EncodedVectorArgs);
+
+void BM_EncodeEmbedding(benchmark::State& state) {
+    const size_t dims = state.range(0);
+    const EmbeddingEncoding encoding = kEncodings[state.range(1)];
+    const auto vector = randomVector(dims, 3);
+    QuantizedEmbedding encoded;
+    state.SetLabel(kEncodingNames[state.range(1)]);
+
+    AllocationScope allocations(state);
+    for (auto _ : state) {
+        encodeEmbedding(vector.data(), 1, dims, encoding, &encoded);
+        benchmark::DoNotOptimize(encoded.data().data());
+    }
+    state.SetBytesProcessed(state.iterations() * dims * sizeof(float));
+}
+BENCHMARK(BM_EncodeEmbedding)->Apply(EncodedVectorArgs);
+
+void BM_DecodeEmbedding(benchmark::State& state) {
+    const size_t dims = state.range(0);
+    const EmbeddingEncoding encoding = kEncodings[state.range(1)];
+    const auto vector = randomVector(dims, 3);
+    QuantizedEmbedding encoded;
+    encodeEmbedding(vector.data(), 1, dims, encoding, &encoded);
+    google::protobuf::RepeatedField<float> decoded;
+    state.SetLabel(kEncodingNames[state.range(1)]);
+
+    AllocationScope allocations(state);
+    for (auto _ : state) {
+        decodeEmbedding(encoded, &decoded);
+        benchmark::DoNotOptimize(decoded.data());
+    }
+    state.SetBytesProcessed(state.iterations() * dims * sizeof(float));
+}
+BENCHMARK(BM_DecodeEmbedding)->Apply(EncodedVectorArgs);
+
+// Wire decode into a reused message, as the stream's read loop does
+void BM_CudaResponseParse(benchmark::State& state) {
+    const std::string wire = makeEmbedResponse(state.range(0)).SerializeAsString();
+    CudaResponse response;
+
+    AllocationScope allocations(state);
+    for (auto _ : state) {
+        response.ParseFromString(wire);
+        benchmark::DoNotOptimize(response.computed_embedding_size());
+    }
+    state.SetBytesProcessed(state.iterations() * wire.size());
+}
+BENCHMARK(BM_CudaResponseParse)->Apply(VectorArgs);
+
+void BM_CudaResponseToJson(benchmark::State& state) {
+    const CudaResponse response = makeEmbedResponse(state.range(0));
+
+    AllocationScope allocations(state);
+    for (auto _ : state) {
+        std::string json = cudaResponseToJson(response);
+        benchmark::DoNotOptimize(json.data());
+    }
+}
+BENCHMARK(BM_CudaResponseToJson)->Apply(VectorArgs);
+
+void BM_CudaResponseToFlat(benchmark::State& state) {
+    const CudaResponse response = makeEmbedResponse(state.range(0));
+    FlatMessageWriter writer;
+
+    AllocationScope allocations(state);
+    for (auto _ : state) {
+        cudaResponseToFlat(response, writer);
+        benchmark::DoNotOptimize(writer.data());
+    }
+}
+BENCHMARK(BM_CudaResponseToFlat)->Apply(VectorArgs);
+
+void BM_SearchResponseParse(benchmark::State& state) {
+    const std::string wire = makeSearchResponse(state.range(0), false).SerializeAsString();
+    SearchResponse response;
+
+    AllocationScope allocations(state);
+    for (auto _ : state) {
+        response.ParseFromString(wire);
+        benchmark::DoNotOptimize(response.matches_size());
+    }
+    state.SetBytesProcessed(state.iterations() * wire.size());
+}
+BENCHMARK(BM_SearchResponseParse)->Apply(HitArgs);
+
+void BM_SearchResponseToJson(benchmark::State& state) {
+    const SearchResponse response = makeSearchResponse(state.range(0), false);
+
+    AllocationScope allocations(state);
+    for (auto _ : state) {
+        std::string json = searchResponseToJson(response);
+        benchmark::DoNotOptimize(json.data());
+    }
+}
+BENCHMARK(BM_SearchResponseToJson)->Apply(HitArgs);
+
+void BM_SearchResponseToFlat(benchmark::State& state) {
+    const SearchResponse response = makeSearchResponse(state.range(0), false);
+    FlatMessageWriter writer;
+
+    AllocationScope allocations(state);
+    for (auto _ : state) {
+        searchResponseToFlat(response, writer);
+        benchmark::DoNotOptimize(writer.data());
+    }
+}
+BENCHMARK(BM_SearchResponseToFlat)->Apply(HitArgs);
+
+// Keeping matches with embeddings for rerankLastSearch
+void BM_SearchCandidatesAdd(benchmark::State& state) {
+    const SearchResponse response = makeSearchResponse(state.range(0), true);
+    SearchCandidateSet candidates;
+
+    AllocationScope allocations(state);
+    for (auto _ : state) {
+        candidates.add(response);
+        benchmark::DoNotOptimize(candidates.size());
+    }
+}
+BENCHMARK(BM_SearchCandidatesAdd)->Apply(HitArgs);
+
+void BM_SearchCandidatesScore(benchmark::State& state) {
+    const size_t hits = state.range(0);
+    SearchCandidateSet candidates;
+    candidates.add(makeSearchResponse(hits, true));
+    const auto query = randomVector(kSearchDims, 11);
+    std::vector<float> scores(candidates.size());
+
+    AllocationScope allocations(state);
+    for (auto _ : state) {
+        candidates.score(query.data(), scores.data());
+        auto best = simd::topK(scores.data(), scores.size(), 10);
+        benchmark::DoNotOptimize(best.data());
+    }
+}
+BENCHMARK(BM_SearchCandidatesScore)->Apply(HitArgs);
+
+} // namespace
+} // namespace legal_cuda_streaming
+
+BENCHMARK_MAIN();
@@ -0,0 +1,105 @@
+// legal_core_tests.cpp - Unit tests for the parts of the client core that
+// work on protobuf messages
+//
+// Built with the load driver, against the same generated messages.
+//
+//   build-native/legal_core_tests --gtest_filter='SearchCandidateSet*'
+
+#include "legal_client_core.h"
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+namespace legal_cuda_streaming {
+namespace {
+
+SearchMatch* addFloatMatch(SearchResponse& response, const std::string& id,
+                           const std::vector<float>& embedding) {
+    SearchMatch* match = response.add_matches();
+    match->set_document_id(id);
+    match->set_similarity_score(0.5f);
+    match->mutable_embedding()->Add(embedding.begin(), embedding.end());
+    return match;
+}
+
+// An encoding value from a newer server, parsed the way it arrives: proto3
+// keeps unknown enum values
+QuantizedEmbedding unknownEncoding(uint32_t dims, const std::string& data) {
+    QuantizedEmbedding wire;
+    wire.set_dims(dims);
+    wire.set_data(data);
+    std::string bytes = wire.SerializeAsString();
+    bytes += std::string("\x08\x07", 2);  // encoding = 7
+
+    QuantizedEmbedding parsed;
+    EXPECT_TRUE(parsed.ParseFromString(bytes));
+    EXPECT_EQ(static_cast<int>(parsed.encoding()), 7);
+    return parsed;
+}
+
+TEST(SearchCandidateSet, ScoresKeptFloatVectors) {
+    SearchCandidateSet candidates(4);
+    SearchResponse response;
+    addFloatMatch(response, "a", {1, 0, 0});
+    addFloatMatch(response, "b", {0, 2, 0});
+    candidates.add(response);
+
+    ASSERT_EQ(candidates.size(), 2u);
+    EXPECT_EQ(candidates.dims(), 3u);
+    EXPECT_EQ(candidates.candidate(1).document_id, "b");
+
+    const float query[] = {0, 1, 0};
+    float scores[2];
+    candidates.score(query, scores);
+    EXPECT_NEAR(scores[0], 0.0f, 1e-6f);
+    EXPECT_NEAR(scores[1], 1.0f, 1e-6f);
+}
+
+TEST(SearchCandidateSet, SkipsUnknownEncodingWithEmptyData) {
+    SearchCandidateSet candidates(4);
+    SearchResponse response;
+    *response.add_matches()->mutable_quantized_embedding() = unknownEncoding(8, "");
+    candidates.add(response);
+
+    EXPECT_EQ(candidates.size(), 0u);
+    EXPECT_EQ(candidates.dims(), 0u);
+    const float query[8] = {1};
+    float score = -2.0f;
+    candidates.score(query, &score);
+    EXPECT_EQ(score, -2.0f);
+}
+
+TEST(SearchCandidateSet, UnknownEncodingKeepsEarlierCandidates) {
+    SearchCandidateSet candidates(4);
+    SearchResponse first;
+    addFloatMatch(first, "a", {1, 0});
+    candidates.add(first);
+
+    SearchResponse second;
+    *second.add_matches()->mutable_quantized_embedding() = unknownEncoding(2, std::string(4, '\0'));
+    addFloatMatch(second, "b", {0, 1});
+    candidates.add(second);
+
+    ASSERT_EQ(candidates.size(), 2u);
+    EXPECT_EQ(candidates.candidate(0).document_id, "a");
+    EXPECT_EQ(candidates.candidate(1).document_id, "b");
+}
+
+TEST(SearchCandidateSet, SkipsQuantizedDataOfTheWrongSize) {
+    SearchCandidateSet candidates(4);
+    SearchResponse response;
+    SearchMatch* match = response.add_matches();
+    match->set_document_id("short");
+    QuantizedEmbedding* quantized = match->mutable_quantized_embedding();
+    quantized->set_encoding(EMBEDDING_FLOAT16);
+    quantized->set_dims(4);
+    quantized->set_data(std::string(6, '\0'));
+    candidates.add(response);
+
+    EXPECT_EQ(candidates.size(), 0u);
+}
+
+}  // namespace
+}  // namespace legal_cuda_streaming
@@ -0,0 +1,139 @@
+// legal_flat_fixtures.cpp - Golden flat messages for the TS decoder tests
+//
+// Encodes a fixed set of responses with the *ToFlat helpers the client
+// uses, so legal-grpc-decoder.test.ts decodes the bytes C++ really writes
+// rather than those of its own test-side writer. Map fields carry a single
+// entry each, as protobuf does not fix map iteration order.
+//
+// Regenerate after changing a layout:
+//   build-native/legal_flat_fixtures sveltekit-frontend/src/lib/wasm/__tests__/fixtures
+// With --check the files are compared instead, and any difference fails
+// (ctest runs it that way).
+
+#include "legal_client_core.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+using namespace legal_cuda_streaming;
+
+namespace {
+
+struct Fixture {
+    std::string name;
+    FlatMessageWriter writer;
+};
+
+std::vector<Fixture> buildFixtures() {
+    std::vector<Fixture> fixtures;
+    auto add = [&fixtures](const char* name) -> FlatMessageWriter& {
+        fixtures.push_back({name, FlatMessageWriter()});
+        return fixtures.back().writer;
+    };
+
+    {
+        CudaResponse response;
+        response.set_session_id("session-1");
+        response.set_operation_type("embed");
+        response.set_status(0);
+        for (float value : {0.5f, -1.25f, 3.0f, 0.0f}) response.add_computed_embedding(value);
+        CudaMetrics* metrics = response.mutable_cuda_metrics();
+        metrics->set_total_processing_time_us(1234);
+        metrics->set_gpu_utilization(0.75f);
+        metrics->set_gpu_model("RTX 3060 Ti");
+        cudaResponseToFlat(response, add("cuda-response"));
+
+        // As delivered when an embedding callback takes the vector instead
+        response.clear_cuda_metrics();
+        response.set_status(-2);
+        cudaResponseToFlat(response, add("cuda-response-without-embeddings"), false);
+    }
+
+    {
+        DocumentResponse response;
+        response.set_document_id("doc-7");
+        response.set_stage(static_cast<decltype(response.stage())>(3));
+        response.set_progress(0.5f);
+        documentResponseToFlat(response, add("document-response"));
+    }
+
+    {
+        SearchResponse response;
+        response.set_query_id("query-9");
+        response.set_total_matches(42);
+        response.set_is_complete(true);
+        SearchMatch* first = response.add_matches();
+        first->set_document_id("doc-a");
+        first->set_similarity_score(0.875f);
+        first->set_title("Title A");
+        first->set_snippet("Snippet with \xc3\xbc and \xe4\xb8\xad\xe6\x96\x87");
+        (*first->mutable_metadata())["court"] = "9th Cir.";
+        SearchMatch* second = response.add_matches();
+        second->set_document_id("doc-b");
+        second->set_similarity_score(0.5f);
+        searchResponseToFlat(response, add("search-response"));
+    }
+
+    {
+        SimilarityResponse response;
+        response.set_base_case_id("case-base");
+        CaseSimilarityScore* first = response.add_similarities();
+        first->set_case_id("case-1");
+        first->set_similarity(0.25f);
+        (*first->mutable_metrics())["factual"] = 0.5f;
+        CaseSimilarityScore* second = response.add_similarities();
+        second->set_case_id("case-2");
+        second->set_similarity(0.75f);
+        similarityResponseToFlat(response, add("similarity-response"));
+    }
+
+    // As ResponseFanout ends a streaming call
+    FlatMessageWriter& completion = add("call-complete");
+    completion.reset(FlatMessageKind::CallComplete);
+    completion.writeU32(1);
+
+    return fixtures;
+}
+
+std::string pathFor(const std::string& directory, const Fixture& fixture) {
+    return directory + "/" + fixture.name + ".bin";
+}
+
+bool write(const std::string& directory, const Fixture& fixture) {
+    std::ofstream out(pathFor(directory, fixture), std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char*>(fixture.writer.data()),
+              static_cast<std::streamsize>(fixture.writer.size()));
+    return static_cast<bool>(out);
+}
+
+bool matches(const std::string& directory, const Fixture& fixture) {
+    std::ifstream in(pathFor(directory, fixture), std::ios::binary);
+    if (!in) return false;
+    const std::vector<char> bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    return bytes.size() == fixture.writer.size() &&
+           std::memcmp(bytes.data(), fixture.writer.data(), bytes.size()) == 0;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const bool check = argc == 3 && std::strcmp(argv[1], "--check") == 0;
+    if (argc != 2 && !check) {
+        std::fprintf(stderr, "usage: %s [--check] <fixture directory>\n", argv[0]);
+        return 2;
+    }
+    const std::string directory = argv[argc - 1];
+
+    int failures = 0;
+    for (const Fixture& fixture : buildFixtures()) {
+        if (check ? matches(directory, fixture) : write(directory, fixture)) continue;
+        std::fprintf(stderr, "%s: %s\n", pathFor(directory, fixture).c_str(),
+                     check ? "differs from the C++ encoding; regenerate the fixtures" : "cannot write");
+        ++failures;
+    }
+    return failures == 0 ? 0 : 1;
+}
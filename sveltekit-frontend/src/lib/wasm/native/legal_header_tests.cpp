@@ -0,0 +1,729 @@
+// legal_header_tests.cpp - Unit tests for the client's standalone headers
+//
+// Covers the pieces that need neither gRPC nor a browser: the shared-memory
+// result ring (read here the way legal-grpc-result-ring.ts reads it) and the
+// client-core classes that never touch the transport. The scoring kernels,
+// the local vector index and the case similarity matrix have their own
+// files, built into the same target.
+//
+//   build-native/legal_header_tests --gtest_filter='ResultRing*'
+
+#include "legal_bulk_queue.h"
+#include "legal_client_metrics.h"
+#include "legal_embedding_cache.h"
+#include "legal_result_ring.h"
+#include "legal_session_map.h"
+
+#if LEGAL_TEST_REQUEST_ARENAS
+#include "legal_request_arenas.h"
+
+#include <google/protobuf/struct.pb.h>
+#endif
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace legal_cuda_streaming {
+namespace {
+
+// ---------------------------------------------------------------------------
+// ResultRing
+
+struct RingRecord {
+    uint32_t tag;
+    std::vector<uint8_t> payload;
+};
+
+// Consumer side, as in ResultRingReader.drain
+class RingReader {
+public:
+    explicit RingReader(ResultRing& ring) : ring_(ring) {}
+
+    std::vector<RingRecord> drain() {
+        std::vector<RingRecord> records;
+        const uint8_t* base = ring_.base();
+        const uint8_t* data = base + ResultRing::kHeaderSize;
+        const uint32_t capacity = ring_.capacity();
+        const uint32_t write = counter(ResultRing::kWriteOffset)->load(std::memory_order_acquire);
+        uint32_t read = counter(ResultRing::kReadOffset)->load(std::memory_order_relaxed);
+
+        while (read != write) {
+            const uint32_t position = read & (capacity - 1);
+            uint32_t size;
+            std::memcpy(&size, data + position, sizeof(size));
+            if (size == ResultRing::kWrapMarker) {
+                ++wraps;
+                read += capacity - position;
+                continue;
+            }
+            RingRecord record;
+            std::memcpy(&record.tag, data + position + 4, sizeof(record.tag));
+            const uint8_t* payload = data + position + ResultRing::kRecordHeader;
+            record.payload.assign(payload, payload + size);
+            records.push_back(std::move(record));
+            read += static_cast<uint32_t>(ResultRing::kRecordHeader + ((size + 3) & ~3u));
+            counter(ResultRing::kReadOffset)->store(read, std::memory_order_release);
+        }
+        counter(ResultRing::kReadOffset)->store(read, std::memory_order_release);
+        return records;
+    }
+
+    uint32_t overflowed() const {
+        uint32_t value;
+        std::memcpy(&value, ring_.base() + ResultRing::kOverflowedOffset, sizeof(value));
+        return value;
+    }
+
+    size_t wraps = 0;
+
+private:
+    ResultRing& ring_;
+
+    std::atomic<uint32_t>* counter(size_t offset) const {
+        return reinterpret_cast<std::atomic<uint32_t>*>(const_cast<uint8_t*>(ring_.base()) + offset);
+    }
+};
+
+std::vector<uint8_t> payloadOf(size_t size, uint8_t seed) {
+    std::vector<uint8_t> payload(size);
+    for (size_t i = 0; i < size; ++i) payload[i] = static_cast<uint8_t>(seed + i * 7);
+    return payload;
+}
+
+TEST(ResultRing, RoundsCapacityToPowerOfTwo) {
+    EXPECT_EQ(ResultRing(100).capacity(), 4096u);
+    EXPECT_EQ(ResultRing(5000).capacity(), 8192u);
+    EXPECT_EQ(ResultRing(8192).capacity(), 8192u);
+
+    ResultRing ring(10000);
+    uint32_t stored;
+    std::memcpy(&stored, ring.base() + ResultRing::kCapacityOffset, sizeof(stored));
+    EXPECT_EQ(stored, ring.capacity());
+}
+
+TEST(ResultRing, DeliversRecordsInOrder) {
+    ResultRing ring(4096);
+    RingReader reader(ring);
+    for (uint32_t i = 0; i < 10; ++i) {
+        const auto payload = payloadOf(i * 13, static_cast<uint8_t>(i));
+        ASSERT_TRUE(ring.publish(i, payload.data(), payload.size()));
+    }
+    EXPECT_FALSE(ring.hasOverflow());
+
+    const auto records = reader.drain();
+    ASSERT_EQ(records.size(), 10u);
+    for (uint32_t i = 0; i < 10; ++i) {
+        EXPECT_EQ(records[i].tag, i);
+        EXPECT_EQ(records[i].payload, payloadOf(i * 13, static_cast<uint8_t>(i)));
+    }
+}
+
+TEST(ResultRing, WrapsWithMarkerAtEndOfArea) {
+    ResultRing ring(4096);
+    RingReader reader(ring);
+
+    // 3 x 1008 bytes in, then a record that cannot fit in the last 1072
+    const auto filler = payloadOf(1000, 1);
+    for (int i = 0; i < 3; ++i) {
+        ASSERT_TRUE(ring.publish(1, filler.data(), filler.size()));
+    }
+    ASSERT_EQ(reader.drain().size(), 3u);
+
+    const auto second = payloadOf(1500, 2);
+    ASSERT_TRUE(ring.publish(2, second.data(), second.size()));
+    EXPECT_FALSE(ring.hasOverflow());
+
+    const auto records = reader.drain();
+    EXPECT_EQ(reader.wraps, 1u);
+    ASSERT_EQ(records.size(), 1u);
+    EXPECT_EQ(records[0].tag, 2u);
+    EXPECT_EQ(records[0].payload, second);
+}
+
+TEST(ResultRing, QueuesOverflowUntilReaderCatchesUp) {
+    ResultRing ring(4096);
+    RingReader reader(ring);
+    std::vector<std::vector<uint8_t>> sent;
+    for (uint32_t i = 0; i < 12; ++i) {
+        sent.push_back(payloadOf(600, static_cast<uint8_t>(i)));
+        ASSERT_TRUE(ring.publish(i, sent.back().data(), sent.back().size()));
+    }
+    ASSERT_TRUE(ring.hasOverflow());
+    EXPECT_GT(reader.overflowed(), 0u);
+
+    std::vector<RingRecord> received;
+    for (int round = 0; round < 10; ++round) {
+        for (auto& record : reader.drain()) received.push_back(std::move(record));
+        if (!ring.flushOverflow()) break;
+    }
+    for (auto& record : reader.drain()) received.push_back(std::move(record));
+
+    EXPECT_FALSE(ring.hasOverflow());
+    ASSERT_EQ(received.size(), sent.size());
+    for (uint32_t i = 0; i < sent.size(); ++i) {
+        EXPECT_EQ(received[i].tag, i);
+        EXPECT_EQ(received[i].payload, sent[i]);
+    }
+}
+
+TEST(ResultRing, RejectsRecordsOverHalfTheCapacity) {
+    ResultRing ring(4096);
+    const auto too_large = payloadOf(ring.maxRecordSize() - ResultRing::kRecordHeader + 4, 0);
+    EXPECT_FALSE(ring.publish(1, too_large.data(), too_large.size()));
+    EXPECT_FALSE(ring.hasOverflow());
+}
+
+TEST(ResultRing, LargestRecordFitsAfterDrainEvenWhenItWraps) {
+    ResultRing ring(4096);
+    RingReader reader(ring);
+
+    // Leave the write position a little past the middle, so the largest
+    // accepted record needs a wrap
+    const auto filler = payloadOf(1050, 3);
+    ASSERT_TRUE(ring.publish(1, filler.data(), filler.size()));
+    ASSERT_TRUE(ring.publish(1, filler.data(), filler.size()));
+    ASSERT_EQ(reader.drain().size(), 2u);
+
+    const auto largest = payloadOf(ring.maxRecordSize() - ResultRing::kRecordHeader, 4);
+    ASSERT_TRUE(ring.publish(2, largest.data(), largest.size()));
+    EXPECT_FALSE(ring.hasOverflow());
+
+    const auto records = reader.drain();
+    EXPECT_EQ(reader.wraps, 1u);
+    ASSERT_EQ(records.size(), 1u);
+    EXPECT_EQ(records[0].payload, largest);
+}
+
+// ---------------------------------------------------------------------------
+// LatencyHistogram
+
+TEST(LatencyHistogram, EmptySummaryHasOnlyTheCount) {
+    LatencyHistogram histogram;
+    const auto summary = histogram.summary();
+    EXPECT_EQ(summary.count, 0u);
+    EXPECT_EQ(summary.p99, 0u);
+}
+
+TEST(LatencyHistogram, SmallValuesAreExact) {
+    LatencyHistogram histogram;
+    for (uint64_t value = 0; value < 32; ++value) histogram.record(value);
+    const auto summary = histogram.summary();
+    EXPECT_EQ(summary.count, 32u);
+    EXPECT_EQ(summary.min, 0u);
+    EXPECT_EQ(summary.max, 31u);
+    EXPECT_DOUBLE_EQ(summary.mean, 15.5);
+    EXPECT_EQ(summary.p50, 15u);
+    EXPECT_EQ(summary.p90, 28u);
+    EXPECT_EQ(summary.p99, 31u);
+}
+
+// One value under a much larger one: p50 is then the upper edge of the
+// value's bucket
+uint64_t bucketUpperEdge(uint64_t value) {
+    LatencyHistogram histogram;
+    histogram.record(value);
+    histogram.record(uint64_t(1) << 40);
+    return histogram.summary().p50;
+}
+
+TEST(LatencyHistogram, BucketEdges) {
+    EXPECT_EQ(bucketUpperEdge(32), 32u);
+    EXPECT_EQ(bucketUpperEdge(63), 63u);
+    EXPECT_EQ(bucketUpperEdge(64), 65u);
+    EXPECT_EQ(bucketUpperEdge(65), 65u);
+    EXPECT_EQ(bucketUpperEdge(66), 67u);
+    EXPECT_EQ(bucketUpperEdge(1000), 1007u);
+    EXPECT_EQ(bucketUpperEdge(1024), 1055u);
+}
+
+TEST(LatencyHistogram, BucketsStayWithinAThirtySecond) {
+    for (unsigned bit = 5; bit < 33; ++bit) {
+        for (uint64_t value : {uint64_t(1) << bit, (uint64_t(3) << bit) / 2, (uint64_t(2) << bit) - 1}) {
+            const uint64_t edge = bucketUpperEdge(value);
+            EXPECT_GE(edge, value) << value;
+            EXPECT_LE(edge - value, value / 32) << value;
+        }
+    }
+}
+
+TEST(LatencyHistogram, TopBucketEndsAtTwoToTheThirtyThird) {
+    const uint64_t top = (uint64_t(1) << 33) - 1;
+    EXPECT_EQ(bucketUpperEdge(top), top);
+    EXPECT_EQ(bucketUpperEdge(uint64_t(1) << 33), top);
+    EXPECT_EQ(bucketUpperEdge(uint64_t(1) << 38), top);
+
+    // The percentiles are clamped, the maximum is not
+    LatencyHistogram histogram;
+    histogram.record(uint64_t(1) << 36);
+    EXPECT_EQ(histogram.summary().max, uint64_t(1) << 36);
+    EXPECT_EQ(histogram.summary().p50, top);
+}
+
+TEST(LatencyHistogram, PercentilesNeverExceedTheMaximum) {
+    LatencyHistogram histogram;
+    histogram.record(1000);
+    EXPECT_EQ(histogram.summary().p999, 1000u);
+}
+
+TEST(LatencyHistogram, ResetStartsOver) {
+    LatencyHistogram histogram;
+    histogram.record(500);
+    histogram.reset();
+    histogram.record(7);
+    const auto summary = histogram.summary();
+    EXPECT_EQ(summary.count, 1u);
+    EXPECT_EQ(summary.min, 7u);
+    EXPECT_EQ(summary.max, 7u);
+}
+
+TEST(LatencyHistogram, ConcurrentRecordsAreAllCounted) {
+    LatencyHistogram histogram;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&histogram, t]() {
+            for (uint64_t i = 0; i < 10000; ++i) histogram.record(i * (t + 1));
+        });
+    }
+    for (auto& thread : threads) thread.join();
+
+    const auto summary = histogram.summary();
+    EXPECT_EQ(summary.count, 40000u);
+    EXPECT_EQ(summary.min, 0u);
+    EXPECT_EQ(summary.max, 39996u);
+}
+
+TEST(MessageTimer, FirstMessageThenGaps) {
+    RpcMetrics metrics;
+    MessageTimer timer;
+    timer.start();
+    timer.onMessage(metrics);
+    timer.onMessage(metrics);
+    timer.onMessage(metrics);
+    EXPECT_EQ(metrics.time_to_first_message.summary().count, 1u);
+    EXPECT_EQ(metrics.inter_message_gap.summary().count, 2u);
+
+    // A restarted timer measures a new first message
+    timer.start();
+    timer.onMessage(metrics);
+    EXPECT_EQ(metrics.time_to_first_message.summary().count, 2u);
+}
+
+// ---------------------------------------------------------------------------
+// EmbeddingCache
+
+std::vector<float> embeddingOf(float value) { return {value, value + 1, value + 2}; }
+
+void putEmbedding(EmbeddingCache& cache, const std::string& text, float value) {
+    const auto embedding = embeddingOf(value);
+    cache.put(EmbeddingCache::keyFor(text), embedding.data(), embedding.size());
+}
+
+bool cached(EmbeddingCache& cache, const std::string& text) {
+    std::vector<float> out;
+    return cache.get(EmbeddingCache::keyFor(text), out);
+}
+
+TEST(EmbeddingCache, KeysAreFnv1a) {
+    EXPECT_EQ(EmbeddingCache::keyFor(""), 0xcbf29ce484222325ull);
+    EXPECT_EQ(EmbeddingCache::keyFor("a"), 0xaf63dc4c8601ec8cull);
+    EXPECT_NE(EmbeddingCache::keyFor("ab"), EmbeddingCache::keyFor("ba"));
+}
+
+TEST(EmbeddingCache, DisabledAtZeroCapacity) {
+    EmbeddingCache cache;
+    EXPECT_FALSE(cache.enabled());
+    putEmbedding(cache, "a", 1);
+    EXPECT_FALSE(cached(cache, "a"));
+    EXPECT_EQ(cache.stats().size, 0u);
+    EXPECT_EQ(cache.stats().misses, 0u);
+}
+
+TEST(EmbeddingCache, EvictsTheLeastRecentlyUsed) {
+    EmbeddingCache cache;
+    cache.setCapacity(2);
+    putEmbedding(cache, "a", 1);
+    putEmbedding(cache, "b", 2);
+    EXPECT_TRUE(cached(cache, "a"));  // b is now the oldest
+    putEmbedding(cache, "c", 3);
+
+    EXPECT_FALSE(cached(cache, "b"));
+    std::vector<float> out;
+    ASSERT_TRUE(cache.get(EmbeddingCache::keyFor("a"), out));
+    EXPECT_EQ(out, embeddingOf(1));
+    EXPECT_TRUE(cached(cache, "c"));
+
+    const EmbeddingCache::Stats stats = cache.stats();
+    EXPECT_EQ(stats.size, 2u);
+    EXPECT_EQ(stats.hits, 3u);
+    EXPECT_EQ(stats.misses, 1u);
+}
+
+TEST(EmbeddingCache, PutRefreshesAnExistingEntry) {
+    EmbeddingCache cache;
+    cache.setCapacity(2);
+    putEmbedding(cache, "a", 1);
+    putEmbedding(cache, "b", 2);
+    putEmbedding(cache, "a", 5);
+    putEmbedding(cache, "c", 3);
+
+    EXPECT_FALSE(cached(cache, "b"));
+    std::vector<float> out;
+    ASSERT_TRUE(cache.get(EmbeddingCache::keyFor("a"), out));
+    EXPECT_EQ(out, embeddingOf(5));
+}
+
+TEST(EmbeddingCache, ShrinkingEvictsOldestFirst) {
+    EmbeddingCache cache;
+    cache.setCapacity(4);
+    for (int i = 0; i < 4; ++i) putEmbedding(cache, std::to_string(i), float(i));
+    cache.setCapacity(1);
+
+    EXPECT_EQ(cache.stats().size, 1u);
+    EXPECT_TRUE(cached(cache, "3"));
+    EXPECT_FALSE(cached(cache, "0"));
+}
+
+TEST(EmbeddingCache, SnapshotKeepsEntriesAndRecency) {
+    EmbeddingCache cache;
+    cache.setCapacity(3);
+    putEmbedding(cache, "a", 1);
+    putEmbedding(cache, "b", 2);
+    putEmbedding(cache, "c", 3);
+    EXPECT_TRUE(cached(cache, "a"));  // recency is now a, c, b
+
+    FlatMessageWriter writer;
+    cache.serialize(writer);
+
+    EmbeddingCache restored;
+    restored.setCapacity(3);
+    EXPECT_EQ(restored.deserialize(writer.data(), writer.size()), 3u);
+    putEmbedding(restored, "d", 4);
+
+    EXPECT_FALSE(cached(restored, "b"));
+    std::vector<float> out;
+    ASSERT_TRUE(restored.get(EmbeddingCache::keyFor("c"), out));
+    EXPECT_EQ(out, embeddingOf(3));
+    EXPECT_TRUE(cached(restored, "a"));
+    EXPECT_TRUE(cached(restored, "d"));
+}
+
+TEST(EmbeddingCache, SnapshotReadStopsAtTruncationAndRejectsOtherKinds) {
+    EmbeddingCache cache;
+    cache.setCapacity(4);
+    putEmbedding(cache, "a", 1);
+    putEmbedding(cache, "b", 2);
+    FlatMessageWriter writer;
+    cache.serialize(writer);
+
+    EmbeddingCache restored;
+    restored.setCapacity(4);
+    EXPECT_EQ(restored.deserialize(writer.data(), writer.size() - 4), 1u);
+    EXPECT_TRUE(cached(restored, "b"));
+    EXPECT_FALSE(cached(restored, "a"));
+
+    FlatMessageWriter other;
+    other.reset(FlatMessageKind::CallComplete);
+    other.writeU32(1);
+    EXPECT_EQ(restored.deserialize(other.data(), other.size()), 0u);
+}
+
+// ---------------------------------------------------------------------------
+// ShardedSessionMap
+
+TEST(ShardedSessionMap, FindsEntriesInEveryShard) {
+    ShardedSessionMap<int, 4> map;
+    for (int i = 0; i < 64; ++i) {
+        map.assign("session-" + std::to_string(i), std::make_shared<int>(i));
+    }
+    for (int i = 0; i < 64; ++i) {
+        auto value = map.find("session-" + std::to_string(i));
+        ASSERT_NE(value, nullptr) << i;
+        EXPECT_EQ(*value, i);
+    }
+    EXPECT_EQ(map.find("missing"), nullptr);
+
+    int visited = 0, sum = 0;
+    map.forEach([&](const int& value) {
+        ++visited;
+        sum += value;
+    });
+    EXPECT_EQ(visited, 64);
+    EXPECT_EQ(sum, 63 * 64 / 2);
+}
+
+TEST(ShardedSessionMap, RemoveHandsBackTheEntry) {
+    ShardedSessionMap<std::string> map;
+    map.assign("a", std::make_shared<std::string>("first"));
+    map.assign("a", std::make_shared<std::string>("second"));
+
+    auto removed = map.remove("a");
+    ASSERT_NE(removed, nullptr);
+    EXPECT_EQ(*removed, "second");
+    EXPECT_EQ(map.find("a"), nullptr);
+    EXPECT_EQ(map.remove("a"), nullptr);
+}
+
+TEST(ShardedSessionMap, RemoveIfLeavesAReplacementAlone) {
+    ShardedSessionMap<int> map;
+    auto old_session = std::make_shared<int>(1);
+    auto new_session = std::make_shared<int>(2);
+    map.assign("a", old_session);
+    map.assign("a", new_session);
+
+    // A finished call of the old session must not unregister the new one
+    EXPECT_FALSE(map.removeIf("a", old_session.get()));
+    EXPECT_EQ(map.find("a"), new_session);
+    EXPECT_TRUE(map.removeIf("a", new_session.get()));
+    EXPECT_EQ(map.find("a"), nullptr);
+}
+
+TEST(ShardedSessionMap, ConcurrentWritersKeepTheirOwnEntries) {
+    ShardedSessionMap<int> map;
+    std::vector<std::thread> writers;
+    for (int t = 0; t < 4; ++t) {
+        writers.emplace_back([&map, t]() {
+            for (int i = 0; i < 500; ++i) {
+                const std::string id = std::to_string(t) + "-" + std::to_string(i);
+                map.assign(id, std::make_shared<int>(i));
+                if (i % 2 == 1) map.remove(id);
+            }
+        });
+    }
+    for (auto& writer : writers) writer.join();
+
+    for (int t = 0; t < 4; ++t) {
+        for (int i = 0; i < 500; ++i) {
+            auto value = map.find(std::to_string(t) + "-" + std::to_string(i));
+            if (i % 2 == 1) {
+                EXPECT_EQ(value, nullptr);
+            } else {
+                ASSERT_NE(value, nullptr);
+                EXPECT_EQ(*value, i);
+            }
+        }
+    }
+}
+
+#if LEGAL_TEST_REQUEST_ARENAS
+
+// ---------------------------------------------------------------------------
+// RequestArenas
+
+void fillList(google::protobuf::ListValue* list, int values) {
+    for (int i = 0; i < values; ++i) list->add_values()->set_number_value(i);
+}
+
+TEST(RequestArenas, DrainedArenaStartsOverAtTheSameAddress) {
+    RequestArenas<google::protobuf::ListValue> arenas(4096);
+    auto first = arenas.create();
+    fillList(first.request, 10);
+    const auto* address = first.request;
+    arenas.release(first);
+
+    auto second = arenas.create();
+    EXPECT_EQ(second.request, address);
+    EXPECT_EQ(second.arena, first.arena);
+    EXPECT_EQ(second.request->values_size(), 0);
+    arenas.release(second);
+}
+
+TEST(RequestArenas, SwitchesOnceTheActiveArenaOutgrowsItsBlock) {
+    RequestArenas<google::protobuf::ListValue> arenas(1024);
+    auto large = arenas.create();
+    fillList(large.request, 100);
+
+    // The other arena is idle, so new requests move there
+    auto next = arenas.create();
+    EXPECT_NE(next.arena, large.arena);
+
+    // Both arenas hold live requests now, so the active one keeps growing
+    fillList(next.request, 100);
+    auto third = arenas.create();
+    EXPECT_EQ(third.arena, next.arena);
+
+    // Once drained, the active arena is reset and starts over
+    arenas.release(large);
+    arenas.release(next);
+    arenas.release(third);
+    auto again = arenas.create();
+    EXPECT_EQ(again.arena, next.arena);
+    EXPECT_EQ(again.request, next.request);
+    arenas.release(again);
+}
+
+TEST(RequestArenas, LiveRequestsSurviveOtherReleases) {
+    RequestArenas<google::protobuf::ListValue> arenas(4096);
+    auto kept = arenas.create();
+    fillList(kept.request, 8);
+    auto released = arenas.create();
+    fillList(released.request, 8);
+    arenas.release(released);
+
+    auto reused = arenas.create();
+    fillList(reused.request, 8);
+    ASSERT_EQ(kept.request->values_size(), 8);
+    EXPECT_EQ(kept.request->values(7).number_value(), 7);
+    arenas.release(kept);
+    arenas.release(reused);
+}
+
+#endif  // LEGAL_TEST_REQUEST_ARENAS
+
+// ---------------------------------------------------------------------------
+// BulkQueue
+
+BulkQueue::Limits unthrottled(uint32_t max_concurrent) {
+    BulkQueue::Limits limits;
+    limits.max_concurrent = max_concurrent;
+    limits.starts_per_second = 0;
+    limits.yield_ms = 0;
+    return limits;
+}
+
+TEST(BulkQueue, AdmitsInSubmissionOrderUpToTheConcurrencyLimit) {
+    BulkQueue queue;
+    queue.setLimits(unthrottled(2));
+    std::vector<int> started;
+    for (int i = 0; i < 5; ++i) {
+        queue.submit([&started, i]() { started.push_back(i); });
+    }
+
+    EXPECT_EQ(queue.pump().count(), 0);
+    EXPECT_EQ(started, (std::vector<int>{0, 1}));
+    EXPECT_EQ(queue.stats().queued, 3u);
+    EXPECT_EQ(queue.stats().running, 2u);
+
+    queue.finished();
+    queue.pump();
+    EXPECT_EQ(started, (std::vector<int>{0, 1, 2}));
+
+    queue.finished();
+    queue.finished();
+    queue.pump();
+    EXPECT_EQ(started, (std::vector<int>{0, 1, 2, 3, 4}));
+    EXPECT_EQ(queue.stats().started, 5u);
+    EXPECT_EQ(queue.waits().summary().count, 5u);
+}
+
+TEST(BulkQueue, StartThatFinishesAtOnceLetsTheNextOneIn) {
+    BulkQueue queue;
+    queue.setLimits(unthrottled(1));
+    std::vector<int> started;
+    for (int i = 0; i < 3; ++i) {
+        queue.submit([&queue, &started, i]() {
+            started.push_back(i);
+            queue.finished();
+        });
+    }
+    queue.pump();
+    EXPECT_EQ(started, (std::vector<int>{0, 1, 2}));
+    EXPECT_EQ(queue.stats().running, 0u);
+}
+
+// Counts copies of itself, so queuing can be checked to move the start
+struct CopyCountingStart {
+    std::shared_ptr<int> copies;
+    std::shared_ptr<int> runs;
+
+    CopyCountingStart(std::shared_ptr<int> copies, std::shared_ptr<int> runs)
+        : copies(std::move(copies)), runs(std::move(runs)) {}
+    CopyCountingStart(const CopyCountingStart& other) : copies(other.copies), runs(other.runs) {
+        ++*copies;
+    }
+    CopyCountingStart(CopyCountingStart&&) = default;
+
+    void operator()() const { ++*runs; }
+};
+
+TEST(BulkQueue, MovesStartsThroughTheQueue) {
+    BulkQueue queue;
+    queue.setLimits(unthrottled(1));
+    auto copies = std::make_shared<int>(0);
+    auto runs = std::make_shared<int>(0);
+    auto request = std::make_shared<std::string>("queued request");
+
+    queue.submit(CopyCountingStart(copies, runs));
+    queue.submit([request]() {});
+    EXPECT_EQ(request.use_count(), 2);
+
+    queue.pump();
+    EXPECT_EQ(*runs, 1);
+    EXPECT_EQ(*copies, 0);
+
+    // Once started, a start's captures are released
+    queue.finished();
+    queue.pump();
+    EXPECT_EQ(request.use_count(), 1);
+    EXPECT_EQ(*copies, 0);
+}
+
+TEST(BulkQueue, YieldsToInteractiveCalls) {
+    BulkQueue queue;
+    BulkQueue::Limits limits = unthrottled(2);
+    limits.yield_ms = 20;
+    limits.max_yield_ms = 60000;
+    queue.setLimits(limits);
+
+    int started = 0;
+    queue.interactiveStarted();
+    queue.submit([&started]() { ++started; });
+
+    // While a search is in flight, only its finish can let the call in
+    EXPECT_GT(queue.pump().count(), 1000);
+    EXPECT_EQ(started, 0);
+    EXPECT_EQ(queue.stats().yielded, 1u);
+
+    // Then the quiet period has to pass
+    queue.interactiveFinished();
+    const auto retry = queue.pump();
+    EXPECT_GT(retry.count(), 0);
+    EXPECT_LE(retry.count(), 20);
+    EXPECT_EQ(started, 0);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(25));
+    EXPECT_EQ(queue.pump().count(), 0);
+    EXPECT_EQ(started, 1);
+    EXPECT_EQ(queue.stats().yielded, 1u);
+}
+
+TEST(BulkQueue, StopsYieldingAfterTheMaximumWait) {
+    BulkQueue queue;
+    BulkQueue::Limits limits = unthrottled(1);
+    limits.yield_ms = 1000;
+    limits.max_yield_ms = 0;
+    queue.setLimits(limits);
+
+    int started = 0;
+    queue.interactiveStarted();
+    queue.submit([&started]() { ++started; });
+    queue.pump();
+    EXPECT_EQ(started, 1);
+    EXPECT_EQ(queue.stats().interactive, 1u);
+}
+
+TEST(BulkQueue, RateLimitAllowsOneBurstThenWaits) {
+    BulkQueue queue;
+    BulkQueue::Limits limits = unthrottled(4);
+    limits.starts_per_second = 2;
+    queue.setLimits(limits);
+
+    int started = 0;
+    for (int i = 0; i < 4; ++i) queue.submit([&started]() { ++started; });
+
+    // A new queue holds two tokens; the third start waits half a second
+    const auto retry = queue.pump();
+    EXPECT_EQ(started, 2);
+    EXPECT_GT(retry.count(), 400);
+    EXPECT_LE(retry.count(), 500);
+}
+
+} // namespace
+} // namespace legal_cuda_streaming
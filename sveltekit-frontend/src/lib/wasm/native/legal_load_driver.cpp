@@ -0,0 +1,727 @@
+// legal_load_driver.cpp - Replays recorded bidirectional sessions against the CUDA service
+//
+// Built natively from the same core as the WebAssembly client
+// (legal_client_core.h), so load numbers reflect the service and the
+// client's own request construction, batching, caching and decode rather
+// than a JS runtime. Requests are issued open-loop at a fixed rate: each
+// request's latency is measured from the moment it was scheduled, so a
+// slow server shows up as latency instead of silently lowering the rate.
+//
+// A recording is JSON Lines, one CudaRequest per line in the protobuf JSON
+// mapping, e.g.
+//   {"sessionId":"case-17","operationType":"embed","rawText":"..."}
+// Lines are grouped into sessions by session_id, in file order. Blank lines
+// and lines starting with '#' are skipped. Each session is replayed as one
+// bidirectional stream; the driver keeps --concurrency of them open,
+// cycling through the recording.
+//
+// Usage:
+//   legal_load_driver --recording sessions.jsonl [--target host:port]
+//       [--qps 100] [--concurrency 16] [--duration 30] [--warmup 5]
+//       [--threads N] [--channels 4] [--batch 1]
+//       [--encoding float32|fp16|int8] [--cache 0] [--json]
+
+#include "legal_client_core.h"
+#include <google/protobuf/util/json_util.h>
+
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+namespace legal_cuda_streaming {
+namespace {
+
+struct DriverOptions {
+    std::string target = "localhost:50051";
+    std::string recording;
+    double qps = 100.0;
+    size_t concurrency = 16;
+    size_t threads = std::max(1u, std::thread::hardware_concurrency() / 2);
+    size_t channels = 4;
+    double duration_s = 30.0;
+    double warmup_s = 0.0;
+    size_t batch = 1;  // consecutive single-text embeds merged per request
+    EmbeddingEncoding encoding = EMBEDDING_FLOAT32;
+    size_t cache_entries = 0;
+    bool json = false;
+};
+
+using Recording = std::vector<std::vector<CudaRequest>>;
+
+bool parseEncoding(const std::string& name, EmbeddingEncoding& out) {
+    if (name == "float32") out = EMBEDDING_FLOAT32;
+    else if (name == "fp16") out = EMBEDDING_FLOAT16;
+    else if (name == "int8") out = EMBEDDING_INT8;
+    else return false;
+    return true;
+}
+
+bool parseArguments(int argc, char** argv, DriverOptions& options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string key = argv[i];
+        std::string value;
+        const size_t equals = key.find('=');
+        if (equals != std::string::npos) {
+            value = key.substr(equals + 1);
+            key.resize(equals);
+        } else if (key != "--json") {
+            if (i + 1 >= argc) {
+                std::cerr << "Missing value for " << key << "\n";
+                return false;
+            }
+            value = argv[++i];
+        }
+
+        if (key == "--target") options.target = value;
+        else if (key == "--recording") options.recording = value;
+        else if (key == "--qps") options.qps = std::atof(value.c_str());
+        else if (key == "--concurrency") options.concurrency = std::strtoul(value.c_str(), nullptr, 10);
+        else if (key == "--threads") options.threads = std::strtoul(value.c_str(), nullptr, 10);
+        else if (key == "--channels") options.channels = std::strtoul(value.c_str(), nullptr, 10);
+        else if (key == "--duration") options.duration_s = std::atof(value.c_str());
+        else if (key == "--warmup") options.warmup_s = std::atof(value.c_str());
+        else if (key == "--batch") options.batch = std::strtoul(value.c_str(), nullptr, 10);
+        else if (key == "--cache") options.cache_entries = std::strtoul(value.c_str(), nullptr, 10);
+        else if (key == "--json") options.json = true;
+        else if (key == "--encoding") {
+            if (!parseEncoding(value, options.encoding)) {
+                std::cerr << "Unknown encoding " << value << "\n";
+                return false;
+            }
+        } else {
+            std::cerr << "Unknown option " << key << "\n";
+            return false;
+        }
+    }
+
+    if (options.recording.empty() || options.qps <= 0.0 || options.concurrency == 0 ||
+        options.threads == 0 || options.duration_s <= 0.0) {
+        std::cerr << "Usage: legal_load_driver --recording sessions.jsonl [--target host:port]\n"
+                     "    [--qps 100] [--concurrency 16] [--duration 30] [--warmup 5]\n"
+                     "    [--threads N] [--channels 4] [--batch 1]\n"
+                     "    [--encoding float32|fp16|int8] [--cache 0] [--json]\n";
+        return false;
+    }
+    options.batch = std::max<size_t>(options.batch, 1);
+    return true;
+}
+
+bool loadRecording(const std::string& path, Recording& sessions) {
+    std::ifstream in(path);
+    if (!in) {
+        std::cerr << "Cannot open " << path << "\n";
+        return false;
+    }
+
+    std::unordered_map<std::string, size_t> index;
+    std::string line;
+    size_t line_number = 0;
+    while (std::getline(in, line)) {
+        ++line_number;
+        if (line.empty() || line[0] == '#') continue;
+
+        CudaRequest request;
+        const auto status = google::protobuf::util::JsonStringToMessage(line, &request);
+        if (!status.ok()) {
+            std::cerr << path << ":" << line_number << ": " << status.ToString() << "\n";
+            return false;
+        }
+
+        auto it = index.find(request.session_id());
+        if (it == index.end()) {
+            it = index.emplace(request.session_id(), sessions.size()).first;
+            sessions.emplace_back();
+        }
+        sessions[it->second].push_back(std::move(request));
+    }
+
+    if (sessions.empty()) {
+        std::cerr << path << ": no requests\n";
+        return false;
+    }
+    return true;
+}
+
+// Apply the client's batching and accept_encoding to a recorded session:
+// runs of single-text embeds become fillEmbeddingBatch requests of up to
+// batch texts, as the client's coalescing would send them
+std::vector<CudaRequest> prepareSession(const std::vector<CudaRequest>& recorded, const DriverOptions& options) {
+    std::vector<CudaRequest> prepared;
+    std::vector<std::string> texts;
+    CudaCallOptions call_options;
+    bool is_final = false;
+
+    auto flush = [&]() {
+        if (texts.empty()) return;
+        prepared.emplace_back();
+        fillEmbeddingBatch(prepared.back(), recorded.front().session_id(), texts, is_final,
+                           call_options, options.encoding);
+        texts.clear();
+        is_final = false;
+    };
+
+    for (const CudaRequest& request : recorded) {
+        const bool single_embed = request.operation_type() == "embed" && !request.raw_text().empty() &&
+                                  request.raw_texts_size() == 0;
+        if (options.batch > 1 && single_embed) {
+            CudaCallOptions request_options;
+            request_options.use_tensor_cores = request.cuda_options().use_tensor_cores();
+            request_options.enable_memory_pool = request.cuda_options().enable_memory_pool();
+            if (!texts.empty() && request_options != call_options) {
+                flush();
+            }
+            call_options = request_options;
+            texts.push_back(request.raw_text());
+            is_final = is_final || request.is_final_chunk();
+            if (texts.size() >= options.batch || is_final) {
+                flush();
+            }
+            continue;
+        }
+
+        flush();
+        prepared.push_back(request);
+        prepared.back().set_accept_encoding(options.encoding);
+    }
+    flush();
+    return prepared;
+}
+
+// One text key per embed request text, for the optional embedding cache
+std::vector<uint64_t> embedKeys(const CudaRequest& request) {
+    std::vector<uint64_t> keys;
+    if (request.operation_type() != "embed") return keys;
+    if (request.raw_texts_size() > 0) {
+        for (const auto& text : request.raw_texts()) {
+            keys.push_back(EmbeddingCache::keyFor(text));
+        }
+    } else if (!request.raw_text().empty()) {
+        keys.push_back(EmbeddingCache::keyFor(request.raw_text()));
+    }
+    return keys;
+}
+
+struct DriverStats {
+    LatencyHistogram latency;         // scheduled send to response
+    LatencyHistogram first_response;  // stream start to first response
+    LatencyHistogram decode;          // compact embedding widening
+    std::atomic<uint64_t> scheduled{0};
+    std::atomic<uint64_t> sent{0};
+    std::atomic<uint64_t> answered{0};
+    std::atomic<uint64_t> cache_hits{0};
+    std::atomic<uint64_t> unanswered{0};
+    std::atomic<uint64_t> unscheduled{0};  // ticks with no session ready to send
+    std::atomic<uint64_t> response_bytes{0};
+    std::atomic<uint64_t> sessions_completed{0};
+    std::atomic<uint64_t> sessions_failed{0};
+
+    mutable std::mutex errors_mutex;
+    std::map<int, uint64_t> errors;  // status code -> failed streams
+
+    void recordError(const Status& status) {
+        std::lock_guard<std::mutex> lock(errors_mutex);
+        ++errors[status.error_code()];
+    }
+};
+
+class LoadDriver;
+
+// One replayed session: a bidirectional stream whose requests are written
+// as the pacer schedules them. Handlers run on the session's reactor
+// thread; schedule() and close() come from the pacer thread. The driver's
+// slot owns the session until its stream has finished.
+class Session : public std::enable_shared_from_this<Session> {
+public:
+    Session(LoadDriver& driver, size_t slot, const std::vector<CudaRequest>& requests)
+        : driver_(driver), slot_(slot), requests_(requests), scheduled_at_(requests.size()),
+          keys_(requests.size()) {}
+
+    void start(ChannelPool& channels, RpcReactor& reactor);
+
+    // Queue the next request with its intended send time; false once every
+    // request has been scheduled
+    bool schedule(MetricsClock::time_point intended);
+
+    // Stop scheduling and half-close once what is queued has gone out
+    void close() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        total_ = next_;
+        pump();
+    }
+
+    void cancel() { context_.TryCancel(); }
+
+    size_t slot() const { return slot_; }
+
+private:
+    LoadDriver& driver_;
+    size_t slot_;
+    const std::vector<CudaRequest>& requests_;
+    std::vector<MetricsClock::time_point> scheduled_at_;
+    std::vector<std::vector<uint64_t>> keys_;
+
+    ClientContext context_;
+    std::shared_ptr<ChannelPool::Lease> lease_;
+    std::unique_ptr<ClientAsyncReaderWriter<CudaRequest, CudaResponse>> stream_;
+    RequestArenas<CudaRequest> arenas_;
+    CudaResponse response_;
+    Status status_;
+    RpcReactor* reactor_ = nullptr;
+    MetricsClock::time_point started_at_;
+    bool received_any_ = false;
+
+    // Guarded by mutex_
+    std::mutex mutex_;
+    size_t next_ = 0;                  // next request to schedule
+    size_t total_ = SIZE_MAX;          // lowered by close()
+    std::deque<size_t> queued_;        // scheduled, not yet written
+    std::deque<size_t> outstanding_;   // written, awaiting a response
+    std::optional<RequestArenas<CudaRequest>::Slot> writing_;
+    bool started_ = false;
+    bool writes_done_ = false;
+
+    RpcReactor::Tag on_started_;
+    RpcReactor::Tag on_write_;
+    RpcReactor::Tag on_read_;
+    RpcReactor::Tag on_writes_done_ = [](bool) {};
+    RpcReactor::Tag on_finished_;
+
+    size_t limit() const { return std::min(total_, requests_.size()); }
+
+    // Requires mutex_
+    void pump();
+    void onResponse();
+    void answer(size_t index, MetricsClock::time_point now, bool carries_embedding);
+};
+
+class LoadDriver {
+public:
+    LoadDriver(const DriverOptions& options, Recording recording)
+        : options_(options), recording_(std::move(recording)) {
+        for (const auto& session : recording_) {
+            prepared_.push_back(prepareSession(session, options_));
+        }
+        cache_.setCapacity(options_.cache_entries);
+        channels_.init(options_.target, options_.channels, ChannelPool::Policy::LeastLoaded, false);
+        for (size_t i = 0; i < options_.threads; ++i) {
+            reactors_.push_back(std::make_unique<RpcReactor>());
+        }
+        slots_.resize(options_.concurrency);
+    }
+
+    DriverStats& stats() { return stats_; }
+    EmbeddingCache& cache() { return cache_; }
+
+    bool measuring(MetricsClock::time_point when) const {
+        return when >= measure_from_ && when < measure_until_;
+    }
+
+    void run() {
+        const auto start = MetricsClock::now();
+        measure_from_ = start + toDuration(options_.warmup_s);
+        measure_until_ = measure_from_ + toDuration(options_.duration_s);
+
+        for (size_t slot = 0; slot < slots_.size(); ++slot) {
+            startSession(slot);
+        }
+        pace(start);
+        drain();
+        measured_s_ = std::chrono::duration<double>(
+            std::min(MetricsClock::now(), measure_until_) - measure_from_).count();
+    }
+
+    // Reactor thread, from a finished session's handler
+    void onSessionFinished(Session& session, const Status& status) {
+        if (status.ok()) {
+            ++stats_.sessions_completed;
+        } else {
+            ++stats_.sessions_failed;
+            stats_.recordError(status);
+        }
+
+        std::lock_guard<std::mutex> lock(slots_mutex_);
+        if (stopping_) {
+            slots_[session.slot()].reset();
+            slots_changed_.notify_all();
+            return;
+        }
+        startSessionLocked(session.slot());
+    }
+
+    void report(std::ostream& out) const;
+    void reportJson(std::ostream& out) const;
+
+private:
+    DriverOptions options_;
+    Recording recording_;
+    std::vector<std::vector<CudaRequest>> prepared_;
+    EmbeddingCache cache_;
+    ChannelPool channels_;
+    std::vector<std::unique_ptr<RpcReactor>> reactors_;
+    DriverStats stats_;
+    MetricsClock::time_point measure_from_;
+    MetricsClock::time_point measure_until_;
+    double measured_s_ = 0.0;
+
+    std::mutex slots_mutex_;
+    std::condition_variable slots_changed_;
+    std::vector<std::shared_ptr<Session>> slots_;
+    size_t next_recording_ = 0;
+    bool stopping_ = false;
+
+    static MetricsClock::duration toDuration(double seconds) {
+        return std::chrono::duration_cast<MetricsClock::duration>(std::chrono::duration<double>(seconds));
+    }
+
+    void startSession(size_t slot) {
+        std::lock_guard<std::mutex> lock(slots_mutex_);
+        startSessionLocked(slot);
+    }
+
+    // Requires slots_mutex_
+    void startSessionLocked(size_t slot) {
+        const auto& requests = prepared_[next_recording_++ % prepared_.size()];
+        slots_[slot] = std::make_shared<Session>(*this, slot, requests);
+        slots_[slot]->start(channels_, *reactors_[slot % reactors_.size()]);
+    }
+
+    // Open-loop pacer: one request per tick, handed round-robin to the
+    // first open session with requests left
+    void pace(MetricsClock::time_point start) {
+        const auto interval = toDuration(1.0 / options_.qps);
+        size_t cursor = 0;
+        for (uint64_t tick = 0;; ++tick) {
+            const auto intended = start + interval * tick;
+            if (intended >= measure_until_) break;
+            std::this_thread::sleep_until(intended);
+            ++stats_.scheduled;
+
+            bool placed = false;
+            for (size_t tried = 0; tried < slots_.size() && !placed; ++tried) {
+                std::shared_ptr<Session> session;
+                {
+                    std::lock_guard<std::mutex> lock(slots_mutex_);
+                    session = slots_[cursor];
+                }
+                cursor = (cursor + 1) % slots_.size();
+                placed = session && session->schedule(intended);
+            }
+            if (!placed && measuring(intended)) {
+                ++stats_.unscheduled;
+            }
+        }
+    }
+
+    // Half-close every session, give responses a grace period, then cancel
+    void drain() {
+        std::vector<std::shared_ptr<Session>> open;
+        {
+            std::lock_guard<std::mutex> lock(slots_mutex_);
+            stopping_ = true;
+            for (const auto& session : slots_) {
+                if (session) open.push_back(session);
+            }
+        }
+        for (const auto& session : open) {
+            session->close();
+        }
+        open.clear();
+
+        auto idle = [this]() {
+            return std::all_of(slots_.begin(), slots_.end(), [](const auto& slot) { return !slot; });
+        };
+        std::unique_lock<std::mutex> lock(slots_mutex_);
+        if (!slots_changed_.wait_for(lock, std::chrono::seconds(5), idle)) {
+            for (const auto& session : slots_) {
+                if (session) session->cancel();
+            }
+            slots_changed_.wait(lock, idle);
+        }
+        lock.unlock();
+
+        channels_.stop();
+        reactors_.clear();
+    }
+};
+
+void Session::start(ChannelPool& channels, RpcReactor& reactor) {
+    lease_ = channels.acquire(RpcClass::Interactive);
+    for (size_t i = 0; i < requests_.size(); ++i) {
+        if (driver_.cache().enabled()) keys_[i] = embedKeys(requests_[i]);
+    }
+
+    on_started_ = [this](bool ok) {
+        if (!ok) {
+            stream_->Finish(&status_, &on_finished_);
+            return;
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        started_ = true;
+        stream_->Read(&response_, &on_read_);
+        pump();
+    };
+    on_write_ = [this](bool ok) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        arenas_.release(*writing_);
+        writing_.reset();
+        if (!ok) {
+            // The read side sees the failure and finishes the stream
+            queued_.clear();
+            total_ = next_;
+            writes_done_ = true;
+            return;
+        }
+        pump();
+    };
+    on_read_ = [this](bool ok) {
+        if (!ok) {
+            stream_->Finish(&status_, &on_finished_);
+            return;
+        }
+        onResponse();
+        stream_->Read(&response_, &on_read_);
+    };
+    // The driver lets go of the session here, so a reference is held until
+    // the handler has returned
+    on_finished_ = [this](bool) {
+        reactor_->defer([self = shared_from_this()]() {});
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            driver_.stats().unanswered += outstanding_.size() + queued_.size();
+            outstanding_.clear();
+            queued_.clear();
+        }
+        driver_.onSessionFinished(*this, status_);
+    };
+
+    reactor_ = &reactor;
+    started_at_ = MetricsClock::now();
+    stream_ = lease_->stub()->PrepareAsyncBidirectionalLegalStream(&context_, reactor.queue());
+    stream_->StartCall(&on_started_);
+}
+
+bool Session::schedule(MetricsClock::time_point intended) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (next_ >= limit()) return false;
+
+    const size_t index = next_++;
+    scheduled_at_[index] = intended;
+
+    // Embeds the client would answer from its cache never reach the server
+    const auto& keys = keys_[index];
+    if (!keys.empty()) {
+        std::vector<float> cached;
+        bool all_cached = true;
+        for (uint64_t key : keys) {
+            all_cached = all_cached && driver_.cache().get(key, cached);
+        }
+        if (all_cached) {
+            if (driver_.measuring(intended)) {
+                ++driver_.stats().cache_hits;
+                driver_.stats().latency.record(elapsedMicros(intended));
+            }
+            pump();
+            return true;
+        }
+    }
+
+    queued_.push_back(index);
+    pump();
+    return true;
+}
+
+void Session::pump() {
+    if (!started_ || writing_ || writes_done_) return;
+
+    if (!queued_.empty()) {
+        const size_t index = queued_.front();
+        queued_.pop_front();
+
+        writing_ = arenas_.create();
+        CudaRequest* request = writing_->request;
+        request->CopyFrom(requests_[index]);
+        request->set_sequence(index + 1);
+        outstanding_.push_back(index);
+        if (driver_.measuring(scheduled_at_[index])) {
+            ++driver_.stats().sent;
+        }
+        stream_->Write(*request, &on_write_);
+    } else if (next_ >= limit()) {
+        writes_done_ = true;
+        stream_->WritesDone(&on_writes_done_);
+    }
+}
+
+// Responses acknowledge requests cumulatively through ack_sequence (the
+// request's index + 1); a server that leaves it unset answers in order.
+// The embedding belongs only to the request the response names; earlier
+// ones it acknowledges are answered without caching anything.
+void Session::onResponse() {
+    const auto now = MetricsClock::now();
+    if (!received_any_) {
+        received_any_ = true;
+        if (driver_.measuring(started_at_)) {
+            driver_.stats().first_response.record(elapsedMicros(started_at_, now));
+        }
+    }
+    if (driver_.measuring(now)) {
+        driver_.stats().response_bytes += response_.ByteSizeLong();
+    }
+
+    if (response_.has_quantized_embedding()) {
+        const auto decode_start = MetricsClock::now();
+        decodeEmbedding(response_.quantized_embedding(), response_.mutable_computed_embedding());
+        response_.clear_quantized_embedding();
+        driver_.stats().decode.record(elapsedMicros(decode_start));
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    const uint64_t ack = response_.ack_sequence();
+    if (ack == 0) {
+        if (!outstanding_.empty()) {
+            answer(outstanding_.front(), now, true);
+            outstanding_.pop_front();
+        }
+        return;
+    }
+    while (!outstanding_.empty() && outstanding_.front() + 1 <= ack) {
+        answer(outstanding_.front(), now, outstanding_.front() + 1 == ack);
+        outstanding_.pop_front();
+    }
+}
+
+// Requires mutex_. carries_embedding caches response_'s embedding under the
+// request's texts.
+void Session::answer(size_t index, MetricsClock::time_point now, bool carries_embedding) {
+    if (driver_.measuring(scheduled_at_[index])) {
+        ++driver_.stats().answered;
+        driver_.stats().latency.record(elapsedMicros(scheduled_at_[index], now));
+    }
+    if (!carries_embedding) return;
+
+    const auto& keys = keys_[index];
+    const size_t total = response_.computed_embedding_size();
+    if (keys.empty() || total == 0 || total % keys.size() != 0) return;
+    const size_t dims = total / keys.size();
+    for (size_t i = 0; i < keys.size(); ++i) {
+        driver_.cache().put(keys[i], response_.computed_embedding().data() + i * dims, dims);
+    }
+}
+
+const char* statusName(int code) {
+    static const char* const kNames[] = {
+        "OK", "CANCELLED", "UNKNOWN", "INVALID_ARGUMENT", "DEADLINE_EXCEEDED", "NOT_FOUND",
+        "ALREADY_EXISTS", "PERMISSION_DENIED", "RESOURCE_EXHAUSTED", "FAILED_PRECONDITION",
+        "ABORTED", "OUT_OF_RANGE", "UNIMPLEMENTED", "INTERNAL", "UNAVAILABLE", "DATA_LOSS",
+        "UNAUTHENTICATED"};
+    return (code >= 0 && code < 17) ? kNames[code] : "UNKNOWN";
+}
+
+void printHistogram(std::ostream& out, const char* name, const LatencyHistogram& histogram) {
+    const auto summary = histogram.summary();
+    char line[256];
+    std::snprintf(line, sizeof(line),
+                  "%-16s n=%llu  p50 %llu  p90 %llu  p99 %llu  p999 %llu  max %llu us\n", name,
+                  static_cast<unsigned long long>(summary.count),
+                  static_cast<unsigned long long>(summary.p50),
+                  static_cast<unsigned long long>(summary.p90),
+                  static_cast<unsigned long long>(summary.p99),
+                  static_cast<unsigned long long>(summary.p999),
+                  static_cast<unsigned long long>(summary.max));
+    out << line;
+}
+
+void LoadDriver::report(std::ostream& out) const {
+    const double seconds = std::max(measured_s_, 1e-9);
+    char line[256];
+    std::snprintf(line, sizeof(line),
+                  "target           %s\n"
+                  "offered          %.1f req/s for %.1f s (concurrency %zu, %zu threads, %zu channels)\n"
+                  "sent             %llu (%llu cache hits, %llu ticks with no session ready)\n"
+                  "answered         %llu (%llu unanswered)\n"
+                  "throughput       %.1f resp/s, %.2f MB/s\n",
+                  options_.target.c_str(), options_.qps, options_.duration_s, options_.concurrency,
+                  options_.threads, options_.channels,
+                  static_cast<unsigned long long>(stats_.sent.load()),
+                  static_cast<unsigned long long>(stats_.cache_hits.load()),
+                  static_cast<unsigned long long>(stats_.unscheduled.load()),
+                  static_cast<unsigned long long>(stats_.answered.load()),
+                  static_cast<unsigned long long>(stats_.unanswered.load()),
+                  (stats_.answered + stats_.cache_hits) / seconds,
+                  stats_.response_bytes / seconds / 1e6);
+    out << line;
+    printHistogram(out, "latency", stats_.latency);
+    printHistogram(out, "first response", stats_.first_response);
+    if (stats_.decode.summary().count > 0) {
+        printHistogram(out, "decode", stats_.decode);
+    }
+
+    out << "sessions         " << stats_.sessions_completed << " completed, "
+        << stats_.sessions_failed << " failed\n";
+    std::lock_guard<std::mutex> lock(stats_.errors_mutex);
+    for (const auto& error : stats_.errors) {
+        out << "  " << statusName(error.first) << " x" << error.second << "\n";
+    }
+}
+
+void histogramJson(std::ostream& out, const LatencyHistogram& histogram) {
+    const auto summary = histogram.summary();
+    out << "{\"count\":" << summary.count << ",\"mean\":" << summary.mean
+        << ",\"p50\":" << summary.p50 << ",\"p90\":" << summary.p90 << ",\"p99\":" << summary.p99
+        << ",\"p999\":" << summary.p999 << ",\"max\":" << summary.max << "}";
+}
+
+void LoadDriver::reportJson(std::ostream& out) const {
+    const double seconds = std::max(measured_s_, 1e-9);
+    out << "{\"target\":\"" << options_.target << "\",\"qps\":" << options_.qps
+        << ",\"concurrency\":" << options_.concurrency << ",\"seconds\":" << measured_s_
+        << ",\"scheduled\":" << stats_.scheduled << ",\"sent\":" << stats_.sent << ",\"answered\":" << stats_.answered
+        << ",\"cache_hits\":" << stats_.cache_hits << ",\"unanswered\":" << stats_.unanswered
+        << ",\"unscheduled\":" << stats_.unscheduled
+        << ",\"throughput\":" << (stats_.answered + stats_.cache_hits) / seconds
+        << ",\"response_bytes\":" << stats_.response_bytes << ",\"latency_us\":";
+    histogramJson(out, stats_.latency);
+    out << ",\"first_response_us\":";
+    histogramJson(out, stats_.first_response);
+    out << ",\"decode_us\":";
+    histogramJson(out, stats_.decode);
+    out << ",\"sessions_completed\":" << stats_.sessions_completed
+        << ",\"sessions_failed\":" << stats_.sessions_failed << ",\"errors\":{";
+    std::lock_guard<std::mutex> lock(stats_.errors_mutex);
+    bool first = true;
+    for (const auto& error : stats_.errors) {
+        out << (first ? "" : ",") << "\"" << statusName(error.first) << "\":" << error.second;
+        first = false;
+    }
+    out << "}}\n";
+}
+
+} // namespace
+} // namespace legal_cuda_streaming
+
+int main(int argc, char** argv) {
+    using namespace legal_cuda_streaming;
+
+    DriverOptions options;
+    if (!parseArguments(argc, argv, options)) {
+        return 2;
+    }
+
+    Recording recording;
+    if (!loadRecording(options.recording, recording)) {
+        return 1;
+    }
+
+    LoadDriver driver(options, std::move(recording));
+    driver.run();
+    if (options.json) {
+        driver.reportJson(std::cout);
+    } else {
+        driver.report(std::cout);
+    }
+    return driver.stats().sessions_failed > 0 ? 3 : 0;
+}
@@ -0,0 +1,167 @@
+// legal_simd_kernel_tests.cpp - Unit tests for the scoring kernels
+//
+// Natively the kernels take their scalar paths, which the SIMD paths must
+// match.
+//
+//   build-native/legal_header_tests --gtest_filter='SimdKernels*'
+
+#include "legal_simd_kernels.h"
+#include "legal_test_vectors.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace legal_cuda_streaming {
+namespace {
+
+TEST(SimdKernels, CosineMatchesReferenceAndHandlesZeroNorm) {
+    for (size_t dims : {1u, 3u, 4u, 7u, 64u, 385u}) {
+        const auto a = randomVectors(1, dims, 12);
+        const auto b = randomVectors(1, dims, 13);
+        EXPECT_NEAR(simd::cosine(a.data(), b.data(), dims),
+                    referenceCosine(a.data(), b.data(), dims), 1e-5f) << dims;
+        EXPECT_NEAR(simd::dot(a.data(), a.data(), dims), simd::squaredNorm(a.data(), dims), 1e-3f);
+    }
+    const std::vector<float> zero(16, 0.0f);
+    const auto other = randomVectors(1, 16, 14);
+    EXPECT_EQ(simd::cosine(zero.data(), other.data(), 16), 0.0f);
+    EXPECT_EQ(simd::cosine(other.data(), zero.data(), 16), 0.0f);
+}
+
+TEST(SimdKernels, CosineBatchScoresEachRow) {
+    constexpr size_t kDims = 10, kDocs = 9;
+    const auto query = randomVectors(1, kDims, 15);
+    const auto docs = randomVectors(kDocs, kDims, 16);
+    std::vector<float> scores(kDocs);
+    simd::cosineBatch(query.data(), docs.data(), kDocs, kDims, scores.data());
+    for (size_t d = 0; d < kDocs; ++d) {
+        EXPECT_NEAR(scores[d], referenceCosine(query.data(), docs.data() + d * kDims, kDims), 1e-5f);
+    }
+}
+
+TEST(SimdKernels, HalfConversionRoundsToNearestEven) {
+    EXPECT_EQ(simd::floatToHalf(0.0f), 0x0000u);
+    EXPECT_EQ(simd::floatToHalf(-0.0f), 0x8000u);
+    EXPECT_EQ(simd::floatToHalf(1.0f), 0x3c00u);
+    EXPECT_EQ(simd::floatToHalf(-2.0f), 0xc000u);
+    EXPECT_EQ(simd::floatToHalf(65504.0f), 0x7bffu);
+    EXPECT_EQ(simd::floatToHalf(1e6f), 0x7c00u);
+    EXPECT_EQ(simd::floatToHalf(std::nanf("")) & 0x7e00u, 0x7e00u);
+    // Halfway between 1 and the next half (1 + 2^-10) rounds to even, 1
+    EXPECT_EQ(simd::floatToHalf(1.0f + 1.0f / 2048.0f), 0x3c00u);
+    EXPECT_EQ(simd::floatToHalf(1.0f + 3.0f / 2048.0f), 0x3c02u);
+    // Smallest subnormal
+    EXPECT_EQ(simd::floatToHalf(std::ldexp(1.0f, -24)), 0x0001u);
+
+    // Every finite half survives a round trip through float
+    for (uint32_t bits = 0; bits < 0x10000u; ++bits) {
+        if ((bits & 0x7c00u) == 0x7c00u) continue;
+        const uint16_t half = static_cast<uint16_t>(bits);
+        ASSERT_EQ(simd::floatToHalf(simd::halfToFloat(half)), half) << bits;
+    }
+    EXPECT_TRUE(std::isinf(simd::halfToFloat(0x7c00u)));
+
+    std::vector<float> values = randomVectors(1, 37, 17);
+    std::vector<uint16_t> halves(values.size());
+    std::vector<float> back(values.size());
+    simd::floatsToHalves(values.data(), values.size(), halves.data());
+    simd::halvesToFloats(halves.data(), halves.size(), back.data());
+    for (size_t i = 0; i < values.size(); ++i) {
+        EXPECT_NEAR(back[i], values[i], std::fabs(values[i]) / 1024.0f + 1e-7f);
+    }
+}
+
+TEST(SimdKernels, Int8QuantizationStaysWithinHalfAStep) {
+    const auto values = randomVectors(1, 53, 18);
+    std::vector<int8_t> quantized(values.size());
+    const float scale = simd::quantizeInt8(values.data(), values.size(), quantized.data());
+    ASSERT_GT(scale, 0.0f);
+
+    float max_abs = 0.0f;
+    for (float value : values) max_abs = std::max(max_abs, std::fabs(value));
+    EXPECT_FLOAT_EQ(scale, max_abs / 127.0f);
+
+    std::vector<float> back(values.size());
+    simd::dequantizeInt8(quantized.data(), quantized.size(), scale, back.data());
+    for (size_t i = 0; i < values.size(); ++i) {
+        EXPECT_LE(std::fabs(back[i] - values[i]), scale * 0.5f + 1e-6f);
+    }
+
+    const std::vector<float> zero(8, 0.0f);
+    std::vector<int8_t> zero_quantized(8, 1);
+    EXPECT_EQ(simd::quantizeInt8(zero.data(), zero.size(), zero_quantized.data()), 0.0f);
+    EXPECT_TRUE(std::all_of(zero_quantized.begin(), zero_quantized.end(),
+                            [](int8_t q) { return q == 0; }));
+}
+
+TEST(SimdKernels, QuantizedCosineTracksFloatCosine) {
+    constexpr size_t kDims = 96, kDocs = 5;
+    const auto query = randomVectors(1, kDims, 19);
+    const auto docs = randomVectors(kDocs, kDims, 20);
+
+    std::vector<int8_t> int8_docs(kDocs * kDims);
+    std::vector<float> scales(kDocs);
+    std::vector<uint16_t> half_docs(kDocs * kDims);
+    for (size_t d = 0; d < kDocs; ++d) {
+        scales[d] = simd::quantizeInt8(docs.data() + d * kDims, kDims, int8_docs.data() + d * kDims);
+    }
+    simd::floatsToHalves(docs.data(), docs.size(), half_docs.data());
+
+    const float query_norm = std::sqrt(simd::squaredNorm(query.data(), kDims));
+    for (size_t d = 0; d < kDocs; ++d) {
+        const float expected = referenceCosine(query.data(), docs.data() + d * kDims, kDims);
+        EXPECT_NEAR(simd::cosineInt8WithQueryNorm(query.data(), query_norm,
+                                                  int8_docs.data() + d * kDims, kDims),
+                    expected, 0.02f);
+        EXPECT_NEAR(simd::cosineHalfWithQueryNorm(query.data(), query_norm,
+                                                  half_docs.data() + d * kDims, kDims),
+                    expected, 1e-3f);
+    }
+}
+
+TEST(SimdKernels, PairwiseDotsCoverEdgeTiles) {
+    constexpr size_t kDims = 9;
+    for (size_t n1 : {1u, 4u, 6u, 13u}) {
+        for (size_t n2 : {1u, 5u, 8u, 70u}) {
+            const auto a = randomVectors(n1, kDims, 21);
+            const auto b = randomVectors(n2, kDims, 22);
+            const size_t stride = n2 + 3;
+            std::vector<float> out(n1 * stride, -99.0f);
+            simd::pairwiseDots(a.data(), n1, b.data(), n2, kDims, out.data(), stride);
+            for (size_t i = 0; i < n1; ++i) {
+                for (size_t j = 0; j < n2; ++j) {
+                    double expected = 0.0;
+                    for (size_t k = 0; k < kDims; ++k) expected += double(a[i * kDims + k]) * b[j * kDims + k];
+                    ASSERT_NEAR(out[i * stride + j], expected, 1e-4) << n1 << "x" << n2;
+                }
+                for (size_t j = n2; j < stride; ++j) {
+                    ASSERT_EQ(out[i * stride + j], -99.0f) << "wrote past the row";
+                }
+            }
+        }
+    }
+}
+
+TEST(SimdKernels, TopKReturnsBestFirstAndHonoursAccept) {
+    const std::vector<float> scores = {0.1f, 0.9f, 0.4f, 0.8f, -0.2f, 0.95f, 0.3f};
+    const auto best = simd::topK(scores.data(), scores.size(), 3);
+    ASSERT_EQ(best.size(), 3u);
+    EXPECT_EQ(best[0].index, 5u);
+    EXPECT_EQ(best[1].index, 1u);
+    EXPECT_EQ(best[2].index, 3u);
+    EXPECT_FLOAT_EQ(best[0].score, 0.95f);
+
+    const auto odd = simd::topK(scores.data(), scores.size(), 2, [](size_t i) { return i % 2 == 0; });
+    ASSERT_EQ(odd.size(), 2u);
+    EXPECT_EQ(odd[0].index, 2u);
+    EXPECT_EQ(odd[1].index, 6u);
+
+    EXPECT_EQ(simd::topK(scores.data(), scores.size(), 100).size(), scores.size());
+    EXPECT_TRUE(simd::topK(scores.data(), scores.size(), 0).empty());
+}
+
+} // namespace
+} // namespace legal_cuda_streaming
@@ -0,0 +1,103 @@
+// legal_similarity_matrix_tests.cpp - Unit tests for the case similarity matrix
+//
+// Incremental updates are checked against the reference cosine.
+//
+//   build-native/legal_header_tests --gtest_filter='CaseSimilarityMatrix*'
+
+#include "legal_similarity_matrix.h"
+#include "legal_test_vectors.h"
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+namespace legal_cuda_streaming {
+namespace {
+
+void expectMatchesReference(const CaseSimilarityMatrix& matrix,
+                            const std::vector<std::vector<float>>& vectors, size_t dims) {
+    ASSERT_EQ(matrix.size(), vectors.size());
+    for (size_t i = 0; i < vectors.size(); ++i) {
+        for (size_t j = 0; j < vectors.size(); ++j) {
+            EXPECT_NEAR(matrix.similarity(i, j),
+                        referenceCosine(vectors[i].data(), vectors[j].data(), dims), 1e-4f)
+                << i << ", " << j;
+        }
+    }
+}
+
+TEST(CaseSimilarityMatrix, IncrementalAddsMatchFullComputation) {
+    constexpr size_t kDims = 19;  // not a multiple of the tile or SIMD width
+    CaseSimilarityMatrix matrix;
+    std::vector<std::vector<float>> reference;
+
+    // One large batch, then single cases, so both the tiled and the edge
+    // paths of pairwiseDots are exercised, and the stride has to grow
+    const auto batch = randomVectors(23, kDims, 9);
+    std::vector<std::string> ids;
+    for (size_t i = 0; i < 23; ++i) {
+        ids.push_back("case-" + std::to_string(i));
+        reference.emplace_back(batch.begin() + i * kDims, batch.begin() + (i + 1) * kDims);
+    }
+    EXPECT_EQ(matrix.add(ids, batch.data(), kDims), 23u);
+    for (size_t i = 23; i < 30; ++i) {
+        const auto single = randomVectors(1, kDims, 100 + uint32_t(i));
+        EXPECT_EQ(matrix.add({"case-" + std::to_string(i)}, single.data(), kDims), 1u);
+        reference.push_back(single);
+    }
+    expectMatchesReference(matrix, reference, kDims);
+    EXPECT_EQ(matrix.stats().rows_computed, 30u);
+
+    const auto packed = matrix.packed();
+    ASSERT_EQ(packed.size(), 30u * 30u);
+    EXPECT_FLOAT_EQ(packed[3 * 30 + 7], matrix.similarity(3, 7));
+}
+
+TEST(CaseSimilarityMatrix, ReplacingAndRemovingCases) {
+    constexpr size_t kDims = 12;
+    CaseSimilarityMatrix matrix;
+    const auto initial = randomVectors(6, kDims, 10);
+    std::vector<std::vector<float>> reference;
+    for (size_t i = 0; i < 6; ++i) {
+        reference.emplace_back(initial.begin() + i * kDims, initial.begin() + (i + 1) * kDims);
+    }
+    matrix.add({"a", "b", "c", "d", "e", "f"}, initial.data(), kDims);
+
+    // Non-contiguous replacements are gathered before the kernel runs
+    const auto replacement = randomVectors(2, kDims, 11);
+    EXPECT_EQ(matrix.add({"b", "e"}, replacement.data(), kDims), 2u);
+    reference[1].assign(replacement.begin(), replacement.begin() + kDims);
+    reference[4].assign(replacement.begin() + kDims, replacement.end());
+    expectMatchesReference(matrix, reference, kDims);
+
+    EXPECT_TRUE(matrix.remove("c"));
+    EXPECT_FALSE(matrix.remove("c"));
+    reference.erase(reference.begin() + 2);
+    EXPECT_FALSE(matrix.contains("c"));
+    EXPECT_EQ(matrix.caseIds(), (std::vector<std::string>{"a", "b", "d", "e", "f"}));
+    expectMatchesReference(matrix, reference, kDims);
+}
+
+TEST(CaseSimilarityMatrix, NearestExcludesTheCaseItself) {
+    constexpr size_t kDims = 4;
+    CaseSimilarityMatrix matrix;
+    const std::vector<float> vectors = {
+        1, 0, 0, 0,
+        0.9f, 0.1f, 0, 0,
+        0, 1, 0, 0,
+        -1, 0, 0, 0,
+    };
+    matrix.add({"base", "close", "orthogonal", "opposite"}, vectors.data(), kDims);
+
+    const auto nearest = matrix.nearest("base", 3);
+    ASSERT_EQ(nearest.size(), 3u);
+    EXPECT_EQ(nearest[0].case_id, "close");
+    EXPECT_EQ(nearest[1].case_id, "orthogonal");
+    EXPECT_EQ(nearest[2].case_id, "opposite");
+    EXPECT_NEAR(nearest[2].similarity, -1.0f, 1e-6f);
+    EXPECT_TRUE(matrix.nearest("missing", 3).empty());
+}
+
+} // namespace
+} // namespace legal_cuda_streaming
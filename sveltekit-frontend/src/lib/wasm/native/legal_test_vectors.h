@@ -0,0 +1,33 @@
+// legal_test_vectors.h - Random vectors and a reference cosine for the
+// native unit tests
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+namespace legal_cuda_streaming {
+
+inline std::vector<float> randomVectors(size_t count, size_t dims, uint32_t seed) {
+    std::mt19937 random(seed);
+    std::normal_distribution<float> normal;
+    std::vector<float> vectors(count * dims);
+    for (float& value : vectors) value = normal(random);
+    return vectors;
+}
+
+// In double precision, as the kernels under test are compared against it
+inline float referenceCosine(const float* a, const float* b, size_t dims) {
+    double dot = 0.0, norm_a = 0.0, norm_b = 0.0;
+    for (size_t i = 0; i < dims; ++i) {
+        dot += double(a[i]) * b[i];
+        norm_a += double(a[i]) * a[i];
+        norm_b += double(b[i]) * b[i];
+    }
+    if (norm_a == 0.0 || norm_b == 0.0) return 0.0f;
+    return static_cast<float>(dot / (std::sqrt(norm_a) * std::sqrt(norm_b)));
+}
+
+} // namespace legal_cuda_streaming
@@ -0,0 +1,142 @@
+// legal_vector_index_tests.cpp - Unit tests for the local vector index
+//
+// Graph searches are checked against an exhaustive scan.
+//
+//   build-native/legal_header_tests --gtest_filter='LocalVectorIndex*'
+
+#include "legal_test_vectors.h"
+#include "legal_vector_index.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace legal_cuda_streaming {
+namespace {
+
+std::vector<size_t> bruteForceTop(const std::vector<float>& vectors, size_t first, size_t last,
+                                  const float* query, size_t dims, size_t k) {
+    std::vector<std::pair<float, size_t>> scored;
+    for (size_t i = first; i < last; ++i) {
+        scored.emplace_back(-referenceCosine(query, vectors.data() + i * dims, dims), i);
+    }
+    std::sort(scored.begin(), scored.end());
+    std::vector<size_t> top;
+    for (size_t i = 0; i < k && i < scored.size(); ++i) top.push_back(scored[i].second);
+    return top;
+}
+
+TEST(LocalVectorIndex, DisabledUntilConfigured) {
+    LocalVectorIndex index;
+    EXPECT_FALSE(index.enabled());
+    const auto vector = randomVectors(1, 8, 1);
+    index.add(vector.data(), 8, "a", "s");
+    EXPECT_EQ(index.stats().size, 0u);
+}
+
+TEST(LocalVectorIndex, ExhaustiveSearchIsExact) {
+    constexpr size_t kDims = 24, kCount = 300;
+    LocalVectorIndex index;
+    LocalVectorIndex::Options options;
+    options.capacity = 1000;
+    index.configure(options);
+
+    const auto vectors = randomVectors(kCount, kDims, 2);
+    for (size_t i = 0; i < kCount; ++i) {
+        index.add(vectors.data() + i * kDims, kDims, std::to_string(i), "session");
+    }
+    EXPECT_EQ(index.stats().levels, 0u);
+
+    const auto queries = randomVectors(10, kDims, 3);
+    for (size_t q = 0; q < 10; ++q) {
+        const float* query = queries.data() + q * kDims;
+        const auto hits = index.search(query, kDims, 5);
+        const auto expected = bruteForceTop(vectors, 0, kCount, query, kDims, 5);
+        ASSERT_EQ(hits.size(), 5u);
+        for (size_t i = 0; i < 5; ++i) {
+            EXPECT_EQ(hits[i].label, std::to_string(expected[i]));
+            EXPECT_NEAR(hits[i].score,
+                        referenceCosine(query, vectors.data() + expected[i] * kDims, kDims), 1e-4f);
+            EXPECT_EQ(hits[i].session_id, "session");
+        }
+    }
+}
+
+TEST(LocalVectorIndex, NewDimensionReplacesIndex) {
+    LocalVectorIndex index;
+    LocalVectorIndex::Options options;
+    options.capacity = 100;
+    index.configure(options);
+
+    const auto small = randomVectors(3, 8, 4);
+    for (size_t i = 0; i < 3; ++i) index.add(small.data() + i * 8, 8, "small", "s");
+    const auto large = randomVectors(1, 16, 5);
+    index.add(large.data(), 16, "large", "s");
+
+    EXPECT_EQ(index.stats().size, 1u);
+    EXPECT_EQ(index.stats().dims, 16u);
+    EXPECT_TRUE(index.search(small.data(), 8, 3).empty());
+    EXPECT_EQ(index.search(large.data(), 16, 3).front().label, "large");
+}
+
+TEST(LocalVectorIndex, GraphEvictionKeepsOnlyRecentVectors) {
+    constexpr size_t kDims = 16, kCapacity = 800, kInserts = 3000, kK = 10;
+    LocalVectorIndex index;
+    LocalVectorIndex::Options options;
+    options.capacity = kCapacity;
+    options.hnsw_threshold = 200;
+    index.configure(options);
+
+    const auto vectors = randomVectors(kInserts, kDims, 6);
+    for (size_t i = 0; i < kInserts; ++i) {
+        index.add(vectors.data() + i * kDims, kDims, std::to_string(i), "s");
+        ASSERT_LE(index.stats().size, kCapacity);
+    }
+    const auto stats = index.stats();
+    EXPECT_GT(stats.levels, 0u);
+    const size_t oldest_live = kInserts - stats.size;
+
+    const auto queries = randomVectors(50, kDims, 7);
+    size_t found = 0;
+    for (size_t q = 0; q < 50; ++q) {
+        const float* query = queries.data() + q * kDims;
+        const auto hits = index.search(query, kDims, kK);
+        ASSERT_EQ(hits.size(), kK);
+        const auto expected = bruteForceTop(vectors, oldest_live, kInserts, query, kDims, kK);
+        for (const auto& hit : hits) {
+            const size_t id = std::stoul(hit.label);
+            EXPECT_GE(id, oldest_live) << "evicted vector returned";
+            found += std::count(expected.begin(), expected.end(), id);
+        }
+    }
+    EXPECT_GE(double(found) / (50 * kK), 0.9);
+}
+
+TEST(LocalVectorIndex, ShrinkingCapacityBelowThresholdFallsBackToScan) {
+    constexpr size_t kDims = 8;
+    LocalVectorIndex index;
+    LocalVectorIndex::Options options;
+    options.capacity = 400;
+    options.hnsw_threshold = 100;
+    index.configure(options);
+
+    const auto vectors = randomVectors(300, kDims, 8);
+    for (size_t i = 0; i < 300; ++i) {
+        index.add(vectors.data() + i * kDims, kDims, std::to_string(i), "s");
+    }
+    ASSERT_GT(index.stats().levels, 0u);
+
+    options.capacity = 50;
+    index.configure(options);
+    EXPECT_EQ(index.stats().size, 50u);
+    EXPECT_EQ(index.stats().levels, 0u);
+
+    const float* newest = vectors.data() + 299 * kDims;
+    EXPECT_EQ(index.search(newest, kDims, 1).front().label, "299");
+}
+
+} // namespace
+} // namespace legal_cuda_streaming
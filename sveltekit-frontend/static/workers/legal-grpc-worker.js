@@ -0,0 +1,101 @@
+// legal-grpc-worker.js
+// Hosts LegalGrpcWebClient in a dedicated worker so networking and decoding
+// never run on the UI thread. Results are written to a shared-memory ring
+// (legal_result_ring.h) that the page reads in place; this worker only
+// answers method calls, forwards session events and posts the few results
+// too large for the ring.
+//
+// Protocol (see src/lib/wasm/legal-grpc-worker-client.ts):
+//   in:  { type: 'init', endpoint, options, ringBytes }
+//        { type: 'call', id, method, args, callbackIndex? }
+//   out: { type: 'ready', memory, ring: { offset, capacity } }
+//        { type: 'result', id, value } | { type: 'result', id, error }
+//        { type: 'event', name, args }
+//        { type: 'record', tag?, bytes }  (a flat message; tag is the call
+//                                          handle, 0 for stream results, and
+//                                          missing for uploads)
+
+importScripts('/wasm/legal_grpc_client.js');
+
+const STREAM_TAG = 0;
+
+let client = null;
+
+function postEvent(name, ...args) {
+  self.postMessage({ type: 'event', name, args });
+}
+
+// The view is over WASM memory and only valid during the callback
+function postRecord(tag, view) {
+  const bytes = view.slice();
+  self.postMessage({ type: 'record', tag, bytes }, [bytes.buffer]);
+}
+
+async function initialize({ endpoint, options, ringBytes }) {
+  const module = await self.LegalGrpcModule({
+    // Loaded from /workers/, so point the runtime and its pthreads at /wasm/
+    locateFile: (path) => '/wasm/' + path,
+    mainScriptUrlOrBlob: '/wasm/legal_grpc_client.js'
+  });
+
+  client = new module.LegalGrpcWebClient(endpoint, options || {});
+  const ring = client.attachResultRing(ringBytes || 4 * 1024 * 1024);
+
+  // Stream results too large for the ring arrive here as flat messages
+  client.setResponseCallback((view) => postRecord(STREAM_TAG, view));
+  client.setErrorCallback((error) => postEvent('error', error));
+  client.setCompletionCallback(() => postEvent('complete'));
+  client.setDrainCallback((sessionId) => postEvent('drain', sessionId));
+  client.setReconnectCallback((sessionId, attempt, delayMs) =>
+    postEvent('reconnect', sessionId, attempt, delayMs));
+
+  // Sharing the Memory (not its buffer) lets the page follow memory growth
+  self.postMessage({ type: 'ready', memory: module.wasmMemory, ring });
+}
+
+function invoke({ id, method, args, callbackIndex }) {
+  try {
+    if (!client || typeof client[method] !== 'function') {
+      throw new Error(`Unknown client method: ${method}`);
+    }
+    // Results of streaming calls arrive through the ring, except those too
+    // large for it, which come to the callback. A cached result can do so
+    // before the call has returned its handle.
+    let handle;
+    let early = null;
+    if (callbackIndex !== undefined) {
+      early = [];
+      args[callbackIndex] = (view) => {
+        if (early) {
+          early.push(view.slice());
+        } else {
+          postRecord(handle, view);
+        }
+      };
+    }
+    const value = client[method](...args);
+    if (early) {
+      // Uploads return a boolean and are matched by document id instead
+      handle = typeof value === 'number' ? value : undefined;
+      early.forEach((bytes) => self.postMessage({ type: 'record', tag: handle, bytes }, [bytes.buffer]));
+      early = null;
+    }
+    self.postMessage({ type: 'result', id, value });
+  } catch (error) {
+    self.postMessage({ type: 'result', id, error: String(error && error.message || error) });
+  }
+}
+
+self.onmessage = (event) => {
+  const message = event.data;
+  switch (message.type) {
+    case 'init':
+      initialize(message).catch((error) => {
+        self.postMessage({ type: 'failed', error: String(error && error.message || error) });
+      });
+      break;
+    case 'call':
+      invoke(message);
+      break;
+  }
+};